@@ -908,6 +908,10 @@ void dofile(const boost::program_options::variables_map& vm) {
     fomus_run(fom);
 #endif
     CHECK_ERR;
+    // LilyPond might still be running--wait on every instance, fomus_run()
+    // frees `fom' when it isn't a copy
+    fomus_wait(0);
+    CHECK_ERR;
   } else {
     CERR << "missing input filename" << std::endl;
     throw err();
@@ -29,19 +29,34 @@
 #include "schedr.h"
 #include "vars.h" // initvars
 
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 105300
+#include <boost/atomic.hpp>
+#endif
+
 int fomus_api_version() {
   return FOMUS_API_VERSION;
 }
 
 namespace fomus {
 
-#define RINGBUF_SIZE 2048
+#define RINGBUF_SIZE 8192 // must be a power of 2
 
   boost::shared_mutex
       listenermut; // must lock this when doing something important!!!!!
   volatile bool listening = false;
 
-  enum whichbuf { buf_ival, buf_rval, buf_mval, buf_fval, buf_sval, buf_act };
+  enum whichbuf {
+    buf_ival,
+    buf_rval,
+    buf_mval,
+    buf_fval,
+    buf_sval,
+    buf_act,
+    buf_notes
+  };
   struct bufobj {
     whichbuf wh;
     FOMUS fom;
@@ -55,16 +70,17 @@ namespace fomus {
       } val;
       fomus_float fval;
       const char* str;
+      apiqueue_notes* notes; // owned, deleted by doit() or drop()
     } x;
     bufobj() {}
-    void set(FOMUS fom0, const int par0, const int act0) volatile {
+    void set(FOMUS fom0, const int par0, const int act0) {
       fom = fom0;
       wh = buf_act;
       par = par0;
       act = act0;
     }
     void set(FOMUS fom0, const int par0, const int act0,
-             const fomus_int val1) volatile {
+             const fomus_int val1) {
       fom = fom0;
       wh = buf_ival;
       par = par0;
@@ -72,7 +88,7 @@ namespace fomus {
       x.val.val1 = val1;
     }
     void set(FOMUS fom0, const int par0, const int act0, const fomus_int val1,
-             const fomus_int val2) volatile {
+             const fomus_int val2) {
       fom = fom0;
       wh = buf_rval;
       par = par0;
@@ -81,7 +97,7 @@ namespace fomus {
       x.val.val2 = val2;
     }
     void set(FOMUS fom0, const int par0, const int act0, const fomus_int val1,
-             const fomus_int val2, const fomus_int val3) volatile {
+             const fomus_int val2, const fomus_int val3) {
       fom = fom0;
       wh = buf_mval;
       par = par0;
@@ -91,7 +107,7 @@ namespace fomus {
       x.val.val3 = val3;
     }
     void set(FOMUS fom0, const int par0, const int act0,
-             const fomus_float val1) volatile {
+             const fomus_float val1) {
       fom = fom0;
       wh = buf_fval;
       par = par0;
@@ -99,17 +115,77 @@ namespace fomus {
       x.fval = val1;
     }
     void set(FOMUS fom0, const int par0, const int act0,
-             const char* str0) volatile {
+             const char* str0) {
       fom = fom0;
       wh = buf_sval;
       par = par0;
       act = act0;
       x.str = str0;
     }
+    void set(FOMUS fom0, apiqueue_notes* notes0) {
+      fom = fom0;
+      wh = buf_notes;
+      par = fomus_par_noteevent;
+      act = fomus_act_add;
+      x.notes = notes0;
+    }
     void doit() const;
+    void drop() const { // instead of doit()
+      if (wh == buf_notes)
+        delete x.notes;
+    }
+  };
+#if BOOST_VERSION >= 105300
+  typedef boost::atomic<unsigned long> ringcount;
+#else
+  // same interface as boost::atomic, which this version of boost doesn't
+  // have--each counter has its own lock, so the ring isn't lock-free
+  class ringcount _NONCOPYABLE {
+    mutable boost::mutex mut;
+    unsigned long v;
+
+public:
+    ringcount(const unsigned long v) : v(v) {}
+    unsigned long load() const {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      return v;
+    }
+    void store(const unsigned long x) {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      v = x;
+    }
+    bool compare_exchange_weak(unsigned long& ex, const unsigned long x) {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      if (v != ex) {
+        ex = v;
+        return false;
+      }
+      v = x;
+      return true;
+    }
+    unsigned long fetch_add(const unsigned long x) {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      unsigned long r = v;
+      v += x;
+      return r;
+    }
+  };
+#endif
+  // bounded MPSC ring: producers claim a position by advancing ringhead with a
+  // compare-and-swap and publish the event through the slot's `seq', so they
+  // never take a lock unless the ring is full or the listener is asleep--a
+  // single consumer at a time (holding drainmut) drains it in order
+  struct ringslot {
+    ringcount seq; // == position when free, position + 1 when full
+    bufobj b;
+    ringslot() : seq(0) {}
   };
-  volatile bufobj* volatile inptr;
-  bufobj* volatile outptr;
+  ringcount ringhead(0), ringtail(0);
+  ringcount ringmaxdepth(0), ringoverruns(0);
+  ringcount ringasleep(0); // 1 while the listener waits on ringcond
+  boost::mutex ringmut;
+  boost::condition_variable ringcond; // listener sleeps here on an empty ring
+  boost::mutex drainmut; // keeps batches in order
 
   extern const char* partostrs[];
   extern const char* acttostrs[];
@@ -120,10 +196,26 @@ namespace fomus {
     return (act >= 0 && act < fomus_act_n) ? acttostrs[act] : "?";
   }
 
+  // every instance--API calls only hold listenermut shared, so instances made,
+  // run or freed from several threads at once need their own lock for the set
   boost::ptr_set<fomusdata> data;
+  boost::mutex datamut;
   bool operator<(const fomusdata& x, const fomusdata& y) {
     return &x < &y;
   }
+  inline fomusdata* insertdata(fomusdata* x) {
+    boost::lock_guard<boost::mutex> lock(datamut);
+    data.insert(x);
+    return x;
+  }
+  inline void erasedata(const FOMUS f) { // destroyed after the lock is let go
+    fomusdata* x;
+    {
+      boost::lock_guard<boost::mutex> lock(datamut);
+      x = data.release(data.find(*(fomusdata*) f)).release();
+    }
+    delete x;
+  }
 
   void inituserconfig();
   void initfomusconfig();
@@ -133,27 +225,64 @@ namespace fomus {
   void initcommkeysigsmap();
   void initpresets();
 
-  boost::condition_variable_any listenercond;
   boost::thread inthread;
   void listener();
 
-  struct scoped_ring : std::vector<bufobj> {
+  class scoped_ring {
+    boost::scoped_array<ringslot> slots;
+
+public:
     ~scoped_ring() {
       off();
     }
+    bool empty() const {
+      return !slots;
+    }
+    void init() {
+      slots.reset(new ringslot[RINGBUF_SIZE]);
+      for (unsigned long i = 0; i < RINGBUF_SIZE; ++i)
+        slots[i].seq.store(i);
+    }
+    ringslot& operator[](const unsigned long p) {
+      return slots[p & (RINGBUF_SIZE - 1)];
+    }
+    bool ready() { // something to drain
+      const unsigned long t = ringtail.load();
+      return slots && slots[t & (RINGBUF_SIZE - 1)].seq.load() == t + 1;
+    }
     void off();
   };
   scoped_ring ringbuf;
 
-  inline void catchup() {
-    while (outptr != inptr) {
-      outptr->doit();
-      if (outptr >= &ringbuf[RINGBUF_SIZE - 1])
-        outptr = &ringbuf[0];
+  std::vector<bufobj> ringbatch; // guarded by drainmut
+
+  // runs everything queued so far (at most one ring's worth), events for
+  // `skip' are dropped--drainmut must be locked
+  void drain(const FOMUS skip) {
+    if (ringbuf.empty())
+      return;
+    ringbatch.clear();
+    unsigned long t = ringtail.load();
+    for (const unsigned long te = t + RINGBUF_SIZE; t != te; ++t) {
+      ringslot& x = ringbuf[t];
+      if (x.seq.load() != t + 1)
+        break; // not published yet
+      ringbatch.push_back(x.b);
+      x.seq.store(t + RINGBUF_SIZE); // free for the producer one lap ahead
+    }
+    ringtail.store(t);
+    for (std::vector<bufobj>::const_iterator i(ringbatch.begin());
+         i != ringbatch.end(); ++i) {
+      if (i->fom != skip)
+        i->doit();
       else
-        ++outptr;
+        i->drop();
     }
   }
+  inline void catchup() {
+    boost::lock_guard<boost::mutex> lock(drainmut);
+    drain(0);
+  }
 
   template <typename T>
   inline std::string numbtostr(const T& val) {
@@ -183,7 +312,10 @@ void fomus_init() {
   clearmodules();
   inituserconfig();  // just the filename!
   initfomusconfig(); // just the filename!
-  data.clear();
+  {
+    boost::lock_guard<boost::mutex> lock(datamut);
+    data.clear();
+  }
   initpresets();
   initvars();
   initmarks();
@@ -195,18 +327,14 @@ void fomus_init() {
 FOMUS fomus_new() {
   ENTER_MAINAPI;
   checkinit();
-  fomusdata* x;
-  data.insert(x = new fomusdata);
-  return x;
+  return insertdata(new fomusdata);
   EXIT_API_0;
 }
 FOMUS fomus_copy(FOMUS f) {
   ENTER_MAINAPI;
   checkinit();
   assert(((fomusdata*) f)->isvalid());
-  fomusdata* x;
-  data.insert(x = new fomusdata(*(fomusdata*) f));
-  return x;
+  return insertdata(new fomusdata(*(fomusdata*) f));
   EXIT_API_0;
 }
 void fomus_merge(FOMUS to, FOMUS from) {
@@ -218,12 +346,25 @@ void fomus_merge(FOMUS to, FOMUS from) {
   EXIT_API_VOID;
 }
 void fomus_free(const FOMUS f) {
+  ENTER_MAINAPIENT;
+  checkinit();
+  assert(((fomusdata*) f)->isvalid());
+  boost::lock_guard<boost::mutex> lock(drainmut); // no batch runs until f is gone
+  drain(f); // f's queued events are dropped, the rest still run
+  erasedata(f);
+  EXIT_API_VOID;
+}
+
+void fomus_alloc_stats(FOMUS f, fomus_int* allocs, fomus_int* live) {
   ENTER_MAINAPI;
   checkinit();
   assert(((fomusdata*) f)->isvalid());
-  if (listening)
-    outptr = (fomus::bufobj*) inptr;
-  data.erase(data.find(*(fomusdata*) f));
+  fint a, l;
+  ((fomusdata*) f)->getarena().getstats(a, l);
+  if (allocs)
+    *allocs = a;
+  if (live)
+    *live = l;
   EXIT_API_VOID;
 }
 
@@ -249,22 +390,44 @@ namespace fomus {
   bool dumping = false;
 #endif
 
-  inline void advlistener() {
-    if (inptr >= &ringbuf[RINGBUF_SIZE - 1])
-      inptr = &ringbuf[0];
-    else
-      inptr = (bufobj*) (inptr + 1);
-    if (inptr == outptr) {
-      boost::unique_lock<boost::shared_mutex> lock(
-          listenermut); // if buffer is overrun, then block anyways rather than
-                        // lose data
-      outptr->doit();
-      if (outptr >= &ringbuf[RINGBUF_SIZE - 1])
-        outptr = &ringbuf[0];
+  // false if the ring is full
+  bool trypush(const bufobj& b) {
+    unsigned long p = ringhead.load();
+    while (true) {
+      ringslot& x = ringbuf[p];
+      const long d = (long) (x.seq.load() - p);
+      if (d == 0) { // free, try to claim it
+        if (ringhead.compare_exchange_weak(p, p + 1)) {
+          x.b = b;
+          x.seq.store(p + 1); // publish
+          break;
+        }
+      } else if (d < 0)
+        return false; // still holds the event from one lap ago
       else
-        ++outptr;
+        p = ringhead.load(); // another producer got there first
+    }
+    const unsigned long d = p + 1 - ringtail.load(); // approximate
+    unsigned long m = ringmaxdepth.load();
+    while (d > m && d <= RINGBUF_SIZE &&
+           !ringmaxdepth.compare_exchange_weak(m, d))
+      ;
+    if (ringasleep.load()) { // the listener set this before checking the ring
+      boost::lock_guard<boost::mutex> lock(ringmut);
+      ringcond.notify_one();
     }
-    listenercond.notify_one();
+    return true;
+  }
+
+  void pushlistener(const bufobj& b) {
+    if (trypush(b))
+      return;
+    ringoverruns.fetch_add(1);
+    do {
+      boost::unique_lock<boost::shared_mutex> lock(
+          listenermut); // ring is full, block anyways rather than lose data
+      catchup();
+    } while (!trypush(b));
   }
 
   void scoped_ring::off() {
@@ -273,9 +436,10 @@ namespace fomus {
     {
       {
         boost::unique_lock<boost::shared_mutex> xxx(listenermut);
+        boost::lock_guard<boost::mutex> lock(ringmut);
         listening = false;
       }
-      listenercond.notify_one();
+      ringcond.notify_one();
     }
     inthread.join();
   }
@@ -285,15 +449,33 @@ void fomus_rt(int rt) {
   ENTER_API;
   if (rt) {
     if (!listening) {
-      ringbuf.resize(RINGBUF_SIZE);
-      inptr = outptr = &ringbuf[0];
+      if (ringbuf.empty())
+        ringbuf.init();
       listening = true;
       inthread = boost::thread(listener);
     }
   } else {
-    if (listening)
+    if (listening) {
       ringbuf.off();
+      boost::shared_lock<boost::shared_mutex> xxx(listenermut);
+      catchup();
+    }
+  }
+  EXIT_API_VOID;
+}
+
+void fomus_rt_stats(fomus_int* depth, fomus_int* maxdepth,
+                    fomus_int* overruns) {
+  ENTER_MAINAPIENT;
+  checkinit();
+  if (depth) {
+    const long d = (long) (ringhead.load() - ringtail.load());
+    *depth = d > 0 ? d : 0; // the two aren't read at the same moment
   }
+  if (maxdepth)
+    *maxdepth = ringmaxdepth.load();
+  if (overruns)
+    *overruns = ringoverruns.load();
   EXIT_API_VOID;
 }
 
@@ -303,6 +485,20 @@ void fomus_flush() {
   EXIT_API_VOID;
 }
 
+void fomus_wait(FOMUS f) {
+  ENTER_API;
+  assert(!f || ((fomusdata*) f)->isvalid());
+  if (!waitbackground(f ? ((fomusdata*) f)->getbg().get() : 0))
+    throw errbase();
+  EXIT_API_VOID;
+}
+int fomus_running(FOMUS f) {
+  ENTER_API;
+  assert(!f || ((fomusdata*) f)->isvalid());
+  return runningbackground(f ? ((fomusdata*) f)->getbg().get() : 0);
+  EXIT_API_0;
+}
+
 namespace fomus {
   void fomus_ivalaux(FOMUS f, int par, int act, fomus_int val) {
     assert(((fomusdata*) f)->isvalid());
@@ -934,8 +1130,9 @@ void fomus_ival(FOMUS f, int par, int act, fomus_int val) {
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act, val);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act, val);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -1386,8 +1583,9 @@ void fomus_rval(FOMUS f, int par, int act, fomus_int num, fomus_int den) {
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act, num, den);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act, num, den);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -1867,8 +2065,9 @@ void fomus_mval(FOMUS f, int par, int act, fomus_int val, fomus_int num,
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act, val, num, den);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act, val, num, den);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -2317,8 +2516,9 @@ void fomus_fval(FOMUS f, int par, int act, fomus_float val) {
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act, val);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act, val);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -2668,8 +2868,9 @@ void fomus_sval(FOMUS f, int par, int act, const char* val) {
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act, val);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act, val);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -3211,8 +3412,9 @@ void fomus_act(FOMUS f, int par, int act) {
   assert(((fomusdata*) f)->isvalid());
   if (listening) {
     resetfomuserr();
-    inptr->set(f, par, act);
-    advlistener();
+    bufobj b;
+    b.set(f, par, act);
+    pushlistener(b);
     return;
   }
   ENTER_MAINAPIENT;
@@ -3221,6 +3423,57 @@ void fomus_act(FOMUS f, int par, int act) {
   EXIT_API_VOID;
 }
 
+namespace fomus {
+  void fomus_addnotesaux(FOMUS f, const fomus_note_rec* recs, fomus_int n) {
+    assert(((fomusdata*) f)->isvalid());
+    if (dumping)
+      fout << "    - " << paramtostr(fomus_par_noteevent) << ' '
+           << actiontostr(fomus_act_add) << "  (" << n << " notes)"
+           << std::endl;
+    if (((fomusdata*) f)->queueing())
+      ((fomusdata*) f)->store(new apiqueue_notes(recs, n));
+    else
+      ((fomusdata*) f)->addnotes(recs, n);
+  }
+} // namespace fomus
+// one lock and one catchup() for the whole batch instead of a dozen calls per
+// note--in realtime mode the batch is copied and goes through the ring like
+// everything else, so it stays in order with the other calls
+void fomus_add_notes(FOMUS f, const struct fomus_note_rec* recs, fomus_int n) {
+  assert(((fomusdata*) f)->isvalid());
+  if (listening) {
+    resetfomuserr();
+    if (n <= 0)
+      return;
+    bufobj b;
+    b.set(f, new apiqueue_notes(recs, n));
+    pushlistener(b);
+    return;
+  }
+  ENTER_MAINAPI;
+  checkinit();
+  assert(((fomusdata*) f)->isvalid());
+  fomus_addnotesaux(f, recs, n);
+  EXIT_API_VOID;
+}
+int fomus_intern_part(FOMUS f, const char* id) {
+  ENTER_MAINAPI;
+  checkinit();
+  assert(((fomusdata*) f)->isvalid());
+  return ((fomusdata*) f)->internpart(id);
+  EXIT_API_0;
+}
+int fomus_intern_mark(const char* id) {
+  ENTER_MAINAPI;
+  checkinit();
+  std::map<std::string, markbase*, isiless>::const_iterator i(
+      marksbyname.find(id));
+  if (i == marksbyname.end())
+    return -1;
+  return i->second->getid();
+  EXIT_API_0;
+}
+
 fomus_int fomus_get_ival(FOMUS f, const char* set) {
   ENTER_MAINAPI;
   checkinit();
@@ -3354,6 +3607,38 @@ void fomus_load(FOMUS f, const char* filename) {
   EXIT_API_VOID;
 }
 
+namespace fomus {
+  // output module for file extension `ii' (`mod-output' setting first)
+  modbase* getoutmod(const listelmap& xm, const std::string& ii) {
+    listelmap_constit x(xm.find(ii));
+    if (x == xm.end())
+      x = xm.find(boost::to_lower_copy(ii));
+    if (x != xm.end()) {
+      modsmap_constit mbi(modsbyname.find(listel_getstring(x->second)));
+      if (mbi == modsbyname.end()) {
+        CERR << "invalid module name `" << x->second
+             << "' in setting `mod-output'" << std::endl;
+        throw errbase();
+      }
+      return mbi->second;
+    }
+    modsvect_it i(std::find_if(
+        mods.begin(), mods.end(),
+        boost::lambda::bind(&modbase::modout_hasext, boost::lambda::_1,
+                            boost::lambda::constant_ref(ii))));
+    if (i == mods.end()) {
+      i = find_if(mods.begin(), mods.end(),
+                  bind(&modbase::modout_hasext, std::placeholders::_1,
+                       boost::to_lower_copy(ii)));
+      if (i == mods.end()) {
+        CERR << "cannot write file of type `." << ii << '\'' << std::endl;
+        throw errbase();
+      }
+    }
+    return &*i;
+  }
+} // namespace fomus
+
 void fomus_run(FOMUS f) {
   ENTER_MAINAPI;
   checkinit();
@@ -3392,44 +3677,62 @@ void fomus_run(FOMUS f) {
         if (!exts0.insert(listel_getstring(*i)).second)
           continue;
         const std::string ii(listel_getstring(*i));
-        listelmap_constit x(xm.find(ii));
-        if (x == xm.end()) {
-          x = xm.find(boost::to_lower_copy(ii));
-        } else
-          goto SKIPIF;
-        if (x != xm.end()) {
-        SKIPIF:
-          modsmap_constit mbi(modsbyname.find(listel_getstring(x->second)));
-          if (mbi == modsbyname.end()) {
-            CERR << "invalid module name `" << x->second
-                 << "' in setting `mod-output'" << std::endl;
-            throw errbase();
-          }
-          std::string ex('.' + ii);
-          mds.push_back(
-              runpair(mbi->second, FS_CHANGE_EXTENSION(fn, ex).FS_FILE_STRING(),
-                      FS_CHANGE_EXTENSION(boost::filesystem::path(ou), ex)
-                          .FS_FILE_STRING()));
-        } else {
-          modsvect_it i(std::find_if(
-              mods.begin(), mods.end(),
-              boost::lambda::bind(&modbase::modout_hasext, boost::lambda::_1,
-                                  boost::lambda::constant_ref(ii))));
-          if (i == mods.end()) {
-            i = find_if(mods.begin(), mods.end(),
-                        bind(&modbase::modout_hasext, std::placeholders::_1,
-                             boost::to_lower_copy(ii)));
-            if (i == mods.end()) {
-              CERR << "cannot write file of type `." << ii << '\'' << std::endl;
-              throw errbase();
-            }
-          }
-          std::string ex('.' + ii);
-          mds.push_back(
-              runpair(&*i, FS_CHANGE_EXTENSION(fn, ex).FS_FILE_STRING(),
-                      FS_CHANGE_EXTENSION(boost::filesystem::path(ou), ex)
-                          .FS_FILE_STRING()));
+        std::string ex('.' + ii);
+        mds.push_back(runpair(
+            getoutmod(xm, ii), FS_CHANGE_EXTENSION(fn, ex).FS_FILE_STRING(),
+            FS_CHANGE_EXTENSION(boost::filesystem::path(ou), ex)
+                .FS_FILE_STRING()));
+      }
+      stable_sort(
+          mds.begin(), mds.end(),
+          boost::lambda::bind<int>(&runpair::prenum, boost::lambda::_1) <
+              boost::lambda::bind<int>(&runpair::prenum, boost::lambda::_2));
+    }
+    if (mds.empty()) {
+      CERR << "no output format specified" << std::endl;
+      throw errbase();
+    }
+    ((fomusdata*) f)->runfomus(mds.begin(), mds.end());
+  } catch (const errbase& e) {
+    erasedata(f);
+    throw;
+  }
+  erasedata(f);
+  EXIT_API_VOID;
+}
+
+void fomus_run_sinks(FOMUS f, struct fomus_sink* sinks, int n) {
+  ENTER_MAINAPI;
+  checkinit();
+  assert(((fomusdata*) f)->isvalid());
+  threadfd.reset((fomusdata*) f);
+  try {
+    boost::filesystem::path cur(boost::filesystem::current_path());
+    std::vector<runpair> mds;
+    std::string ou(((fomusdata*) f)->get_sval(FILENAME_ID));
+    if (ou.empty()) {
+      ou = ((fomusdata*) f)->getfilename();
+      if (ou.empty())
+        ou = "fomus"; // nothing is created, modules only need a name
+    }
+    boost::filesystem::path fn(FS_COMPLETE(ou, cur));
+    {
+      const listelmap& xm(((fomusdata*) f)->get_map(OUTPUTMOD_ID));
+      for (int i = 0; i < n; ++i) {
+        std::string ii(sinks[i].ext ? sinks[i].ext : "");
+        boost::trim_left_if(ii, boost::lambda::_1 == '.');
+        std::string ex('.' + ii);
+        std::string fi(FS_CHANGE_EXTENSION(fn, ex).FS_FILE_STRING());
+        if (((fomusdata*) f)->hassink(fi)) {
+          CERR << "more than one sink for file type `." << ii << '\''
+               << std::endl;
+          throw errbase();
         }
+        ((fomusdata*) f)->addsink(fi, sinks[i]);
+        mds.push_back(runpair(
+            getoutmod(xm, ii), fi,
+            FS_CHANGE_EXTENSION(boost::filesystem::path(ou), ex)
+                .FS_FILE_STRING()));
       }
       stable_sort(
           mds.begin(), mds.end(),
@@ -3442,13 +3745,19 @@ void fomus_run(FOMUS f) {
     }
     ((fomusdata*) f)->runfomus(mds.begin(), mds.end());
   } catch (const errbase& e) {
-    data.erase(data.find(*(fomusdata*) f));
+    erasedata(f);
     throw;
   }
-  data.erase(data.find(*(fomusdata*) f));
+  erasedata(f);
   EXIT_API_VOID;
 }
 
+void fomus_free_sink(struct fomus_sink* sink) {
+  std::free(sink->buf);
+  sink->buf = 0;
+  sink->size = 0;
+}
+
 void fomus_save(FOMUS f, const char* filename) {
   ENTER_MAINAPI;
   checkinit();
@@ -3468,11 +3777,20 @@ void fomus_save(FOMUS f, const char* filename) {
         }
       }
       boost::filesystem::path fn(FS_COMPLETE(ou /*.c_str()*/, cur));
-      const std::string ii("fms");
+      std::string ii(FS_EXTENSION(fn)); // a format that can be read back in
+      boost::trim_left_if(ii, boost::lambda::_1 == '.');
+      boost::to_lower(ii);
       modsvect_it i(std::find_if(
           mods.begin(), mods.end(),
           boost::lambda::bind(&modbase::modout_hasext, boost::lambda::_1,
                               boost::lambda::constant_ref(ii))));
+      if (i == mods.end() || !i->ispre()) {
+        ii = "fms";
+        i = std::find_if(
+            mods.begin(), mods.end(),
+            boost::lambda::bind(&modbase::modout_hasext, boost::lambda::_1,
+                                boost::lambda::constant_ref(ii)));
+      }
       if (i == mods.end()) {
         CERR << "cannot write file, module `fmsin' not found" << std::endl;
         throw errbase();
@@ -3483,13 +3801,19 @@ void fomus_save(FOMUS f, const char* filename) {
     assert(!mds.empty());
     ((fomusdata*) f)->runfomus(mds.begin(), mds.end());
   } catch (const errbase& e) {
-    data.erase(data.find(*(fomusdata*) f));
+    erasedata(f);
     throw;
   }
-  data.erase(data.find(*(fomusdata*) f));
+  erasedata(f);
   EXIT_API_VOID;
 }
 
+const char* fomus_get_profile() {
+  ENTER_MAINAPI;
+  return lastprofile.get() ? lastprofile->c_str() : "";
+  EXIT_API_0;
+}
+
 namespace fomus {
 
   inline void bufobj::doit() const {
@@ -3513,18 +3837,28 @@ namespace fomus {
     case buf_act:
       fomus_actaux(fom, par, act);
       break;
+    case buf_notes: {
+      boost::scoped_ptr<apiqueue_notes> q(x.notes);
+      q->enter(fom);
+    } break;
     }
     EXIT_API_VOID;
   }
 
   void listener() {
-    boost::unique_lock<boost::shared_mutex> lock(listenermut);
     DBG("realtime listener launched" << std::endl);
     while (true) {
-      listenercond.wait(lock);
-      if (!listening)
-        return;
-      catchup();
+      {
+        boost::unique_lock<boost::mutex> lock(ringmut);
+        ringasleep.store(1); // producers that publish after this wake us
+        while (listening && !ringbuf.ready())
+          ringcond.wait(lock);
+        ringasleep.store(0);
+        if (!listening)
+          return;
+      }
+      boost::unique_lock<boost::shared_mutex> lock(listenermut);
+      catchup(); // drains the whole batch
     }
   }
 
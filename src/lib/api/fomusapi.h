@@ -173,6 +173,26 @@ enum fomus_action {
 // callback function
 typedef void (*fomus_output)(const char* str);
 
+// note records for fomus_add_notes()
+enum fomus_note_flags {
+  fomus_note_rest = 1, // a rest (`pitch' and `perc' are ignored)
+  fomus_note_float = 2, // use `ftime', `fdur' and `fpitch' instead of the
+                        // rationals
+  fomus_note_intdyn = 4  // `dyn' is a whole number (stays an integer)
+};
+struct fomus_note_rec {
+  int flags;  // fomus_note_flags
+  int part;   // from fomus_intern_part(), -1 = the currently selected part
+  struct fomus_rat time, dur, pitch;
+  fomus_float ftime, fdur, fpitch;
+  fomus_float dyn;
+  const char* perc; // percussion instrument instead of a pitch, or NULL
+  int nvoices;      // -1 = keep the current voices
+  const int* voices;
+  int nmarks;       // marks that don't take arguments
+  const int* marks; // from fomus_intern_mark()
+};
+
 #ifndef LIBFOMUS_HIDE
 
 // return API version number that library was compiled with
@@ -205,17 +225,46 @@ LIBFOMUS_EXPORT void fomus_fval(FOMUS f, int par, int act, fomus_float val);
 LIBFOMUS_EXPORT void fomus_sval(FOMUS f, int par, int act, const char* str);
 LIBFOMUS_EXPORT void fomus_act(FOMUS f, int par, int act);
 
+// ids for fomus_note_rec fields, -1 if there's no such part or mark (part ids
+// stay valid if the part is redefined)
+LIBFOMUS_EXPORT int fomus_intern_part(FOMUS f, const char* id);
+LIBFOMUS_EXPORT int fomus_intern_mark(const char* id);
+// insert `n' notes/rests at once, same as setting each field with the calls
+// above followed by `fomus_act(f, fomus_par_noteevent, fomus_act_add)', but
+// with one lock per batch (the selected part isn't changed)--in realtime mode
+// the batch is copied and queued like any other call
+LIBFOMUS_EXPORT void fomus_add_notes(FOMUS f, const struct fomus_note_rec* recs,
+                                     fomus_int n);
+
 // turn realtime input mode on/off
 LIBFOMUS_EXPORT void fomus_rt(int on);
+// realtime input queue statistics: events waiting, highest number waiting,
+// times a caller found the queue full and had to block (any can be NULL)
+LIBFOMUS_EXPORT void fomus_rt_stats(fomus_int* depth, fomus_int* maxdepth,
+                                    fomus_int* overruns);
 // flush output
 LIBFOMUS_EXPORT void fomus_flush();
+// external programs started by output modules (e.g., LilyPond with
+// `lily-exe-wait' off) can still be running after fomus_run() returns: wait for
+// the ones started by runs of `f' or of copies made from it, or for every one
+// in the process if `f' is NULL (fomus_err() reports an error if any failed
+// since the last wait, the messages go to the error output), or get the number
+// still running--`f' can be freed before waiting on one of its copies
+LIBFOMUS_EXPORT void fomus_wait(FOMUS f);
+LIBFOMUS_EXPORT int fomus_running(FOMUS f);
 
 // load a `.fms' file
 LIBFOMUS_EXPORT void fomus_load(FOMUS f, const char* filename);
 // parse and input string as if it were a `.fms' file
 LIBFOMUS_EXPORT void fomus_parse(FOMUS f, const char* input);
 
-// copies instance
+// note, rest and mark event objects allocated for an instance so far and how
+// many of them are still alive (either can be NULL)
+LIBFOMUS_EXPORT void fomus_alloc_stats(FOMUS f, fomus_int* allocs,
+                                       fomus_int* live);
+
+// copies instance (the notes entered so far are shared by both until one of
+// them adds to, changes or runs them, so copying a loaded score is cheap)
 LIBFOMUS_EXPORT FOMUS fomus_copy(FOMUS f);
 // merges `from' instance into `to'
 LIBFOMUS_EXPORT void fomus_merge(FOMUS to, FOMUS from);
@@ -225,6 +274,32 @@ LIBFOMUS_EXPORT void fomus_run(FOMUS f);
 // save instance as `.fms' file, always destroys instance (copy it first if
 // necessary)
 LIBFOMUS_EXPORT void fomus_save(FOMUS f, const char* filename);
+// JSON timing report of the last run/save in the calling thread (empty string
+// if the `profile' setting was off), valid until the next run in that thread
+LIBFOMUS_EXPORT const char* fomus_get_profile();
+
+// receives an output file a piece at a time, returns 0 if it was stored (any
+// other value makes the output module fail with a write error)
+typedef int (*fomus_write)(void* data, const char* buf, fomus_int n);
+// an output file that goes to the caller instead of the file system
+struct fomus_sink {
+  const char* ext;   // in: output format (file extension), e.g. "ly", "xml",
+                     // "mid"
+  fomus_write write; // in: called as the file is written, NULL to collect the
+                     // whole file in `buf'
+  void* data;        // in: passed to `write'
+  char* buf;         // out: the file if `write' is NULL (free it with
+                     // fomus_free_sink())
+  fomus_int size;    // out: number of bytes written
+};
+// runs FOMUS like fomus_run(), but writes one output file for each of the `n'
+// sinks (their formats replace the `output' setting) and hands it to the sink
+// instead of creating it--the `filename' setting, input filename or "fomus"
+// is used as the name modules see (LilyPond isn't run on `.ly' output), always
+// destroys instance
+LIBFOMUS_EXPORT void fomus_run_sinks(FOMUS f, struct fomus_sink* sinks, int n);
+// frees a sink's buffer
+LIBFOMUS_EXPORT void fomus_free_sink(struct fomus_sink* sink);
 
 // set output callback functions, either/both of these can be NULL, `newline'
 // set to 1 means include newline in output
@@ -33,12 +33,23 @@ extern "C" {
 
 #define FOMUS_MODAPI_VERSION 1
 
+// extra module_itertype() flag, combined with module_bypart or module_bymeas:
+// the module never looks at or changes anything outside of the part it's
+// given, so with `part-parallel' FOMUS can run it in a separate chain of
+// passes for each part
+enum module_iter_type_ext { module_partlocal = 0x8000 };
+
 LIBFOMUS_EXPORT void
 module_stdout(const char* str,
               unsigned long n); // if n = 0, then str must be zero terminated
 LIBFOMUS_EXPORT void
 module_stderr(const char* str,
               unsigned long n); // if n = 0, then str must be zero terminated
+// engines report the number of search nodes they generated (for `profile')
+LIBFOMUS_EXPORT void module_countnodes(fomus_int n);
+// modules that cache results report lookups and how many of them were hits
+// (for `profile')
+LIBFOMUS_EXPORT void module_countcache(fomus_int lookups, fomus_int hits);
 
 LIBFOMUS_EXPORT struct module_list module_new_list(
     int n); // it's actually a vector, but in the config files it's a list
@@ -211,6 +222,60 @@ LIBFOMUS_EXPORT module_measobj module_peeknextmeas(
                           // sequence from above
 LIBFOMUS_EXPORT module_partobj module_peeknextpart(module_partobj part);
 
+// snapshot of note/rest events in parallel arrays, for modules that would
+// otherwise call module_time(), module_pitch(), module_setting_fval(), etc. for
+// every note--caller allocates the arrays (any pointer can be NULL to skip that
+// field) and sets `cap' and the settings to fetch
+enum module_snapflags {
+  module_snap_note = 1,     // a note (not a rest)
+  module_snap_grace = 2,    // a grace note
+  module_snap_perc = 4,     // percussion note
+  module_snap_tiedleft = 8, // tied to previous note
+  module_snap_tiedright = 16
+};
+struct module_notesnap {
+  int cap; // in: size of the arrays
+  int n;   // out: number of events in the object (if more than `cap', only
+           // `cap' were filled in, call again with bigger arrays)
+  module_noteobj* notes;
+  int* flags; // module_snapflags
+  fomus_float *time, *dur, *endtime, *tiedendtime, *pitch; // grace notes have
+                                                            // dur = 0, rests
+                                                            // have pitch = 0
+  struct fomus_rat *rtime, *rtiedendtime, *rpitch; // exact values
+  int *voice, *staff; // first one if there's still a list, otherwise 0
+  int nsets;          // number of setting values for each event
+  const int* setids;  // IDs from module_settingid()
+  fomus_float* setvals; // setting `s' of event `i' is in setvals[s * cap + i]
+};
+// `obj' is a note, measure or part--a measure's events must be ready (i.e.
+// module_nextnote() has returned one of them), returns `n'
+LIBFOMUS_EXPORT int module_snapshot(module_obj obj,
+                                    struct module_notesnap* snap);
+
+// calls `fun(data, i)' for i = 0 to n - 1 on up to `n-threads' threads of the
+// run's thread pool, the calling thread included (only the calling thread if
+// `n-threads' is 0), returns when all calls are done--`fun'
+// may use the module API on objects the calling module already has but must
+// not call module_nextnote(), module_nextmeas(), module_nextpart() or
+// module_skipassign(), calls after one that returns non-zero might not be made,
+// returns non-zero if one of them does
+LIBFOMUS_EXPORT int module_parallel(int n, int (*fun)(void* data, int i),
+                                    void* data);
+
+// non-zero if the file `filename' passed to modout_write() goes to one of the
+// caller's fomus_run_sinks() sinks instead of the file system
+LIBFOMUS_EXPORT int module_hassink(const char* filename);
+
+// runs `fun' on its own thread (e.g., to wait for an external program) and
+// returns right away, the job can outlive the run and the instance so `fun'
+// can only call module_stdout() and module_stderr(), it must free `data' and
+// returns non-zero on an error (fomus_wait() on the instance waits for these)
+LIBFOMUS_EXPORT void module_background(int (*fun)(void* data), void* data);
+// appends `n' bytes to that sink, returns non-zero on an error
+LIBFOMUS_EXPORT int module_sinkwrite(const char* filename, const char* buf,
+                                     fomus_int n);
+
 LIBFOMUS_EXPORT module_measobj
 module_meas(module_noteobj note);                           // get parent object
 LIBFOMUS_EXPORT module_partobj module_part(module_obj obj); // get parent object
@@ -763,6 +828,33 @@ FOMUSMOD_EXPORT void modout_write(FOMUS f, void* data, const char* filename);
 }
 #endif
 
+#ifdef __cplusplus
+// true if cross-multiplying `a' and `b' can't overflow (positive
+// denominators, every term fits in 31 bits)--lets the rational operators
+// compare and add quantized times without a library call or a gcd
+inline bool module_ratsmall(const fomus_int x) {
+  return sizeof(fomus_int) >= 8 && x <= 0x7fffffffL && x >= -0x7fffffffL;
+}
+inline bool module_ratsmall(const struct fomus_rat& a,
+                            const struct fomus_rat& b) {
+  return a.den > 0 && b.den > 0 && module_ratsmall(a.num) &&
+         module_ratsmall(a.den) && module_ratsmall(b.num) &&
+         module_ratsmall(b.den);
+}
+inline bool module_ratsmall(const struct fomus_rat& a, const fomus_int b) {
+  return a.den > 0 && module_ratsmall(a.num) && module_ratsmall(a.den) &&
+         module_ratsmall(b);
+}
+// sign is the sign of a - b, only valid if module_ratsmall(a, b)
+inline fomus_int module_ratcmp(const struct fomus_rat& a,
+                               const struct fomus_rat& b) {
+  return a.num * b.den - b.num * a.den;
+}
+inline fomus_int module_ratcmp(const struct fomus_rat& a, const fomus_int b) {
+  return a.num - b * a.den;
+}
+#endif
+
 // --------------------------------------------------------------------------------
 // C++ stuff
 #if defined(__cplusplus) && !defined(BUILD_LIBFOMUS)
@@ -772,29 +864,39 @@ inline fomus_rat operator-(const struct fomus_rat& x) {
 }
 
 inline bool operator==(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_rateq(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) == 0 : module_rateq(a, b);
 }
 inline bool operator!=(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_ratneq(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) != 0 : module_ratneq(a, b);
 }
 inline bool operator<(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_ratlt(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) < 0 : module_ratlt(a, b);
 }
 inline bool operator<=(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_ratlteq(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) <= 0
+                               : module_ratlteq(a, b);
 }
 inline bool operator>(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_ratgt(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) > 0 : module_ratgt(a, b);
 }
 inline bool operator>=(const struct fomus_rat& a, const struct fomus_rat& b) {
-  return module_ratgteq(a, b);
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) >= 0
+                               : module_ratgteq(a, b);
 }
 inline struct fomus_rat operator+(const struct fomus_rat& a,
                                   const struct fomus_rat& b) {
+  if (a.den == 1 && b.den == 1 && module_ratsmall(a, b)) {
+    struct fomus_rat r = {a.num + b.num, 1};
+    return r;
+  }
   return module_ratplus(a, b);
 }
 inline struct fomus_rat operator-(const struct fomus_rat& a,
                                   const struct fomus_rat& b) {
+  if (a.den == 1 && b.den == 1 && module_ratsmall(a, b)) {
+    struct fomus_rat r = {a.num - b.num, 1};
+    return r;
+  }
   return module_ratminus(a, b);
 }
 inline struct fomus_rat operator*(const struct fomus_rat& a,
@@ -807,29 +909,43 @@ inline struct fomus_rat operator/(const struct fomus_rat& a,
 }
 
 inline bool operator==(const struct fomus_rat& a, const fomus_int b) {
-  return module_rateq(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) == 0
+                               : module_rateq(a, module_inttorat(b));
 }
 inline bool operator!=(const struct fomus_rat& a, const fomus_int b) {
-  return module_ratneq(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) != 0
+                               : module_ratneq(a, module_inttorat(b));
 }
 inline bool operator<(const struct fomus_rat& a, const fomus_int b) {
-  return module_ratlt(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) < 0
+                               : module_ratlt(a, module_inttorat(b));
 }
 inline bool operator<=(const struct fomus_rat& a, const fomus_int b) {
-  return module_ratlteq(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) <= 0
+                               : module_ratlteq(a, module_inttorat(b));
 }
 inline bool operator>(const struct fomus_rat& a, const fomus_int b) {
-  return module_ratgt(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) > 0
+                               : module_ratgt(a, module_inttorat(b));
 }
 inline bool operator>=(const struct fomus_rat& a, const fomus_int b) {
-  return module_ratgteq(a, module_inttorat(b));
+  return module_ratsmall(a, b) ? module_ratcmp(a, b) >= 0
+                               : module_ratgteq(a, module_inttorat(b));
 }
 inline struct fomus_rat operator+(const struct fomus_rat& a,
                                   const fomus_int b) {
+  if (a.den == 1 && module_ratsmall(a, b)) {
+    struct fomus_rat r = {a.num + b, 1};
+    return r;
+  }
   return module_ratplus(a, module_inttorat(b));
 }
 inline struct fomus_rat operator-(const struct fomus_rat& a,
                                   const fomus_int b) {
+  if (a.den == 1 && module_ratsmall(a, b)) {
+    struct fomus_rat r = {a.num - b, 1};
+    return r;
+  }
   return module_ratminus(a, module_inttorat(b));
 }
 inline struct fomus_rat operator*(const struct fomus_rat& a,
@@ -842,22 +958,28 @@ inline struct fomus_rat operator/(const struct fomus_rat& a,
 }
 
 inline bool operator==(const fomus_int a, const struct fomus_rat& b) {
-  return module_rateq(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 == module_ratcmp(b, a)
+                               : module_rateq(module_inttorat(a), b);
 }
 inline bool operator!=(const fomus_int a, const struct fomus_rat& b) {
-  return module_ratneq(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 != module_ratcmp(b, a)
+                               : module_ratneq(module_inttorat(a), b);
 }
 inline bool operator<(const fomus_int a, const struct fomus_rat& b) {
-  return module_ratlt(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 < module_ratcmp(b, a)
+                               : module_ratlt(module_inttorat(a), b);
 }
 inline bool operator<=(const fomus_int a, const struct fomus_rat& b) {
-  return module_ratlteq(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 <= module_ratcmp(b, a)
+                               : module_ratlteq(module_inttorat(a), b);
 }
 inline bool operator>(const fomus_int a, const struct fomus_rat& b) {
-  return module_ratgt(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 > module_ratcmp(b, a)
+                               : module_ratgt(module_inttorat(a), b);
 }
 inline bool operator>=(const fomus_int a, const struct fomus_rat& b) {
-  return module_ratgteq(module_inttorat(a), b);
+  return module_ratsmall(b, a) ? 0 >= module_ratcmp(b, a)
+                               : module_ratgteq(module_inttorat(a), b);
 }
 inline struct fomus_rat operator+(const fomus_int a,
                                   const struct fomus_rat& b) {
@@ -29,6 +29,169 @@ namespace fomus {
   boost::thread_specific_ptr<bool> lockcheck;
 #endif
 
+  boost::thread_specific_ptr<arenaslot> threadarena(delarenaslot);
+
+  // pool blocks are handed back here when an arena goes away and reused by
+  // the next one, so a batch of runs keeps working in the same (already
+  // touched) memory
+#define ARENA_MAXCACHED (16 << 20)
+  struct arenacache {
+    boost::mutex mut;
+    std::multimap<std::size_t, char*> blocks;
+    std::size_t bytes;
+    arenacache() : bytes(0) {}
+  };
+  inline arenacache& getarenacache() { // never destroyed, events can still be
+                                       // freed during static destruction
+    static arenacache* x = new arenacache;
+    return *x;
+  }
+  char* arenablocks::malloc BOOST_PREVENT_MACRO_SUBSTITUTION(const size_type n) {
+    arenacache& ca = getarenacache();
+    {
+      boost::lock_guard<boost::mutex> xxx(ca.mut);
+      std::multimap<std::size_t, char*>::iterator i(ca.blocks.find(n));
+      if (i != ca.blocks.end()) {
+        char* r = i->second;
+        ca.blocks.erase(i);
+        ca.bytes -= n;
+        return r;
+      }
+    }
+    std::size_t* r = (std::size_t*) std::malloc(n + sizeof(std::max_align_t));
+    if (!r)
+      return 0;
+    *r = n;
+    return (char*) r + sizeof(std::max_align_t);
+  }
+  void arenablocks::free BOOST_PREVENT_MACRO_SUBSTITUTION(char* const p) {
+    const std::size_t n = *(std::size_t*) (p - sizeof(std::max_align_t));
+    arenacache& ca = getarenacache();
+    {
+      boost::lock_guard<boost::mutex> xxx(ca.mut);
+      if (ca.bytes + n <= ARENA_MAXCACHED) {
+        ca.blocks.insert(std::pair<const std::size_t, char*>(n, p));
+        ca.bytes += n;
+        return;
+      }
+    }
+    std::free(p - sizeof(std::max_align_t));
+  }
+
+  struct arenahdr { // in front of every object
+    evarena* ar;    // 0 if it came from the heap
+    std::size_t n;  // size with the header, a multiple of ARENA_ALIGN
+  };
+
+  inline void delpools(arenapools& pools) {
+    for (arenapools::iterator i(pools.begin()); i != pools.end(); ++i)
+      delete *i;
+  }
+  // every pool of a size can take a chunk back no matter which one it came
+  // from--they all go away together with the arena
+  inline arenapool& getpool(arenapools& pools, const std::size_t n) {
+    const std::size_t i = n / ARENA_ALIGN;
+    if (i >= pools.size())
+      pools.resize(i + 1);
+    arenapool*& p = pools[i];
+    if (!p)
+      p = new arenapool(n, 64, 64);
+    return *p;
+  }
+
+  arenaslot::~arenaslot() {
+    delpools(pools);
+  }
+
+  evarena::~evarena() {
+    delpools(pools); // everything at once, the slots go with `slots'
+  }
+  arenaslot& evarena::enter() {
+    boost::lock_guard<boost::mutex> xxx(mut);
+    ++guards;
+    for (boost::ptr_vector<arenaslot>::iterator i(slots.begin());
+         i != slots.end(); ++i) {
+      if (!i->busy) {
+        i->busy = true;
+        return *i;
+      }
+    }
+    slots.push_back(new arenaslot(*this));
+    return slots.back();
+  }
+  void evarena::leave(arenaslot& sl) {
+    bool fin;
+    {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      nallocs += sl.nallocs;
+      live += sl.nallocs - sl.nfrees;
+      sl.nallocs = sl.nfrees = 0;
+      sl.busy = false;
+      --guards;
+      fin = done();
+    }
+    if (fin)
+      delete this;
+  }
+  void evarena::free(void* p) {
+    if (!p)
+      return;
+    arenahdr* h = (arenahdr*) p - 1;
+    evarena* ar = h->ar;
+    if (!ar) {
+      ::operator delete(h);
+      return;
+    }
+    arenaslot* sl = threadarena.get();
+    if (sl && &sl->ar == ar) { // our own arena, no lock
+      getpool(sl->pools, h->n).free(h);
+      ++sl->nfrees;
+      return;
+    }
+    bool fin;
+    {
+      boost::lock_guard<boost::mutex> xxx(ar->mut);
+      getpool(ar->pools, h->n).free(h);
+      --ar->live;
+      fin = ar->done();
+    }
+    if (fin)
+      delete ar;
+  }
+  void evarena::release() {
+    bool fin;
+    {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      owned = false;
+      fin = done();
+    }
+    if (fin)
+      delete this;
+  }
+  void evarena::getstats(fint& allocs, fint& live0) {
+    boost::lock_guard<boost::mutex> xxx(mut);
+    allocs = nallocs;
+    live0 = live;
+  }
+  void* arenaalloc(const std::size_t sz) {
+    const std::size_t n =
+        (sz + sizeof(arenahdr) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    arenaslot* sl = threadarena.get();
+    arenahdr* h;
+    if (sl) {
+      h = (arenahdr*) getpool(sl->pools, n).malloc();
+      if (!h)
+        throw std::bad_alloc();
+      h->ar = &sl->ar;
+      ++sl->nallocs;
+    } else {
+      h = (arenahdr*) ::operator new(n);
+      h->ar = 0;
+    }
+    h->n = n;
+    return h + 1;
+  }
+
   void marksbase::cachessort() {
     boost::ptr_vector<markobj>::iterator x1(std::lower_bound(
         RMUT(marks).begin(), RMUT(marks).end(), m_voicebegin,
@@ -716,6 +879,10 @@ namespace fomus {
                   const numb& trun2) { // notes need to go to measures for .fms
                                        // output (and any other preproc output)
     assert(!CMUT(meass).empty());
+    {
+      WRITELOCK;
+      unshare(); // events are changed from here on
+    }
     for (std::vector<makemeas>::iterator i(makemeass.begin());
          i != makemeass.end(); ++i) {
       if (i->off < trun1 || (trun2 > (fint) 0 && i->off >= trun2))
@@ -735,6 +902,7 @@ namespace fomus {
     }
     assert(!CMUT(meass).empty());
     def->cachesinit();
+    def->setscacheinit();
     std::for_each(getmeass().begin(), getmeass().end(),
                   boost::lambda::bind(&measure::getkeysig_init,
                                       boost::lambda::bind(&measmap_val::second,
@@ -911,6 +1079,65 @@ namespace fomus {
     return c;
   }
 
+  // one read lock for all of the fields (module_snapshot)
+  int noteevbase::snapshot(module_notesnap& snap, const int i) {
+    assert(isvalid());
+    if (i >= snap.cap)
+      return i + 1;
+    const noteev* tr;
+    numb et;
+    {
+      READLOCK;
+      const bool gr = isgrace();
+      const numb& ti = RMUT(off).off;
+      et = gr ? ti : ti + RMUT(dur);
+      int fl = gr ? module_snap_grace : 0;
+      tr = snapshot_nomut(snap, i, fl);
+      if (snap.notes)
+        snap.notes[i] = (module_noteobj) (modobjbase*) this;
+      if (snap.flags)
+        snap.flags[i] = fl;
+      if (snap.time)
+        snap.time[i] = numtofloat(ti);
+      if (snap.rtime)
+        snap.rtime[i] = numtofrat(ti);
+      if (snap.dur)
+        snap.dur[i] = gr ? 0 : numtofloat(RMUT(dur));
+      if (snap.endtime)
+        snap.endtime[i] = numtofloat(et);
+      if (snap.voice)
+        snap.voice[i] = get1voice();
+      if (snap.staff)
+        snap.staff[i] = get1staff();
+      for (int s = 0; s < snap.nsets; ++s)
+        snap.setvals[s * snap.cap + i] = get_fval0(snap.setids[s], true);
+    }
+    if (snap.tiedendtime || snap.rtiedendtime) {
+      if (tr)
+        et = tr->gettiedendtime();
+      if (snap.tiedendtime)
+        snap.tiedendtime[i] = numtofloat(et);
+      if (snap.rtiedendtime)
+        snap.rtiedendtime[i] = numtofrat(et);
+    }
+    return i + 1;
+  }
+  const noteev* noteev::snapshot_nomut(module_notesnap& snap, const int i,
+                                       int& fl) const {
+    fl |= module_snap_note;
+    if (getisperc_nomut())
+      fl |= module_snap_perc;
+    if (RMUT(tiedl))
+      fl |= module_snap_tiedleft;
+    if (RMUT(tiedr))
+      fl |= module_snap_tiedright;
+    if (snap.pitch)
+      snap.pitch[i] = numtofloat(RMUT(note));
+    if (snap.rpitch)
+      snap.rpitch[i] = numtofrat(RMUT(note));
+    return RMUT(tiedr);
+  }
+
   void noteevbase::domerge() {
     assert(isntlocked());
     {
@@ -930,16 +1157,58 @@ namespace fomus {
     post_apisetvalue();
   }
 
+  void part::share() { // x's write lock is held by mergefrom()
+    if (shared || (CMUT(tmpevs).empty() && CMUT(markevs).empty()))
+      return;
+    shared.reset(new sharedevs);
+    shared->evs.transfer(shared->evs.end(), CMUT(tmpevs));
+    shared->markevs.transfer(shared->markevs.end(), CMUT(markevs));
+  }
+
+  void part::unshare() { // caller holds the write lock
+    if (!shared)
+      return;
+    boost::shared_ptr<sharedevs> x;
+    x.swap(shared);
+    if (x.unique()) { // the other copies are gone
+      CMUT(tmpevs).transfer(CMUT(tmpevs).end(), x->evs);
+      CMUT(markevs).transfer(CMUT(markevs).end(), x->markevs);
+      return;
+    }
+    for (boost::ptr_list<noteevbase>::iterator i(x->evs.begin());
+         i != x->evs.end(); ++i)
+      CMUT(tmpevs).push_back(i->fomclone(module_none));
+    for (boost::ptr_vector<modobjbase>::iterator i(x->markevs.begin());
+         i != x->markevs.end(); ++i)
+      CMUT(markevs).push_back(((markev&) *i).fomclone(module_none));
+  }
+
   void part::mergefrom(part& x, const numb& shift) {
+    assert(&x != this);
+    // several instances can be copied from x at once, and share() moves x's
+    // events
+    boost::unique_lock<boost::shared_mutex> xl(x.mut);
+    WRITELOCK;
     for (measmap_it i(CMUT(x.meass).begin()); i != CMUT(x.meass).end(); ++i) {
       measure* m = i->second->fomclone(def, shift);
       m->setself(CMUT(meass).insert(i->first, m));
     }
-    for (boost::ptr_list<noteevbase>::iterator i(RMUT(x.tmpevs).begin());
-         i != RMUT(x.tmpevs).end(); ++i)
+    if (shift.isnull() && !shared && CMUT(tmpevs).empty() &&
+        CMUT(markevs).empty()) { // a plain copy, the events are shared
+      x.share();
+      shared = x.shared;
+      return;
+    }
+    unshare();
+    boost::ptr_list<noteevbase>& evs(x.shared ? x.shared->evs
+                                              : RMUT(x.tmpevs));
+    for (boost::ptr_list<noteevbase>::iterator i(evs.begin()); i != evs.end();
+         ++i)
       CMUT(tmpevs).push_back(i->fomclone(shift));
-    for (boost::ptr_vector<modobjbase>::iterator i(CMUT(x.markevs).begin());
-         i != CMUT(x.markevs).end(); ++i)
+    boost::ptr_vector<modobjbase>& mevs(x.shared ? x.shared->markevs
+                                                 : CMUT(x.markevs));
+    for (boost::ptr_vector<modobjbase>::iterator i(mevs.begin());
+         i != mevs.end(); ++i)
       CMUT(markevs).push_back(((markev&) *i).fomclone(shift));
   }
 
@@ -1097,20 +1366,12 @@ namespace fomus {
         return *ret;
       return meas->get_lval_up(id, *this);
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_lval0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_lval0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        return meas->get_lval_up(id, *this);
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_lval0(id, ret))
+        return *ret;
+      if (RMUT(stf) && RMUT(stf)->get_lval0(id, ret))
+        return *ret;
+      return meas->get_lval_up(id, *this);
     }
   }
   const std::string& event::get_sval0(const int id, const bool nomut) const {
@@ -1129,20 +1390,12 @@ namespace fomus {
         return *ret;
       return meas->get_sval_up(id, *this);
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_sval0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_sval0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        return meas->get_sval_up(id, *this);
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_sval0(id, ret))
+        return *ret;
+      if (RMUT(stf) && RMUT(stf)->get_sval0(id, ret))
+        return *ret;
+      return meas->get_sval_up(id, *this);
     }
   }
   ffloat event::get_fval0(const int id, const bool nomut) const {
@@ -1161,20 +1414,12 @@ namespace fomus {
         return ret;
       return meas->get_fval_up(id, *this);
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_fval0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_fval0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        return meas->get_fval_up(id, *this);
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_fval0(id, ret))
+        return ret;
+      if (RMUT(stf) && RMUT(stf)->get_fval0(id, ret))
+        return ret;
+      return meas->get_fval_up(id, *this);
     }
   }
   rat event::get_rval0(const int id, const bool nomut) const {
@@ -1193,20 +1438,12 @@ namespace fomus {
         return ret;
       return meas->get_rval_up(id, *this);
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_rval0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_rval0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        return meas->get_rval_up(id, *this);
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_rval0(id, ret))
+        return ret;
+      if (RMUT(stf) && RMUT(stf)->get_rval0(id, ret))
+        return ret;
+      return meas->get_rval_up(id, *this);
     }
   }
   fint event::get_ival0(const int id, const bool nomut) const {
@@ -1225,20 +1462,12 @@ namespace fomus {
         return ret;
       return meas->get_ival_up(id, *this); // go up to part
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_ival0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_ival0(id, ret))
-          return ret;
-      }
-      {
-        READLOCK;
-        return meas->get_ival_up(id, *this); // go up to part
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_ival0(id, ret))
+        return ret;
+      if (RMUT(stf) && RMUT(stf)->get_ival0(id, ret))
+        return ret;
+      return meas->get_ival_up(id, *this); // go up to part
     }
   }
   const varbase& event::get_varbase0(const int id, const bool nomut) const {
@@ -1257,20 +1486,12 @@ namespace fomus {
         return *ret;
       return meas->get_varbase_up(id, *this); // go up to part
     } else {
-      {
-        READLOCK;
-        if (RMUT(clf) && UNLOCKP(RMUT(clf))->get_varbase0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        if (RMUT(stf) && UNLOCKP(RMUT(stf))->get_varbase0(id, ret))
-          return *ret;
-      }
-      {
-        READLOCK;
-        return meas->get_varbase_up(id, *this); // go up to part
-      }
+      READLOCK; // covers the clef, staff and percussion instrument pointers
+      if (RMUT(clf) && RMUT(clf)->get_varbase0(id, ret))
+        return *ret;
+      if (RMUT(stf) && RMUT(stf)->get_varbase0(id, ret))
+        return *ret;
+      return meas->get_varbase_up(id, *this); // go up to part
     }
   }
 
@@ -359,6 +359,85 @@ public:
     }
   };
 
+  struct arenablocks { // block source for the arena pools, see classes.cc
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    static char* malloc BOOST_PREVENT_MACRO_SUBSTITUTION(const size_type n);
+    static void free BOOST_PREVENT_MACRO_SUBSTITUTION(char* const p);
+  };
+  typedef boost::pool<arenablocks> arenapool;
+  typedef std::vector<arenapool*> arenapools; // by size / ARENA_ALIGN
+#define ARENA_ALIGN sizeof(std::max_align_t)
+  class evarena;
+  struct arenaslot _NONCOPYABLE { // used by one thread at a time, no locking
+    evarena& ar;
+    arenapools pools;
+    fint nallocs, nfrees; // added to the arena's counts when the guard closes
+    bool busy;
+    arenaslot(evarena& ar) : ar(ar), nallocs(0), nfrees(0), busy(true) {}
+    ~arenaslot();
+  };
+  // pooled storage for the note, rest and mark events and marks of one
+  // fomusdata instance--freed in one piece once the instance and every object
+  // allocated from it are gone
+  class evarena _NONCOPYABLE {
+    boost::mutex mut;
+    boost::ptr_vector<arenaslot> slots; // one for each open arenaguard
+    arenapools pools; // for objects freed outside of a guard on this arena
+    fint live; // counts are only exact while no guard is open
+    fint nallocs;
+    int guards;
+    bool owned;
+    ~evarena();
+    bool done() const {
+      return !owned && !guards && live <= 0;
+    }
+
+public:
+    evarena() : live(0), nallocs(0), guards(0), owned(true) {}
+    static void free(void* p);
+    void release(); // owner is done with it
+    void getstats(fint& allocs, fint& live);
+    arenaslot& enter();
+    void leave(arenaslot& sl);
+  };
+  class evarenaref { // each copy of the owner gets a fresh arena, fomus_clear
+                     // renews the whole owner and so releases it too
+    evarena* ar;
+    evarenaref& operator=(const evarenaref&);
+
+public:
+    evarenaref() : ar(new evarena) {}
+    evarenaref(const evarenaref&) : ar(new evarena) {}
+    ~evarenaref() {
+      ar->release();
+    }
+    evarena& get() const {
+      return *ar;
+    }
+  };
+  inline void delarenaslot(arenaslot*) {} // no cleanup--owned by the arena
+  extern boost::thread_specific_ptr<arenaslot> threadarena;
+  struct arenaguard { // objects created in this scope come from `ar'
+    arenaslot* bak;
+    arenaslot& sl;
+    arenaguard(evarena& ar) : bak(threadarena.get()), sl(ar.enter()) {
+      threadarena.reset(&sl);
+    }
+    ~arenaguard() {
+      threadarena.reset(bak);
+      sl.ar.leave(sl);
+    }
+  };
+  void* arenaalloc(const std::size_t sz); // from threadarena or the heap
+#define ARENA_NEW                                                              \
+  void* operator new(const std::size_t sz) {                                   \
+    return arenaalloc(sz);                                                     \
+  }                                                                            \
+  void operator delete(void* p) {                                              \
+    evarena::free(p);                                                          \
+  }
+
   class measure;
   class event : public modobjbase_sets NONCOPYABLE {
 protected:
@@ -374,6 +453,7 @@ protected:
     eventmap_it self;
 
 public:
+    ARENA_NEW
     event(const filepos& pos)
         : meas(0), pos(pos), clf((clef_str*) 0 _MUT), stf((staff_str*) 0 _MUT) {
       assert(isvalid());
@@ -852,6 +932,7 @@ public:
     numb val;
     int sort; // set at very very end of processing
     enum module_markpos pos;
+    ARENA_NEW
     markobj() {
       assert(false);
     }
@@ -1794,6 +1875,17 @@ public:
     virtual bool getistiedright_nomut() const {
       return false;
     }
+    int snapshot(module_notesnap& snap, const int i);
+    // fields that only notes have, called with the lock held--returns the note
+    // this one is tied to on the right
+    virtual const noteev* snapshot_nomut(module_notesnap& snap, const int i,
+                                         int& fl) const {
+      if (snap.pitch)
+        snap.pitch[i] = 0;
+      if (snap.rpitch)
+        snap.rpitch[i] = makerat(0, 1);
+      return 0;
+    }
     int getclef() const {
       READLOCK;
       return RMUT(clef);
@@ -2319,6 +2411,8 @@ public:
     bool getistiedright_nomut() const {
       return RMUT(tiedr);
     }
+    const noteev* snapshot_nomut(module_notesnap& snap, const int i,
+                                 int& fl) const;
     bool getisbeginchord() const;
     bool getisendchord() const;
     bool getischordlow() const;
@@ -3418,6 +3512,11 @@ public:
       module_intslist r = {stavescache.size(), &stavescache[0]};
       return r;
     }
+    int snapshot(module_notesnap& snap, int i) {
+      for (eventmap_it e(CMUT(events).begin()); e != CMUT(events).end(); ++e)
+        i = e->second->snapshot(snap, i);
+      return i;
+    }
     bool objless(const modobjbase& y) const {
       return y.objgreat(*this);
     }
@@ -3765,6 +3864,14 @@ public:
     post_apisetvalue();
   }
 
+  // input events of a part that haven't been run yet, shared by copies of an
+  // instance (fomus_copy()) and only read until one of them changes or runs
+  // its part
+  struct sharedevs _NONCOPYABLE {
+    boost::ptr_list<noteevbase> evs;
+    boost::ptr_vector<modobjbase> markevs;
+  };
+
   // holds the notes & objects
   class part _NONCOPYABLE {
     boost::shared_mutex mut; //, cachemut;
@@ -3779,6 +3886,11 @@ protected:
     MUTCHECK(boost::ptr_vector<modobjbase>) markevs;
     MUTCHECK(boost::ptr_vector<modobjbase>) tmpmarkevs;
     MUTCHECK(bool) tmark;
+    // stands in for tmpevs and markevs (which are empty) while it's set
+    boost::shared_ptr<sharedevs> shared;
+    void share();
+    void unshare(); // call before tmpevs or markevs are used, with the write
+                    // lock held (copies share() under it)
 #ifndef NDEBUG
     int valid;
 #endif
@@ -3821,6 +3933,7 @@ public:
     void insertnew(noteevbase* nt) {
       WRITELOCK;
       assert(!CMUT(meass).empty());
+      unshare();
       WMUT(tmpevs).push_back(nt);
     } // fresh new note events
     part* fomclone(partormpart_str* def0, const numb& shift) {
@@ -3834,10 +3947,11 @@ public:
 #endif
     bool tmpevsempty() const {
       READLOCK;
-      return RMUT(tmpevs).empty();
+      return shared ? shared->evs.empty() : RMUT(tmpevs).empty();
     }
     bool alltmpevsempty() const { /*READLOCK;*/
-      return CMUT(tmpevs).empty() && CMUT(markevs).empty();
+      return shared ? shared->evs.empty() && shared->markevs.empty()
+                    : CMUT(tmpevs).empty() && CMUT(markevs).empty();
     } // called before running
     int maxbgrouplvl() const {
       return RMUT(bgroups).empty() ? -1
@@ -3996,9 +4110,15 @@ public:
     }
     void insertnewmarkev(markev* m) {
       assert(isvalid());
+      WRITELOCK;
+      unshare();
       XMUT(markevs).push_back(m);
     }
     module_objlist getmarkevslist() {
+      {
+        WRITELOCK;
+        unshare();
+      }
       module_objlist r = {CMUT(markevs).size(),
                           (void**) CMUT(markevs).c_array()};
       return r;
@@ -4013,6 +4133,7 @@ public:
     }
     void clearallnotes() {
       WRITELOCK;
+      shared.reset();
       WMUT(tmpevs).clear();
       XMUT(markevs).clear();
     }
@@ -4156,6 +4277,11 @@ public:
   inline struct module_intslist partormpart_str::getstaves() {
     return prt->getstaves();
   }
+  inline int partormpart_str::snapshot(module_notesnap& snap, int i) {
+    for (measmap_it m(prt->getmeass().begin()); m != prt->getmeass().end(); ++m)
+      i = m->second->snapshot(snap, i);
+    return i;
+  }
   inline partormpart_str::partormpart_str(const partormpart_str& x,
                                           const numb& shift)
       : str_base(x), prt(x.prt->fomclone(this, shift)), ind(x.ind),
@@ -4221,50 +4347,63 @@ public:
 
   inline const varbase& measure::get_varbase(const int id) const {
     setmap_constit i(attrs->sets.find(id));
-    return (i != attrs->sets.end()) ? *i->second : prt->get_varbase(id);
+    return (i != attrs->sets.end()) ? *i->second : prt->get_varbase_cached(id);
   }
   inline fint measure::get_ival(const int id) const {
     setmap_constit i(attrs->sets.find(id));
-    return (i != attrs->sets.end()) ? i->second->getival() : prt->get_ival(id);
+    return (i != attrs->sets.end()) ? i->second->getival()
+                                    : prt->get_varbase_cached(id).getival();
   }
   inline rat measure::get_rval(const int id) const {
     setmap_constit i(attrs->sets.find(id));
-    return (i != attrs->sets.end()) ? i->second->getrval() : prt->get_rval(id);
+    return (i != attrs->sets.end()) ? i->second->getrval()
+                                    : prt->get_varbase_cached(id).getrval();
   }
   inline ffloat measure::get_fval(const int id) const {
     setmap_constit i(attrs->sets.find(id));
-    return (i != attrs->sets.end()) ? i->second->getfval() : prt->get_fval(id);
+    return (i != attrs->sets.end()) ? i->second->getfval()
+                                    : prt->get_varbase_cached(id).getfval();
   }
   inline const std::string& measure::get_sval(const int id) const {
     setmap_constit i(attrs->sets.find(id));
-    return (i != attrs->sets.end()) ? i->second->getsval() : prt->get_sval(id);
+    return (i != attrs->sets.end()) ? i->second->getsval()
+                                    : prt->get_varbase_cached(id).getsval();
   }
   inline const module_value& measure::get_lval(const int id) const {
     setmap_constit i(attrs->sets.find(id));
     return (i != attrs->sets.end()) ? i->second->getmodval()
-                                    : prt->get_lval(id);
+                                    : prt->get_varbase_cached(id).getmodval();
   }
 
+  // percussion instruments sit between the part and instrument settings, so
+  // only those events need the whole lookup--the part's cache can't hold it
+  // since it's per part and not per percussion instrument
   inline const varbase& measure::get_varbase_up(const int id,
                                                 const event& ev) const {
-    return prt->get_varbase(id, ev);
+    return ev.getpercinst0() ? prt->get_varbase(id, ev)
+                             : prt->get_varbase_cached(id);
   }
   inline fint measure::get_ival_up(const int id, const event& ev) const {
-    return prt->get_ival(id, ev);
+    return ev.getpercinst0() ? prt->get_ival(id, ev)
+                             : prt->get_varbase_cached(id).getival();
   }
   inline rat measure::get_rval_up(const int id, const event& ev) const {
-    return prt->get_rval(id, ev);
+    return ev.getpercinst0() ? prt->get_rval(id, ev)
+                             : prt->get_varbase_cached(id).getrval();
   }
   inline ffloat measure::get_fval_up(const int id, const event& ev) const {
-    return prt->get_fval(id, ev);
+    return ev.getpercinst0() ? prt->get_fval(id, ev)
+                             : prt->get_varbase_cached(id).getfval();
   }
   inline const std::string& measure::get_sval_up(const int id,
                                                  const event& ev) const {
-    return prt->get_sval(id, ev);
+    return ev.getpercinst0() ? prt->get_sval(id, ev)
+                             : prt->get_varbase_cached(id).getsval();
   }
   inline const module_value& measure::get_lval_up(const int id,
                                                   const event& ev) const {
-    return prt->get_lval(id, ev);
+    return ev.getpercinst0() ? prt->get_lval(id, ev)
+                             : prt->get_varbase_cached(id).getmodval();
   }
 
   inline bool spanmark::getcantouch(const noteevbase& ev) const {
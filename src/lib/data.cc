@@ -22,6 +22,8 @@
 #include "instrs.h"
 #include "moremath.h" // floor_base
 
+#include <cstring> // memcpy
+
 namespace fomus {
 
   int fomusdata::getvarid(const std::string& str) const {
@@ -818,6 +820,31 @@ public:
     prt->insdefmeas(fd.getdefmeasdefptr("default"));
   }
 
+  bool fomusdata::sinkwrite(const std::string& fn, const char* buf,
+                            const fint n) {
+    sinkmap_it i(sinks.find(fn));
+    if (i == sinks.end() || n < 0)
+      return false;
+    fomus_sink& s = *i->second.s;
+    if (s.write) {
+      if (s.write(s.data, buf, n))
+        return false;
+    } else {
+      std::size_t sz = s.size + n;
+      if (sz > i->second.cap) {
+        std::size_t c = std::max(sz, i->second.cap * 2);
+        char* b = (char*) std::realloc(s.buf, c);
+        if (!b)
+          return false;
+        s.buf = b;
+        i->second.cap = c;
+      }
+      std::memcpy(s.buf + s.size, buf, n);
+    }
+    s.size += n;
+    return true;
+  }
+
   fomusdata::fomusdata()
       :
 #ifndef NDEBUG
@@ -835,7 +862,8 @@ public:
         note_inprint(note_print), acc_inprint(acc_print),
         mic_inprint(mic_print), oct_inprint(oct_print), prevnote((fint) 60),
         prevnotegup(true), stagenum(0),
-        partind(-(std::numeric_limits<fint>::min() / 2)), grpcnt(0) {
+        partind(-(std::numeric_limits<fint>::min() / 2)), grpcnt(0),
+        bg(new bggroup) {
     std::for_each(
         vars.begin(), vars.end(),
         boost::lambda::bind(&fomusdata::makein, this, boost::lambda::_1));
@@ -873,6 +901,7 @@ public:
         strinvars(x.strinvars), // get rid of this eventually, don't need it
         curvar(-1), pos(info_global), queuestate(false), data(&datanorm),
         redunent(false), soff(false), curblast(fomus_par_noteevent),
+        internedparts(x.internedparts),
         makemeass(x.makemeass), // COPY MEASURE!
         imp(new import_str()), exp(new export_str()), clef(new clef_str()),
         staff(new staff_str()), perc(new percinstr_str()),
@@ -893,8 +922,9 @@ public:
         mic_inprint(mic_print), oct_inprint(oct_print), prevnote((fint) 60),
         prevnotegup(true), stagenum(0),
         partind(x.partind), // COPY PART INDEX COUNTER!
-        grpcnt(0) {
+        grpcnt(0), bg(x.bg) {
     DBG("############## COPY COPY COPY" << std::endl);
+    arenaguard xxx(getarena()); // clones go into the new instance
 #ifndef NDEBUGOUT
     for (defpartsmap_it jj(default_parts.begin()); jj != default_parts.end();
          ++jj)
@@ -910,7 +940,8 @@ public:
     std::map<part_str*, boost::shared_ptr<part_str>> clones;
     for (scorepartlist_it i(scoreparts.begin()); i != scoreparts.end(); ++i) {
       if (!(*i)->ismetapart()) {
-        boost::shared_ptr<part_str> tmp(((part_str&) (**i)).fomclone());
+        boost::shared_ptr<part_str> tmp(
+            ((part_str&) (**i)).fomclone()); // shares x's events
         //#warning "compare part against x.thedefpart and reset to tmp clone if
         //matches"
         clones.insert(
@@ -1009,6 +1040,7 @@ public:
   void fomusdata::mergeinto(fomusdata& x) {
     if (&x == this)
       return;
+    arenaguard xxx(getarena());
     std::map<part_str*, boost::shared_ptr<part_str>> clones;
     const scorepartlist_it beg((x.scoreparts.size() > 1 &&
                                 x.scoreparts.front()->getpart().tmpevsempty())
@@ -1232,6 +1264,92 @@ public:
       curseldpart = i3->second;
   }
 
+  int fomusdata::internpart(const std::string& id) {
+    if (default_parts.find(id) == default_parts.end() &&
+        default_mparts.find(id) == default_mparts.end() &&
+        !boost::algorithm::iequals(id, "default") &&
+        !boost::algorithm::iequals(id, "all"))
+      return -1;
+    for (std::vector<std::string>::const_iterator i(internedparts.begin());
+         i != internedparts.end(); ++i) {
+      if (boost::algorithm::iequals(*i, id))
+        return i - internedparts.begin();
+    }
+    internedparts.push_back(id);
+    return internedparts.size() - 1;
+  }
+
+  inline numb recnumb(const fomus_rat& x, fomusdata& fd) {
+    if (x.den == 0)
+      fd.throwfpe();
+    return x.den == 1 ? numb(x.num) : numb(rat(x.num, x.den));
+  }
+  // part ids are looked up by name once per batch, so they follow parts that
+  // are redefined in between
+  void fomusdata::addnotes(const fomus_note_rec* recs, const fomus_int n) {
+    const boost::shared_ptr<partormpart_str> sel(curseldpart);
+    std::vector<boost::shared_ptr<partormpart_str>> prts(internedparts.size());
+    try {
+      for (const fomus_note_rec *r = recs, *re = recs + n; r < re; ++r) {
+        if (r->part >= 0) {
+          if (r->part >= (int) prts.size()) {
+            CERR << "invalid part id " << r->part;
+            pos.printerr();
+            throw errbase();
+          }
+          boost::shared_ptr<partormpart_str>& p(prts[r->part]);
+          if (!p.get()) {
+            setpart(internedparts[r->part]);
+            p = curseldpart;
+          } else
+            curseldpart = p;
+        } else
+          curseldpart = sel;
+        if (r->flags & fomus_note_float) {
+          setoffs(numb(r->ftime));
+          setdur(numb(r->fdur));
+        } else {
+          setoffs(recnumb(r->time, *this));
+          setdur(recnumb(r->dur, *this));
+        }
+        setdyn((r->flags & fomus_note_intdyn) ? numb((fint) r->dyn)
+                                              : numb(r->dyn));
+        if (r->nvoices >= 0) {
+          data->clearvoices();
+          for (const int *v = r->voices, *ve = r->voices + r->nvoices; v < ve;
+               ++v)
+            addvoices(numb((fint) *v));
+        }
+        for (const int *m = r->marks, *me = r->marks + r->nmarks; m < me;
+             ++m) {
+          if (*m < 0 || *m >= (int) markdefs.size()) {
+            CERR << "invalid mark id " << *m;
+            pos.printerr();
+            throw errbase();
+          }
+          amark.reset(new markobj(markdefs[*m]));
+          setmarklist();
+        }
+        if (r->flags & fomus_note_rest) {
+          setblastnote(fomus_par_restevent);
+        } else {
+          if (r->perc)
+            setpitch(r->perc);
+          else if (r->flags & fomus_note_float)
+            setpitch(numb(r->fpitch));
+          else
+            setpitch(recnumb(r->pitch, *this));
+          setblastnote(fomus_par_noteevent);
+        }
+        blastnote();
+      }
+    } catch (const errbase& e) {
+      curseldpart = sel;
+      throw;
+    }
+    curseldpart = sel;
+  }
+
   void fomusdata::endregion(const fint val) { // actual end of region
     for (datastack_rit i(stack.rbegin()); i != stack.rend(); ++i) {
       if (i->hasid(val)) {
@@ -1370,6 +1488,7 @@ public:
           }
         }
       }
+      arenaguard xxx(fd.getarena()); // marks are copied in here too
       switch (fd.curblast) {
       case fomus_par_noteevent:
         fd.curseldpart->insertnew(new noteev(off, groff, dur, pitch, dyn, vs,
@@ -1456,41 +1575,47 @@ public:
     }
   }
 
-  void fomusdata::collectallvoices() {
+  void fomusdata::collectallvoices(const partscope& sc) {
     std::set<int> allvoices;
     std::for_each(
-        scoreparts.begin(), scoreparts.end(),
+        sc.b, sc.e,
         boost::lambda::bind(
             &partormpart_str::collectallvoices,
             boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
                                 boost::lambda::_1),
             boost::lambda::var(allvoices)));
-    voicescache.assign(allvoices.begin(), allvoices.end());
+    if (!sc.chain) // other parts might be using it
+      voicescache.assign(allvoices.begin(), allvoices.end());
   }
 
-  void fomusdata::collectallstaves() {
+  void fomusdata::collectallstaves(const partscope& sc) {
     std::set<int> allstaves;
     std::for_each(
-        scoreparts.begin(), scoreparts.end(),
+        sc.b, sc.e,
         boost::lambda::bind(
             &partormpart_str::collectallstaves,
             boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
                                 boost::lambda::_1),
             boost::lambda::var(allstaves)));
-    stavescache.assign(allstaves.begin(), allstaves.end());
+    if (!sc.chain)
+      stavescache.assign(allstaves.begin(), allstaves.end());
   }
 
-  void fomusdata::sortorder() {
-    fomus_int srtord = -1;
-    std::for_each(
-        scoreparts.begin(), scoreparts.end(),
-        boost::lambda::bind(
-            &partormpart_str::sortord,
-            boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
-                                boost::lambda::_1),
-            boost::lambda::var(srtord)));
-    for (measmapview_it i(tmpmeass.begin()); i != tmpmeass.end(); ++i)
-      i->second->sortord(srtord);
+  void fomusdata::sortorder(const partscope& sc) {
+    // every part has its own range of indexes so that a part in a chain
+    // can be resorted without overlapping the others
+    const fomus_int r = std::numeric_limits<fomus_int>::max() /
+                        ((fomus_int) scoreparts.size() + 1);
+    fomus_int k = std::distance(scoreparts.begin(), sc.b);
+    for (scorepartlist_it i(sc.b); i != sc.e; ++i, ++k) {
+      fomus_int srtord = k * r - 1;
+      (*i)->sortord(srtord);
+    }
+    if (!sc.chain) {
+      fomus_int srtord = k * r - 1;
+      for (measmapview_it i(tmpmeass.begin()); i != tmpmeass.end(); ++i)
+        i->second->sortord(srtord);
+    }
   }
 
   void fomusdata::postmparts() {
@@ -1502,27 +1627,33 @@ public:
     }
   }
 
-  void fomusdata::fillnotes1() {
+  void fomusdata::fillnotes1(const partscope& sc) {
+    if (sc.plan)
+      return;
     std::for_each(
-        scoreparts.begin(), scoreparts.end(),
+        sc.b, sc.e,
         boost::lambda::bind(
             &partormpart_str::reinserttmps,
             boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
                                 boost::lambda::_1)));
   }
 
-  void fomusdata::fillholes1() {
+  void fomusdata::fillholes1(const partscope& sc) {
+    if (sc.plan)
+      return;
     std::for_each(
-        scoreparts.begin(), scoreparts.end(),
+        sc.b, sc.e,
         boost::lambda::bind(
             &partormpart_str::fillholes1,
             boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
                                 boost::lambda::_1)));
   }
 
-  void fomusdata::fillholes2() {
+  void fomusdata::fillholes2(const partscope& sc) {
+    if (sc.plan)
+      return;
     std::for_each(
-        scoreparts.begin(), scoreparts.end(),
+        sc.b, sc.e,
         boost::lambda::bind(
             &partormpart_str::fillholes2,
             boost::lambda::bind(&boost::shared_ptr<partormpart_str>::get,
@@ -1543,10 +1674,11 @@ public:
     for (scorepartlist_it i(scoreparts.begin()); i != scoreparts.end(); ++i)
       (*i)->insertfiller();
   }
-  void fomusdata::delfills() {
+  void fomusdata::delfills(const partscope& sc) {
+    if (sc.plan)
+      return;
     // std::vector<eventmap_it>::iterator x(its.begin());
-    for (scorepartlist_it i(scoreparts.begin()); i != scoreparts.end();
-         ++i /*, ++x*/)
+    for (scorepartlist_it i(sc.b); i != sc.e; ++i /*, ++x*/)
       (*i)->deletefiller(/**x*/);
   }
 
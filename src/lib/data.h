@@ -830,6 +830,7 @@ namespace fomus {
                      fomus_int den);
   void fomus_fvalaux(FOMUS f, int par, int act, fomus_float val);
   void fomus_svalaux(FOMUS f, int par, int act, const char* str);
+  void fomus_addnotesaux(FOMUS f, const fomus_note_rec* recs, fomus_int n);
   void fomus_actaux(
       FOMUS f, int par,
       int act); // use fomus_append action to append (or fomus_set to replace)
@@ -887,6 +888,33 @@ namespace fomus {
       fomus_svalaux(f, par, act, val.c_str());
     }
   };
+  struct apiqueue_notes : public apiqueuebase {
+    std::vector<fomus_note_rec> recs;
+    std::vector<int> ids; // copies of the voice and mark arrays
+    std::vector<std::string> percs;
+    apiqueue_notes(const fomus_note_rec* recs0, const fomus_int n)
+        : apiqueuebase(fomus_par_noteevent, fomus_act_add),
+          recs(recs0, recs0 + n), percs(n) {
+      std::vector<int> offs;
+      for (const fomus_note_rec *r = recs0, *re = recs0 + n; r < re; ++r) {
+        offs.push_back(ids.size());
+        if (r->nvoices > 0)
+          ids.insert(ids.end(), r->voices, r->voices + r->nvoices);
+        ids.insert(ids.end(), r->marks, r->marks + r->nmarks);
+      }
+      for (fomus_int i = 0; i < n; ++i) { // ids won't move after this
+        fomus_note_rec& r = recs[i];
+        if (r.perc)
+          r.perc = (percs[i] = r.perc).c_str();
+        const int* v = ids.empty() ? 0 : &ids[0] + offs[i];
+        r.voices = v;
+        r.marks = v ? v + std::max(r.nvoices, 0) : 0;
+      }
+    }
+    void enter(FOMUS f) const {
+      fomus_addnotesaux(f, recs.empty() ? 0 : &recs[0], recs.size());
+    }
+  };
 
   struct scoped_module_obj_list : public module_objlist {
     std::vector<module_obj> arr;
@@ -944,6 +972,56 @@ namespace fomus {
   typedef boost::ptr_vector<stage> stagesvect; // container of all stages
 
   struct syncs;
+  class workpool;
+
+  // the parts that getstages() works on: all of them, or a single part when
+  // passes are chained with `part-parallel'.  If `plan' is set, getstages()
+  // doesn't make stages or call any helpers--it only clears `*plan' when the
+  // pass does something that looks across parts
+  struct partscope {
+    scorepartlist_it b, e;
+    bool chain;
+    bool* plan;
+    partscope(const scorepartlist_it& b, const scorepartlist_it& e,
+              const bool chain = false, bool* plan = 0)
+        : b(b), e(e), chain(chain), plan(plan) {}
+  };
+
+  // `profile' totals for one module in one pass (times are in seconds)
+  struct profentry {
+    fint stages, notes, nodes, lookups, hits;
+    double wall, cpu, wait;
+    profentry()
+        : stages(0), notes(0), nodes(0), lookups(0), hits(0), wall(0), cpu(0),
+          wait(0) {}
+  };
+  typedef std::map<std::pair<int, std::string>, profentry> profmap;
+  typedef profmap::const_iterator profmap_constit;
+
+  class profiler _NONCOPYABLE {
+    boost::mutex mut;
+    profmap mods;
+    std::vector<std::pair<std::pair<int, int>, double>> passes;
+
+public:
+    void addstage(const int pass, const std::string& mod, const profentry& e);
+    void addpass(const int pa1, const int pa2, const double wall) {
+      passes.push_back(std::make_pair(std::make_pair(pa1, pa2), wall));
+    }
+    void print(std::ostream& ou, const int nthreads, const double wall,
+               const double cpu) const; // JSON
+  };
+  // last report made in this thread, for fomus_get_profile()
+  extern boost::thread_specific_ptr<std::string> lastprofile;
+
+  // module_background() jobs started by runs of an instance and its copies
+  struct bggroup _NONCOPYABLE {
+    boost::mutex mut;
+    boost::condition_variable cond;
+    int running;
+    bool failed; // since the last wait
+    bggroup() : running(0), failed(false) {}
+  };
 
   // *************************************************************************************************
   class fomusdata : public modobjbase_sets {
@@ -957,6 +1035,7 @@ public:
 #endif
 
 private:
+    evarenaref arena; // note/rest/mark events and marks
     varcopiesvect invars; // input file variables (temporary), by id
     varsptrmap strinvars; // lookup by name
 
@@ -1342,6 +1421,9 @@ public:
         curseldpart; // currently selected part (for input)
     void setpart(const std::string& str);
     fomus_param curblast;
+    std::vector<std::string> internedparts; // fomus_intern_part()
+    int internpart(const std::string& id);
+    void addnotes(const fomus_note_rec* recs, const fomus_int n);
     void setblastnote(const fomus_param par) {
       redunent = false;
       curblast = par;
@@ -2062,6 +2144,23 @@ private:
 public:
     fomusdata();
     fomusdata(fomusdata& x);
+    evarena& getarena() const {
+      return arena.get();
+    }
+    profiler* getprofiler() const {
+      return prof.get();
+    }
+    // output files that go to the caller's sinks, by complete filename (set
+    // by fomus_run_sinks())
+    void addsink(const std::string& fn, fomus_sink& s) {
+      s.buf = 0;
+      s.size = 0;
+      sinks.insert(sinkmap_val(fn, outsink(s)));
+    }
+    bool hassink(const std::string& fn) const {
+      return sinks.find(fn) != sinks.end();
+    }
+    bool sinkwrite(const std::string& fn, const char* buf, const fint n);
 
     numb prevnote;
     bool prevnotegup;
@@ -2256,17 +2355,36 @@ public:
     void singlethread(const int v, const std::vector<runpair>::iterator& b1,
                       const std::vector<runpair>::iterator& b2, const int pa,
                       int& endpass, bool& efix);
-    void multithread(const int n, const int v,
+    void multithread(workpool& pool, const int n, const int v,
                      const std::vector<runpair>::iterator& b1,
                      const std::vector<runpair>::iterator& b2, const int pa,
                      int& endpass, bool& efix);
+    bool canchain(const int pa, const std::vector<runpair>::iterator& b1,
+                  const std::vector<runpair>::iterator& b2);
+    void partchains(workpool& pool, const int n, const int v,
+                    const std::vector<runpair>::iterator& b1,
+                    const std::vector<runpair>::iterator& b2, const int pa1,
+                    const int pa2);
     void runfomus(std::vector<runpair>::iterator b1,
                   const std::vector<runpair>::iterator& b2);
 
 private:
+    boost::scoped_ptr<profiler> prof; // only while running with `profile'
+    struct outsink {
+      fomus_sink* s;
+      std::size_t cap; // size of s->buf
+      outsink(fomus_sink& s) : s(&s), cap(0) {}
+    };
+    typedef std::map<std::string, outsink> sinkmap;
+    typedef sinkmap::iterator sinkmap_it;
+    typedef sinkmap::value_type sinkmap_val;
+    sinkmap sinks; // each one is only written by its output module's thread
     fint stagenum;
 
 public:
+    partscope allparts() {
+      return partscope(scoreparts.begin(), scoreparts.end());
+    }
     int getstages(stagesvect& sta, syncs& sys,
                   const std::vector<runpair>::iterator& b1,
                   const std::vector<runpair>::iterator& b2, const int pa,
@@ -2291,6 +2409,13 @@ public:
 
     int grpcnt;
 
+    // shared with copies, so waiting on an instance includes the runs of the
+    // copies made from it (see fomus_wait())
+    boost::shared_ptr<bggroup> bg;
+    const boost::shared_ptr<bggroup>& getbg() const {
+      return bg;
+    }
+
     std::vector<int> voicescache;
     struct module_intslist getvoices() {
       module_intslist r = {voicescache.size(), &voicescache[0]};
@@ -2302,23 +2427,34 @@ public:
       return r;
     }
 
-    void collectallvoices();
-    void collectallstaves();
-    void sortorder();
+    void collectallvoices(const partscope& sc);
+    void collectallstaves(const partscope& sc);
+    void sortorder(const partscope& sc);
     void postmparts();
-    void fillnotes1();
-    void fillholes1();
-    void fillholes2();
+    void fillnotes1(const partscope& sc);
+    void fillholes1(const partscope& sc);
+    void fillholes2(const partscope& sc);
     void fillholes3();
     void postparts();
     void insfills();
-    void delfills();
+    void delfills(const partscope& sc);
     void preprocess();
 
-    void prepare() {
-      collectallvoices();
-      collectallstaves();
-      sortorder();
+    void prepare(const partscope& sc) {
+      if (sc.plan)
+        return;
+      collectallvoices(sc);
+      collectallstaves(sc);
+      sortorder(sc);
+    }
+    // may a helper that looks at every part be called?
+    bool acrossparts(const partscope& sc) {
+      if (sc.plan) {
+        *sc.plan = false;
+        return false;
+      }
+      assert(!sc.chain);
+      return true;
     }
 
 #ifndef NDEBUGOUT
@@ -38,6 +38,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib> // getenv, exit
+#include <ctime>   // clock, clock_gettime
 #include <new>
 /* #include <cerrno> */
 //#include <cstring> // strcasecmp
@@ -54,6 +55,7 @@
 #include <set>
 #include <stack>
 #include <string>
+#include <type_traits>
 
 #ifndef NDEBUG
 #include <iostream>
@@ -64,6 +66,7 @@
 #include <sstream>
 
 #include <boost/integer.hpp>
+#include <boost/pool/pool.hpp>
 
 #include <boost/ptr_container/ptr_list.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
@@ -72,6 +75,7 @@
 /* #include <boost/ptr_container/ptr_deque.hpp> */
 
 /* #include <boost/bind.hpp> */
+#include <boost/function.hpp>
 #include <boost/functional.hpp>
 
 #include <boost/rational.hpp>
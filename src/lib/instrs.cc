@@ -25,6 +25,12 @@
 
 namespace fomus {
 
+  bool useeventpool() {
+    static const bool u = !std::getenv("FOMUS_EVENTPOOL") ||
+                          std::string(std::getenv("FOMUS_EVENTPOOL")) != "0";
+    return u;
+  }
+
   template <typename I, typename F>
   inline void for_each_pr(std::ostream& ou, I first, const I& last,
                           const F& fun) {
@@ -979,6 +985,20 @@ namespace fomus {
     return 0;
   }
 
+  // resolves every setting from the part up through the instrument and score
+  // once, before the modules run--nothing at these levels changes after input.
+  // Only these levels are cached: an event's and measure's own settings are
+  // small maps looked up first, the clef and staff an event is on change while
+  // the modules run, and percussion events sit between the part and its
+  // instrument (see measure::get_varbase_up())
+  void partormpart_str::setscacheinit() {
+    std::vector<const varbase*> c;
+    c.reserve(vars.size());
+    for (int i = 0; i < (int) vars.size(); ++i)
+      c.push_back(&get_varbase(i));
+    setscache.swap(c);
+  }
+
   void mpart_str::cachesinit() {
     if (partscache.empty()) {
       std::transform(parts.begin(), parts.end(), std::back_inserter(partscache),
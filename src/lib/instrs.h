@@ -129,7 +129,77 @@ namespace fomus {
 
   class event;
   class noteevbase;
-  typedef boost::ptr_multimap<offgroff, noteevbase> eventmap;
+  // tree nodes for one measure's events, kept together in a pool so walking
+  // a measure doesn't jump all over the heap--freed with the measure
+  class eventnodes _NONCOPYABLE {
+    boost::scoped_ptr<boost::pool<>> pl;
+
+public:
+    void* alloc(const std::size_t sz) {
+      if (!pl.get())
+        pl.reset(new boost::pool<>(sz, 8));
+      assert(pl->get_requested_size() == sz);
+      void* r = pl->malloc();
+      if (!r)
+        throw std::bad_alloc();
+      return r;
+    }
+    void free(void* p) {
+      pl->free(p);
+    }
+  };
+  // stateful (each map has its own pool), so containers must never swap or
+  // assign allocators--an eventmap's nodes only ever go back to its own pool
+  template <typename T>
+  class eventalloc {
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+    eventnodes* nodes;
+    template <typename U>
+    struct rebind {
+      typedef eventalloc<U> other;
+    };
+    eventalloc() : nodes(0) {}
+    eventalloc(eventnodes* nodes) : nodes(nodes) {}
+    template <typename U>
+    eventalloc(const eventalloc<U>& x) : nodes(x.nodes) {}
+    T* allocate(const std::size_t n) {
+      return nodes && n == 1 ? (T*) nodes->alloc(sizeof(T))
+                             : (T*) ::operator new(n * sizeof(T));
+    }
+    void deallocate(T* p, const std::size_t n) {
+      if (nodes && n == 1)
+        nodes->free(p);
+      else
+        ::operator delete(p);
+    }
+  };
+  template <typename T, typename U>
+  inline bool operator==(const eventalloc<T>& x, const eventalloc<U>& y) {
+    return x.nodes == y.nodes;
+  }
+  template <typename T, typename U>
+  inline bool operator!=(const eventalloc<T>& x, const eventalloc<U>& y) {
+    return x.nodes != y.nodes;
+  }
+  typedef boost::ptr_multimap<offgroff, noteevbase, std::less<offgroff>,
+                              boost::heap_clone_allocator,
+                              eventalloc<std::pair<const offgroff, void*>>>
+      eventmap_base;
+  // false if FOMUS_EVENTPOOL is set to 0--every node is then allocated on
+  // its own as in a plain ptr_multimap (for `make bench-eventpool')
+  bool useeventpool();
+  // (eventnodes is destroyed after the map)
+  struct eventmap : public eventnodes, public eventmap_base {
+    eventmap()
+        : eventmap_base(std::less<offgroff>(),
+                        eventalloc<std::pair<const offgroff, void*>>(
+                            useeventpool() ? this : 0)) {}
+  };
   typedef eventmap::iterator eventmap_it;
   typedef eventmap::const_iterator eventmap_constit;
   typedef eventmap::value_type eventmap_val;
@@ -342,6 +412,11 @@ public:
     virtual bool getisgrace() const {
       throw wrongtype("a note or rest");
     }
+    // fill in `snap' starting at index `i', returns the index after the last
+    // event
+    virtual int snapshot(module_notesnap& snap, const int i) {
+      throw wrongtype("a note, measure or part");
+    }
     virtual module_ratslist getdivs() const {
       throw wrongtype("a measure");
     }
@@ -1836,6 +1911,7 @@ public:
     boost::shared_ptr<part> prt; // make new ones as user selects them
     int ind;
     int insord;
+    std::vector<const varbase*> setscache; // see setscacheinit()
     partormpart_str();
     partormpart_str(const partormpart_str& x);
     partormpart_str(const partormpart_str& x,
@@ -1897,6 +1973,11 @@ public:
     virtual const varbase& get_varbase(const int id, const event& ev) const {
       assert(false);
     }
+    void setscacheinit();
+    const varbase& get_varbase_cached(const int id) const {
+      assert(setscache.empty() || (id >= 0 && id < (int) setscache.size()));
+      return setscache.empty() ? get_varbase(id) : *setscache[id];
+    }
     virtual fint get_ival(const int id, const event& ev) const {
       assert(false);
     }
@@ -1942,6 +2023,7 @@ public:
 #endif
     struct module_intslist getvoices();
     struct module_intslist getstaves();
+    int snapshot(module_notesnap& snap, int i);
     virtual void cachesinit() {
       assert(false);
     }
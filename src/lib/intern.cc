@@ -253,7 +253,7 @@ namespace fomus {
     }
   }
 
-  void posttquantinvdoit(FOMUS fom, void* moddata) { // BY ALL
+  void posttquantinvdoit(FOMUS fom, void* moddata) { // BY PART
     while (true) { // eat the notes--this is last in substage section
       module_noteobj n = stageobj->api_nextnote();
       if (!n)
@@ -109,7 +109,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart;
+      return module_bypart | module_partlocal;
     }
   };
   struct intmod_posttquant : public intmodbase {
@@ -129,7 +129,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_all;
+      return module_bypart | module_partlocal;
     }
   };
   struct intmod_postpquant : public intmodbase {
@@ -139,7 +139,8 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_norests | module_noperc | module_firsttied;
+      return module_bymeas | module_norests | module_noperc | module_firsttied |
+             module_partlocal;
     }
   };
   struct intmod_postvoices : public intmodbase {
@@ -149,8 +150,9 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart /*| module_noperc | module_firsttied |
-                              module_norests*/
+      return module_bypart |
+             module_partlocal /*| module_noperc | module_firsttied |
+                                 module_norests*/
           ;
     }
   };
@@ -161,7 +163,8 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart /*| module_norests | module_firsttied*/;
+      return module_bypart |
+             module_partlocal /*| module_norests | module_firsttied*/;
     }
   };
   struct intmod_poststaves2 : public intmodbase {
@@ -171,7 +174,8 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas /*| module_restsonly | module_noperc*/;
+      return module_bymeas |
+             module_partlocal /*| module_restsonly | module_noperc*/;
     }
   };
   struct intmod_postprune : public intmodbase {
@@ -181,8 +185,9 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas /*| module_norests | module_noperc |
-                              module_firsttied*/
+      return module_bymeas |
+             module_partlocal /*| module_norests | module_noperc |
+                                 module_firsttied*/
           ;
     }
   };
@@ -194,7 +199,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_prevspan : public intmodbase {
@@ -204,7 +209,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_postvspan : public intmodbase {
@@ -214,7 +219,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_postsspan : public intmodbase {
@@ -228,7 +233,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_bystaff;
+      return module_bypart | module_bystaff | module_partlocal;
     }
   };
   struct intmod_postoct : public intmodbase {
@@ -238,7 +243,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
 
@@ -249,7 +254,8 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_norests | module_firsttied;
+      return module_bymeas | module_norests | module_firsttied |
+             module_partlocal;
     }
   };
 
@@ -260,7 +266,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
 
@@ -271,7 +277,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_byvoice;
+      return module_bymeas | module_byvoice | module_partlocal;
     }
   };
 
@@ -282,7 +288,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_byvoice;
+      return module_bymeas | module_byvoice | module_partlocal;
     }
   };
 
@@ -293,7 +299,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
 
@@ -313,7 +319,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_byvoice;
+      return module_bymeas | module_byvoice | module_partlocal;
     }
   };
 
@@ -332,7 +338,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
   struct intmod_fillnotes1 : public intmodbase {
@@ -342,7 +348,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   // struct intmod_fillnotes1a:public intmodbase {
@@ -360,7 +366,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas | module_byvoice;
+      return module_bymeas | module_byvoice | module_partlocal;
     }
   };
   struct intmod_postmarkevs : public intmodbase {
@@ -370,7 +376,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
   struct intmod_redoties : public intmodbase {
@@ -380,7 +386,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice | module_norests;
+      return module_bypart | module_byvoice | module_norests | module_partlocal;
     }
   };
 
@@ -391,7 +397,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_finalmarkss : public intmodbase {
@@ -405,7 +411,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_bystaff;
+      return module_bypart | module_bystaff | module_partlocal;
     }
   };
   struct intmod_postspecial : public intmodbase {
@@ -416,7 +422,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart;
+      return module_bypart | module_partlocal;
     }
   };
   struct intmod_barlines : public intmodbase {
@@ -427,7 +433,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_splittrems : public intmodbase {
@@ -438,7 +444,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart;
+      return module_bypart | module_partlocal;
     }
   };
   struct intmod_markhelpers : public intmodbase {
@@ -449,7 +455,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bymeas;
+      return module_bymeas | module_partlocal;
     }
   };
   struct intmod_inbetweenmarks : public intmodbase {
@@ -460,7 +466,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_sysbreak : public intmodbase {
@@ -482,7 +488,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice;
+      return module_bypart | module_byvoice | module_partlocal;
     }
   };
   struct intmod_contmarkss : public intmodbase {
@@ -493,7 +499,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_bystaff;
+      return module_bypart | module_bystaff | module_partlocal;
     }
   };
   // struct intmod_eatnotes_bymeas:public intmodbase {
@@ -512,7 +518,7 @@ namespace fomus {
       ((dumb_iface*) iface)->err = internalerr_fun;
     }
     int getitertype() const {
-      return module_bypart | module_byvoice | module_norests;
+      return module_bypart | module_byvoice | module_norests | module_partlocal;
     }
   };
 
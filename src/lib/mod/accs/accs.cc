@@ -41,6 +41,8 @@
 #include "modutil.h"
 
 #include "debugaux.h"
+#include "distwtaux.h"
+using namespace distwtaux;
 
 namespace accs {
 
@@ -59,6 +61,19 @@ namespace accs {
       exponid, octdistid, beatdistid, rangeid, distmodid, enginemodid, accid,
       wrongdirid; //, inkeyid;
 
+  // simqt() for every pair of choices (filled in by module_init())
+  bool simqttab[NACC * NQT][NACC * NQT];
+
+  // what every choice for a note reads, fetched once for the note
+  struct notesets {
+    module_noteobj note;
+    bool daccs, qts;
+    fomus_rat pitch;
+    fomus_float stepwisepenalty, diaintpenalty, dianotepenalty, simqtpenalty,
+        wrongdirpenalty;
+    fomus_float exponset, expon; // setting and pow(2, -1 / setting)
+  };
+
   struct accsnode _NONCOPYABLE {
     module_noteobj note;
     bool daccs, qts; // is this note qt-enabled?
@@ -67,23 +82,40 @@ namespace accs {
     fomus_float expon;
     int acc;
     fomus_rat qtacc;
+    // the rest are for scoring without rational arithmetic--written notes
+    // are integers, so pitches are multiples of 1/2
+    int choice;
+    fomus_int wr; // written note
+    fomus_int sp; // pitch without the quartertone
+    fomus_int hp; // pitch * 2
+    int asg;      // sign of the whole accidental
+    fomus_float dianotesc;
     // struct module_keysigref keyaccs;
     // bool oacc;
     accsnode(
-        const module_noteobj note,
+        const notesets& sets,
         /*const deque<accsnode*>::type::const_iterator& it,*/ const int acc,
         const fomus_rat& qtacc, /*const dist_iface& diface,*/
-        const bool daccs, const bool qts)
-        : note(note), /*it(it),*/ daccs(daccs), qts(qts), acc(acc),
-          qtacc(qtacc) /*,*/ /*, diface(diface)*/
+        const int choice)
+        : note(sets.note), /*it(it),*/ daccs(sets.daccs), qts(sets.qts),
+          acc(acc), qtacc(qtacc), choice(choice) /*,*/ /*, diface(diface)*/
     /*keyaccs(module_keysigacc(note))*/ {
-      stepwisepenalty = module_setting_fval(note, stepwiseid);
-      diaintpenalty = module_setting_fval(note, diaintid);
-      dianotepenalty = module_setting_fval(note, dianoteid);
-      simqtpenalty = module_setting_fval(note, simqtid);
-      wrongdirpenalty = module_setting_fval(note, wrongdirid);
-      expon = pow(2, -1 / module_setting_fval(note, exponid));
+      stepwisepenalty = sets.stepwisepenalty;
+      diaintpenalty = sets.diaintpenalty;
+      dianotepenalty = sets.dianotepenalty;
+      simqtpenalty = sets.simqtpenalty;
+      wrongdirpenalty = sets.wrongdirpenalty;
+      expon = sets.expon;
       fomus_rat a((fomus_int) acc + qtacc);
+      fomus_rat w(sets.pitch - a), h((fomus_int) 2 * sets.pitch);
+      assert(w.den == 1 && h.den == 1);
+      wr = w.num;
+      sp = wr + acc;
+      hp = h.num;
+      asg = (a < (fomus_int) 0 ? -1 : (a > (fomus_int) 0 ? 1 : 0));
+      dianotesc = ((acc != 0 && iswhite(sp)) || acc < -1 || acc > 1)
+                      ? dianotepenalty
+                      : 0; // acc = semitone-acc
       //       module_measobj m(module_meas(note));
       //       assert((module_note(note) - a).den == 1);
       //       int nn = (module_note(note) - a).num;
@@ -109,25 +141,13 @@ namespace accs {
         : node(node), dist(dist) {}
   };
 
-  inline fomus_float stepwise(const accsnode& n1, const accsnode& n2,
-                              const fomus_rat& o1,
-                              const fomus_rat& o2) { // o1 and o2 = notes
-    fomus_rat a1((fomus_int) n1.acc + n1.qtacc); // quartertone also considered
-    fomus_rat a2((fomus_int) n2.acc + n2.qtacc); // quartertone also considered
-    return ((o1 - a1 == o2 - a2) &&
-            ((o2 > o1 && (a2 < (fomus_int) 0 || a1 < (fomus_int) 0)) ||
-             (o2 < o1 && (a2 > (fomus_int) 0 || a1 > (fomus_int) 0))))
+  inline fomus_float stepwise(const accsnode& n1, const accsnode& n2) {
+    return (n1.wr == n2.wr && // quartertone also considered
+            ((n2.hp > n1.hp && (n2.asg < 0 || n1.asg < 0)) ||
+             (n2.hp < n1.hp && (n2.asg > 0 || n1.asg > 0))))
                ? n2.stepwisepenalty
                : 0;
   }
-  inline fomus_float dianote(const accsnode& n2,
-                             const fomus_rat& o2) { // o2 is note
-    // int a = n2.acc;
-    return ((n2.acc != 0 && iswhite(o2 - n2.qtacc)) || n2.acc < -1 ||
-            n2.acc > 1)
-               ? n2.dianotepenalty
-               : 0; // acc = semitone-acc
-  }
   //   inline fomus_float inkey(const accsnode& n2, const fomus_rat& o2) {
   //     return // ((n2.keyaccs.acc1 > (fomus_int)0  && n2.acc < (fomus_int)0)
   //       // 	    || (n2.keyaccs.acc1 < (fomus_int)0 && n2.acc > (fomus_int)0)
@@ -137,43 +157,35 @@ namespace accs {
   //       (fomus_int)0)) n2.oacc ? n2.inkeypenalty : 0;
   //   }
   // increase in sharpness/flatness must match the allowed values for that IC
-  inline fomus_float diaint(const accsnode& n1, const accsnode& n2,
-                            const fomus_rat& o1, const fomus_rat& o2) {
-    assert(diff(o1 - /*n1.acc -*/ n1.qtacc, o2 - /*n2.acc -*/ n2.qtacc).den ==
-           1);
-    int it(diff(o1 - /*n1.acc -*/ n1.qtacc, o2 - /*n2.acc -*/ n2.qtacc).num %
-           12); // the base written interval mod 12
-    int id(o1 > o2
+  inline fomus_float diaint(const accsnode& n1, const accsnode& n2) {
+    int it((int) (diff(n1.sp, n2.sp) %
+                  12)); // the base written interval mod 12
+    int id(n1.hp > n2.hp
                ? n1.acc - n2.acc
                : n2.acc -
                      n1.acc); // the accidental difference (not including qt)
     return (id < minaccdiff[it] || id > maxaccdiff[it]) ? n2.diaintpenalty : 0;
   }
   inline fomus_float simqt(const accsnode& n1, const accsnode& n2) {
-    fomus_rat q1(n1.qtacc);
-    fomus_rat q2(n2.qtacc);
-    return ((n1.acc < (fomus_int) 0 && q2 > (fomus_int) 0) ||
-            (n1.acc > (fomus_int) 0 && q2 < (fomus_int) 0) ||
-            (q1 < (fomus_int) 0 && q2 > (fomus_int) 0) ||
-            (q1 > (fomus_int) 0 && q2 < (fomus_int) 0) ||
-            (q1 < (fomus_int) 0 && n2.acc > (fomus_int) 0) ||
-            (q1 > (fomus_int) 0 && n2.acc < (fomus_int) 0))
-               ? n2.simqtpenalty
-               : 0;
+    return simqttab[n1.choice][n2.choice] ? n2.simqtpenalty : 0;
   }
-  inline fomus_float wrongdir(const accsnode& n1, const accsnode& n2,
-                              const fomus_rat& o1, const fomus_rat& o2) {
-    fomus_rat a1(o1 - ((fomus_int) n1.acc + n1.qtacc)),
-        a2(o2 - ((fomus_int) n2.acc + n2.qtacc));
-    return ((o1 > o2 && a1 < a2) || (o1 < o2 && a1 > a2)) ? n2.wrongdirpenalty
-                                                          : 0;
+  inline fomus_float wrongdir(const accsnode& n1, const accsnode& n2) {
+    return ((n1.hp > n2.hp && n1.wr < n2.wr) || (n1.hp < n2.hp && n1.wr > n2.wr))
+               ? n2.wrongdirpenalty
+               : 0;
   }
 
   struct accsdata _NONCOPYABLE {
     search_api api; // engine api
     module_noteobj ass, getn;
     dist_iface diface;
+    notesets sets;
+    // scratch space for getscore() (only used from the search thread, see
+    // distwtaux.h)
+    mutable scorescratch<scorenode> scr;
     accsdata() : ass(0), getn(0) {
+      sets.note = 0;
+      sets.exponset = 0;
       diface.moddata = 0;
       diface.data.octdist_setid = octdistid;
       diface.data.beatdist_setid = beatdistid;
@@ -197,32 +209,34 @@ namespace accs {
       assert(
           nodes.n >
           0); // nodes are guaranteed to be in range, though needs to be pruned
-      std::vector<scorenode> arr;
-      accsnode** ie = (accsnode**) nodes.nodes + nodes.n - 1;
+      std::vector<scorenode>& arr(scr.arr);
+      accsnode** ib = (accsnode**) nodes.nodes;
+      accsnode** ie = ib + nodes.n - 1;
       const accsnode& n2 = **ie; // the last one (current one) in the list
-      for (accsnode** i = (accsnode**) nodes.nodes; i != ie; ++i) {
-        fomus_float d = diface.dist(diface.moddata, (*i)->note, n2.note);
-        if (d <= diface.data.rangemax)
-          arr.push_back(scorenode(*i, pow(n2.expon, d)));
+      scr.begin(n2.note);
+      for (accsnode** i = ib; i != ie; ++i) {
+        const distweight& w(scr.weight(diface, (ie - i) - 1, (*i)->note,
+                                       n2.note, n2.expon));
+        if (w.inrange)
+          arr.push_back(scorenode(*i, w.wt));
       }
       union search_score sc;
-      fomus_rat o2(module_pitch(n2.note));
-      sc.f = dianote(
-          n2, o2) /*+ inkey(n2, o2)*/; // vertmax(arr, n2) * arr.size(); //
-                                       // multiply by arr size so matches with
-                                       // accumulated calculations in loop
+      sc.f = n2.dianotesc /*+ inkey(n2, o2)*/; // vertmax(arr, n2) *
+                                               // arr.size(); // multiply by
+                                               // arr size so matches with
+                                               // accumulated calculations in
+                                               // loop
       if (!arr.empty()) {
         fomus_float mx = 0, ll = 0;
         for (std::vector<scorenode>::const_iterator i(arr.begin());
              i != arr.end(); ++i) {
-          fomus_rat o1(module_pitch(i->node->note));
           DBG("  dist " << module_time(i->node->note) << " to "
                         << module_time(n2.note) << " = " << i->dist
                         << std::endl);
           assert(i->dist > 0);
           ll += i->dist;
-          mx += (stepwise(*i->node, n2, o1, o2) + diaint(*i->node, n2, o1, o2) +
-                 simqt(*i->node, n2) + wrongdir(*i->node, n2, o1, o2)) *
+          mx += (stepwise(*i->node, n2) + diaint(*i->node, n2) +
+                 simqt(*i->node, n2) + wrongdir(*i->node, n2)) *
                 i->dist;
         }
         sc.f += mx / ll;
@@ -248,14 +262,16 @@ namespace accs {
                      : (getn = module_nextnote()));
       if (!n)
         return api.end;
-      bool daccs = module_setting_ival(n, daccsid); // double accs allowed?
+      if (n != sets.note)
+        getsets(n);
+      bool daccs = sets.daccs; // double accs allowed?
       if (!daccs && choice >= (3 * NQT))
         return 0;
-      bool qts = module_setting_ival(n, qtsid);
+      bool qts = sets.qts;
       fomus_int theacc1 = choicetoacc[choice / NQT];
       fomus_rat theacc2 = choicetoqtacc[choice % NQT];
       if ((!qts && (choice % NQT) > 0) ||
-          (!iswhite(module_pitch(n) - (fomus_int) theacc1 - theacc2)))
+          (!iswhite(sets.pitch - (fomus_int) theacc1 - theacc2)))
         return 0;
       fomus_rat a1(module_acc1(n));
       if (a1.num != std::numeric_limits<fomus_int>::max()) {
@@ -279,7 +295,7 @@ namespace accs {
             goto ITSOK;
           if (ret.num != std::numeric_limits<fomus_int>::max() &&
               (qts || (choice % NQT) <= 0) &&
-              (iswhite(module_pitch(n) - parts.acc1 - parts.acc2)))
+              (iswhite(sets.pitch - parts.acc1 - parts.acc2)))
             gotval = true;
         }
         if (gotval)
@@ -290,8 +306,24 @@ namespace accs {
     ITSOK:
       DBG("  considering acc: " << module_pitch(n) << ' ' << theacc1 << ' '
                                 << theacc2 << std::endl);
-      return new accsnode(n, /*boost::prior(vect.end()),*/ theacc1, theacc2,
-                          /*getdiface(n),*/ daccs, qts);
+      return new accsnode(sets, /*boost::prior(vect.end()),*/ theacc1, theacc2,
+                          /*getdiface(n),*/ choice);
+    }
+    void getsets(const module_noteobj n) {
+      sets.note = n;
+      sets.daccs = module_setting_ival(n, daccsid);
+      sets.qts = module_setting_ival(n, qtsid);
+      sets.pitch = module_pitch(n);
+      sets.stepwisepenalty = module_setting_fval(n, stepwiseid);
+      sets.diaintpenalty = module_setting_fval(n, diaintid);
+      sets.dianotepenalty = module_setting_fval(n, dianoteid);
+      sets.simqtpenalty = module_setting_fval(n, simqtid);
+      sets.wrongdirpenalty = module_setting_fval(n, wrongdirid);
+      fomus_float x = module_setting_fval(n, exponid);
+      if (x != sets.exponset) { // usually the same for every note
+        sets.exponset = x;
+        sets.expon = pow(2, -1 / x);
+      }
     }
     void assignnext(const int choice) {
       DBG("ASSIGNING ACC = " << module_pitch(module_peeknextnote(ass))
@@ -450,12 +482,28 @@ enum module_type module_type() {
   return module_modaccs;
 }
 int module_itertype() {
-  return module_bypart | module_byvoice | module_firsttied | module_norests;
+  return module_bypart | module_byvoice | module_firsttied | module_norests |
+         module_partlocal;
 }
 const char* module_initerr() {
   return ierr;
 }
-void module_init() {}
+void module_init() {
+  // nearby quartertone accidentals should go in the same direction as each
+  // other and as semitone accidentals
+  for (int i = 0; i < NACC * NQT; ++i) {
+    for (int j = 0; j < NACC * NQT; ++j) {
+      fomus_rat q1(choicetoqtacc[i % NQT]), q2(choicetoqtacc[j % NQT]);
+      int a1 = choicetoacc[i / NQT], a2 = choicetoacc[j / NQT];
+      simqttab[i][j] = ((a1 < 0 && q2 > (fomus_int) 0) ||
+                        (a1 > 0 && q2 < (fomus_int) 0) ||
+                        (q1 < (fomus_int) 0 && q2 > (fomus_int) 0) ||
+                        (q1 > (fomus_int) 0 && q2 < (fomus_int) 0) ||
+                        (q1 < (fomus_int) 0 && a2 > 0) ||
+                        (q1 > (fomus_int) 0 && a2 < 0));
+    }
+  }
+}
 void module_free() { /*assert(newcount == 0);*/
 }
 
@@ -212,7 +212,8 @@ int module_engine_iface() {
   return ENGINE_INTERFACEID;
 } // dumb
 int module_itertype() {
-  return module_bypart | module_byvoice | module_firsttied | module_norests;
+  return module_bypart | module_byvoice | module_firsttied | module_norests |
+         module_partlocal;
 } // notes aren't divided yet, so they reach across measures
 // const char* module_engine(void* d) {return
 // module_setting_sval(module_peeknextpart(0), enginemodid);}
@@ -701,7 +701,7 @@ void module_init() {}
 void module_free() { /*assert(newcount == 0);*/
 }
 int module_itertype() {
-  return module_bymeas | module_byvoice;
+  return module_bymeas | module_byvoice | module_partlocal;
 } // notes aren't divided yet, so they reach across measures
 int module_get_setting(int n, module_setting* set, int id) {
   switch (n) {
@@ -130,7 +130,7 @@ void module_init() {}
 void module_free() { /*assert(newcount == 0);*/
 }
 int module_itertype() {
-  return module_bypart | module_norests | module_noperc;
+  return module_bypart | module_norests | module_noperc | module_partlocal;
 }
 
 // ------------------------------------------------------------------------------------------------------------------------
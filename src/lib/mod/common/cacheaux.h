@@ -0,0 +1,312 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_CACHEAUX_H
+#define FOMUSMOD_CACHEAUX_H
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ios>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#if defined(HAVE_FLOCK) && defined(HAVE_SYS_FILE_H)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#define CACHEAUX_FLOCK
+#endif
+
+#include "module.h"
+
+#include "keyaux.h"
+
+// Cache files that later runs read back (divide's solutions, divrules'
+// expansions).  The records are opaque strings:
+//
+//   fileheader
+//   fingerprint: everything the records depend on (FOMUS version, settings)
+//   records: boost::uint32_t size, boost::uint64_t hash of the record, then
+//            the record
+//
+// Everything is in the writer's byte order.  A file with the wrong magic,
+// version, byte order or fingerprint is stale, and records that don't match
+// their hashes are skipped.  Several processes can share a directory: a
+// writer holds an advisory lock on NAME.lock (where the system has flock()),
+// reads the records the others added since it last looked and appends its
+// own.  A file is never rewritten in place--when it's stale, has a damaged
+// record or would hold more than the caller's maximum, its newest good
+// records (half of the maximum if it's full) are written to NAME.tmp, which
+// replaces it.
+namespace cacheaux {
+
+  const char magic[8] = {'\x89', 'F', 'M', 'D', '\r', '\n', '\x1a', '\n'};
+  const boost::uint32_t version = 1;
+  const boost::uint32_t order = 0x01020304;
+  struct fileheader {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t order;
+    boost::uint32_t fplen; // fingerprint length
+    boost::uint32_t pad;
+  };
+  struct filestate {
+    bool stale, bad;      // header doesn't match, has a damaged record
+    boost::uintmax_t end; // read up to here
+    fomus_int nrecs;      // good records
+    filestate() : stale(false), bad(false), end(0), nrecs(0) {}
+  };
+
+  // held while a cache file is read or written (files are replaced by
+  // renaming, so the lock is on a file of its own)
+  struct filelock : boost::noncopyable {
+#ifdef CACHEAUX_FLOCK
+    int fd;
+    filelock(const std::string& path, const bool ex)
+        : fd(open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0666)) {
+      if (fd >= 0)
+        while (flock(fd, ex ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR)
+          ;
+    }
+    ~filelock() {
+      if (fd >= 0)
+        close(fd); // releases the lock
+    }
+#else
+    filelock(const std::string& path, const bool ex) {}
+#endif
+  };
+
+  template <typename T>
+  inline void putbin(std::string& s, const T& x) {
+    s.append((const char*) &x, sizeof(x));
+  }
+  inline void putbinrat(std::string& s, const fomus_rat& x) {
+    putbin(s, (boost::int64_t) x.num);
+    putbin(s, (boost::int64_t) x.den);
+  }
+  inline void putbinstr(std::string& s, const std::string& x) {
+    putbin(s, (boost::uint32_t) x.size());
+    s += x;
+  }
+  struct binreader {
+    const char *p, *e;
+    binreader(const char* p, const char* e) : p(p), e(e) {}
+    template <typename T>
+    bool get(T& x) {
+      if (e - p < (std::ptrdiff_t) sizeof(x))
+        return false;
+      std::memcpy(&x, p, sizeof(x));
+      p += sizeof(x);
+      return true;
+    }
+    bool getrat(fomus_rat& x) {
+      boost::int64_t n, d;
+      if (!get(n) || !get(d) || d <= 0)
+        return false;
+      x.num = n;
+      x.den = d;
+      return true;
+    }
+    bool getstr(std::string& x, const boost::uint32_t n) {
+      if ((boost::uint64_t)(e - p) < n)
+        return false;
+      x.assign(p, n);
+      p += n;
+      return true;
+    }
+    bool getstr(std::string& x) {
+      boost::uint32_t n;
+      return get(n) && getstr(x, n);
+    }
+  };
+
+  inline void putrecord(std::string& s, const std::string& r) {
+    putbin(s, (boost::uint32_t) r.size());
+    putbin(s, keyaux::hash(r.data(), r.size()));
+    s += r;
+  }
+
+  // reads the good records after `cf.end' into `recs', called with the file
+  // locked
+  inline void readrecs(const std::string& path, const std::string& fp,
+                       filestate& cf, std::vector<std::string>& recs) {
+    std::string buf;
+    try {
+      boost::filesystem::ifstream in(boost::filesystem::path(path),
+                                     std::ios_base::in | std::ios_base::binary);
+      if (!in) {
+        cf = filestate(); // not there (yet)
+        return;
+      }
+      in.seekg(0, std::ios_base::end);
+      if ((boost::uintmax_t)(std::streamoff) in.tellg() < cf.end)
+        cf = filestate(); // replaced
+      in.seekg((std::streamoff) cf.end);
+      buf.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+    } catch (const boost::filesystem::filesystem_error& e) {
+      return;
+    }
+    binreader rd(buf.data(), buf.data() + buf.size());
+    if (cf.end == 0 && !buf.empty()) {
+      fileheader h;
+      std::string fp0;
+      if (!rd.get(h) || std::memcmp(h.magic, magic, sizeof(magic)) != 0 ||
+          h.version != version || h.order != order ||
+          !rd.getstr(fp0, h.fplen) || fp0 != fp) {
+        cf.stale = true;
+        cf.end = buf.size();
+        return;
+      }
+    }
+    while (rd.p < rd.e) {
+      boost::uint32_t n;
+      boost::uint64_t hs;
+      if (!rd.get(n) || !rd.get(hs) || (boost::uint64_t)(rd.e - rd.p) < n) {
+        cf.bad = true; // cut off, nothing after it can be read
+        rd.p = rd.e;
+        break;
+      }
+      const char* b = rd.p;
+      rd.p += n;
+      if (keyaux::hash(b, n) != hs) {
+        cf.bad = true;
+        continue;
+      }
+      ++cf.nrecs;
+      recs.push_back(std::string(b, n));
+    }
+    cf.end += rd.p - buf.data();
+  }
+
+  // the cache files a module has read or written in this process--reading
+  // and writing them is serialized by a lock of its own, so the module
+  // shouldn't hold its in-memory cache's lock while it calls these
+  class files {
+    boost::mutex mut;
+    std::map<std::string, filestate> sts;
+
+public:
+    // the records of a file that hasn't been read yet
+    void load(const std::string& path, const std::string& fp,
+              std::vector<std::string>& recs) {
+      boost::lock_guard<boost::mutex> xxx(mut);
+      std::pair<std::map<std::string, filestate>::iterator, bool> f(
+          sts.insert(std::map<std::string, filestate>::value_type(
+              path, filestate())));
+      if (!f.second)
+        return;
+      filelock yyy(path, false);
+      readrecs(path, fp, f.first->second, recs);
+    }
+    // appends `recs' to a file that holds at most `max' records, the ones the
+    // other processes added since it was last read go into `others'
+    void save(const std::string& path, const std::string& fp,
+              const std::vector<std::string>& recs, const fomus_int max,
+              std::vector<std::string>& others) {
+      std::string out;
+      for (std::vector<std::string>::const_iterator i(recs.begin());
+           i != recs.end(); ++i)
+        putrecord(out, *i);
+      try {
+        boost::filesystem::path pa(path);
+        boost::lock_guard<boost::mutex> xxx(mut);
+        if (pa.has_parent_path())
+          boost::filesystem::create_directories(pa.parent_path());
+        filelock yyy(path, true);
+        filestate& cf = sts[path];
+        const boost::uintmax_t e0 = cf.end;
+        readrecs(path, fp, cf, others); // what the others added
+        if (cf.bad && e0 > 0) {         // might have been replaced
+          cf = filestate();
+          readrecs(path, fp, cf, others);
+        }
+        if (cf.end > 0 && !cf.stale && !cf.bad &&
+            cf.nrecs + (fomus_int) recs.size() <= max) {
+          boost::filesystem::ofstream f(pa, std::ios_base::out |
+                                                std::ios_base::binary |
+                                                std::ios_base::app);
+          f.write(out.data(), out.size());
+          f.close();
+          if (f.fail()) {
+            cf.bad = true; // might have written part of it
+          } else {
+            cf.end += out.size();
+            cf.nrecs += recs.size();
+          }
+          return;
+        }
+        std::vector<std::string> old; // start over with the newest ones
+        if (cf.end > 0 && !cf.stale) {
+          filestate c0;
+          readrecs(path, fp, c0, old);
+        }
+        std::vector<std::string>::size_type k = old.size();
+        if ((fomus_int)(k + recs.size()) > max)
+          k = std::min(k, (std::vector<std::string>::size_type)(max / 2));
+        std::string all;
+        fileheader h;
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.order = order;
+        h.fplen = fp.size();
+        h.pad = 0;
+        putbin(all, h);
+        all += fp;
+        for (std::vector<std::string>::const_iterator i(old.end() - k);
+             i != old.end(); ++i)
+          putrecord(all, *i);
+        all += out;
+        boost::filesystem::path tm(path + ".tmp");
+        boost::filesystem::ofstream f(tm, std::ios_base::out |
+                                              std::ios_base::binary |
+                                              std::ios_base::trunc);
+        f.write(all.data(), all.size());
+        f.close();
+        if (f.fail()) {
+          boost::filesystem::remove(tm);
+          return;
+        }
+        boost::filesystem::rename(tm, pa);
+        cf = filestate();
+        cf.end = all.size();
+        cf.nrecs = k + recs.size();
+      } catch (const boost::filesystem::filesystem_error& e) {
+      }
+    }
+  };
+
+} // namespace cacheaux
+
+#endif
@@ -0,0 +1,93 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_DISTWTAUX_H
+#define FOMUSMOD_DISTWTAUX_H
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#ifndef NDEBUG
+#include <boost/thread/thread.hpp>
+#endif
+
+#include "ifacedist.h"
+#include "module.h"
+
+// Scratch space for the getscore() function of a search module that weighs
+// the notes before the one being scored by their distance from it (voices,
+// staves, accs)
+namespace distwtaux {
+
+  // weight of a note before the one being scored
+  struct distweight {
+    module_noteobj note;
+    bool inrange;
+    fomus_float wt; // pow(expon, dist)
+  };
+
+  // `arr' holds whatever the module collects for the notes in range, the
+  // weights are kept while the same note is scored again (for another choice
+  // or another partial solution)--the engines call getscore() from the search
+  // thread only, which is checked here
+  template <typename S>
+  class scorescratch {
+    std::vector<distweight> wts; // by distance from the end of the window
+    module_noteobj wtsnote;
+#ifndef NDEBUG
+    boost::thread::id owner;
+#endif
+public:
+    std::vector<S> arr;
+    scorescratch() : wtsnote(0) {}
+    // call first in getscore(), `n2' is the note being scored
+    void begin(const module_noteobj n2) {
+#ifndef NDEBUG
+      if (owner == boost::thread::id())
+        owner = boost::this_thread::get_id();
+      assert(owner == boost::this_thread::get_id());
+#endif
+      arr.clear();
+      if (n2 != wtsnote) {
+        wts.clear();
+        wtsnote = n2;
+      }
+    }
+    // weight of `n1', the note `k' places before the end of the window
+    const distweight& weight(const dist_iface& diface, const std::size_t k,
+                             const module_noteobj n1, const module_noteobj n2,
+                             const fomus_float expon) {
+      if (k >= wts.size() || wts[k].note != n1) {
+        fomus_float d = diface.dist(diface.moddata, n1, n2);
+        distweight w = {n1, d <= diface.data.rangemax, 0};
+        if (w.inrange)
+          w.wt = pow(expon, d);
+        if (k >= wts.size())
+          wts.resize(k + 1);
+        wts[k] = w;
+      }
+      return wts[k];
+    }
+  };
+
+} // namespace distwtaux
+
+#endif
@@ -0,0 +1,113 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_FMBAUX_H
+#define FOMUSMOD_FMBAUX_H
+
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+// .fmb layout, shared by fmbout (writer) and fmbin (reader)
+//
+//   fmbheader
+//   fmbsect[nsects]
+//   sections, each starting on an 8-byte boundary
+//
+// Everything is stored in the writer's byte order (checked by `order') with
+// fixed-size records, so a mapped file can be read in place.  Strings are
+// byte offsets into the fmbsect_strings section (0 is the empty string).
+// Object definitions and measures are kept as `.fms' text (they are few and
+// nested), everything else is binary.
+namespace fmbaux {
+
+  const char fmbmagic[8] = {'\x89', 'F', 'M', 'B', '\r', '\n', '\x1a', '\n'};
+  const boost::uint32_t fmbversion = 1;
+  const boost::uint32_t fmborder = 0x01020304;
+  const boost::uint32_t fmbnone = 0xffffffff; // no string/index
+
+  enum fmbsect_kind {
+    fmbsect_strings = 1, // NUL-terminated strings
+    fmbsect_text,        // `.fms' text: definitions, then measures
+    fmbsect_settings,    // fmbsetting, global settings in input order
+    fmbsect_values,      // fmbval, elements of list values
+    fmbsect_events,      // fmbevent, in output order
+    fmbsect_voices,      // boost::int32_t
+    fmbsect_marks,       // fmbmark
+    fmbsect_notesets     // fmbsetting, note settings
+  };
+
+  struct fmbheader {
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t order;
+    boost::uint32_t nsects;
+    boost::uint32_t pad;
+  };
+  struct fmbsect {
+    boost::uint32_t kind;
+    boost::uint32_t size; // size of one record (1 for bytes)
+    boost::uint64_t count;
+    boost::uint64_t offset; // from the start of the file
+  };
+
+  // a module_value, lists point into fmbsect_values
+  struct fmbval {
+    boost::int32_t type; // enum module_value_type
+    boost::uint32_t n;   // list: number of elements
+    union {
+      boost::int64_t i; // int, rat numerator
+      double f;
+      boost::uint64_t s; // string offset, list: index of first element
+    } v;
+    boost::int64_t den;
+  };
+
+  struct fmbsetting {
+    boost::uint32_t name; // setting name, resolved when loaded
+    boost::uint32_t pad;
+    fmbval val;
+  };
+
+  struct fmbmark {
+    boost::uint32_t id;
+    boost::uint32_t str; // fmbnone if there's no string argument
+    fmbval num;          // module_none if there's no number argument
+  };
+
+  enum fmbevent_type { fmbev_note, fmbev_rest, fmbev_mark };
+  struct fmbevent {
+    boost::uint32_t type; // fmbevent_type
+    boost::uint32_t part; // part id
+    fmbval time, grace, dur;
+    fmbval pitch; // a string for percussion instruments
+    fmbval dyn;
+    boost::uint32_t voice0, nvoices;
+    boost::uint32_t mark0, nmarks;
+    boost::uint32_t set0, nsets;
+  };
+
+  inline boost::uint64_t fmbalign(const boost::uint64_t x) {
+    return (x + 7) & ~(boost::uint64_t) 7;
+  }
+
+} // namespace fmbaux
+
+#endif
@@ -23,6 +23,9 @@
 
 #include "config.h"
 
+#include <cstddef>
+#include <vector>
+
 #include <boost/iostreams/concepts.hpp> // sink
 #include <boost/iostreams/stream.hpp>
 
@@ -39,6 +42,44 @@ namespace foutaux {
   };
   boost::iostreams::stream<mymodout> fout(mymodout(0));
 
+  // one part's measures and notes, fetched in the module's own thread so the
+  // part can be printed from a module_parallel() thread (which can't call
+  // module_nextmeas() or module_nextnote()) in exactly the same order
+  struct partobjs {
+    std::vector<module_measobj> meass;
+    std::vector<module_noteobj> notes;
+    std::size_t mi, ni;
+    partobjs() : mi(0), ni(0) {}
+    // takes the measures of `p' starting at `m' and its notes starting at `n',
+    // leaves `m' and `n' at the first ones after the part
+    void collect(const module_partobj p, module_measobj& m, module_noteobj& n) {
+      while (m && module_part(m) == p) {
+        meass.push_back(m);
+        m = module_nextmeas();
+      }
+      while (n && module_part(n) == p) {
+        notes.push_back(n);
+        module_skipassign(n);
+        n = module_nextnote();
+      }
+    }
+    void rewind() {
+      mi = ni = 0;
+    }
+    module_measobj firstmeas() const {
+      return meass.empty() ? 0 : meass[0];
+    }
+    module_noteobj firstnote() const {
+      return notes.empty() ? 0 : notes[0];
+    }
+    module_measobj nextmeas() {
+      return ++mi < meass.size() ? meass[mi] : 0;
+    }
+    module_noteobj nextnote() {
+      return ++ni < notes.size() ? notes[ni] : 0;
+    }
+  };
+
 } // namespace foutaux
 
 #endif
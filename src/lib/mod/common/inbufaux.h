@@ -0,0 +1,105 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_INBUFAUX_H
+#define FOMUSMOD_INBUFAUX_H
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define INBUFAUX_MMAP
+#endif
+
+// a whole input file (used by fmsin and fmbin), mapped read-only when the
+// system can do that
+namespace inbufaux {
+
+  struct inbuf {
+    const char *beg, *end;
+    std::vector<boost::uint64_t>
+        buf; // 8-byte aligned like a mapping, with a 0 after the end
+#ifdef INBUFAUX_MMAP
+    void* map;
+    size_t len;
+    inbuf() : beg(0), end(0), map(MAP_FAILED), len(0) {}
+    ~inbuf() {
+      if (map != MAP_FAILED)
+        munmap(map, len);
+    }
+#else
+    inbuf() : beg(0), end(0) {}
+#endif
+    bool mapfile(const char* fn);
+    void readfile(const std::string& fn);
+  };
+
+  inline bool inbuf::mapfile(const char* fn) {
+#ifdef INBUFAUX_MMAP
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      len = st.st_size;
+      map = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+      return false;
+#ifdef MADV_SEQUENTIAL
+    madvise(map, len, MADV_SEQUENTIAL);
+#endif
+    beg = (const char*) map;
+    end = beg + len;
+    return true;
+#else
+    return false;
+#endif
+  }
+  inline void inbuf::readfile(const std::string& fn) { // throws ifstream::failure
+    boost::filesystem::ifstream f;
+    f.exceptions(boost::filesystem::ifstream::eofbit |
+                 boost::filesystem::ifstream::failbit |
+                 boost::filesystem::ifstream::badbit);
+    f.open(fn, boost::filesystem::ifstream::in |
+                   boost::filesystem::ifstream::ate |
+                   boost::filesystem::ifstream::binary);
+    long l = f.tellg();
+    f.seekg(0);
+    buf.resize(l / 8 + 1);
+    char* b = (char*) &buf[0];
+    f.read(b, l);
+    b[l] = 0;
+    f.close();
+    beg = b;
+    end = b + l;
+  }
+
+} // namespace inbufaux
+
+#endif
@@ -0,0 +1,95 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_KEYAUX_H
+#define FOMUSMOD_KEYAUX_H
+
+#include <cstring>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include "module.h"
+
+// Cache keys built by appending values to a string (bytes are written as hex
+// digits so a key is also a valid C string)--two keys are equal only if every
+// value that went into them is
+namespace keyaux {
+
+  template <typename T>
+  inline void putraw(std::string& k, const T& x) {
+    static const char hex[] = "0123456789abcdef";
+    for (const unsigned char *i = (const unsigned char*) &x,
+                             *ie = (const unsigned char*) &x + sizeof(x);
+         i < ie; ++i) {
+      k += hex[*i >> 4];
+      k += hex[*i & 0xf];
+    }
+  }
+  inline void putint(std::string& k, const fomus_int x) {
+    putraw(k, x);
+  }
+  inline void putrat(std::string& k, const fomus_rat& x) {
+    putraw(k, x.num);
+    putraw(k, x.den);
+  }
+  inline void putstr(std::string& k, const char* s) {
+    std::size_t n = std::strlen(s);
+    putraw(k, n);
+    k.append(s, n);
+  }
+  inline void putval(std::string& k, const module_value& x) {
+    k += (char) ('a' + x.type);
+    switch (x.type) {
+    case module_int:
+      putraw(k, x.val.i);
+      break;
+    case module_rat:
+      putrat(k, x.val.r);
+      break;
+    case module_float:
+      putraw(k, x.val.f);
+      break;
+    case module_string:
+      putstr(k, x.val.s);
+      break;
+    case module_list:
+      putraw(k, x.val.l.n);
+      for (const module_value *i = x.val.l.vals, *ie = x.val.l.vals + x.val.l.n;
+           i < ie; ++i)
+        putval(k, *i);
+      break;
+    default:;
+    }
+  }
+
+  // FNV-1a, for naming and checking cache files
+  inline boost::uint64_t hash(const char* s, const std::size_t n) {
+    boost::uint64_t h = 14695981039346656037ULL;
+    for (const char *i = s, *ie = s + n; i < ie; ++i) {
+      h ^= (unsigned char) *i;
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+} // namespace keyaux
+
+#endif
@@ -0,0 +1,145 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_SINKAUX_H
+#define FOMUSMOD_SINKAUX_H
+
+#include <cstddef>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/utility.hpp>
+
+#include "module.h"
+
+// Output files for modout_write().  A file goes to the caller's sink if the
+// score is run with fomus_run_sinks() and to the file system otherwise.
+namespace sinkaux {
+
+  // hands everything written to module_sinkwrite() in large chunks
+  class sinkbuf : public std::streambuf, boost::noncopyable {
+    std::string fn;
+    std::vector<char> buf;
+
+public:
+    void open(const std::string& fn0) {
+      fn = fn0;
+      buf.resize(65536);
+      setp(&buf[0], &buf[0] + buf.size());
+    }
+    bool close() {
+      bool r = flushbuf();
+      setp(0, 0);
+      return r;
+    }
+
+protected:
+    int_type overflow(int_type c) {
+      if (!flushbuf())
+        return traits_type::eof();
+      if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+      }
+      return traits_type::not_eof(c);
+    }
+    int sync() {
+      return flushbuf() ? 0 : -1;
+    }
+
+private:
+    bool flushbuf() {
+      if (!pbase())
+        return false;
+      std::ptrdiff_t n = pptr() - pbase();
+      if (n > 0 && module_sinkwrite(fn.c_str(), pbase(), n))
+        return false;
+      setp(pbase(), epptr());
+      return true;
+    }
+  };
+
+  // constructed before the stream that uses them
+  struct outfilebufs {
+    boost::filesystem::filebuf file;
+    sinkbuf sink;
+    std::stringbuf mem; // whole file, for writers that seek
+  };
+
+  // used like a boost::filesystem::ofstream (set exceptions() before open())
+  class outfile : private outfilebufs, public std::ostream {
+    enum { to_file, to_sink, to_mem } to;
+    std::string fn;
+
+public:
+    outfile() : std::ostream(&file), to(to_file) {}
+    // `seekable' if the writer uses seekp()
+    void open(const std::string& filename,
+              const std::ios_base::openmode mode = std::ios_base::out,
+              const bool seekable = false) {
+      fn = filename;
+      if (module_hassink(filename.c_str())) {
+        if (seekable) {
+          to = to_mem;
+          rdbuf(&mem);
+        } else {
+          to = to_sink;
+          sink.open(filename);
+          rdbuf(&sink);
+        }
+      } else {
+        to = to_file;
+        rdbuf(&file);
+        if (!file.open(boost::filesystem::path(filename),
+                       mode | std::ios_base::out | std::ios_base::trunc))
+          setstate(std::ios_base::failbit);
+      }
+    }
+    void close() {
+      bool ok;
+      switch (to) {
+      case to_file:
+        ok = file.close() != 0;
+        break;
+      case to_sink:
+        ok = sink.close();
+        break;
+      default: {
+        const std::string s(mem.str());
+        mem.str(std::string());
+        ok = !module_sinkwrite(fn.c_str(), s.data(), s.size());
+      }
+      }
+      if (!ok)
+        setstate(std::ios_base::failbit);
+    }
+    // true if nothing is written to the file system
+    bool issink() const {
+      return to != to_file;
+    }
+  };
+
+} // namespace sinkaux
+
+#endif
@@ -0,0 +1,72 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_TICKAUX_H
+#define FOMUSMOD_TICKAUX_H
+
+#include <boost/integer/common_factor.hpp>
+
+#include "module.h"
+
+// Quantized times as integer ticks--a grid is the lcm of the denominators of
+// a set of times, so each of them is a whole number of 1/grid beats and
+// differences and comparisons between them are integer operations (no gcd,
+// no library call).  A value that isn't on the grid (e.g., the end of a tuplet
+// division that no note falls on) has to be handled as a rational.
+namespace tickaux {
+
+  const fomus_int maxgrid = 1048576; // keeps the products below in 63 bits
+
+  // lcm of `grid' and the denominator of `x', 0 if there's no grid (`grid' is
+  // 0 or the lcm would be bigger than maxgrid)
+  inline fomus_int addgrid(const fomus_int grid, const fomus_rat& x) {
+    if (grid <= 0 || x.den <= 0)
+      return 0;
+    const fomus_int g = boost::integer::lcm(grid, x.den);
+    return g > maxgrid ? 0 : g;
+  }
+
+  // `x' in ticks, false if it isn't on the grid
+  inline bool toticks(const fomus_rat& x, const fomus_int grid, fomus_int& t) {
+    if (grid <= 0 || x.den <= 0 || grid % x.den != 0 || !module_ratsmall(x.num))
+      return false;
+    t = x.num * (grid / x.den);
+    return true;
+  }
+
+  // back to a (reduced) rational
+  inline fomus_rat torat(const fomus_int t, const fomus_int grid) {
+    const fomus_int g = boost::integer::gcd(t, grid);
+    fomus_rat r = {t / g, grid / g};
+    return r;
+  }
+
+  // the sign of t / grid - x in `s', false if it might overflow
+  inline bool cmp(const fomus_int t, const fomus_int grid, const fomus_rat& x,
+                  fomus_int& s) {
+    if (!module_ratsmall(x, t))
+      return false;
+    s = t * x.den - x.num * grid;
+    return true;
+  }
+
+} // namespace tickaux
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <set>
 
@@ -44,22 +45,59 @@ namespace cartdist {
   }
 
   typedef std::set<etnode> prevmap;
+  struct notevals { // everything dist() needs from a note
+    fomus_rat ti, teti, no;
+    fomus_float beatdist, octdist;
+  };
+  // dist() is called for every pair of notes in range, so keep the values of
+  // recent notes (times and pitches don't change in the passes that use this)--
+  // direct-mapped so it stays the same size however long the part is
+#define NOTEVALS_SIZE 256 // must be a power of 2
+  struct notevalsent {
+    module_noteobj note;
+    notevals v;
+  };
   struct distdata {
     int octdistid, beatdistid; // these belong here, shouldn't be global
     const bool byendtime;      // does note1's point = endtime instead of time?
     const fomus_float rng;
     prevmap prevs;
+    notevalsent vals[NOTEVALS_SIZE];
     distdata(const dist_iface& iface)
         : octdistid(iface.data.octdist_setid),
           beatdistid(iface.data.beatdist_setid),
-          byendtime(iface.data.byendtime), rng(iface.data.rangemax) {}
+          byendtime(iface.data.byendtime), rng(iface.data.rangemax) {
+      for (int i = 0; i < NOTEVALS_SIZE; ++i)
+        vals[i].note = 0;
+    }
+    const notevals& getvals(const module_noteobj note) {
+      notevalsent& e =
+          vals[((std::size_t) note / sizeof(void*)) & (NOTEVALS_SIZE - 1)];
+      if (e.note == note)
+        return e.v;
+      e.note = note;
+      notevals& v = e.v;
+      int ids[2] = {beatdistid, octdistid};
+      fomus_float sets[2];
+      module_notesnap sn;
+      memset(&sn, 0, sizeof(sn));
+      sn.cap = 1;
+      sn.rtime = &v.ti;
+      sn.rtiedendtime = &v.teti;
+      sn.rpitch = &v.no;
+      sn.nsets = 2;
+      sn.setids = ids;
+      sn.setvals = sets;
+      module_snapshot(note, &sn);
+      v.beatdist = sets[0];
+      v.octdist = sets[1];
+      return v;
+    }
     fomus_float dist(const module_noteobj note1, const module_noteobj note2) {
-      fomus_float x =
-          (module_time(note2) -
-           (byendtime ? module_tiedendtime(note1) : module_time(note1))) *
-          module_setting_fval(note2, beatdistid);
-      fomus_float y = diff(module_pitch(note2), module_pitch(note1)) *
-                      module_setting_fval(note2, octdistid) * ((double) 1 / 12);
+      const notevals v1(getvals(note1)); // a copy, note2 can take its slot
+      const notevals& v2 = getvals(note2);
+      fomus_float x = (v2.ti - (byendtime ? v1.teti : v1.ti)) * v2.beatdist;
+      fomus_float y = diff(v2.no, v1.no) * v2.octdist * ((double) 1 / 12);
       return sqrt(x * x + y * y);
     }
     bool isoutofmaxrange(
@@ -67,23 +105,22 @@ namespace cartdist {
         const module_noteobj
             note2) { // return true if possible to add notes to beginning or end
                      // and be inside the max range (rng)
+      const notevals v1(getvals(note1)); // a copy, note2 can take its slot
+      const notevals& v2 = getvals(note2);
       fomus_rat et;
       if (byendtime) {
-        et = module_tiedendtime(note1);
-        for (prevmap::const_iterator i(
-                 prevs.upper_bound(etnode(module_tiedendtime(note1), 0)));
+        et = v1.teti;
+        for (prevmap::const_iterator i(prevs.upper_bound(etnode(v1.teti, 0)));
              i != prevs.end(); ++i) {
           if (module_less(i->note, note1)) {
             et = i->et;
             break;
           }
         }
-        prevs.insert(prevmap::value_type(module_tiedendtime(note1), note1));
+        prevs.insert(prevmap::value_type(v1.teti, note1));
       } else
-        et = module_time(note1);
-      return (module_time(note2) - et) *
-                 module_setting_fval(note2, beatdistid) >
-             rng;
+        et = v1.ti;
+      return (v2.ti - et) * v2.beatdist > rng;
     }
   };
 
@@ -22,6 +22,7 @@
 
 #include <cstring>
 #include <limits>
+#include <map>
 #include <set>
 #include <vector>
 //#include <cstring> // strcmp
@@ -33,6 +34,8 @@
 #include <stack>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <boost/ptr_container/ptr_list.hpp>
@@ -40,6 +43,8 @@
 #include <boost/ptr_container/ptr_set.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 
 #include "ifacedist.h"
@@ -49,8 +54,11 @@
 #include "module.h"
 #include "modutil.h"
 
+#include "cacheaux.h"
 #include "debugaux.h"
 #include "ilessaux.h"
+#include "keyaux.h"
+#include "tickaux.h"
 using namespace ilessaux;
 
 namespace split {
@@ -257,9 +265,12 @@ namespace split {
     comdivsset coms;
     noteobjvectmap nobjs; // put this in a pool!
     std::string divgrp;
+    std::string key; // this part's input, see makekey()
+    std::vector<module_noteobj> keynotes; // notes in key order
     // std::vector<divrules_range> exclvect;
     meascache(const divrules_data& rlifacedata, const module_measobj m);
     module_noteobj sticknotes(module_noteobj n, splitdata& sd);
+    void makekey();
     ~meascache() {
       if (rliface.moddata)
         rliface.free_moddata(rliface.moddata);
@@ -282,7 +293,167 @@ namespace split {
       forcetupratid, rightsizetupletscoreid, bigtupletnumscoreid,
       tupletrestscoreid, samedurtupletscoreid, avedurscoreid,
       smalltupletscoreid, simptupletscoreid, beatdivid, prefmeasdivscoreid,
-      weirdtupdurscoreid; // ids for settings
+      weirdtupdurscoreid, cachesizeid, cachedirid; // ids for settings
+
+  // ------------------------------------------------------------------------------------------------------------------------
+  // SOLUTION CACHE
+  // ------------------------------------------------------------------------------------------------------------------------
+  // what assignnotes() assigned to one divgroup of a search, notes are numbered
+  // in the order makekey() put them in the key and times are relative to the
+  // measure
+  struct cachedsplit {
+    int note;
+    fomus_rat o1;
+    std::vector<divide_tuplet> tups;
+  };
+  struct cachedsol {
+    std::vector<fomus_rat> initdivs;
+    std::vector<cachedsplit> splits;
+  };
+  typedef std::map<std::string, boost::shared_ptr<const cachedsol>> solcachemap;
+  typedef std::vector<std::pair<std::string, boost::shared_ptr<const cachedsol>>>
+      solvect;
+  // shared by all instances and threads--the keys hold every setting the
+  // search depends on
+  boost::mutex solcachemut;
+  solcachemap solcache;
+  std::set<std::string> loadedpaths; // cache files already in solcache
+
+  // With `div-cache-dir' set, solutions are also kept in files that later
+  // runs read back (see cacheaux.h).  There's one file for each set of rules
+  // (the divrules key of a search's first measure, which includes the measure
+  // duration), named after a hash of its fingerprint (FOMUS version and rules
+  // key), and each record is a search key and its solution.
+  cacheaux::files solfiles;
+
+  std::string solrecord(const std::string& key, const cachedsol& sol) {
+    std::string r;
+    cacheaux::putbin(r, (boost::uint32_t) key.size());
+    r += key;
+    cacheaux::putbin(r, (boost::uint32_t) sol.initdivs.size());
+    for (std::vector<fomus_rat>::const_iterator i(sol.initdivs.begin());
+         i != sol.initdivs.end(); ++i)
+      cacheaux::putbinrat(r, *i);
+    cacheaux::putbin(r, (boost::uint32_t) sol.splits.size());
+    for (std::vector<cachedsplit>::const_iterator i(sol.splits.begin());
+         i != sol.splits.end(); ++i) {
+      cacheaux::putbin(r, (boost::int32_t) i->note);
+      cacheaux::putbinrat(r, i->o1);
+      cacheaux::putbin(r, (boost::uint32_t) i->tups.size());
+      for (std::vector<divide_tuplet>::const_iterator t(i->tups.begin());
+           t != i->tups.end(); ++t) {
+        cacheaux::putbinrat(r, t->tuplet);
+        cacheaux::putbin(r, (boost::int32_t) t->begin);
+        cacheaux::putbin(r, (boost::int32_t) t->end);
+        cacheaux::putbinrat(r, t->fulldur);
+      }
+    }
+    return r;
+  }
+  bool readrecord(cacheaux::binreader& rd, std::string& key, cachedsol& sol) {
+    boost::uint32_t n;
+    if (!rd.get(n) || !rd.getstr(key, n) || !rd.get(n))
+      return false;
+    sol.initdivs.resize(n);
+    for (std::vector<fomus_rat>::iterator i(sol.initdivs.begin());
+         i != sol.initdivs.end(); ++i)
+      if (!rd.getrat(*i))
+        return false;
+    if (!rd.get(n))
+      return false;
+    sol.splits.resize(n);
+    for (std::vector<cachedsplit>::iterator i(sol.splits.begin());
+         i != sol.splits.end(); ++i) {
+      boost::int32_t x;
+      if (!rd.get(x) || x < 0 || !rd.getrat(i->o1) || !rd.get(n))
+        return false;
+      i->note = x;
+      i->tups.resize(n);
+      for (std::vector<divide_tuplet>::iterator t(i->tups.begin());
+           t != i->tups.end(); ++t) {
+        boost::int32_t b, e;
+        if (!rd.getrat(t->tuplet) || !rd.get(b) || !rd.get(e) ||
+            !rd.getrat(t->fulldur))
+          return false;
+        t->begin = b;
+        t->end = e;
+      }
+    }
+    return rd.p == rd.e;
+  }
+  // the records of `recs' that can be read
+  inline void readsols(const std::vector<std::string>& recs, solvect& sols) {
+    for (std::vector<std::string>::const_iterator i(recs.begin());
+         i != recs.end(); ++i) {
+      cacheaux::binreader rd(i->data(), i->data() + i->size());
+      std::string key;
+      boost::shared_ptr<cachedsol> sol(new cachedsol);
+      if (readrecord(rd, key, *sol))
+        sols.push_back(solvect::value_type(key, sol));
+    }
+  }
+
+  // called with solcachemut locked
+  inline void insertsols(const solvect& sols, const fomus_int max) {
+    for (solvect::const_iterator i(sols.begin());
+         i != sols.end() && (fomus_int) solcache.size() < max; ++i)
+      solcache.insert(solcachemap::value_type(i->first, i->second));
+  }
+  // `path' is empty if there's no cache file
+  inline boost::shared_ptr<const cachedsol> findsol(const std::string& key,
+                                                    const std::string& path,
+                                                    const std::string& fp,
+                                                    const fomus_int max) {
+    if (!path.empty()) {
+      bool ld;
+      {
+        boost::lock_guard<boost::mutex> xxx(solcachemut);
+        ld = loadedpaths.find(path) != loadedpaths.end();
+      }
+      if (!ld) {
+        std::vector<std::string> recs;
+        solfiles.load(path, fp, recs);
+        solvect sols;
+        readsols(recs, sols);
+        boost::lock_guard<boost::mutex> xxx(solcachemut);
+        insertsols(sols, max);
+        loadedpaths.insert(path);
+      }
+    }
+    boost::lock_guard<boost::mutex> xxx(solcachemut);
+    solcachemap::const_iterator i(solcache.find(key));
+    return i == solcache.end() ? boost::shared_ptr<const cachedsol>()
+                               : i->second;
+  }
+  inline void addsol(const std::string& key,
+                     const boost::shared_ptr<const cachedsol>& sol,
+                     const fomus_int max, const std::string& path,
+                     const std::string& fp) {
+    {
+      boost::lock_guard<boost::mutex> xxx(solcachemut);
+      if ((fomus_int) solcache.size() >= max)
+        solcache.clear(); // start over rather than keep track of what's used
+      solcache.insert(solcachemap::value_type(key, sol));
+    }
+    if (!path.empty()) {
+      std::vector<std::string> recs(1, solrecord(key, *sol)), others;
+      solfiles.save(path, fp, recs, max, others);
+      solvect sols;
+      readsols(others, sols);
+      boost::lock_guard<boost::mutex> xxx(solcachemut);
+      insertsols(sols, max);
+    }
+  }
+
+  // the divgroups of a search are divided independently, so each one has its
+  // own entry, keyed on the input of its parts
+  struct cachegrp {
+    std::string key; // empty if it isn't cached
+    std::vector<module_noteobj> notes; // notes in key order
+    boost::shared_ptr<const cachedsol> sol; // set if it was found
+    mutable boost::shared_ptr<cachedsol> nsol; // what the search assigned
+  };
+  typedef std::map<std::string, cachegrp> cachegrpmap; // by divgroup
 
   // SPLITDATA module data object
   struct splitdata _NONCOPYABLE {
@@ -294,6 +465,11 @@ namespace split {
     boost::ptr_map<std::string,
                    boost::ptr_vector<meascache, boost::view_clone_allocator>>
         vects;
+    fomus_int cachesize;
+    std::string cachepath, fingerprint; // cache file, if there is one
+    cachegrpmap grps;                   // empty if nothing is cached
+    // a searched note's group and number in the group's key
+    std::map<module_noteobj, std::pair<const cachegrp*, int>> keyidxs;
     splitdata() {
       rlifacedata.dotnotelvl_setid = dotnotelevelid;
       rlifacedata.dbldotnotelvl_setid = doubledotnotelevelid;
@@ -304,12 +480,21 @@ namespace split {
 #endif
     }
     divsearch_node getroot();
+    void makekey();
+    // the search gives every measure the initial divisions of the first
+    // divgroup, which might have come from the cache
+    const initdivsvect& rootdivs(const initdivsvect& searched) const {
+      return (!grps.empty() && grps.begin()->second.sol.get())
+                 ? grps.begin()->second.sol->initdivs
+                 : searched;
+    }
   };
 
   meascache::meascache(const divrules_data& rlifacedata, const module_measobj m)
       : m(m), divgrp(module_setting_sval(m, setsimid)) {
     rliface.data = rlifacedata;
     rliface.data.meas = m;
+    rliface.get_key = 0;
     const char* rlmod = module_setting_sval(m, divrulesmodid);
     assert(rlmod);
     module_get_auxiface(rlmod, DIVRULES_INTERFACEID, &rliface);
@@ -525,6 +710,8 @@ namespace split {
   struct noteobj {
     const fomus_rat o1,
         o2; // begin and end offsets, subdivision of note in `no'
+    fomus_int grid, k1, k2; // o1 and o2 in ticks of the measure's grid (see
+                            // tickaux.h), grid is 0 if they aren't on one
     const divrules_iface& rliface;
     module_noteobj no;
     boost::shared_ptr<scoped_div> rule;
@@ -532,10 +719,11 @@ namespace split {
         notups; // user specifies tuplet begin or end
     noteobj(const divrules_iface& rliface, boost::shared_ptr<scoped_div>& rule,
             const fomus_rat& o1, const fomus_rat& o2, const module_noteobj no)
-        : o1(o1), o2(o2), rliface(rliface), no(no), rule(rule) {}
+        : o1(o1), o2(o2), grid(0), rliface(rliface), no(no), rule(rule) {}
     noteobj(const noteobj& x, boost::shared_ptr<scoped_div>& rule,
             const fomus_rat& o1, const fomus_rat& o2)
         : o1(o1), o2(o2), rliface(x.rliface), no(x.no), rule(rule) {
+      setticks(x.grid);
       if (!x.tupbegs.empty()) {
         tupbegs.insert(x.tupbegs.begin(), x.tupbegs.end());
       } else {
@@ -545,6 +733,7 @@ namespace split {
     noteobj(const noteobj& x, boost::shared_ptr<scoped_div>& rule,
             const fomus_rat& o1, const fomus_rat& o2, const int)
         : o1(o1), o2(o2), rliface(x.rliface), no(x.no), rule(rule) {
+      setticks(x.grid);
       if (!x.tupends.empty()) {
         tupends.insert(x.tupends.begin(), x.tupends.end());
       } else {
@@ -552,6 +741,21 @@ namespace split {
       }
     }
     virtual ~noteobj() {}
+    void setticks(const fomus_int g) {
+      grid = tickaux::toticks(o1, g, k1) && tickaux::toticks(o2, g, k2) ? g : 0;
+    }
+    // o2 - o1
+    fomus_rat getdur() const {
+      return grid ? tickaux::torat(k2 - k1, grid) : o2 - o1;
+    }
+    // the sign of o2 - o1 - x
+    fomus_int durcmp(const fomus_rat& x) const {
+      fomus_int s;
+      if (grid && tickaux::cmp(k2 - k1, grid, x, s))
+        return s;
+      const fomus_rat d(o2 - o1);
+      return d < x ? -1 : (d > x ? 1 : 0);
+    }
     bool iscomp() const {
       return rliface.iscompound(rliface.moddata);
     }
@@ -602,8 +806,8 @@ namespace split {
     bool maxo2(fomus_rat& off) const {
       if (o2 > off)
         off = o2;
-      return (o2 - o1 <=
-              module_makerat(1, module_setting_ival(no, beatdivid) * 2));
+      return durcmp(module_makerat(1, module_setting_ival(no, beatdivid) * 2)) <=
+             0;
     }
     void dotups(const usertup& ut) {
       assert(ut.lvl >= 0);
@@ -696,11 +900,12 @@ namespace split {
             << rliface.dur(rliface.moddata, rule->get()) << ','
             << rliface.tieleftallowed(rliface.moddata, rule->get()) << ','
             << rliface.tierightallowed(rliface.moddata, rule->get()) << ") ");
-    fomus_rat d1(o2 - o1);
-    if (d1 != rliface.dur(rliface.moddata, rule->get()) // <-- note matches rule
+    if (durcmp(rliface.dur(rliface.moddata, rule->get())) !=
+            0 // <-- note matches rule
         || (tl && !rliface.tieleftallowed(rliface.moddata, rule->get())) ||
         (tr && !rliface.tierightallowed(rliface.moddata, rule->get())))
       return false;
+    fomus_rat d1(getdur());
     fomus_rat d(d1 * rliface.durmult(rliface.moddata, rule->get()));
     DBG("effectivedur = " << d << " ");
     if (rliface.iscompound(rliface.moddata)) {
@@ -728,7 +933,7 @@ namespace split {
       sc += tiescore; // extra score for a tie
     if (tl)
       sc += tiescore;
-    fomus_rat d1(o2 - o1);
+    fomus_rat d1(getdur());
     fomus_rat d(rule.get() ? d1 * rliface.durmult(rliface.moddata, rule->get())
                            : d1);
     if (rliface.iscompound(rliface.moddata) && d1 < (fomus_int) 1 &&
@@ -790,7 +995,7 @@ namespace split {
       tscntset* tc = &tscnt2;
       fomus_float tpn(module_setting_fval(no, samedurtupletscoreid));
       fomus_float dtpn(module_setting_fval(no, weirdtupdurscoreid));
-      fomus_rat avd(o2 - o1);
+      fomus_rat avd(getdur());
       // if (!isexpof2((rliface.iscompound(rliface.moddata) ? (avd *
       // (fomus_int)3) : avd).den)) needtup = true;
       fomus_rat rdc = {1, 1};
@@ -917,9 +1122,9 @@ namespace split {
     DBG('(' << o1 << ',' << o2 - o1 << ")ru("
             << rliface.time(rliface.moddata, rule->get()) << ','
             << rliface.dur(rliface.moddata, rule->get()) << ") ");
-    fomus_rat d1(o2 - o1);
-    if (d1 != rliface.dur(rliface.moddata, rule->get()))
+    if (durcmp(rliface.dur(rliface.moddata, rule->get())) != 0)
       return false;
+    fomus_rat d1(getdur());
     fomus_rat d(d1 * rliface.durmult(rliface.moddata, rule->get()));
     DBG("effectivedur = " << d << " ");
     if (rliface.iscompound(rliface.moddata) && d1 < (fomus_int) 1 &&
@@ -1004,7 +1209,15 @@ namespace split {
       }
       l->clearfrom();
     }
+    fomus_int grid = 1; // tick grid of the measure's notes
+    for (noteobjvectmap_constit nol(nobjs.begin());
+         grid && nol != nobjs.end(); ++nol)
+      for (noteobjlist_constit i(nol->second->begin());
+           grid && i != nol->second->end(); ++i)
+        grid = tickaux::addgrid(tickaux::addgrid(grid, i->o1), i->o2);
     for (noteobjvectmap_it nol(nobjs.begin()); nol != nobjs.end(); ++nol) {
+      for (noteobjlist_it i(nol->second->begin()); i != nol->second->end(); ++i)
+        i->setticks(grid);
       nol->second->donotes();
       std::stack<rangest> st;
       std::set<userpt>& pts(nol->second->pts);
@@ -1118,7 +1331,9 @@ namespace split {
     }
 #endif
     divsearch_score getscore(const splitdata& data);
-    void assignnotes(const splitdata& da) const;
+    virtual void assignnotes(const splitdata& da) const {
+      assert(false);
+    }
     virtual void initdivscore(fomus_float& sc) const {}
   };
 
@@ -1463,9 +1678,14 @@ namespace split {
   }
 
   struct divroot0 : public divbase NONCOPYABLE {
+    std::vector<const initdivsvect*> grpdivs; // of each divgroup searched
     divroot0(struct divsearch_andnode& andnode, const initdivsvect* initdivs,
              const fomus_rat& measdur)
-        : divbase(andnode, -3, initdivs, measdur) {}
+        : divbase(andnode, -3, initdivs, measdur) {
+      for (divsearch_node *a = andnode.nodes, *ae = andnode.nodes + andnode.n;
+           a < ae; ++a)
+        grpdivs.push_back(((divbase*) *a)->initdivs);
+    }
     divroot0() : divbase(-3, 0, module_makerat(0, 1)) {}
     void expand(splitdata& data, const divsearch_ornode_ptr ornode) const;
     bool isleaf(const splitdata& data) {
@@ -1476,6 +1696,7 @@ namespace split {
       return -2;
     }
 #endif
+    void assignnotes(const splitdata& da) const;
   };
 
   inline void divroot0::expand(splitdata& data,
@@ -1492,6 +1713,133 @@ namespace split {
     }
   }
 
+  // a search whose divgroups were all done before--the root is the solution
+  struct divcached : public divbase NONCOPYABLE {
+    divcached() : divbase(-3, 0, module_makerat(0, 1)) {}
+    void expand(splitdata& data, const divsearch_ornode_ptr ornode) const {
+      assert(false);
+    }
+    bool isleaf(const splitdata& data) {
+      return true;
+    }
+#ifndef NDEBUG
+    virtual int whichone() const {
+      return -3;
+    }
+#endif
+    void assignnotes(const splitdata& da) const;
+  };
+
+  // a part's key holds everything the search looks at in its measure: the
+  // rules, initial divisions and settings and the notes with their ties,
+  // tuplet marks and settings (times are relative to the measure)--it's built
+  // once, and a divgroup's key is made of the keys of its parts
+  inline void putints(std::string& key, const std::set<int>& s) {
+    keyaux::putint(key, s.size());
+    for (std::set<int>::const_iterator i(s.begin()); i != s.end(); ++i)
+      keyaux::putint(key, *i);
+  }
+  void meascache::makekey() {
+    assert(key.empty() && rliface.get_key);
+    const int noteids[] = {
+        ddallowedid,          dddallowedid,           tiescoreid,
+        basescoreid,          dotscoreid,             dotdotscoreid,
+        dotdotdotscoreid,     beatdivid,              rightsizetupletscoreid,
+        simptupletscoreid,    tupletbasescoreid,      forcetupratid,
+        forcetupsizeid,       bigtupletnumscoreid,    samedurtupletscoreid,
+        weirdtupdurscoreid,   smalltupletscoreid,     avedurscoreid,
+        tupletrestscoreid,    prefmeasdivscoreid};
+    keyaux::putstr(key, module_setting_sval(m, divrulesmodid));
+    keyaux::putstr(key, module_setting_sval(m, enginemodid));
+    keyaux::putstr(key, rliface.get_key(rliface.moddata));
+    keyaux::putval(key, module_setting_val(m, grouptogid));
+    keyaux::putint(key, coms.size());
+    for (comdivsset_constit c(coms.begin()); c != coms.end(); ++c) {
+      keyaux::putint(key, c->size());
+      for (initdivsvect_constit d(c->begin()); d != c->end(); ++d)
+        keyaux::putrat(key, *d);
+    }
+    fomus_rat t(module_time(m));
+    std::string nk, lnk; // settings of this and the last note
+    keyaux::putint(key, nobjs.size());
+    for (noteobjvectmap_constit v(nobjs.begin()); v != nobjs.end(); ++v) {
+      keyaux::putint(key, v->first);
+      keyaux::putint(key, v->second->excl.size());
+      for (std::vector<divrules_range>::const_iterator r(
+               v->second->excl.begin());
+           r != v->second->excl.end(); ++r) {
+        keyaux::putrat(key, r->time1 - t);
+        keyaux::putrat(key, r->time2 - t);
+        keyaux::putint(key, r->lvl);
+      }
+      keyaux::putint(key, v->second->size());
+      for (noteobjlist_constit n(v->second->begin()); n != v->second->end();
+           ++n) {
+        keynotes.push_back(n->no);
+        key += (module_isnote(n->no) ? 'n' : 'r');
+        key += (module_istiedleft(n->no) ? 'l' : '-');
+        key += (module_istiedright(n->no) ? 'r' : '-');
+        keyaux::putrat(key, n->o1 - t);
+        keyaux::putrat(key, n->o2 - t);
+        putints(key, n->tupbegs);
+        putints(key, n->tupends);
+        putints(key, n->notups);
+        nk.clear();
+        for (const int *s = noteids,
+                       *se = noteids + sizeof(noteids) / sizeof(int);
+             s < se; ++s)
+          keyaux::putval(nk, module_setting_val(n->no, *s));
+        if (nk == lnk) {
+          key += '='; // usually all the same
+        } else {
+          key += nk;
+          lnk.swap(nk);
+        }
+      }
+    }
+  }
+  void splitdata::makekey() {
+    assert(grps.empty());
+    cachesize = module_setting_ival(msrs.front().m, cachesizeid);
+    if (cachesize <= 0)
+      return;
+    std::set<std::string> nokey; // groups with a rules module that can't say
+                                 // what it depends on
+    for (boost::ptr_vector<meascache>::iterator i(msrs.begin());
+         i != msrs.end(); ++i) {
+      if (!i->rliface.get_key) {
+        nokey.insert(i->divgrp);
+        continue;
+      }
+      if (i == msrs.begin()) {
+        const char* dir = module_setting_sval(i->m, cachedirid);
+        if (dir[0]) {
+          fingerprint = VERSION;
+          fingerprint += ' ';
+          fingerprint += i->rliface.get_key(i->rliface.moddata);
+          std::string fn("div-");
+          keyaux::putraw(fn, keyaux::hash(fingerprint.data(),
+                                          fingerprint.size()));
+          cachepath = (boost::filesystem::path(dir) / (fn + ".cache")).string();
+        }
+      }
+      i->makekey();
+      cachegrp& g = grps[i->divgrp];
+      if (g.key.empty())
+        keyaux::putstr(g.key, i->divgrp.c_str());
+      g.key += i->key;
+      g.notes.insert(g.notes.end(), i->keynotes.begin(), i->keynotes.end());
+    }
+    for (std::set<std::string>::const_iterator i(nokey.begin());
+         i != nokey.end(); ++i)
+      grps[*i]; // in the map so rootdivs() knows which group is first
+    for (cachegrpmap::iterator i(grps.begin()); i != grps.end(); ++i)
+      if (nokey.find(i->first) != nokey.end()) {
+        i->second.key.clear();
+        i->second.notes.clear();
+      }
+  }
+
   divsearch_node splitdata::getroot() {
     if (!msrs.empty())
       return 0; // NOT called multiple times
@@ -1507,25 +1855,115 @@ namespace split {
     assert(!msrs.empty());
     assert(!lnoteobj);
     assert(vects.empty());
+    makekey();
+    bool all = !grps.empty();
+    for (cachegrpmap::iterator i(grps.begin()); i != grps.end(); ++i) {
+      cachegrp& g = i->second;
+      if (g.key.empty()) {
+        all = false;
+        continue;
+      }
+      g.sol = findsol(g.key, cachepath, fingerprint, cachesize);
+      module_countcache(1, g.sol.get() ? 1 : 0);
+      if (g.sol.get())
+        continue;
+      all = false;
+      for (std::vector<module_noteobj>::size_type j = 0; j < g.notes.size();
+           ++j)
+        keyidxs.insert(
+            std::map<module_noteobj, std::pair<const cachegrp*, int>>::
+                value_type(g.notes[j], std::pair<const cachegrp*, int>(
+                                           &g, (int) j)));
+    }
+    if (all)
+      return new divcached();
     for (boost::ptr_vector<meascache>::iterator i(msrs.begin());
-         i != msrs.end(); ++i)
-      vects[i->divgrp].push_back(&*i);
+         i != msrs.end(); ++i) {
+      cachegrpmap::const_iterator g(grps.find(i->divgrp));
+      if (g == grps.end() || !g->second.sol.get()) // cached ones aren't searched
+        vects[i->divgrp].push_back(&*i);
+    }
     return new divroot0();
   }
 
-  void divbase::assignnotes(const splitdata& da) const {
+  // measures without notes get one division, then the notes are passed on
+  void assignrest(const splitdata& da, std::set<module_measobj>& mss) {
+    for (boost::ptr_vector<meascache>::const_iterator i(da.msrs.begin());
+         i != da.msrs.end(); ++i) {
+      if (mss.insert(i->m).second) {
+        fomus_rat x = module_dur(i->m);
+        module_ratslist idvs = {1, &x};
+        divide_assign_initdivs(i->m, idvs);
+        DBG("ASSIGNING FULL-MEASURE REST DIV: " << x << std::endl);
+      }
+    }
+    module_noteobj n = 0, ln;
+    while (true) {
+      ln = n;
+      n = module_peeknextnote(n);
+      if (ln)
+        module_skipassign(ln);
+      if (!n)
+        break;
+      DBG("-------- " << module_time(n) << ' '
+                      << (module_isnote(n) ? module_pitch(n)
+                                           : module_makerat(0, 1))
+                      << std::endl);
+    }
+  }
+
+  // the divgroups that were found in the cache
+  void assigncached(const splitdata& da, const initdivsvect& idv,
+                    std::set<module_measobj>& mss) {
+    for (cachegrpmap::const_iterator g(da.grps.begin()); g != da.grps.end();
+         ++g) {
+      const cachedsol* sol = g->second.sol.get();
+      if (!sol)
+        continue;
+      DBG("ASSIGNING CACHED SOLUTION" << std::endl);
+      for (std::vector<cachedsplit>::const_iterator i(sol->splits.begin());
+           i != sol->splits.end(); ++i) {
+        assert(i->note < (int) g->second.notes.size());
+        module_noteobj no = g->second.notes[i->note];
+        module_measobj m = module_meas(no);
+        if (mss.insert(m).second) {
+          module_ratslist idvs = {idv.size(), &idv[0]};
+          divide_assign_initdivs(m, idvs);
+        }
+        std::vector<divide_tuplet> tu(i->tups);
+        divide_split sp = {no, i->o1 + module_time(m), tu.size(), &tu[0]};
+        divide_assign_split(m, sp);
+      }
+    }
+  }
+
+  void divroot0::assignnotes(const splitdata& da) const {
     assert(initdivs);
     assert(whichone() == -2);
+    assert(grpdivs.size() == da.vects.size());
+    std::vector<const initdivsvect*>::const_iterator gd(grpdivs.begin());
+    for (boost::ptr_map<std::string,
+                        boost::ptr_vector<meascache,
+                                          boost::view_clone_allocator>>::
+             const_iterator v(da.vects.begin());
+         v != da.vects.end(); ++v, ++gd) { // the searched groups
+      cachegrpmap::const_iterator g(da.grps.find(v->first));
+      if (g != da.grps.end() && !g->second.key.empty()) {
+        g->second.nsol.reset(new cachedsol);
+        g->second.nsol->initdivs = **gd;
+      }
+    }
+    const initdivsvect& idv(da.rootdivs(*initdivs));
     std::set<module_measobj> mss;
     for (noteobjlist::const_iterator i(notes.begin()); i != notes.end(); ++i) {
       module_measobj m = module_meas(i->no);
       if (mss.insert(m).second) {
-        module_ratslist idvs = {initdivs->size(), &(*initdivs)[0]};
+        module_ratslist idvs = {idv.size(), &idv[0]};
         divide_assign_initdivs(m, idvs);
         DBG("ASSIGNING INITDIVS: ");
 #ifndef NDEBUGOUT
-        for (std::vector<fomus_rat>::const_iterator i(initdivs->begin());
-             i != initdivs->end(); ++i) {
+        for (std::vector<fomus_rat>::const_iterator i(idv.begin());
+             i != idv.end(); ++i) {
           DBG(*i << ' ');
         }
 #endif
@@ -1545,35 +1983,27 @@ namespace split {
       DBG(std::endl);
       divide_split sp = {i->no, i->o1, tu.size(), &tu[0]};
       divide_assign_split(m, sp);
-    }
-    for (boost::ptr_vector<meascache>::const_iterator i(da.msrs.begin());
-         i != da.msrs.end(); ++i) {
-      if (mss.insert(i->m).second) {
-        fomus_rat x = module_dur(i->m);
-        module_ratslist idvs = {1, &x};
-        divide_assign_initdivs(i->m, idvs);
-        DBG("ASSIGNING FULL-MEASURE REST DIV: " << x << std::endl);
+      std::map<module_noteobj, std::pair<const cachegrp*, int>>::const_iterator
+          x(da.keyidxs.find(i->no));
+      if (x != da.keyidxs.end()) {
+        assert(x->second.first->nsol.get());
+        cachedsplit c = {x->second.second, i->o1 - module_time(m), tu};
+        x->second.first->nsol->splits.push_back(c);
       }
     }
-    module_noteobj n = 0, ln;
-#ifndef NDEBUG
-    int count = 0;
-#endif
-    while (true) {
-      ln = n;
-      n = module_peeknextnote(n);
-      if (ln)
-        module_skipassign(ln);
-      if (!n)
-        break;
-      DBG("-------- " << module_time(n) << ' '
-                      << (module_isnote(n) ? module_pitch(n)
-                                           : module_makerat(0, 1))
-                      << std::endl);
-#ifndef NDEBUG
-      ++count;
-#endif
-    }
+    assigncached(da, idv, mss);
+    assignrest(da, mss);
+    for (cachegrpmap::const_iterator g(da.grps.begin()); g != da.grps.end();
+         ++g)
+      if (g->second.nsol.get())
+        addsol(g->second.key, g->second.nsol, da.cachesize, da.cachepath,
+               da.fingerprint);
+  }
+
+  void divcached::assignnotes(const splitdata& da) const {
+    std::set<module_measobj> mss;
+    assigncached(da, da.grps.begin()->second.sol->initdivs, mss);
+    assignrest(da, mss);
   }
 
   inline divsearch_node assemble(const splitdata& data,
@@ -1679,6 +2109,11 @@ namespace split {
                             module_makeval((fomus_int) 0), module_nobound, 0,
                             scoretype);
   }
+  const char* cachesizetype = "integer>=0";
+  int valid_cachesize(const struct module_value val) {
+    return module_valid_int(val, 0, module_incl, 0, module_nobound, 0,
+                            cachesizetype);
+  }
   const char* preferredtuptype = "rational>=0 | (rational>=0 rational>=0 ...)";
   int valid_preferredtup(const struct module_value val) {
     return module_valid_listofrats(val, -1, -1, module_makerat(0, 1),
@@ -2330,6 +2765,53 @@ int module_get_setting(int n, module_setting* set, int id) {
     weirdtupdurscoreid = id;
     break;
   }
+  case 27: {
+    set->name = "div-cache-size"; // docscat{rhythmic}
+    set->type = module_int;
+    set->descdoc =
+        "The number of measure division solutions FOMUS remembers."
+        "  Measures (together with the measures of other parts in the same "
+        "`divgroup' at the same time) that have the same rhythms, tuplet marks "
+        "and settings as ones that were already divided are given the same "
+        "divisions without searching again."
+        "  The cache is cleared when it reaches this size, and a file in "
+        "`div-cache-dir' that reaches it keeps only its newest half."
+        "  Set this to 0 to turn the cache off.";
+    set->typedoc = cachesizetype;
+
+    module_setval_int(&set->val, 4096);
+
+    set->loc = module_locscore;
+    set->valid = valid_cachesize;
+    set->uselevel = 3; // probably doesn't concern user
+    cachesizeid = id;
+    break;
+  }
+  case 28: {
+    set->name = "div-cache-dir"; // docscat{rhythmic}
+    set->type = module_string;
+    set->descdoc =
+        "A directory where FOMUS keeps the measure division solutions it "
+        "remembers (see `div-cache-size') so that later runs can use them "
+        "too."
+        "  There is one file for each set of division rules (i.e., each "
+        "combination of measure duration and division settings), and files "
+        "made with different settings or a different version of FOMUS are "
+        "ignored and replaced."
+        "  Several FOMUS processes can use the same directory at once."
+        "  The directory is created if it doesn't exist."
+        "  An empty string means solutions are only remembered while FOMUS "
+        "is running.";
+    // set->typedoc = cachedirtype;
+
+    module_setval_string(&set->val, "");
+
+    set->loc = module_locscore;
+    // set->valid = valid_cachedir;
+    set->uselevel = 3; // probably doesn't concern user
+    cachedirid = id;
+    break;
+  }
   default:
     return 0;
   }
@@ -54,7 +54,7 @@ namespace grdiv {
     return 0;
   }
   inline int itertype() {
-    return module_bymeas | module_byvoice | module_graceonly;
+    return module_bymeas | module_byvoice | module_graceonly | module_partlocal;
   }
   void fill_iface(void* moddata, void* iface);
   inline const char* engine() {
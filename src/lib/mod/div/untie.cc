@@ -311,7 +311,8 @@ enum module_type module_type() {
    only want to process notes (ignoring rests and grace notes) that are in the
    same voice. */
 int module_itertype() {
-  return module_bymeas | module_byvoice | module_norests | module_nograce;
+  return module_bymeas | module_byvoice | module_norests | module_nograce |
+         module_partlocal;
 }
 /* the priority value forces this module to run either before or after other
    modules of the same type.  the default priority that most of FOMUS's modules
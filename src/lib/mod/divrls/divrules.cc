@@ -25,12 +25,15 @@
 #include <functional> // binary_function
 #include <limits>
 #include <map>
+#include <memory>
 #include <new>
 #include <set>
 #include <string>
 #include <vector>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/construct.hpp>
 #include <boost/lambda/lambda.hpp>
@@ -38,14 +41,18 @@
 #include <boost/ptr_container/ptr_set.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 
 #include "ifacedivrules.h"
 #include "module.h"
 #include "modutil.h"
 
+#include "cacheaux.h"
 #include "debugaux.h"
 #include "ilessaux.h"
+#include "keyaux.h"
 using namespace ilessaux;
 
 // TODO:
@@ -69,7 +76,8 @@ namespace divrules {
   }
 
   int nbeatsid, compid, maxtupsid, tuprattypeid, tupdivsid, deftupdivsid,
-      setdefinitdivsid, setinitdivsid, mintupdurid, maxtupdurid, largetupsizeid;
+      setdefinitdivsid, setinitdivsid, mintupdurid, maxtupdurid, largetupsizeid,
+      cachesizeid, cachedirid;
 
   // enums
   enum divpar { div_top, div_sig, div_small };
@@ -204,6 +212,23 @@ namespace divrules {
     virtual bool isnoteonly() const {
       return false;
     }
+    // appends the node to `s' with its time relative to `tim0' (see
+    // rulesdata::cachedexpand)
+    virtual void put(std::string& s, const fomus_rat& tim0) const = 0;
+    void putaux(std::string& s, const char code, const fomus_rat& tim0) const {
+      cacheaux::putbin(s, code);
+      cacheaux::putbinrat(s, tim - tim0);
+      cacheaux::putbinrat(s, dur);
+      cacheaux::putbin(s, (char) alt);
+      cacheaux::putbin(s, (char) art);
+      cacheaux::putbin(s, (boost::uint32_t) tuplet.size());
+      for (tupletvect_constit i(tuplet.begin()); i != tuplet.end(); ++i) {
+        cacheaux::putbinrat(s, i->t);
+        cacheaux::putbinrat(s, i->dur);
+        cacheaux::putbin(s, (char) i->beg);
+        cacheaux::putbin(s, (char) i->end);
+      }
+    }
     virtual ~basediv() {}
 #ifndef NDEBUGOUT
     virtual void print() const {
@@ -235,6 +260,20 @@ namespace divrules {
     }
     virtual bool isdivtop() const = 0;
     virtual bool isdivsig() const = 0;
+    void putaux(std::string& s, const char code, const fomus_rat& tim0) const {
+      basediv::putaux(s, code, tim0);
+      cacheaux::putbin(s, (char) (initdurs.get() != 0));
+      if (!initdurs.get())
+        return;
+      cacheaux::putbin(s, (boost::uint32_t) initdurs->size());
+      for (initdurset::const_iterator i(initdurs->begin());
+           i != initdurs->end(); ++i) {
+        cacheaux::putbin(s, (boost::uint32_t) i->size());
+        for (std::vector<fomus_rat>::const_iterator j(i->begin());
+             j != i->end(); ++j)
+          cacheaux::putbinrat(s, *j);
+      }
+    }
 #ifndef NDEBUGOUT
     void print() const {
       DBG("[sigortop]");
@@ -280,6 +319,9 @@ namespace divrules {
       return false;
     }
     divrules_ornode expand(rulesdata& rd, const divrules_rangelist& excl);
+    void put(std::string& s, const fomus_rat& tim0) const {
+      putaux(s, 't', tim0);
+    }
 #ifndef NDEBUGOUT
     void print() const {
       DBG("[top]");
@@ -310,6 +352,10 @@ namespace divrules {
       return true;
     }
     divrules_ornode expand(rulesdata& rd, const divrules_rangelist& excl);
+    void put(std::string& s, const fomus_rat& tim0) const {
+      putaux(s, 's', tim0);
+      cacheaux::putbin(s, (char) irr);
+    }
 #ifndef NDEBUGOUT
     void print() const {
       DBG("[sig]");
@@ -352,6 +398,10 @@ namespace divrules {
       return div_small;
     }
     divrules_ornode expand(rulesdata& rd, const divrules_rangelist& excl);
+    void put(std::string& s, const fomus_rat& tim0) const {
+      putaux(s, 'm', tim0);
+      cacheaux::putbin(s, (boost::int64_t) div);
+    }
 #ifndef NDEBUGOUT
     void print() const {
       DBG("[small]");
@@ -384,6 +434,11 @@ namespace divrules {
     bool tierightallowed() const {
       return istier;
     }
+    void put(std::string& s, const fomus_rat& tim0) const {
+      putaux(s, 'u', tim0);
+      cacheaux::putbin(s, (char) istiel);
+      cacheaux::putbin(s, (char) istier);
+    }
 #ifndef NDEBUGOUT
     void print() const {
       DBG("[undiv]");
@@ -400,6 +455,77 @@ namespace divrules {
     }
   };
 
+  // reads a node written by put() (0 if it's damaged)
+  basediv* getdiv(cacheaux::binreader& rd, const fomus_rat& tim0) {
+    char c, al, ar;
+    fomus_rat tim, dur;
+    boost::uint32_t n;
+    if (!rd.get(c) || !rd.getrat(tim) || !rd.getrat(dur) || !rd.get(al) ||
+        !rd.get(ar) || !rd.get(n))
+      return 0;
+    tupletvect tups;
+    for (; n > 0; --n) {
+      tupinfo t;
+      char b, e;
+      if (!rd.getrat(t.t) || !rd.getrat(t.dur) || !rd.get(b) || !rd.get(e))
+        return 0;
+      t.beg = b;
+      t.end = e;
+      tups.push_back(t);
+    }
+    tim = tim + tim0;
+    std::auto_ptr<basediv> r;
+    switch (c) {
+    case 't':
+    case 's': {
+      char h, irr;
+      boost::shared_ptr<initdurset> ids;
+      if (!rd.get(h))
+        return 0;
+      if (h) {
+        boost::uint32_t m;
+        if (!rd.get(m))
+          return 0;
+        ids.reset(new initdurset);
+        for (; m > 0; --m) {
+          boost::uint32_t k;
+          if (!rd.get(k))
+            return 0;
+          std::auto_ptr<std::vector<fomus_rat>> v(new std::vector<fomus_rat>);
+          for (; k > 0; --k) {
+            fomus_rat x;
+            if (!rd.getrat(x))
+              return 0;
+            v->push_back(x);
+          }
+          ids->insert(v.release());
+        }
+      }
+      if (c == 't')
+        r.reset(new divtop(ids, dur, tim, tupletvect(), tupinfo()));
+      else if (rd.get(irr))
+        r.reset(new divsig(al, ar, ids, dur, tim, irr, tupletvect(), tupinfo(),
+                           true, true));
+      break;
+    }
+    case 'm': {
+      boost::int64_t dv;
+      if (rd.get(dv))
+        r.reset(new divsmall(al, ar, dur, tim, dv, tupletvect(), tupinfo(),
+                             true, true));
+      break;
+    }
+    case 'u': {
+      char tl, tr;
+      if (rd.get(tl) && rd.get(tr))
+        r.reset(new divundiv(dur, tim, tupletvect(), tl, tr, true, true));
+    }
+    }
+    if (r.get())
+      r->tuplet.swap(tups);
+    return r.release();
+  }
+
   // functions for splitting at sig/top level
   inline bool atsigtop(const divsigortop& div, const divlvl lvl) {
     return (lvl & div_lvlsig) || (div.isdivtop() && (lvl & div_lvltop));
@@ -491,6 +617,31 @@ namespace divrules {
   typedef std::vector<fomus_int> initdivvect;
   typedef boost::ptr_set<initdivvect> initdivsset;
 
+  // Expanding a node doesn't depend on where it is, only on its duration,
+  // tuplets, etc. and on the settings, so expansions are shared by every
+  // rulesdata with the same key: expcaches[key][node] = its ornode, both
+  // written by put() with times relative to the node's.  With
+  // `divrules-cache-dir' set they're also kept in a file for each key (the
+  // records are the node followed by its ornode--see cacheaux.h).
+  typedef std::map<std::string, std::string> expmap;
+  boost::mutex expcachemut; // guards expcaches and expcachecount
+  std::map<std::string, expmap> expcaches;
+  fomus_int expcachecount = 0;
+  cacheaux::files expfiles;
+  // called with expcachemut locked
+  void insertexps(const std::string& key, const std::vector<std::string>& recs,
+                  const fomus_int max) {
+    expmap& m = expcaches[key];
+    for (std::vector<std::string>::const_iterator i(recs.begin());
+         i != recs.end() && expcachecount < max; ++i) {
+      cacheaux::binreader rd(i->data(), i->data() + i->size());
+      std::string k;
+      if (rd.getstr(k) &&
+          m.insert(expmap::value_type(k, std::string(rd.p, rd.e))).second)
+        ++expcachecount;
+    }
+  }
+
   class rulesdata {
     friend struct basediv;
     std::map<const fomus_rat, boost::shared_ptr<initdurset>>
@@ -513,6 +664,11 @@ namespace divrules {
     struct module_list
         initdivslist; // return value cache, rulesdata takes care of freeing it
     fomus_rat mininitlookup, maxinitlookup;
+    std::string key; // every setting value the divisions depend on
+    fomus_int cachesize;
+    std::string cachepath, fingerprint;
+    bool loaded;                      // cache file has been read
+    std::vector<std::string> newrecs; // for the cache file
 #ifndef NDEBUG
     int valid;
 #endif
@@ -559,12 +715,47 @@ public:
       }
       //#warning "*** why are all of these read in? should only need the
       //matching ones ***"
-      fillupinitdivs(module_setting_val(data.meas, setdefinitdivsid), 0);
+      module_value di(module_setting_val(data.meas, setdefinitdivsid)),
+          ui(module_setting_val(data.meas, setinitdivsid)),
+          dt(module_setting_val(data.meas, deftupdivsid)),
+          ut(module_setting_val(data.meas, tupdivsid));
+      fillupinitdivs(di, 0);
       std::set<fomus_rat> x1;
-      fillupinitdivs(module_setting_val(data.meas, setinitdivsid), &x1);
-      filluptupdivs(module_setting_val(data.meas, deftupdivsid), 0);
+      fillupinitdivs(ui, &x1);
+      filluptupdivs(dt, 0);
       std::set<fomus_int> x2;
-      filluptupdivs(module_setting_val(data.meas, tupdivsid), &x2);
+      filluptupdivs(ut, &x2);
+      keyaux::putrat(key, module_dur(data.meas));
+      keyaux::putrat(key, nbeats);
+      keyaux::putint(key, comp);
+      keyaux::putint(key, dotnotelvl);
+      keyaux::putint(key, dbldotnotelvl);
+      keyaux::putint(key, slsnotelvl);
+      keyaux::putint(key, syncnotelvl);
+      keyaux::putrat(key, mintupdur);
+      keyaux::putrat(key, maxtupdur);
+      keyaux::putint(key, tuptyp);
+      keyaux::putint(key, tuptypwh);
+      keyaux::putval(key, x);
+      keyaux::putval(key, di);
+      keyaux::putval(key, ui);
+      keyaux::putval(key, dt);
+      keyaux::putval(key, ut);
+      cachesize = module_setting_ival(data.meas, cachesizeid);
+      loaded = true;
+      if (cachesize > 0) {
+        const char* dir = module_setting_sval(data.meas, cachedirid);
+        if (dir[0]) {
+          fingerprint = VERSION;
+          fingerprint += " divrules ";
+          fingerprint += key;
+          std::string fn("divrules-");
+          keyaux::putraw(fn, keyaux::hash(fingerprint.data(),
+                                          fingerprint.size()));
+          cachepath = (boost::filesystem::path(dir) / (fn + ".cache")).string();
+          loaded = false;
+        }
+      }
       initdivslist.n = -1;
       initdivslist.vals = 0;
 #ifndef NDEBUG
@@ -573,6 +764,7 @@ public:
     }
     ~rulesdata() {
       module_free_list(initdivslist);
+      saveexps();
     }
 #ifndef NDEBUG
     bool isvalid() const {
@@ -582,6 +774,17 @@ public:
     bool iscompound() const {
       return comp;
     }
+    const char* getkey() const {
+      return key.c_str();
+    }
+    bool caching() const {
+      return cachesize > 0;
+    }
+    divrules_ornode cachedexpand(basediv& div, const divrules_rangelist& excl);
+    bool findexp(const std::string& k, std::string& r);
+    bool getexp(const std::string& r, const fomus_rat& tim0);
+    void addexp(const std::string& k, const std::string& r);
+    void saveexps();
     const struct module_list getinitdivs();
     void fillupinitdivs(const module_value& z, std::set<fomus_rat>* repl);
     void filluptupdivs(const module_value& z, std::set<fomus_int>* repl);
@@ -921,24 +1124,29 @@ public:
   }
 
 #warning "sorting isn't really necessary, get rid of it"
-  inline fomus_float sortave(const divrules_andnodeex_nodel& tp) {
+  // times are relative to the parent's so that the order doesn't depend on
+  // where it is (float ties break the same way, see rulesdata::cachedexpand)
+  inline fomus_float sortave(const divrules_andnodeex_nodel& tp,
+                             const fomus_rat& tim0) {
     assert(!tp.arr.empty());
     const basediv& b = *(basediv*) tp.arr.back();
-    fomus_rat s(b.tim + b.dur);
+    fomus_rat s(b.tim + b.dur - tim0);
     for (std::vector<divrules_div>::const_iterator i(tp.arr.begin());
          i != tp.arr.end(); ++i)
-      s = s + ((basediv*) (*i))->tim;
+      s = s + (((basediv*) (*i))->tim - tim0);
     return s / (fomus_float)((fomus_int) tp.arr.size() + 1);
   }
   struct sortors
       : public std::binary_function<const divrules_andnodeex_nodel&,
                                     const divrules_andnodeex_nodel&, bool> {
+    const fomus_rat tim0;
     const fomus_float mid;
-    sortors(const fomus_rat& mid) : mid(mid.num / (fomus_float) mid.den) {}
+    sortors(const fomus_rat& tim0, const fomus_rat& mid)
+        : tim0(tim0), mid(mid.num / (fomus_float) mid.den) {}
     bool operator()(const divrules_andnodeex_nodel& x,
                     const divrules_andnodeex_nodel& y) const {
-      fomus_float ax(sortave(x));
-      fomus_float ay(sortave(y));
+      fomus_float ax(sortave(x, tim0));
+      fomus_float ay(sortave(y, tim0));
       fomus_float ax2(diff(ax, mid));
       fomus_float ay2(diff(ay, mid));
       if (ax2 != ay2)
@@ -971,7 +1179,7 @@ public:
     }
     ornode.getnewandnodeex().pushnew(
         new divtop(dv, nbeats, tim, tupletvect(), tupinfo()));
-    ornode.aex.sort(sortors(tim + nbeats / (fomus_int) 2));
+    ornode.aex.sort(sortors(tim, nbeats / (fomus_int) 2));
     return ornode.getarr();
   }
 
@@ -1410,10 +1618,107 @@ public:
       assert(ti == b.tim + b.dur);
     }
 #endif
-    ornode.aex.sort(sortors(b.tim + b.dur / (fomus_int) 2));
+    ornode.aex.sort(sortors(b.tim, b.dur / (fomus_int) 2));
     return ornode.getarr();
   }
 
+  // expands `div' (with nothing excluded) or gets its expansion from the
+  // cache
+  divrules_ornode rulesdata::cachedexpand(basediv& div,
+                                          const divrules_rangelist& excl) {
+    assert(excl.n == 0);
+    std::string k, r;
+    div.put(k, div.tim);
+    if (findexp(k, r) && getexp(r, div.tim))
+      return ornode.getarr();
+    divrules_ornode o(div.expand(*this, excl));
+    cacheaux::putbin(r, (boost::uint32_t) o.n);
+    for (divrules_andnode *a = o.ands, *ae = o.ands + o.n; a < ae; ++a) {
+      cacheaux::putbin(r, (boost::uint32_t) a->n);
+      for (divrules_div *i = a->divs, *ie = a->divs + a->n; i < ie; ++i)
+        ((basediv*) *i)->put(r, div.tim);
+    }
+    addexp(k, r);
+    return o;
+  }
+  bool rulesdata::findexp(const std::string& k, std::string& r) {
+    if (!loaded) { // the file is only read once (by the first one to get here)
+      loaded = true;
+      std::vector<std::string> recs;
+      expfiles.load(cachepath, fingerprint, recs);
+      if (!recs.empty()) {
+        boost::lock_guard<boost::mutex> xxx(expcachemut);
+        insertexps(key, recs, cachesize);
+      }
+    }
+    boost::lock_guard<boost::mutex> xxx(expcachemut);
+    std::map<std::string, expmap>::const_iterator i(expcaches.find(key));
+    if (i == expcaches.end())
+      return false;
+    expmap::const_iterator j(i->second.find(k));
+    if (j == i->second.end())
+      return false;
+    r = j->second;
+    return true;
+  }
+  // fills `ornode' with the nodes in `r', false if it's damaged
+  bool rulesdata::getexp(const std::string& r, const fomus_rat& tim0) {
+    ornode.clear();
+    cacheaux::binreader rd(r.data(), r.data() + r.size());
+    boost::uint32_t n;
+    if (rd.get(n)) {
+      for (; n > 0; --n) {
+        boost::uint32_t m;
+        if (!rd.get(m))
+          goto FAIL;
+        divrules_andnodeex_nodel& ands = ornode.getnewandnodeex();
+        for (; m > 0; --m) {
+          basediv* d = getdiv(rd, tim0);
+          if (!d)
+            goto FAIL;
+          ands.pushnew(d);
+        }
+      }
+      if (rd.p == rd.e)
+        return true;
+    }
+  FAIL:
+    for (ornodeexvect_constit a(ornode.aex.begin()); a != ornode.aex.end();
+         ++a)
+      for (andnodeexvect_constit i(a->arr.begin()); i != a->arr.end(); ++i)
+        delete (basediv*) *i;
+    ornode.clear();
+    return false;
+  }
+  void rulesdata::addexp(const std::string& k, const std::string& r) {
+    {
+      boost::lock_guard<boost::mutex> xxx(expcachemut);
+      if (expcachecount >= cachesize) { // start over
+        expcaches.clear();
+        expcachecount = 0;
+      }
+      if (expcaches[key].insert(expmap::value_type(k, r)).second)
+        ++expcachecount;
+    }
+    if (!cachepath.empty()) {
+      newrecs.push_back(std::string());
+      cacheaux::putbinstr(newrecs.back(), k);
+      newrecs.back() += r;
+    }
+  }
+  // appends the expansions this one made to the cache file, the ones other
+  // processes added go into the cache
+  void rulesdata::saveexps() {
+    if (newrecs.empty())
+      return;
+    std::vector<std::string> others;
+    expfiles.save(cachepath, fingerprint, newrecs, cachesize, others);
+    if (!others.empty()) {
+      boost::lock_guard<boost::mutex> xxx(expcachemut);
+      insertexps(key, others, cachesize);
+    }
+  }
+
   const initdivsset& rulesdata::gettupdivs(const fomus_int tup) {
     assert(tup > 1);
     boost::ptr_map<const fomus_int, initdivsset>::const_iterator j(
@@ -1516,12 +1821,19 @@ public:
   fomus_rat durmult(void* moddata, divrules_div node);
   int isnoteonly(void* moddata, divrules_div node);
   fomus_rat tuplet(void* moddata, divrules_div node, int lvl);
+  const char* getkey(void* moddata);
+  }
+  inline divrules_ornode expandaux(rulesdata& rd, basediv& node,
+                                   const divrules_rangelist& excl) {
+    return rd.caching() && excl.n == 0 ? rd.cachedexpand(node, excl)
+                                       : node.expand(rd, excl);
   }
   inline divrules_ornode expand(void* moddata, divrules_div node,
                                 divrules_rangelist excl) {
 #ifndef NDEBUGOUT
     ((basediv*) node)->print();
-    divrules_ornode ret(((basediv*) node)->expand(*(rulesdata*) moddata, excl));
+    divrules_ornode ret(
+        expandaux(*(rulesdata*) moddata, *(basediv*) node, excl));
     for (divrules_andnode *a = ret.ands, *ae = ret.ands + ret.n; a < ae; ++a) {
       for (divrules_div *i = a->divs, *ie = a->divs + a->n; i < ie; ++i) {
         DBG("    ");
@@ -1531,7 +1843,7 @@ public:
     }
     return ret;
 #else
-    return ((basediv*) node)->expand(*(rulesdata*) moddata, excl);
+    return expandaux(*(rulesdata*) moddata, *(basediv*) node, excl);
 #endif
   }
   inline void free_moddata(void* moddata) {
@@ -1594,6 +1906,10 @@ public:
     assert(((rulesdata*) moddata)->isvalid());
     return ((rulesdata*) moddata)->iscompound();
   }
+  inline const char* getkey(void* moddata) {
+    assert(((rulesdata*) moddata)->isvalid());
+    return ((rulesdata*) moddata)->getkey();
+  }
   inline fomus_rat durmult(void* moddata, divrules_div node) {
     assert(((basediv*) node)->isvalid());
     return ((basediv*) node)->getdurmult();
@@ -1658,6 +1974,12 @@ public:
     return module_valid_int(val, 0, module_incl, 0, module_nobound, 0,
                             largetupsizetype);
   }
+
+  const char* cachesizetype = "integer>=0";
+  int valid_cachesize(const struct module_value val) {
+    return module_valid_int(val, 0, module_incl, 0, module_nobound, 0,
+                            cachesizetype);
+  }
 } // namespace divrules
 
 using namespace divrules;
@@ -1684,6 +2006,7 @@ void aux_fill_iface(void* iface) {
   ((divrules_iface*) iface)->durmult = divrules::durmult;
   ((divrules_iface*) iface)->isnoteonly = divrules::isnoteonly;
   ((divrules_iface*) iface)->tuplet = divrules::tuplet;
+  ((divrules_iface*) iface)->get_key = divrules::getkey;
 }
 const char* module_longname() {
   return "Divide Rules";
@@ -2499,6 +2822,49 @@ int module_get_setting(int n, module_setting* set, int id) {
     largetupsizeid = id;
     break;
   }
+  case 9: {
+    set->name = "divrules-cache-size"; // docscat{rhythmic}
+    set->type = module_int;
+    set->descdoc =
+        "The number of measure subdivisions FOMUS remembers."
+        "  The ways a measure, beat or tuplet may be divided depend only on its "
+        "duration, its tuplets and the division settings, so they're worked "
+        "out once and reused wherever the same thing appears again."
+        "  The cache is cleared when it reaches this size, and a file in "
+        "`divrules-cache-dir' that reaches it keeps only its newest half."
+        "  Set this to 0 to turn the cache off.";
+    set->typedoc = cachesizetype;
+
+    module_setval_int(&set->val, 4096);
+
+    set->loc = module_locscore;
+    set->valid = valid_cachesize;
+    set->uselevel = 3; // probably doesn't concern user
+    cachesizeid = id;
+    break;
+  }
+  case 10: {
+    set->name = "divrules-cache-dir"; // docscat{rhythmic}
+    set->type = module_string;
+    set->descdoc =
+        "A directory where FOMUS keeps the measure subdivisions it remembers "
+        "(see `divrules-cache-size') so that later runs can use them too."
+        "  There is one file for each combination of measure duration and "
+        "division settings, and files made with different settings or a "
+        "different version of FOMUS are ignored and replaced."
+        "  Several FOMUS processes can use the same directory at once, and it "
+        "can be the same as `div-cache-dir'."
+        "  The directory is created if it doesn't exist."
+        "  An empty string means subdivisions are only remembered while FOMUS "
+        "is running.";
+
+    module_setval_string(&set->val, "");
+
+    set->loc = module_locscore;
+    set->uselevel = 3; // probably doesn't concern user
+    cachedirid = id;
+    break;
+  }
   default:
     return 0;
   }
@@ -86,6 +86,7 @@ typedef int (*divrules_iscompound)(void* moddata);
 typedef fomus_rat (*divrules_durmult)(void* moddata, divrules_div node);
 typedef int (*divrules_isnoteonly)(void* moddata, divrules_div node);
 typedef fomus_rat (*divrules_tuplet)(void* moddata, divrules_div node, int lvl);
+typedef const char* (*divrules_getkey_fun)(void* moddata);
 
 typedef const struct module_list (*divrules_getinitdivs_fun)(void* moddata);
 //   typedef module_list (*divrules_gettupdivs_fun)();
@@ -129,6 +130,9 @@ struct divrules_iface {
   divrules_iscompound iscompound;
   divrules_tuplet tuplet; // get tuplet at some level
                           //     divrules_gettupdivs_fun get_tupdivs;
+  // settings the rules were made from (same key = same rules for a measure of
+  // the same duration), can be NULL
+  divrules_getkey_fun get_key;
 
   struct divrules_data data; // module fills this and sends to divrules.cc
 };
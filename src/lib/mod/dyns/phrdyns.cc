@@ -241,7 +241,7 @@ enum module_type module_type() {
   return module_moddynamics;
 }
 int module_itertype() {
-  return module_bypart | module_byvoice | module_norests;
+  return module_bypart | module_byvoice | module_norests | module_partlocal;
 }
 const char* module_initerr() {
   return ierr;
@@ -20,15 +20,18 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
 #include <list>
+#include <new>
 #include <queue>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <boost/intrusive_ptr.hpp>
+#include <boost/pool/pool.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
-#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp> // next
 
 #include "ifacesearch.h"
@@ -138,21 +141,28 @@ namespace bfsearch {
     }
   };
 
-  // node
+  // node--allocated from a pool that lives as long as the search, refcounts
+  // are only touched by the search thread
+  struct node;
+  typedef boost::intrusive_ptr<node> heapshptr;
   struct node : public scopednode /*NONCOPYABLE*/ {
     fomus_int id;
     int choice;
     union search_score score;
     fomus_int nnds; // how far to go back collecting nodes, xnnds is maximum
-    boost::shared_ptr<node> prev;
+    heapshptr prev;
     nodecounter& cnt;
     bool dead;
     fomus_int brs;
+    boost::pool<>& arena;
+    int refs;
     node(const search_iface& iface, const fomus_int id, search_node dat,
          const int choice, const union search_score score0,
-         boost::shared_ptr<node>& prev, nodecounter& cnt, const fomus_int nnds)
+         const heapshptr& prev, nodecounter& cnt, const fomus_int nnds,
+         boost::pool<>& arena)
         : scopednode(iface, dat), id(id), choice(choice), score(score0),
-          nnds(nnds), prev(prev), cnt(cnt), dead(false), brs(1) {
+          nnds(nnds), prev(prev), cnt(cnt), dead(false), brs(1), arena(arena),
+          refs(0) {
       DBG("BFSEARCH GOT SCORE = " << score.f << std::endl);
       assert(isntbegin()); // after begin
       cnt.inc(choice);
@@ -160,8 +170,9 @@ namespace bfsearch {
       if (!isbegin())
         ++(prev->brs);
     }
-    node(const search_iface& iface, const search_node n, nodecounter& cnt)
-        : scopednode(iface, n), nnds(0), cnt(cnt) {
+    node(const search_iface& iface, const search_node n, nodecounter& cnt,
+         boost::pool<>& arena)
+        : scopednode(iface, n), nnds(0), cnt(cnt), arena(arena), refs(0) {
       assert(isbegin()); // BEGIN node, gets minimum offset possible
     }
     ~node() {
@@ -230,8 +241,25 @@ namespace bfsearch {
     }
   };
 
+  inline void intrusive_ptr_add_ref(node* n) {
+    ++n->refs;
+  }
+  inline void intrusive_ptr_release(node* n) {
+    assert(n->refs > 0);
+    if (--n->refs <= 0) {
+      boost::pool<>& a = n->arena;
+      n->~node();
+      a.free(n);
+    }
+  }
+  inline void* allocnode(boost::pool<>& arena) {
+    void* r = arena.malloc();
+    if (!r)
+      throw std::bad_alloc();
+    return r;
+  }
+
   // heap
-  typedef boost::shared_ptr<node> heapshptr;
   struct heapfrontless {
     bool operator()(const heapshptr& x, const heapshptr& y) const {
       return x->opless(*y);
@@ -242,7 +270,8 @@ namespace bfsearch {
       return x->order(*y);
     }
   };
-  // boost::pool_allocator<heapshptr> causes segfaults
+  // boost::pool_allocator<heapshptr> causes segfaults (nodes themselves are
+  // in a boost::pool, see above)
   typedef std::priority_queue<heapshptr, std::vector<heapshptr>, heapfrontless>
       heapfront;
   typedef std::priority_queue<heapshptr, std::vector<heapshptr>, heapbackless>
@@ -267,10 +296,13 @@ private:
     bool cerr;
     std::stringstream CERR;
     std::string errstr;
+    fomus_int ngen; // nodes generated in the last run
 
 public:
-    data() : cerr(false) {
+    data() : cerr(false), ngen(0) {
       iface.moddata = 0;
+      iface.beamwidth = 0;
+      iface.expandwidth = 0;
       // #ifndef NDEBUG
       //       iface.nchoices = 0;
       //       iface.min_score.ptr = 0;
@@ -293,7 +325,11 @@ public:
       std::getline(CERR, errstr);
       return errstr.c_str();
     }
+    fomus_int getngen() const {
+      return ngen;
+    }
     void run() {
+      ngen = 0;
       assert(NODE_NULL != NODE_BEGIN);
       assert(NODE_NULL != NODE_END);
       assert(NODE_END != NODE_BEGIN);
@@ -307,72 +343,81 @@ public:
         boost::ptr_vector<nodecounter>
             nop; // number of unique nodes open for each position (when a
                  // counter is 1, can assign it)
+        boost::pool<> arena(sizeof(node)); // destroyed after all nodes
         heapfront h;
         heapback rh; // heaps & nodes are destroyed before nodecounters
         fomus_int id = 0;
         fomus_int hs = 0; // doubleheap size
-        std::vector<search_node> arr;
         fomus_int ass = 0; // next to assign
-        heapshptr np(new node(iface, NODE_BEGIN, bcnt));
+        const std::size_t wd = std::max(iface.expandwidth, 1);
+        std::vector<heapshptr> pops; // nodes expanded this round, best first
+        std::vector<search_node> arr;
+        heapshptr np(new (allocnode(arena))
+                         node(iface, NODE_BEGIN, bcnt, arena));
         while (true) {
-          node& n = *np;                 // n = the popped node
-          fomus_int in = n.cnt.seqn + 1; // in = new seq index
-          if (in >= (fomus_int) nop.size())
-            nop.push_back(new nodecounter(nop.size(), iface.nchoices));
-          assert(in < (fomus_int) nop.size());
-          for (int ch = 0; ch < iface.nchoices; ++ch) { // ch = choice#
-            scopednode i(
-                iface, iface.new_node(
-                           iface.moddata, n.get(),
-                           ch)); // i = new node from module--invalid choice = 0
-            if (i.get()) {
-              if (i.get() == NODE_END) {
-                assert(
-                    in ==
-                    (fomus_int) nop.size() -
-                        1); // since node at in is supposedly invalid (at the
-                            // end), actual size = in (one less than nop.size())
-                DBG("ASSIGN REMAINING = " << in - ass << std::endl);
-                if (in > ass)
-                  n.assignrest(in - ass); // go backwards to get optimal path
-                checkerr(iface);
-                return;
+          pops.clear();
+          pops.push_back(np);
+          while (pops.size() < wd && hs > 0) {
+            pops.push_back(popheap(h));
+            --hs;
+          }
+          for (std::vector<heapshptr>::iterator p(pops.begin());
+               p != pops.end(); ++p) {
+            node& n = **p;                 // n = the popped node
+            fomus_int in = n.cnt.seqn + 1; // in = new seq index
+            if (in >= (fomus_int) nop.size())
+              nop.push_back(new nodecounter(nop.size(), iface.nchoices));
+            assert(in < (fomus_int) nop.size());
+            for (int ch = 0; ch < iface.nchoices; ++ch) { // ch = choice#
+              scopednode i(iface,
+                           iface.new_node(iface.moddata, n.get(),
+                                          ch)); // i = new node from
+                                                // module--invalid choice = 0
+              if (i.get()) {
+                if (i.get() == NODE_END) {
+                  assert(
+                      in ==
+                      (fomus_int) nop.size() -
+                          1); // since node at in is supposedly invalid (at the
+                              // end), actual size = in (one less than
+                              // nop.size())
+                  if (p != pops.begin()) { // complete, but a better node in
+                                           // this round might still beat it
+                    h.push(*p);
+                    ++hs;
+                    p->reset(); // not dead
+                    break;
+                  }
+                  DBG("ASSIGN REMAINING = " << in - ass << std::endl);
+                  if (in > ass)
+                    n.assignrest(in - ass); // go backwards to get optimal path
+                  checkerr(iface);
+                  return;
+                }
+                arr.clear();
+                n.pushlst(arr, n.nnds,
+                          i.get()); // gathers list in order by offset
+                arr.push_back(i.get());
+                search_nodes arr0 = {arr.size(), &arr[0]};
+                heapshptr o(new (allocnode(arena)) node(
+                    iface, id++, i.release(), ch,
+                    (n.isbegin()
+                         ? iface.get_score(iface.moddata, arr0)
+                         : iface.score_add(
+                               iface.moddata, n.score,
+                               iface.get_score(iface.moddata, arr0))),
+                    *p, nop[in], arr.size(), arena));
+                h.push(o);
+                rh.push(o);
+                ++hs;
+                ++ngen;
               }
-              arr.clear();
-              n.pushlst(arr, n.nnds,
-                        i.get()); // gathers list in order by offset
-              arr.push_back(i.get());
-              search_nodes arr0 = {arr.size(), &arr[0]};
-              // #ifndef NDEBUGOUT
-              // 	      union search_score score =
-              // iface.get_score(iface.moddata, arr0); 	      DBG("BFSEARCH GOT SCORE =
-              // " << score.f << " and adding to " << n.score.f << std::endl);
-              // 	      union search_score scoreadd =
-              // iface.score_add(iface.moddata, n.score, score); 	      DBG("RESULT = "
-              // << scoreadd.f << std::endl); 	      heapshptr o(new node(iface, id++,
-              // i.release(), ch, 				   scoreadd, //off
-              // /*iface.get_time(iface.moddata, i.get())*/, 				   np, nop[in],
-              // /*iface.get_endtime(iface.moddata, i.get()),*/ 				   arr.size()));
-              // #else
-              heapshptr o(new node(
-                  iface, id++, i.release(), ch,
-                  (n.isbegin()
-                       ? iface.get_score(iface.moddata, arr0)
-                       : iface.score_add(
-                             iface.moddata, n.score,
-                             iface.get_score(
-                                 iface.moddata,
-                                 arr0))), // off /*iface.get_time(iface.moddata,
-                                          // i.get())*/,
-                  np, nop[in], /*iface.get_endtime(iface.moddata, i.get()),*/
-                  arr.size()));
-              // #endif
-              h.push(o);
-              rh.push(o);
-              ++hs;
             }
           }
-          np->setdead(); // popped node is fully removed--it's dead
+          for (std::vector<heapshptr>::const_iterator p(pops.begin());
+               p != pops.end(); ++p)
+            if (*p)
+              (*p)->setdead(); // popped node is fully removed--it's dead
           while (hs > iface.heapsize) {
             popheap(rh)->setdead();
             --hs;
@@ -453,4 +498,5 @@ void* engine_get_iface(void* dat) {
 }
 void engine_run(void* dat) {
   ((data*) dat)->run();
+  module_countnodes(((data*) dat)->getngen());
 }
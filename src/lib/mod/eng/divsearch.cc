@@ -380,9 +380,10 @@ public:
     bool cerr;
     std::stringstream CERR;
     std::string errstr;
+    fomus_int ngen; // nodes generated in the last run
     // std::string modname; // TODO: get this
 public:
-    data() : cerr(false) {
+    data() : cerr(false), ngen(0) {
       iface.moddata = 0;
       iface.api.new_andnode = divsearch_newandnode;
       iface.api.push_back = divsearch_pushback;
@@ -399,7 +400,11 @@ public:
     divsearch_iface* getiface() {
       return &iface;
     }
+    fomus_int getngen() const {
+      return ngen;
+    }
     void run() {
+      ngen = 0;
       try {
         while (true) {
           fomus_int id = 0;
@@ -414,6 +419,7 @@ public:
               throw divsearcherr("no solution");
             ++de;
           }
+          ngen += id;
           iface.solution(iface.moddata, top.getdata());
         }
         checkerr(iface);
@@ -477,4 +483,5 @@ void* engine_get_iface(void* dat) {
 }
 void engine_run(void* dat) {
   ((data*) dat)->run();
+  module_countnodes(((data*) dat)->getngen());
 }
@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
 #include <list>
 #include <new>
@@ -27,8 +28,9 @@
 #include <string>
 #include <vector>
 
+#include <boost/intrusive_ptr.hpp>
+#include <boost/pool/pool.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
-#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp> // next
 
 #include "ifacesearch.h"
@@ -148,24 +150,34 @@ namespace dynprog {
 #endif
   };
 
+  // nodes live in a per-run pool and are refcounted without locking (a run
+  // never leaves its thread), whatever is left is freed with the pool
+  struct node;
+  typedef boost::intrusive_ptr<node> nodeptr;
+
   struct node : public scopednode /*NONCOPYABLE*/ {
     search_score score;
     // fomus_int off, /*eoff*/ /*, feoff*/; // fendoff is farthest endoff so far
     fomus_int nnds; //, xnnds;
-    boost::shared_ptr<node> prev;
+    nodeptr prev;
     int choice;
     nodecounter& cnt;
+    boost::pool<>& arena;
+    int refs;
 
-    node(const search_iface& iface, nodecounter& cnt)
-        : scopednode(iface, 0), score(iface.min_score), choice(-1), cnt(cnt) {
+    node(const search_iface& iface, nodecounter& cnt, boost::pool<>& arena)
+        : scopednode(iface, 0), score(iface.min_score), choice(-1), cnt(cnt),
+          arena(arena), refs(0) {
       assert(isntbegin()); // construct after begin, default choice = -1
     }
-    node(const search_iface& iface, const search_node n, nodecounter& cnt)
-        : scopednode(iface, n), nnds(0), choice(-1), cnt(cnt) {
+    node(const search_iface& iface, const search_node n, nodecounter& cnt,
+         boost::pool<>& arena)
+        : scopednode(iface, n), nnds(0), choice(-1), cnt(cnt), arena(arena),
+          refs(0) {
       assert(isbegin()); // BEGIN node, gets minimum endoffset possible
     }
     void set(search_node n0, const search_score sc0,
-             /*const fomus_int off0,*/ boost::shared_ptr<node>& prev0,
+             /*const fomus_int off0,*/ const nodeptr& prev0,
              const fomus_int choice0, /*const module_value& off1,*/
              const fomus_int nnds0 /*, const fomus_int xnnds0*/) {
       reset(n0);
@@ -206,6 +218,35 @@ namespace dynprog {
     } // delayed inc after construction
   };
 
+  inline void intrusive_ptr_add_ref(node* n) {
+    ++n->refs;
+  }
+  inline void intrusive_ptr_release(node* n) {
+    assert(n->refs > 0);
+    if (--n->refs <= 0) {
+      boost::pool<>& a = n->arena;
+      n->~node();
+      a.free(n);
+    }
+  }
+  inline void* allocnode(boost::pool<>& arena) {
+    void* r = arena.malloc();
+    if (!r)
+      throw std::bad_alloc();
+    return r;
+  }
+
+  // orders indices into the old node vector best-first
+  struct scoregt {
+    const search_iface& iface;
+    const std::vector<nodeptr>& nds;
+    scoregt(const search_iface& iface, const std::vector<nodeptr>& nds)
+        : iface(iface), nds(nds) {}
+    bool operator()(const int a, const int b) const {
+      return iface.score_lt(iface.moddata, nds[b]->score, nds[a]->score);
+    }
+  };
+
   class data _NONCOPYABLE {
 public:
     search_iface iface;
@@ -214,10 +255,13 @@ private:
     bool cerr;
     std::stringstream CERR;
     std::string errstr;
+    fomus_int ngen; // nodes generated in the last run
     // std::string modname; // TODO--get value
 public:
-    data() : cerr(false) {
+    data() : cerr(false), ngen(0) {
       iface.moddata = 0;
+      iface.beamwidth = 0;
+      iface.expandwidth = 0;
       iface.api.begin = NODE_BEGIN;
       iface.api.end = NODE_END;
     }
@@ -231,7 +275,11 @@ public:
     search_iface* getiface() {
       return &iface;
     }
+    fomus_int getngen() const {
+      return ngen;
+    }
     void run() {
+      ngen = 0;
       try {
         if (iface.nchoices <= 0) {
           cerr = true;
@@ -240,77 +288,90 @@ public:
         }
         nodecounter bcnt;
         boost::ptr_vector<nodecounter> nop;
-        boost::shared_ptr<node> beg(
-            new node(iface, NODE_BEGIN, bcnt)); // begin "root" node
-        std::vector<boost::shared_ptr<node>> nds(iface.nchoices,
-                                                 beg); // previous nodes
-        std::vector<boost::shared_ptr<node>> nws;      // new nodes
+        boost::pool<> arena(sizeof(node)); // must outlive all nodes
+        nodeptr beg(new (allocnode(arena))
+                        node(iface, NODE_BEGIN, bcnt, arena)); // "root" node
+        std::vector<nodeptr> nds(iface.nchoices, beg); // previous nodes
+        std::vector<nodeptr> nws;                      // new nodes
         std::vector<search_node> arr;
+        std::vector<int> bm; // old nodes that get expanded
         fomus_int ass = 0;
         nodecounter* nwp; // nwp = new counter
         assert(iface.nchoices > 0);
         nop.push_back(nwp = new nodecounter(iface.nchoices));
         for (int i = 0; i < iface.nchoices; ++i)
-          nws.push_back(boost::shared_ptr<node>(new node(iface, *nwp)));
+          nws.push_back(nodeptr(new (allocnode(arena))
+                                    node(iface, *nwp, arena)));
         while (true) {
+          bm.clear();
+          node* lst = 0;
+          for (int i = 0; i < iface.nchoices; ++i) {
+            node* si = nds[i].get();
+            if (si->isntnull() && si != lst)
+              bm.push_back(i); // same node twice gives same result
+            lst = si;
+          }
+          if (iface.beamwidth > 0 && (int) bm.size() > iface.beamwidth) {
+            std::nth_element(bm.begin(), bm.begin() + iface.beamwidth,
+                             bm.end(), scoregt(iface, nds));
+            bm.resize(iface.beamwidth);
+            std::sort(bm.begin(), bm.end()); // keep ties going to lowest
+          }
           int ch = 0;     // choice
           bool nf = true; // not found flag
-          for (std::vector<boost::shared_ptr<node>>::iterator j(nws.begin());
-               j != nws.end();
+          for (std::vector<nodeptr>::iterator j(nws.begin()); j != nws.end();
                ++j, ++ch) { // j points to new node ptr, ch is choice number
             node& sj = **j; // sj = new node
-            for (std::vector<boost::shared_ptr<node>>::iterator i(nds.begin());
-                 i != nds.end(); ++i) { // i points to old node ptr
-              node& si = **i;           // si = old node
-              if (si.isntnull()) {
-                scopednode n(iface, iface.new_node(iface.moddata, si.get(),
-                                                   ch)); // n = fresh new node
-                if (n.isend()) {                         // done...
-                  node* it;
+            for (std::vector<int>::const_iterator i(bm.begin());
+                 i != bm.end(); ++i) { // i indexes old node ptr
+              node& si = *nds[*i];     // si = old node
+              scopednode n(iface, iface.new_node(iface.moddata, si.get(),
+                                                 ch)); // n = fresh new node
+              if (n.isend()) {                         // done...
+                node* it;
 #ifndef NDEBUG
-                  it = 0;
+                it = 0;
 #endif
-                  search_score bst = iface.min_score;
-                  for (std::vector<boost::shared_ptr<node>>::const_iterator i(
-                           nds.begin());
-                       i != nds.end(); ++i) { // i points to old node ptr
-                    search_score sc = (*i)->score;
-                    if (iface.score_lt(iface.moddata, bst, sc)) {
-                      bst = sc;
-                      it = i->get();
-                    }
+                search_score bst = iface.min_score;
+                for (std::vector<nodeptr>::const_iterator i(nds.begin());
+                     i != nds.end(); ++i) { // i points to old node ptr
+                  search_score sc = (*i)->score;
+                  if (iface.score_lt(iface.moddata, bst, sc)) {
+                    bst = sc;
+                    it = i->get();
                   }
-                  assert(it);
-                  if ((fomus_int) nop.size() - 1 > ass)
-                    it->assignrest((nop.size() - 2) - ass);
-                  checkerr(iface);
-                  return;
                 }
-                if (n.isntnull()) { // got one (maybe)
-                  arr.clear(); // this is supposed to NOT reduce the capacity
-                  si.pushlst(arr, si.nnds,
-                             n.get()); // gathers list in order by offset
-                  // if (arr.size() < si.nnds) si.nnds = arr.size(); that's bad
-                  // assert(!arr.empty());
-                  arr.push_back(n.get());
-                  search_nodes arr0 = {arr.size(), &arr[0]};
-                  search_score sc =
-                      (si.isbegin()
-                           ? iface.get_score(iface.moddata, arr0)
-                           : iface.score_add(
-                                 iface.moddata, si.score,
-                                 iface.get_score(iface.moddata, arr0)));
-                  if (iface.score_lt(iface.moddata, sj.score, sc)) {
-                    // fomus_rat off(GET_R(iface.get_time(iface.moddata,
-                    // n.get()))); bool x = (off > si.off);
-                    sj.set(n.release(), sc, /*newo,*/ *i,
-                           ch, /*iface.get_endtime(iface.moddata, n.get()),*/
-                           /*x ? si.xnnds + 1 : si.nnds + 1,*/
-                           /*x ? arr.size() : std::max((fomus_int)arr.size(),
-                              si.xnnds + 1)*/
-                           arr.size()); // set **j to new node
-                    nf = false;
-                  }
+                assert(it);
+                if ((fomus_int) nop.size() - 1 > ass)
+                  it->assignrest((nop.size() - 2) - ass);
+                checkerr(iface);
+                return;
+              }
+              if (n.isntnull()) { // got one (maybe)
+                ++ngen;
+                arr.clear(); // this is supposed to NOT reduce the capacity
+                si.pushlst(arr, si.nnds,
+                           n.get()); // gathers list in order by offset
+                // if (arr.size() < si.nnds) si.nnds = arr.size(); that's bad
+                // assert(!arr.empty());
+                arr.push_back(n.get());
+                search_nodes arr0 = {arr.size(), &arr[0]};
+                search_score sc =
+                    (si.isbegin()
+                         ? iface.get_score(iface.moddata, arr0)
+                         : iface.score_add(
+                               iface.moddata, si.score,
+                               iface.get_score(iface.moddata, arr0)));
+                if (iface.score_lt(iface.moddata, sj.score, sc)) {
+                  // fomus_rat off(GET_R(iface.get_time(iface.moddata,
+                  // n.get()))); bool x = (off > si.off);
+                  sj.set(n.release(), sc, /*newo,*/ nds[*i],
+                         ch, /*iface.get_endtime(iface.moddata, n.get()),*/
+                         /*x ? si.xnnds + 1 : si.nnds + 1,*/
+                         /*x ? arr.size() : std::max((fomus_int)arr.size(),
+                            si.xnnds + 1)*/
+                         arr.size()); // set **j to new node
+                  nf = false;
                 }
               }
             }
@@ -321,12 +382,12 @@ public:
             CERR << "can't continue--no possible choices" << std::endl;
             return;
           }
-          std::vector<boost::shared_ptr<node>>::iterator i(nds.begin());
+          std::vector<nodeptr>::iterator i(nds.begin());
           nwp = new nodecounter(iface.nchoices);
-          for (std::vector<boost::shared_ptr<node>>::iterator j(nws.begin());
-               j != nws.end(); ++j, ++i) {
+          for (std::vector<nodeptr>::iterator j(nws.begin()); j != nws.end();
+               ++j, ++i) {
             *i = *j;
-            j->reset(new node(iface, *nwp));
+            *j = new (allocnode(arena)) node(iface, *nwp, arena);
           }
           while (ass < (fomus_int) nop.size() && nop[ass].assign(iface))
             ++ass;            // assignments for known solutions
@@ -393,4 +454,5 @@ void* engine_get_iface(void* dat) {
 }
 void engine_run(void* dat) {
   ((data*) dat)->run();
+  module_countnodes(((data*) dat)->getngen());
 }
@@ -91,6 +91,8 @@ struct search_iface {
   int nchoices;
   union search_score min_score;
   fomus_int heapsize;
+  int beamwidth; // dynprog: max predecessor states expanded per step, 0 = all
+  int expandwidth; // bfsearch: best nodes expanded together, <= 1 = one
 
   search_assign_fun assign;
   search_get_score_fun get_score; // scores will accumlate as search progresses
@@ -0,0 +1,524 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// FOMUS BINARY FILE INPUT
+
+#include "config.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <boost/filesystem/exception.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "fomusapi.h"
+#include "module.h"
+
+#include "debugaux.h"
+#include "ferraux.h"
+using namespace ferraux;
+#include "fmbaux.h"
+using namespace fmbaux;
+#include "inbufaux.h"
+using namespace inbufaux;
+
+#ifdef BOOST_FILESYSTEM_OLDAPI
+#define FS_FILE_STRING file_string
+#else
+#define FS_FILE_STRING string
+#endif
+
+namespace fmbin {
+
+  struct badfmb {};
+
+  template <typename T>
+  struct section {
+    const T* recs;
+    boost::uint64_t n;
+    section() : recs(0), n(0) {}
+    const T& operator[](const boost::uint64_t i) const {
+      if (i >= n)
+        throw badfmb();
+      return recs[i];
+    }
+    const T* range(const boost::uint64_t i, const boost::uint64_t m) const {
+      if (i > n || m > n - i)
+        throw badfmb();
+      return recs + i;
+    }
+  };
+
+  // batch of plain notes for fomus_add_notes
+  const std::size_t batchsize = 4096;
+  // nested lists deeper than this are rejected
+  const int maxlistdepth = 256;
+
+  inline boost::int64_t getden(const fmbval& v) {
+    if (v.den <= 0)
+      throw badfmb();
+    return v.den;
+  }
+
+  class loader {
+    FOMUS fom;
+    bool err;
+    section<char> strs, text;
+    section<fmbsetting> sets, notesets;
+    section<fmbval> vals;
+    section<fmbevent> evs;
+    section<boost::int32_t> voices;
+    section<fmbmark> marks;
+    std::map<boost::uint32_t, int> setids, partids, markids; // interned
+    std::vector<fomus_note_rec> recs;
+    std::vector<int> rvoices, rmarks; // storage for the records' arrays
+    std::size_t nrvoices, nrmarks;
+
+    void chk() {
+      if (fomus_err()) {
+        err = true;
+        DBG("FOMUS_ERR() WAS SET!");
+      }
+    }
+    const char* str(const boost::uint64_t o) const {
+      return strs.range(o, 1); // NUL-terminated, checked in load()
+    }
+    template <typename T>
+    void getsect(const char* beg, const char* end, const fmbsect& s,
+                 section<T>& x) {
+      if (s.size != sizeof(T) || s.offset % 8 != 0 ||
+          s.offset > (boost::uint64_t)(end - beg) ||
+          s.count > ((boost::uint64_t)(end - beg) - s.offset) / sizeof(T))
+        throw badfmb();
+      x.recs = (const T*) (beg + s.offset);
+      x.n = s.count;
+    }
+    void putval(const int par, const int act, const fmbval& v);
+    void putlistel(const fmbval* v, const int depth);
+    void putsetting(const fmbsetting& s, const int par);
+    int partid(const boost::uint32_t o);
+    int markid(const boost::uint32_t o);
+    bool getrec(const fmbevent& e, fomus_note_rec& r);
+    void flush();
+    void putevent(const fmbevent& e);
+
+public:
+    loader(FOMUS fom) : fom(fom), err(false), nrvoices(0), nrmarks(0) {}
+    bool load(const char* beg, const char* end);
+  };
+
+  void loader::putval(const int par, const int act, const fmbval& v) {
+    switch (v.type) {
+    case module_int:
+      fomus_ival(fom, par, act, v.v.i);
+      break;
+    case module_rat:
+      fomus_rval(fom, par, act, v.v.i, getden(v));
+      break;
+    case module_float:
+      fomus_fval(fom, par, act, v.v.f);
+      break;
+    case module_string:
+      fomus_sval(fom, par, act, str(v.v.s));
+      break;
+    default:
+      throw badfmb();
+    }
+    chk();
+  }
+  // v points into vals--fmbout writes a list's elements after the list
+  // itself, so anything else is a cycle or a corrupt file
+  void loader::putlistel(const fmbval* v, const int depth) {
+    if (v->type == module_list) {
+      if (depth >= maxlistdepth || v->v.s <= (boost::uint64_t)(v - vals.recs))
+        throw badfmb();
+      fomus_act(fom, fomus_par_list, fomus_act_start);
+      chk();
+      for (const fmbval *i = vals.range(v->v.s, v->n), *ie = i + v->n; i < ie;
+           ++i)
+        putlistel(i, depth + 1);
+      fomus_act(fom, fomus_par_list, fomus_act_add);
+      chk();
+    } else
+      putval(fomus_par_list, fomus_act_add, *v);
+  }
+  // same calls fmsin makes for a setting
+  void loader::putsetting(const fmbsetting& s, const int par) {
+    std::map<boost::uint32_t, int>::iterator i(setids.find(s.name));
+    if (i == setids.end())
+      i = setids
+              .insert(std::map<boost::uint32_t, int>::value_type(
+                  s.name, module_settingid(str(s.name))))
+              .first;
+    if (i->second < 0) {
+      CERR << "unknown setting `" << str(s.name) << '\'' << std::endl;
+      err = true;
+      return;
+    }
+    fomus_ival(fom, fomus_par_setting, fomus_act_set, i->second);
+    chk();
+    if (s.val.type == module_list) {
+      fomus_act(fom, fomus_par_list, fomus_act_start);
+      chk();
+      for (const fmbval *j = vals.range(s.val.v.s, s.val.n), *je = j + s.val.n;
+           j < je; ++j)
+        putlistel(j, 1);
+      fomus_act(fom, fomus_par_list, fomus_act_end);
+      chk();
+      fomus_act(fom, par, fomus_act_set);
+      chk();
+    } else
+      putval(par, fomus_act_set, s.val);
+  }
+
+  int loader::partid(const boost::uint32_t o) {
+    std::map<boost::uint32_t, int>::iterator i(partids.find(o));
+    if (i == partids.end())
+      i = partids
+              .insert(std::map<boost::uint32_t, int>::value_type(
+                  o, fomus_intern_part(fom, str(o))))
+              .first;
+    return i->second;
+  }
+  int loader::markid(const boost::uint32_t o) {
+    std::map<boost::uint32_t, int>::iterator i(markids.find(o));
+    if (i == markids.end())
+      i = markids
+              .insert(std::map<boost::uint32_t, int>::value_type(
+                  o, fomus_intern_mark(str(o))))
+              .first;
+    return i->second;
+  }
+
+  inline bool isexact(const fmbval& v) {
+    return v.type == module_int || v.type == module_rat;
+  }
+  inline fomus_rat getrat(const fmbval& v) {
+    fomus_rat r = {v.v.i, v.type == module_rat ? getden(v) : 1};
+    return r;
+  }
+  inline fomus_float getfloat(const fmbval& v) {
+    switch (v.type) {
+    case module_int:
+      return v.v.i;
+    case module_rat:
+      return (fomus_float) v.v.i / getden(v);
+    default:
+      return v.v.f;
+    }
+  }
+
+  // fills a fomus_add_notes record if the event doesn't need anything the
+  // records can't hold (grace times, settings, mark arguments, mixed
+  // float/rational values)
+  bool loader::getrec(const fmbevent& e, fomus_note_rec& r) {
+    if (e.type == fmbev_mark || e.grace.type != module_none || e.nsets > 0 ||
+        e.nvoices <= 0 || e.dur.type == module_none)
+      return false;
+    bool fl = (e.time.type == module_float);
+    if (fl ? e.dur.type != module_float : !isexact(e.dur))
+      return false;
+    if (!fl && !isexact(e.time))
+      return false;
+    memset(&r, 0, sizeof(r));
+    if (e.type == fmbev_rest) {
+      r.flags = fomus_note_rest;
+    } else {
+      if (e.pitch.type == module_string)
+        r.perc = str(e.pitch.v.s);
+      else if (fl ? e.pitch.type != module_float : !isexact(e.pitch))
+        return false;
+      if (e.dyn.type != module_int && e.dyn.type != module_float)
+        return false;
+      r.dyn = getfloat(e.dyn);
+      if (e.dyn.type == module_int) {
+        if ((fomus_int) r.dyn != e.dyn.v.i) // doesn't fit in a double
+          return false;
+        r.flags |= fomus_note_intdyn;
+      }
+      if (fl)
+        r.fpitch = e.pitch.v.f;
+      else if (!r.perc)
+        r.pitch = getrat(e.pitch);
+    }
+    if (fl) {
+      r.flags |= fomus_note_float;
+      r.ftime = e.time.v.f;
+      r.fdur = e.dur.v.f;
+    } else {
+      r.time = getrat(e.time);
+      r.dur = getrat(e.dur);
+    }
+    if ((r.part = partid(e.part)) < 0)
+      return false;
+    const fmbmark* m = marks.range(e.mark0, e.nmarks);
+    for (const fmbmark *i = m, *ie = m + e.nmarks; i < ie; ++i) {
+      if (i->str != fmbnone || i->num.type != module_none || markid(i->id) < 0)
+        return false;
+    }
+    const boost::int32_t* v = voices.range(e.voice0, e.nvoices);
+    // events may share ranges, so the arrays can fill up before the batch
+    // does (a single event always fits)
+    if (e.nvoices > rvoices.size() - nrvoices ||
+        e.nmarks > rmarks.size() - nrmarks)
+      flush();
+    r.nvoices = e.nvoices;
+    r.voices = &rvoices[nrvoices]; // sized up front, doesn't move
+    std::copy(v, v + e.nvoices, rvoices.begin() + nrvoices);
+    nrvoices += e.nvoices;
+    r.nmarks = e.nmarks;
+    r.marks = &rmarks[nrmarks];
+    for (const fmbmark *i = m, *ie = m + e.nmarks; i < ie; ++i)
+      rmarks[nrmarks++] = markid(i->id);
+    return true;
+  }
+  void loader::flush() {
+    if (!recs.empty()) {
+      fomus_add_notes(fom, &recs[0], recs.size());
+      chk();
+      recs.clear();
+    }
+    nrvoices = nrmarks = 0;
+  }
+
+  // one field at a time, like fmsin
+  void loader::putevent(const fmbevent& e) {
+    fomus_sval(fom, fomus_par_part, fomus_act_set, str(e.part));
+    chk();
+    putval(fomus_par_time, fomus_act_set, e.time);
+    if (e.grace.type != module_none)
+      putval(fomus_par_gracetime, fomus_act_set, e.grace);
+    if (e.dur.type != module_none)
+      putval(fomus_par_duration, fomus_act_set, e.dur);
+    if (e.type == fmbev_note) {
+      putval(fomus_par_pitch, fomus_act_set, e.pitch);
+      if (e.dyn.type != module_none)
+        putval(fomus_par_dynlevel, fomus_act_set, e.dyn);
+    }
+    const boost::int32_t* v = voices.range(e.voice0, e.nvoices);
+    if (e.nvoices == 1) {
+      fomus_ival(fom, fomus_par_voice, fomus_act_set, *v);
+      chk();
+    } else if (e.nvoices > 1) {
+      fomus_act(fom, fomus_par_voice, fomus_act_clear);
+      chk();
+      for (const boost::int32_t *i = v, *ie = v + e.nvoices; i < ie; ++i) {
+        fomus_ival(fom, fomus_par_voice, fomus_act_add, *i);
+        chk();
+      }
+    }
+    const fmbmark* m = marks.range(e.mark0, e.nmarks);
+    for (const fmbmark *i = m, *ie = m + e.nmarks; i < ie; ++i) {
+      fomus_sval(fom, fomus_par_markid, fomus_act_set, str(i->id));
+      chk();
+      if (i->str != fmbnone) {
+        fomus_sval(fom, fomus_par_markval, fomus_act_add, str(i->str));
+        chk();
+      }
+      if (i->num.type != module_none)
+        putval(fomus_par_markval, fomus_act_add, i->num);
+      fomus_act(fom, fomus_par_mark, fomus_act_add);
+      chk();
+    }
+    const fmbsetting* s = notesets.range(e.set0, e.nsets);
+    for (const fmbsetting *i = s, *ie = s + e.nsets; i < ie; ++i)
+      putsetting(*i, fomus_par_note_settingval);
+    fomus_act(fom,
+              e.type == fmbev_mark
+                  ? fomus_par_markevent
+                  : (e.type == fmbev_rest ? fomus_par_restevent
+                                          : fomus_par_noteevent),
+              fomus_act_add);
+    chk();
+  }
+
+  bool loader::load(const char* beg, const char* end) {
+    if ((boost::uint64_t)(end - beg) < sizeof(fmbheader))
+      throw badfmb();
+    const fmbheader& h(*(const fmbheader*) beg);
+    if (memcmp(h.magic, fmbmagic, sizeof(h.magic)) != 0)
+      throw badfmb();
+    if (h.order != fmborder) {
+      CERR << "`.fmb' file was written on a machine with a different byte "
+              "order"
+           << std::endl;
+      return true;
+    }
+    if (h.version != fmbversion) {
+      CERR << "`.fmb' file version " << h.version << " isn't supported"
+           << std::endl;
+      return true;
+    }
+    if (h.nsects > ((boost::uint64_t)(end - beg) - sizeof(fmbheader)) /
+                       sizeof(fmbsect))
+      throw badfmb();
+    const fmbsect* ss = (const fmbsect*) (beg + sizeof(fmbheader));
+    for (const fmbsect *s = ss, *se = ss + h.nsects; s < se; ++s) {
+      switch (s->kind) {
+      case fmbsect_strings:
+        getsect(beg, end, *s, strs);
+        break;
+      case fmbsect_text:
+        getsect(beg, end, *s, text);
+        break;
+      case fmbsect_settings:
+        getsect(beg, end, *s, sets);
+        break;
+      case fmbsect_values:
+        getsect(beg, end, *s, vals);
+        break;
+      case fmbsect_events:
+        getsect(beg, end, *s, evs);
+        break;
+      case fmbsect_voices:
+        getsect(beg, end, *s, voices);
+        break;
+      case fmbsect_marks:
+        getsect(beg, end, *s, marks);
+        break;
+      case fmbsect_notesets:
+        getsect(beg, end, *s, notesets);
+        break;
+      } // skip unknown sections
+    }
+    if (strs.n <= 0 || strs.recs[strs.n - 1] != 0 ||
+        (text.n > 0 && text.recs[text.n - 1] != 0))
+      throw badfmb();
+    for (const fmbsetting *i = sets.recs, *ie = sets.recs + sets.n; i < ie;
+         ++i)
+      putsetting(*i, fomus_par_settingval);
+    if (text.n > 1) {
+      fomus_parse(fom, text.recs);
+      chk();
+    }
+    rvoices.resize(voices.n + 1);
+    rmarks.resize(marks.n + 1);
+    recs.reserve(std::min((boost::uint64_t) batchsize, evs.n));
+    for (const fmbevent *i = evs.recs, *ie = evs.recs + evs.n; i < ie; ++i) {
+      fomus_note_rec r;
+      if (getrec(*i, r)) {
+        recs.push_back(r);
+        if (recs.size() >= batchsize)
+          flush();
+      } else {
+        flush();
+        putevent(*i);
+      }
+    }
+    flush();
+    return err;
+  }
+
+  struct indata {
+    bool modin_load(FOMUS fom, const char* filename, const bool isfile);
+  };
+
+  bool indata::modin_load(FOMUS fom, const char* filename, const bool isfile) {
+    if (!isfile) {
+      CERR << "`.fmb' input must be a file" << std::endl;
+      return true;
+    }
+    try {
+      boost::filesystem::path fn(filename);
+      inbuf in;
+      try {
+        if (!in.mapfile(fn.FS_FILE_STRING().c_str()))
+          in.readfile(fn.FS_FILE_STRING());
+        fomus_sval(fom, fomus_par_locfile, fomus_act_set,
+                   fn.FS_FILE_STRING().c_str());
+        loader ld(fom);
+        return ld.load(in.beg, in.end);
+      } catch (const std::ifstream::failure& e) {
+        CERR << "error reading `" << fn.FS_FILE_STRING() << '\'' << std::endl;
+        return true;
+      } catch (const badfmb& e) {
+        CERR << "invalid or corrupt `.fmb' file `" << fn.FS_FILE_STRING()
+             << '\'' << std::endl;
+        return true;
+      }
+    } catch (const boost::filesystem::filesystem_error& e) {
+      CERR << "invalid path/filename `" << filename << '\'' << std::endl;
+      return true;
+    }
+  }
+
+} // namespace fmbin
+
+using namespace fmbin;
+
+void* module_newdata(FOMUS f) {
+  return new indata;
+}
+void module_freedata(void* dat) {
+  delete (indata*) dat;
+}
+const char* module_err(void* dat) {
+  return 0;
+}
+const char* module_initerr() {
+  return 0;
+}
+
+enum module_type module_type() {
+  return module_modinput;
+}
+
+void module_init() {}
+void module_free() {}
+
+int module_get_setting(int n, module_setting* set, int id) {
+  return 0;
+}
+
+void module_ready() {}
+
+const char* modin_get_extension(int n) {
+  switch (n) {
+  case 0:
+    return "fmb";
+  default:
+    return 0;
+  }
+}
+const char* modin_get_loadid() {
+  return 0;
+}
+
+int modin_load(FOMUS fom, void* dat, const char* filename, int isfile) {
+  return ((indata*) dat)->modin_load(fom, filename, isfile);
+}
+
+const char* module_longname() {
+  return "FOMUS Binary File Input";
+}
+const char* module_author() {
+  return "(fomus)";
+}
+const char* module_doc() {
+  return "Reads `.fmb' files written by the `fmbout' module.";
+}
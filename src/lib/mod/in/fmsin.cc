@@ -68,6 +68,7 @@ namespace boostspirit = boost::spirit::classic;
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/lambda.hpp>
 
+#include <boost/cstdint.hpp>
 #include <boost/utility.hpp>
 
 #include <boost/filesystem/exception.hpp>
@@ -88,6 +89,8 @@ namespace boostspirit = boost::spirit::classic;
 #include "debugaux.h"
 #include "ferraux.h"
 using namespace ferraux;
+#include "inbufaux.h"
+using namespace inbufaux;
 
 #include "numbers.h"
 #include "parse.h"
@@ -156,6 +159,14 @@ namespace fmsin {
   typedef bracketmap::value_type bracketmaptype;
   typedef bracketmap::iterator bracketmap_it;
 
+  // input buffer handed to the fast note scanner (see fastnotes below)
+  struct fastrange {
+    const char *beg, *end;
+    const char* skip; // scanning from before this is known to fail
+    int tabchars;
+    fastrange() : beg(0), end(0), skip(0), tabchars(4) {}
+  };
+
   // scratch structure
   struct rulespackage;
   struct inscratch _NONCOPYABLE {
@@ -181,6 +192,7 @@ namespace fmsin {
     boostspirit::symbols<std::string*>& psyms;
     bool& err;
     std::auto_ptr<listelvect> autolst;
+    fastrange fast;
 
     inscratch(const FOMUS fo, const std::string& file,
               boostspirit::symbols<std::string*>& psyms, bool& err)
@@ -1817,6 +1829,320 @@ public:
       -,
       boostspirit::eps_p(~boostspirit::ch_p('<') & ~boostspirit::ch_p('(')) >>
           strmatch(xx.str, ";")[insstrval(xx, fomus_par_part, fomus_act_set)])
+  // ------------------------------------------------------------------------------------------------------------------------
+  // FAST NOTE SCANNER
+  // Generated .fms files are mostly long runs of plain entries like `time
+  // 1+1/2 dur 1/2 pitch 60 dyn 0.5 ;'.  These are scanned straight off the
+  // input buffer and handed to the API in the same order the grammar would
+  // hand them.  A statement is only entered after it has been scanned to its
+  // `;', anything else (signs, note names, marks, brackets, comments, macros)
+  // is left to the grammar.
+
+  enum fastclass {
+    fc_other = 0,
+    fc_space,
+    fc_alpha,
+    fc_digit,
+    fc_enter, // ; ,
+    fc_eql,   // : =
+    fc_dot
+  };
+  struct fastclasses {
+    unsigned char c[256];
+    fastclasses() {
+      std::fill(c, c + 256, (unsigned char) fc_other);
+      c[(unsigned char) ' '] = c[(unsigned char) '\t'] =
+          c[(unsigned char) '\n'] = c[(unsigned char) '\v'] =
+              c[(unsigned char) '\f'] = c[(unsigned char) '\r'] = fc_space;
+      for (int i = 'a'; i <= 'z'; ++i)
+        c[i] = c[i - 'a' + 'A'] = fc_alpha;
+      for (int i = '0'; i <= '9'; ++i)
+        c[i] = fc_digit;
+      c[(unsigned char) ';'] = c[(unsigned char) ','] = fc_enter;
+      c[(unsigned char) ':'] = c[(unsigned char) '='] = fc_eql;
+      c[(unsigned char) '.'] = fc_dot;
+    }
+    int operator[](const char x) const {
+      return c[(unsigned char) x];
+    }
+  };
+  const fastclasses fastcls;
+
+  // same table as evconts (minus `part', which takes a string)
+  struct fastkeyword {
+    const char* name;
+    fomus_param par;
+  };
+  const fastkeyword fastkeywords[] = {
+      {"time", fomus_par_time},         {"tim", fomus_par_time},
+      {"ti", fomus_par_time},           {"t", fomus_par_time},
+      {"grace", fomus_par_gracetime},   {"gra", fomus_par_gracetime},
+      {"gr", fomus_par_gracetime},      {"g", fomus_par_gracetime},
+      {"duration", fomus_par_duration}, {"dur", fomus_par_duration},
+      {"du", fomus_par_duration},       {"d", fomus_par_duration},
+      {"pitch", fomus_par_pitch},       {"pit", fomus_par_pitch},
+      {"pi", fomus_par_pitch},          {"p", fomus_par_pitch},
+      {"dynamic", fomus_par_dynlevel},  {"dyn", fomus_par_dynlevel},
+      {"dy", fomus_par_dynlevel},       {"y", fomus_par_dynlevel},
+      {"voice", fomus_par_voice},       {"voi", fomus_par_voice},
+      {"vo", fomus_par_voice},          {"v", fomus_par_voice}};
+  const fastkeyword* const fastkeywordsend =
+      fastkeywords + sizeof(fastkeywords) / sizeof(fastkeyword);
+
+  inline bool getfastkeyword(const char* s, const char* e, fomus_param& par) {
+    char w[9];
+    if (e - s >= (std::ptrdiff_t) sizeof(w))
+      return false;
+    char* x = w;
+    while (s < e)
+      *x++ = *s++ | 0x20; // all alpha, so this lowercases (as_lower_d)
+    *x = 0;
+    for (const fastkeyword* i = fastkeywords; i < fastkeywordsend; ++i) {
+      if (strcmp(w, i->name) == 0) {
+        par = i->par;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // digits only, no sign (a sign means inc/dec to the grammar)
+  inline const char* getfastuint(const char* s, const char* e, fint& v,
+                                 int& n) {
+    const char* x = s;
+    v = 0;
+    while (x < e && fastcls[*x] == fc_digit)
+      v = v * 10 + (*x++ - '0');
+    n = x - s;
+    return (n > 0 && n <= 18) ? x : 0; // longer ones might overflow
+  }
+
+  // unsigned version of numbermatch: 1, 1.5, .5, 1/2, 1+1/2, 1-1/2
+  const char* getfastnumb(const char* s, const char* e, numb& num) {
+    fint a, b, c;
+    int n;
+    const char* x;
+    if (s < e && fastcls[*s] == fc_dot) {
+      a = 0;
+      x = s;
+    } else {
+      x = getfastuint(s, e, a, n);
+      if (!x)
+        return 0;
+      if (x >= e)
+        return 0;
+      switch (*x) {
+      case '/':
+        x = getfastuint(x + 1, e, b, n);
+        if (!x || b == 0)
+          return 0; // grammar reports division by zero
+        num = rat(a, b);
+        return x;
+      case '+':
+      case '-': {
+        const char o = *x;
+        x = getfastuint(x + 1, e, b, n);
+        if (!x || x >= e || *x != '/')
+          return 0;
+        x = getfastuint(x + 1, e, c, n);
+        if (!x || c == 0)
+          return 0;
+        num = (o == '+' ? a + rat(b, c) : a - rat(b, c));
+        return x;
+      }
+      }
+      if (fastcls[*x] != fc_dot) {
+        num = a;
+        return x;
+      }
+    }
+    fint f = 0;
+    x = (x + 1 < e && fastcls[x[1]] == fc_digit) ? getfastuint(x + 1, e, f, n)
+                                                  : (n = 0, x + 1);
+    if (!x || (n == 0 && fastcls[*s] == fc_dot))
+      return 0;
+    num = (ffloat) a + (n > 0 ? (ffloat) f / std::pow((ffloat) 10, n) : 0);
+    return x;
+  }
+
+  inline const char* skipfastspace(const char* s, const char* e) {
+    while (s < e && fastcls[*s] == fc_space)
+      ++s;
+    return s;
+  }
+
+  struct fastentry {
+    const char* at;
+    fomus_param par;
+    numb num;
+  };
+  const int fastmaxents = 16;
+
+  // scan one statement, returns its `;' (or 0 and where it stopped)
+  const char* scanfaststmt(const char* s, const char* e, fastentry* ents,
+                           int& n, const char*& stop) {
+    n = 0;
+    while (true) {
+      s = skipfastspace(s, e);
+      stop = s;
+      if (s >= e)
+        return 0;
+      int c = fastcls[*s];
+      if (c == fc_enter)
+        return s;
+      if (c != fc_alpha || n >= fastmaxents)
+        return 0;
+      const char* x = s;
+      while (x < e && fastcls[*x] == fc_alpha)
+        ++x;
+      fastentry& en = ents[n];
+      if (x >= e || !getfastkeyword(s, x, en.par))
+        return 0;
+      c = fastcls[*x];
+      if (c != fc_space && c != fc_eql && c != fc_digit && c != fc_dot)
+        return 0; // what symmatch allows after a keyword, minus `+-*/('
+      x = skipfastspace(x, e);
+      if (x < e && fastcls[*x] == fc_eql)
+        x = skipfastspace(x + 1, e);
+      stop = x;
+      x = getfastnumb(x, e, en.num);
+      if (!x || x >= e)
+        return 0;
+      c = fastcls[*x];
+      if (c != fc_space && c != fc_enter) {
+        stop = x;
+        return 0;
+      }
+      en.at = s;
+      ++n;
+      s = x;
+    }
+  }
+
+  // line/column are only worked out from the last position the cursor was
+  // at when a note is entered, 8 bytes at a time where there's nothing to
+  // count
+  inline bool swarhas(const boost::uint64_t w, const unsigned char ch) {
+    const boost::uint64_t ones = 0x0101010101010101ULL;
+    const boost::uint64_t x = w ^ (ones * ch);
+    return ((x - ones) & ~x & (ones << 7)) != 0;
+  }
+  struct fastcursor {
+    const char* at;
+    const char* end;
+    int line, col, tabs;
+    fastcursor(const char* at, const char* end, const int line, const int col,
+               const int tabs)
+        : at(at), end(end), line(line), col(col), tabs(tabs) {}
+    void advance(const char* to) { // same counting as position_iterator
+      while (at < to) {
+        if (to - at >= 8) {
+          boost::uint64_t w;
+          memcpy(&w, at, 8);
+          if (!swarhas(w, '\n') && !swarhas(w, '\r') && !swarhas(w, '\t')) {
+            at += 8;
+            col += 8;
+            continue;
+          }
+        }
+        switch (*at++) {
+        case '\n':
+          ++line;
+          col = 1;
+          break;
+        case '\r':
+          if (at >= end || *at != '\n') {
+            ++line;
+            col = 1;
+          }
+          break;
+        case '\t':
+          col += tabs - (col - 1) % tabs;
+          break;
+        default:
+          ++col;
+        }
+      }
+    }
+  };
+
+  // values only get a position if entering one fails (the checks happen
+  // when the note is entered), the note itself always needs one--the
+  // library keeps it for later messages about the note
+  inline void fastfilepos(inscratch& xx, fastcursor& cur, const char* at) {
+    cur.advance(at);
+    xx.pos.line = cur.line;
+    xx.pos.col = cur.col;
+    fomus_ival(xx.fom, fomus_par_locline, fomus_act_set, cur.line);
+    if (fomus_err()) {
+      xx.err = true;
+      DBG("FOMUS_ERR() WAS SET!");
+    }
+    fomus_ival(xx.fom, fomus_par_loccol, fomus_act_set, cur.col);
+    if (fomus_err()) {
+      xx.err = true;
+      DBG("FOMUS_ERR() WAS SET!");
+    }
+  }
+
+  // enters as many plain statements as it can, -1 if it couldn't do the first
+  std::ptrdiff_t fastnotes(inscratch& xx, parse_it& first) {
+    fastrange& fr = xx.fast;
+    const char* s = first.base();
+    if (xx.pos.maccnt > 0 || s < fr.beg || s >= fr.end || s < fr.skip)
+      return -1;
+    const boostspirit::file_position_base<std::string>& o(
+        first.get_position());
+    fastcursor cur(s, fr.end, o.line, o.column, fr.tabchars);
+    fastentry ents[fastmaxents];
+    const char* p = s;
+    while (true) {
+      int n;
+      const char* stop;
+      const char* t =
+          scanfaststmt(skipfastspace(p, fr.end), fr.end, ents, n, stop);
+      if (!t) {
+        fr.skip = stop;
+        break;
+      }
+      for (const fastentry *i = ents, *ie = ents + n; i < ie; ++i) {
+        insnumb(xx.fom, i->par, fomus_act_set, i->num);
+        if (fomus_err()) {
+          xx.err = true;
+          DBG("FOMUS_ERR() WAS SET!");
+          fastfilepos(xx, cur, i->at); // for whatever gets reported next
+        }
+      }
+      fastfilepos(xx, cur, t);
+      fomus_act(xx.fom, fomus_par_noteevent, fomus_act_add);
+      if (fomus_err()) {
+        xx.err = true;
+        DBG("FOMUS_ERR() WAS SET!");
+      }
+      p = t + 1;
+    }
+    if (p == s)
+      return -1;
+    cur.advance(p);
+    xx.isplus = xx.isplus2 = false;
+    xx.attop = false;
+    parse_it x(p, fr.end,
+               boostspirit::file_position_base<std::string>(
+                   o.file, cur.line, cur.col));
+    x.set_tabchars(fr.tabchars);
+    first = x;
+    return p - s;
+  }
+  struct fastnotes_f {
+    typedef boostspirit::nil_t result_t;
+    inscratch& xx;
+    fastnotes_f(inscratch& xx) : xx(xx) {}
+    template <typename ScannerT>
+    std::ptrdiff_t operator()(ScannerT const& scan, result_t& result) const {
+      return fastnotes(xx, scan.first);
+    }
+  };
+
   struct istop_f {
     typedef boostspirit::nil_t result_t;
     bool& attop;
@@ -1840,8 +2166,9 @@ public:
         ((boostspirit::symbols<parserule*>&), metconts),
         ((boostspirit::symbols<parserule*>&), macconts))),
       -,
-      recerrpos(xx.pos.file, xx.pos.line, xx.pos.col,
-                xx.pos.maccnt)[dofilepos(xx)] >>
+      boostspirit::functor_parser<fastnotes_f>(fastnotes_f(xx)) |
+          recerrpos(xx.pos.file, xx.pos.line, xx.pos.col,
+                    xx.pos.maccnt)[dofilepos(xx)] >>
 #ifndef NDEBUGOUT
               ((symmatch(evconts, rule,
                          ":=0123456789+-*/.(")[printstr("ENTRY")] >>
@@ -2204,22 +2531,16 @@ bool indata::modin_load(
   if (isfile) {
     try {
       boost::filesystem::path fn(filename);
-      boost::filesystem::ifstream f;
+      inbuf in;
       try {
-        f.exceptions(boost::filesystem::ifstream::eofbit |
-                     boost::filesystem::ifstream::failbit |
-                     boost::filesystem::ifstream::badbit);
-        f.open(fn.FS_FILE_STRING(), boost::filesystem::ifstream::in |
-                                        boost::filesystem::ifstream::ate |
-                                        boost::filesystem::ifstream::binary);
-        long l = f.tellg();
-        f.seekg(0);
-        std::vector<char> buf(l + 1);
-        f.read(&buf[0], l);
-        buf[l] = 0;
-        parse_it p(&buf[0], &buf[l]);
+        if (!in.mapfile(fn.FS_FILE_STRING().c_str()))
+          in.readfile(fn.FS_FILE_STRING());
+        parse_it p(in.beg, in.end);
         settingslist sts(fom); // need to keep this for recursive parts
         rulespackage pkg(fom, stdtostr(fn.FS_FILE_STRING()), *this, err, sts);
+        pkg.xx.fast.beg = in.beg;
+        pkg.xx.fast.end = in.end;
+        pkg.xx.fast.tabchars = tabchars;
         p.set_tabchars(tabchars);
         p.set_position(boostspirit::file_position_base<std::string>(
             stdtostr(fn.FS_FILE_STRING())));
@@ -2230,7 +2551,6 @@ bool indata::modin_load(
           DBG("FOMUS_ERR() WAS SET!");
         }
         parse(p, parse_it(), pkg.rules);
-        f.close();
       } catch (const std::ifstream::failure& e) {
         CERR << "error reading `" << fn.FS_FILE_STRING() << '\'' << std::endl;
         return true;
@@ -2249,6 +2569,9 @@ bool indata::modin_load(
     settingslist sts(fom); // need to keep this for recursive parts
     rulespackage pkg(fom, /*stdtostr(fn.FS_FILE_STRING())*/ "", *this, err,
                      sts);
+    pkg.xx.fast.beg = filename;
+    pkg.xx.fast.end = filename + strlen(filename);
+    pkg.xx.fast.tabchars = tabchars;
     p.set_tabchars(tabchars);
     p.set_position(boostspirit::file_position_base<std::string>(""));
     fomus_sval(fom, fomus_par_locfile, fomus_act_set, "");
@@ -25,6 +25,7 @@
 #include <boost/cstdint.hpp>
 #include <boost/ptr_container/ptr_list.hpp>
 #include <cassert>
+#include <cstring>
 #include <limits>
 #include <set>
 #include <sstream>
@@ -181,13 +182,14 @@ namespace midiin {
     std::string setperc;
     std::vector<int> setvoices;
     fomus_float tpose;
+    mutable int partid; // from fomus_intern_part()
     importstr(const module_obj imp, const std::string& p)
         : pname(p), trackname(module_setting_sval(imp, tracknameid)),
           seqname(module_setting_sval(imp, seqnameid)),
           filename(module_setting_sval(imp, filenamematchid)),
           inname(module_setting_sval(imp, innameid)),
           setperc(module_setting_sval(imp, setpercid)),
-          tpose(module_setting_fval(imp, tposeid)) {
+          tpose(module_setting_fval(imp, tposeid)), partid(-1) {
       fillup(trs, imp, trackid);
       fillup(chs, imp, chanid);
       fillup(prgs, imp, progid);
@@ -208,18 +210,27 @@ namespace midiin {
     bool haspartname(const std::string& nm) const {
       return boost::algorithm::ilexicographical_compare(nm, pname);
     }
-    void setpartandpitch(FOMUS fom, const int pit) const {
-      if (setperc.empty()) { // pitch
-        fomus_fval(fom, fomus_par_pitch, fomus_act_set, pit + tpose);
-      } else
-        fomus_sval(fom, fomus_par_pitch, fomus_act_set, setperc.c_str());
-      fomus_act(fom, fomus_par_voice, fomus_act_clear);
-      for (std::vector<int>::const_iterator i(setvoices.begin());
-           i != setvoices.end(); ++i) {
-        fomus_ival(fom, fomus_par_voice, fomus_act_add, *i);
+    void addnote(FOMUS fom, const int pit, const fomus_float t,
+                 const fomus_float d, const fomus_float dyn) const {
+      if (partid < 0) {
+        partid = fomus_intern_part(fom, pname.c_str());
+        if (partid < 0) // same error as before
+          fomus_sval(fom, fomus_par_part, fomus_act_set, pname.c_str());
       }
-      fomus_sval(fom, fomus_par_part, fomus_act_set, pname.c_str());
-      fomus_act(fom, fomus_par_noteevent, fomus_act_add);
+      fomus_note_rec r;
+      memset(&r, 0, sizeof(r));
+      r.flags = fomus_note_float;
+      r.part = partid;
+      r.ftime = t;
+      r.fdur = d;
+      r.dyn = dyn;
+      if (setperc.empty()) // pitch
+        r.fpitch = pit + tpose;
+      else
+        r.perc = setperc.c_str();
+      r.nvoices = setvoices.size();
+      r.voices = setvoices.empty() ? 0 : &setvoices[0];
+      fomus_add_notes(fom, &r, 1);
     }
     bool midimatches(const int track, const int channel, const int prog,
                      const int note, const std::string& trackname0,
@@ -516,13 +527,12 @@ namespace midiin {
                 t *= (60.0 / tempo); // presumeably need to convert to beats (or
                                      // "quarternotes") using tempo (?)
               t = ltrtime + t;       // absolute time, supposedly in beats
-              fomus_fval(fom, fomus_par_time, fomus_act_set, t * scale);
+              t *= scale;
               double d = (i->tim - o->tim) / rate;
               if (secs)
                 d *= (60.0 / tempo);
-              fomus_fval(fom, fomus_par_duration, fomus_act_set, d * scale);
-              fomus_fval(fom, fomus_par_dynlevel, fomus_act_set,
-                         o->val2 / 127.0);
+              d *= scale;
+              const fomus_float dyn = o->val2 / 127.0;
               if (areparts) { // if areparts, then impmap contains user's parts
                 for (boost::ptr_list<importstr>::const_iterator j(
                          impmap.begin());
@@ -531,7 +541,7 @@ namespace midiin {
                             // multiple parts
                   if (j->midimatches(o->tr, o->ch, progs[o->ch], o->val1,
                                      o->trname, seqname, basefn, o->inname)) {
-                    j->setpartandpitch(fom, o->val1); // and add the note event
+                    j->addnote(fom, o->val1, t, d, dyn); // add the note event
                   }
                 }
               } else { // iterator through all on-thefly added parts--add only
@@ -542,7 +552,7 @@ namespace midiin {
                      j != impmap2.end(); ++j) { // impmap2 is on the fly
                   if (j->midimatches(o->tr, o->ch, progs[o->ch], o->val1,
                                      o->trname, seqname, basefn, o->inname)) {
-                    j->setpartandpitch(fom, o->val1); // and add the note event
+                    j->addnote(fom, o->val1, t, d, dyn); // add the note event
                     goto ALLDONEWITHNOTEOFF;
                   }
                 }
@@ -581,7 +591,8 @@ namespace midiin {
                       fout << "adding part `" << nm << "' using instrument `"
                            << j->pname << '\'' << std::endl;
                     j->pname = nm; // pname is now the new part name
-                    j->setpartandpitch(fom, o->val1); // and add the note event
+                    j->partid = -1;
+                    j->addnote(fom, o->val1, t, d, dyn); // add the note event
                     impmap2.transfer(impmap2.end(), j, impmap);
                     goto ALLDONEWITHNOTEOFF;
                   }
@@ -146,7 +146,7 @@ enum module_type module_type() {
   return module_modmarks;
 }
 int module_itertype() {
-  return module_bymeas | module_byvoice;
+  return module_bymeas | module_byvoice | module_partlocal;
 }
 const char* module_initerr() {
   return 0;
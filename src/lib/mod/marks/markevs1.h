@@ -21,6 +21,8 @@
 #ifndef FOMUSMOD_MARKEVS1_H
 #define FOMUSMOD_MARKEVS1_H
 
+#include "module.h" // module_partlocal
+
 namespace markevs1 {
 
   extern const char* ierr;
@@ -54,7 +56,7 @@ namespace markevs1 {
   inline void free() {}
   int get_setting(int n, module_setting* set, int id);
   inline int itertype() {
-    return module_bypart /*| module_byvoice*/;
+    return module_bypart | module_partlocal /*| module_byvoice*/;
   }
   void fill_iface(void* moddata, void* iface);
   inline const char* engine() {
@@ -21,6 +21,8 @@
 #ifndef FOMUSMOD_MARKEVS2_H
 #define FOMUSMOD_MARKEVS2_H
 
+#include "module.h" // module_partlocal
+
 namespace markevs2 {
 
   extern const char* ierr;
@@ -54,7 +56,7 @@ namespace markevs2 {
   inline void free() {}
   int get_setting(int n, module_setting* set, int id);
   inline int itertype() {
-    return module_bypart | module_byvoice;
+    return module_bypart | module_byvoice | module_partlocal;
   }
   void fill_iface(void* moddata, void* iface);
   inline const char* engine() {
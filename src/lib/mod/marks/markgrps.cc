@@ -431,7 +431,7 @@ const char* module_initerr() {
 void module_init() {}
 void module_free() {}
 int module_itertype() {
-  return module_bypart | module_byvoice;
+  return module_bypart | module_byvoice | module_partlocal;
 }
 int module_engine_iface() {
   return ENGINE_INTERFACEID;
@@ -57,7 +57,7 @@ namespace marks {
   int get_setting(int n, module_setting* set, int id);
 
   inline int itertype() {
-    return module_bymeas | module_byvoice;
+    return module_bymeas | module_byvoice | module_partlocal;
   }
   //   inline int engine_iface() {return ENGINE_INTERFACEID;}
   //   inline const char* engine() {return "dumb";}
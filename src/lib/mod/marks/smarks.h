@@ -57,7 +57,8 @@ namespace smarks {
   int get_setting(int n, module_setting* set, int id);
 
   inline int itertype() {
-    return module_bypart | module_bystaff /*| module_norests*/;
+    return module_bypart | module_bystaff |
+           module_partlocal /*| module_norests*/;
   }
   //   inline int engine_iface() {return ENGINE_INTERFACEID;}
   //   inline const char* engine() {return "dumb";}
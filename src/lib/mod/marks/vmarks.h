@@ -54,7 +54,8 @@ namespace vmarks {
   inline void init() {}
   inline void free() {}
   inline int itertype() {
-    return module_bypart | module_byvoice /*| module_norests*/;
+    return module_bypart | module_byvoice |
+           module_partlocal /*| module_norests*/;
   }
   void fill_iface(void* moddata, void* iface);
   int get_setting(int n, module_setting* set, int id);
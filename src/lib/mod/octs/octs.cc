@@ -355,7 +355,8 @@ enum module_type module_type() {
   return module_modocts;
 }
 int module_itertype() {
-  return module_bypart | module_bystaff | module_norests /*| module_firsttied*/;
+  return module_bypart | module_bystaff | module_norests |
+         module_partlocal /*| module_firsttied*/;
 }
 const char* module_initerr() {
   return ierr;
@@ -47,11 +47,15 @@ namespace execout {
   typedef boost::iostreams::stream<boost::iostreams::file_descriptor_source>
       execout;
   typedef pid_t execpid;
-  inline void waituntildone(const execpid pid) {
+  // exit status, -1 if the process was killed by a signal
+  inline int waitforexit(const execpid pid) {
     int st;
     if (waitpid(pid, &st, 0) < 0)
       throw execerr();
-    if ((WIFEXITED(st) && WEXITSTATUS(st)) || WIFSIGNALED(st))
+    return WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+  }
+  inline void waituntildone(const execpid pid) {
+    if (waitforexit(pid))
       throw execerr();
   }
   execpid exec(execout* out, const char* path,
@@ -111,13 +115,16 @@ public:
     }
   };
   typedef std::auto_ptr<procinfo> execpid;
-  inline void waituntildone(execpid& pid) {
+  inline int waitforexit(execpid& pid) {
     if (WaitForSingleObject(pid->hProcess, INFINITE) != WAIT_OBJECT_0)
       throw execerr();
     DWORD x;
     if (!GetExitCodeProcess(pid->hProcess, &x))
       throw execerr();
-    if (x)
+    return x;
+  }
+  inline void waituntildone(execpid& pid) {
+    if (waitforexit(pid))
       throw execerr();
   }
   execpid exec(execout* out, const char* path,
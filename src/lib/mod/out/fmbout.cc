@@ -0,0 +1,426 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// output a binary .fmb score file
+#include "config.h"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "fomusapi.h"
+#include "infoapi.h"
+#include "module.h"
+
+#include "ferraux.h"
+using namespace ferraux;
+#include "fmbaux.h"
+using namespace fmbaux;
+#include "sinkaux.h"
+
+#ifdef BOOST_FILESYSTEM_OLDAPI
+#define FS_FILE_STRING file_string
+#else
+#define FS_FILE_STRING string
+#endif
+
+namespace fmbout {
+
+  const char* ierr = 0;
+
+  int filenameid, outputid, nthreadsid, nbeatsid;
+  std::set<int> mustbefirst; // same as fmsout
+
+  // each distinct string is stored once
+  class strtable {
+    std::string buf;
+    std::map<std::string, boost::uint32_t> offs;
+
+public:
+    strtable() : buf(1, 0) {}
+    boost::uint32_t get(const char* s) {
+      if (!s || !*s)
+        return 0;
+      std::map<std::string, boost::uint32_t>::iterator i(offs.find(s));
+      if (i != offs.end())
+        return i->second;
+      boost::uint32_t o = buf.size();
+      buf.append(s, strlen(s) + 1);
+      offs.insert(std::map<std::string, boost::uint32_t>::value_type(s, o));
+      return o;
+    }
+    const std::string& str() const {
+      return buf;
+    }
+  };
+
+  struct outsect {
+    fmbsect_kind kind;
+    boost::uint32_t size;
+    boost::uint64_t count;
+    const void* dat;
+  };
+
+  struct outdata {
+    strtable strs;
+    std::vector<fmbsetting> sets, notesets;
+    std::vector<fmbval> vals;
+    std::vector<fmbevent> evs;
+    std::vector<boost::int32_t> voices;
+    std::vector<fmbmark> marks;
+    std::ostringstream defs, meass, pmeass;
+
+    void putval(fmbval& r, const module_value& x);
+    void putsetting(std::vector<fmbsetting>& v, const char* name,
+                    const module_value& x);
+    void putmeas(module_measobj m);
+    void putevent(module_noteobj n, const bool ism);
+    void modout_write(FOMUS fom, const char* filename);
+  };
+
+  void outdata::putval(fmbval& r, const module_value& x) {
+    memset(&r, 0, sizeof(r));
+    r.type = x.type;
+    switch (x.type) {
+    case module_int:
+      r.v.i = x.val.i;
+      break;
+    case module_rat:
+      r.v.i = x.val.r.num;
+      r.den = x.val.r.den;
+      break;
+    case module_float:
+      r.v.f = x.val.f;
+      break;
+    case module_string:
+      r.v.s = strs.get(x.val.s);
+      break;
+    case module_list: {
+      boost::uint64_t b = vals.size();
+      r.n = x.val.l.n;
+      r.v.s = b;
+      vals.resize(b + x.val.l.n); // elements are contiguous
+      for (int i = 0; i < x.val.l.n; ++i) {
+        fmbval e;
+        putval(e, x.val.l.vals[i]); // might grow `vals'
+        vals[b + i] = e;
+      }
+    } break;
+    default:
+      r.type = module_none;
+    }
+  }
+
+  void outdata::putsetting(std::vector<fmbsetting>& v, const char* name,
+                           const module_value& x) {
+    fmbsetting s;
+    memset(&s, 0, sizeof(s));
+    s.name = strs.get(name);
+    putval(s.val, x);
+    v.push_back(s);
+  }
+
+  // measures stay `.fms' text--measure definitions are nested settings
+  void outdata::putmeas(module_measobj m) {
+    module_partobj p = module_part(m);
+    std::ostringstream& o(p ? pmeass : meass);
+    if (p)
+      o << "part " << module_id(p) << ' ';
+    o << "time " << module_valuetostr(module_vtime(m)) << ' ';
+    if (module_setting_rval(m, nbeatsid) <= (fomus_int) 0)
+      o << "duration " << module_valuetostr(module_vdur(m)) << ' ';
+    o << info_valstr(m) << '\n';
+  }
+
+  void outdata::putevent(module_noteobj n, const bool ism) {
+    fmbevent e;
+    memset(&e, 0, sizeof(e));
+    e.type = ism ? fmbev_mark : (module_isrest(n) ? fmbev_rest : fmbev_note);
+    e.part = strs.get(module_id(module_part(n)));
+    putval(e.time, module_vtime(n));
+    putval(e.grace, module_vgracetime(n));
+    putval(e.dur, module_vdur(n));
+    if (e.type == fmbev_note) {
+      if (module_isperc(n)) {
+        module_value x;
+        x.type = module_string;
+        x.val.s = module_percinststr(n);
+        putval(e.pitch, x);
+      } else
+        putval(e.pitch, module_vpitch(n));
+      putval(e.dyn, module_dyn(n));
+    } else {
+      e.pitch.type = module_none;
+      e.dyn.type = module_none;
+    }
+    module_intslist vl(module_voices(n));
+    e.voice0 = voices.size();
+    e.nvoices = vl.n;
+    voices.insert(voices.end(), vl.ints, vl.ints + vl.n);
+    module_markslist ml(module_marks(n));
+    e.mark0 = marks.size();
+    e.nmarks = ml.n;
+    for (const module_markobj *i = ml.marks, *ie = ml.marks + ml.n; i < ie;
+         ++i) {
+      fmbmark m;
+      memset(&m, 0, sizeof(m));
+      m.id = strs.get(module_id(*i));
+      const char* s = module_markstring(*i);
+      m.str = s ? strs.get(s) : fmbnone;
+      putval(m.num, module_marknum(*i));
+      marks.push_back(m);
+    }
+    info_setlist ss(info_get_settings(n));
+    e.set0 = notesets.size();
+    e.nsets = ss.n;
+    for (const info_setting *i = ss.sets, *ie = ss.sets + ss.n; i < ie; ++i)
+      putsetting(notesets, i->name, i->val);
+    evs.push_back(e);
+  }
+
+  inline void putobjs(std::ostream& o, const char* typ,
+                      const info_objinfo_list& l) {
+    for (const info_objinfo *i = l.objs, *e = l.objs + l.n; i < e; ++i)
+      o << typ << ' ' << i->valstr << '\n';
+  }
+
+  template <typename T>
+  inline void addsect(std::vector<outsect>& ss, const fmbsect_kind kind,
+                      const std::vector<T>& v) {
+    outsect s = {kind, sizeof(T), v.size(), v.empty() ? 0 : &v[0]};
+    ss.push_back(s);
+  }
+  inline void addsect(std::vector<outsect>& ss, const fmbsect_kind kind,
+                      const std::string& v) {
+    outsect s = {kind, 1, v.size(), v.data()};
+    ss.push_back(s);
+  }
+
+  void outdata::modout_write(FOMUS fom, const char* filename) {
+    { // settings set in the score, the ones others depend on go first
+      info_setfilter fi = {0, 0, 0, module_nomodtype, 0, module_noloc, 3,
+                           info_global};
+      info_setfilterlist fl = {1, &fi};
+      info_sortpair so[] = {{info_modname, info_ascending},
+                            {info_setname, info_ascending}};
+      info_sortlist sl = {2, so};
+      info_setlist l(info_list_settings(fom, &fl, 0, &sl, 0));
+      for (int pass = 0; pass < 2; ++pass) {
+        for (info_setting *i = l.sets, *ie = l.sets + l.n; i < ie; ++i) {
+          if (i->id == filenameid || i->id == outputid || i->id == nthreadsid)
+            continue;
+          if ((mustbefirst.find(i->id) != mustbefirst.end()) == (pass == 0))
+            putsetting(sets, i->name, i->val);
+        }
+      }
+    }
+    putobjs(defs, "percinst", info_get_percinsts(fom));
+    putobjs(defs, "inst", info_get_insts(fom));
+    putobjs(defs, "part", info_get_parts(fom));
+    putobjs(defs, "metapart", info_get_metaparts(fom));
+    putobjs(defs, "measdef", info_get_measdefs(fom));
+    while (true) {
+      module_measobj m = module_nextmeas();
+      if (!m)
+        break;
+      putmeas(m);
+    }
+    while (true) {
+      module_noteobj n = module_nextnote();
+      if (!n)
+        break;
+      putevent(n, false);
+      module_skipassign(n);
+    }
+    while (true) {
+      module_partobj p = module_nextpart();
+      if (!p)
+        break;
+      module_objlist me(module_getmarkevlist(p));
+      for (const module_obj *i = me.objs, *ie = me.objs + me.n; i < ie; ++i)
+        putevent(*i, true);
+    }
+    std::string text(defs.str() + meass.str() + pmeass.str());
+    text += '\0'; // parsed in place
+    std::vector<outsect> ss;
+    addsect(ss, fmbsect_strings, strs.str());
+    addsect(ss, fmbsect_text, text);
+    addsect(ss, fmbsect_settings, sets);
+    addsect(ss, fmbsect_values, vals);
+    addsect(ss, fmbsect_events, evs);
+    addsect(ss, fmbsect_voices, voices);
+    addsect(ss, fmbsect_marks, marks);
+    addsect(ss, fmbsect_notesets, notesets);
+    try {
+      boost::filesystem::path fn(filename);
+      sinkaux::outfile f;
+      try {
+        f.exceptions(boost::filesystem::ofstream::eofbit |
+                     boost::filesystem::ofstream::failbit |
+                     boost::filesystem::ofstream::badbit);
+        f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::binary);
+        fmbheader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, fmbmagic, sizeof(h.magic));
+        h.version = fmbversion;
+        h.order = fmborder;
+        h.nsects = ss.size();
+        f.write((const char*) &h, sizeof(h));
+        boost::uint64_t o =
+            fmbalign(sizeof(fmbheader) + ss.size() * sizeof(fmbsect));
+        for (std::vector<outsect>::const_iterator i(ss.begin()); i != ss.end();
+             ++i) {
+          fmbsect s = {(boost::uint32_t) i->kind, i->size, i->count, o};
+          f.write((const char*) &s, sizeof(s));
+          o = fmbalign(o + i->size * i->count);
+        }
+        static const char zeros[8] = {0};
+        boost::uint64_t at = sizeof(fmbheader) + ss.size() * sizeof(fmbsect);
+        for (std::vector<outsect>::const_iterator i(ss.begin()); i != ss.end();
+             ++i) {
+          f.write(zeros, fmbalign(at) - at);
+          at = fmbalign(at);
+          f.write((const char*) i->dat, i->size * i->count);
+          at += i->size * i->count;
+        }
+        f.close();
+      } catch (const boost::filesystem::ofstream::failure& e) {
+        CERR << "error writing `" << fn.FS_FILE_STRING() << '\'' << std::endl;
+      }
+    } catch (const boost::filesystem::filesystem_error& e) {
+      CERR << "invalid path/filename `" << filename << '\'' << std::endl;
+    }
+  }
+
+} // namespace fmbout
+
+using namespace fmbout;
+// ------------------------------------------------------------------------------------------------------------------------
+// END OF NAMESPACE
+
+const char* module_longname() {
+  return "FOMUS Binary File Output";
+}
+const char* module_author() {
+  return "(fomus)";
+}
+const char* module_doc() {
+  return "Writes `.fmb' files, a binary form of FOMUS's input (events, parts, "
+         "definitions and settings) that is read without going through the "
+         "`.fms' parser.";
+}
+void* module_newdata(FOMUS f) {
+  return new fmbout::outdata;
+}
+void module_freedata(void* dat) {
+  delete (fmbout::outdata*) dat;
+}
+const char* module_err(void* dat) {
+  return 0;
+}
+
+enum module_type module_type() {
+  return module_modoutput;
+}
+const char* module_initerr() {
+  return ierr;
+}
+int module_itertype() {
+  return module_all;
+}
+
+void module_init() {}
+void module_free() {}
+
+int module_get_setting(int n, struct module_setting* set, int id) {
+  return 0;
+}
+
+void module_ready() {
+  const char* fi[] = {"note-accs",    "note-microtones", "note-octaves",
+                      "note-symbols", "dur-dots",        "dur-symbols",
+                      "dur-tie",      "tuplet-symbols"};
+  for (const char **i = fi, **ie = fi + sizeof(fi) / sizeof(const char*);
+       i < ie; ++i) {
+    int id = module_settingid(*i);
+    if (id < 0) {
+      ierr = "missing required setting"; // (shouldn't happen)
+      return;
+    }
+    mustbefirst.insert(id);
+  }
+  nbeatsid = module_settingid("measdur");
+  if (nbeatsid < 0) {
+    ierr = "missing required setting `measdur'";
+    return;
+  }
+  filenameid = module_settingid("filename");
+  if (filenameid < 0) {
+    ierr = "missing required setting `filename'";
+    return;
+  }
+  outputid = module_settingid("output");
+  if (outputid < 0) {
+    ierr = "missing required setting `output'";
+    return;
+  }
+  nthreadsid = module_settingid("n-threads");
+  if (nthreadsid < 0) {
+    ierr = "missing required setting `n-threads'";
+    return;
+  }
+}
+
+// like fmsout, writes the input before anything is processed
+fomus_bool modout_ispre() {
+  return true;
+}
+
+const char* modout_get_extension(int n) {
+  switch (n) {
+  case 0:
+    return "fmb";
+  default:
+    return 0;
+  }
+}
+
+const char* modout_get_saveid() {
+  return 0;
+}
+
+void modout_write(FOMUS f, void* dat, const char* filename) {
+  ((fmbout::outdata*) dat)->modout_write(f, filename);
+}
+int module_sameinst(module_obj a, module_obj b) {
+  return true;
+}
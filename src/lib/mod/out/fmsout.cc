@@ -66,6 +66,7 @@
 using namespace ilessaux;
 #include "ferraux.h"
 using namespace ferraux;
+#include "sinkaux.h"
 // #include "debugaux.h"
 
 #ifdef BOOST_FILESYSTEM_OLDAPI
@@ -565,13 +566,12 @@ namespace fmsout {
                         const char* filename) { // filename should be complete
     try {
       boost::filesystem::path fn(filename);
-      boost::filesystem::ofstream f;
+      sinkaux::outfile f;
       try {
         f.exceptions(boost::filesystem::ofstream::eofbit |
                      boost::filesystem::ofstream::failbit |
                      boost::filesystem::ofstream::badbit);
-        f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::out |
-                                        boost::filesystem::ofstream::trunc);
+        f.open(fn.FS_FILE_STRING());
         f << "// " << PACKAGE_STRING << '\n';
         {
           time_t tim;
@@ -971,7 +971,8 @@ void module_ready() {
   }
 }
 
-// only fmsout.cc returns true here (outputs before processing anything)
+// only fmsout.cc and fmbout.cc return true here (output before processing
+// anything)
 fomus_bool modout_ispre() {
   return true;
 }
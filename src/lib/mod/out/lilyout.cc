@@ -32,6 +32,7 @@
 #include <ctime>   // need this
 #include <fstream>
 #include <map>
+#include <memory> // auto_ptr
 #include <set>
 #include <string>
 #include <utility> // pair
@@ -76,6 +77,7 @@
 using namespace ilessaux;
 #include "foutaux.h"
 using namespace foutaux;
+#include "sinkaux.h"
 #include "debugaux.h"
 
 //#define LILYPOND_VERSION_STRING "2.12.1"
@@ -154,7 +156,8 @@ namespace lilyout {
       defgracedurid, pitchedtrillid, beatid, lilymacropreitaltextspanid,
       lilytextinsertid, lilymacropedstyletextid, lilymacropedstylebracketid,
       pedstyleid, lilypapersizeid, lilypaperorientid, lilystaffsizeid,
-      lilymacrofzpid, lilymacrosfpid, lilymacrosfzpid;
+      lilymacrofzpid, lilymacrosfpid, lilymacrosfzpid, nthreadsid,
+      lilyexewaitid;
 
   struct noteholder {
     module_noteobj n;
@@ -202,12 +205,14 @@ namespace lilyout {
   };
 
   struct encloseinfo {
-    boost::filesystem::ofstream f;
-    int ind; // indent size
+    sinkaux::outfile file;
+    std::ostream f; // writes to `file', or to a buffer when printing a part
+    int ind;        // indent size
     const int inc;
     bool eol;
     bool ok;
-    encloseinfo(const int inc) : ind(0), inc(inc), eol(true), ok(true) {}
+    encloseinfo(const int inc)
+        : f(file.rdbuf()), ind(0), inc(inc), eol(true), ok(true) {}
     void incind() {
       ind += inc;
     }
@@ -292,6 +297,7 @@ public:
 
   std::map<int, const char*> specaccs;
 
+  struct partjob;
   struct lilyoutdata {
     struct aaas {
       fomus_rat a1, a2;
@@ -315,6 +321,7 @@ public:
         mpedstylebracket, mfzp, msfp, msfzp;
     int mstaves, mbeams;
     const char* partprefix;
+    foutaux::partobjs* objs; // a part printed in a module_parallel() thread
 
     const char* dnotearr[7]; // = {'c', 'd', 'e', 'f', 'g', 'a', 'b'};
 
@@ -357,8 +364,8 @@ public:
           mpremeastextspan(false), mpreitaltextspan(false),
           mpedstyletext(false), mpedstylebracket(false), mfzp(false),
           msfp(false), msfzp(false), mstaves(0), mbeams(0),
-          partprefix(
-              module_setting_sval(fom, lilypartprefixid)) { // global setting
+          partprefix(module_setting_sval(fom, lilypartprefixid)), // global
+          objs(0) {
       module_value x(module_setting_val(fom, notenameslistid));
       assert(x.type == module_list);
       int z = 0;
@@ -396,8 +403,25 @@ public:
     void lyrprint(part& prt, std::vector<noteholder>::iterator& ni,
                   const std::vector<noteholder>& nos,
                   const std::vector<module_measobj>& meass); // no is modified
+    void partname(part& prt, std::set<std::string>& names);
     void partprint(part& prt, std::set<std::string>& names, module_measobj& m,
                    module_noteobj& o);
+    void printparts(boost::ptr_vector<part>& parts,
+                    boost::ptr_vector<partjob>& jobs);
+    void mergemacros(const lilyoutdata& d);
+    module_measobj nextmeas(const module_measobj m) {
+      if (objs)
+        return objs->nextmeas();
+      return x.ok ? module_nextmeas() : module_peeknextmeas(m);
+    }
+    module_noteobj nextnote(const module_noteobj o) {
+      if (objs)
+        return objs->nextnote();
+      if (!x.ok)
+        return module_peeknextnote(o);
+      module_skipassign(o);
+      return module_nextnote();
+    }
     void modout_write(FOMUS fom, const char* filename);
     void printnotedur(const module_noteobj no, const fomus_rat& wrm,
                       std::ostream& ou, const bool gr, const fomus_int div);
@@ -1912,19 +1936,23 @@ public:
     assert(ou.str().empty());
   }
 
+  void lilyoutdata::partname(part& prt, std::set<std::string>& names) {
+    std::ostringstream vn;
+    assert(!prt.var.empty());
+    vn << partprefix << (char) toupper(prt.var[0]) << prt.var.substr(1);
+    while (names.find(vn.str()) != names.end())
+      vn << 'x';
+    prt.var = vn.str();
+    names.insert(prt.var);
+  }
+
   void
   lilyoutdata::partprint(part& prt, std::set<std::string>& names,
                          module_measobj& m,
                          module_noteobj& o) { // return the leftover measure
-    if (!x.ok) {                              // only do this the first time
-      std::ostringstream vn;
-      assert(!prt.var.empty());
-      vn << partprefix << (char) toupper(prt.var[0]) << prt.var.substr(1);
-      while (names.find(vn.str()) != names.end())
-        vn << 'x';
-      prt.var = vn.str();
-    }
-    names.insert(prt.var);
+    if (!x.ok && !objs) // only do this the first time (printparts() names
+                        // the parts itself)
+      partname(prt, names);
     std::string pn(module_setting_sval(prt.p, partnameid));
     x << "%% part `" << (pn.empty() ? prt.var : pn) << '\'' << el();
     // struct module_intslist st(module_staves(prt.p));
@@ -1959,7 +1987,7 @@ public:
       std::vector<module_measobj> meass(1, (module_measobj) 0);
       while (m && module_part(m) == prt.p) {
         meass.push_back(m);
-        m = (x.ok ? module_nextmeas() : module_peeknextmeas(m));
+        m = nextmeas(m);
       }
       std::vector<int> inicl(nst, -1), cclef(nst);
       std::vector<noteholder> nos;
@@ -2013,12 +2041,7 @@ public:
             }
           }
         }
-        if (x.ok) {
-          module_skipassign(o);
-          o = module_nextnote();
-        } else {
-          o = module_peeknextnote(o);
-        }
+        o = nextnote(o);
       }
       for (int s = 1; s <= nst; ++s) {
         if (nst > 1) {
@@ -2073,6 +2096,173 @@ public:
     x << el();
   }
 
+  // a part printed into its own buffer
+  struct partjob {
+    part& pa;
+    lilyoutdata dat;
+    foutaux::partobjs objs;
+    std::ostringstream out;
+    int ind; // state the passes start with in the file
+    bool eol, err;
+    partjob(FOMUS fom, part& pa, const lilyoutdata& d)
+        : pa(pa), dat(fom), ind(d.x.ind), eol(d.x.eol), err(false) {
+      dat.objs = &objs;
+      dat.x.ind = ind;
+      dat.autobeam = d.autobeam;
+      dat.autoaccs = d.autoaccs;
+      dat.x.f.rdbuf(out.rdbuf());
+    }
+  };
+
+  int printpartjob(void* jobs, int i) {
+    partjob& j = ((boost::ptr_vector<partjob>*) jobs)->at(i);
+    try {
+      std::set<std::string> names;
+      j.dat.x.ok = false; // fake pass, collects macros and slur states
+      module_measobj m = j.objs.firstmeas();
+      module_noteobj o = j.objs.firstnote();
+      j.dat.partprint(j.pa, names, m, o);
+      j.dat.x.ok = true;
+      j.dat.x.ind = j.ind;
+      j.dat.x.eol = j.eol;
+      j.objs.rewind();
+      m = j.objs.firstmeas();
+      o = j.objs.firstnote();
+      j.dat.partprint(j.pa, names, m, o);
+      return 0;
+    } catch (const errbase& e) {
+      j.err = true;
+      return 1;
+    }
+  }
+
+  // does both passes over each part (same as in modout_write()) on
+  // `n-threads' threads--the parts' objects are fetched and the parts named
+  // here first, the buffers are written out in place of the real pass
+  void lilyoutdata::printparts(boost::ptr_vector<part>& parts,
+                               boost::ptr_vector<partjob>& jobs) {
+    std::set<std::string> names;
+    module_measobj m = module_nextmeas();
+    module_noteobj o = module_nextnote();
+    for (boost::ptr_vector<part>::iterator i(parts.begin()); i != parts.end();
+         ++i) {
+      partname(*i, names);
+      jobs.push_back(new partjob(fom, *i, *this));
+      jobs.back().objs.collect(i->p, m, o);
+    }
+    module_parallel(jobs.size(), printpartjob, &jobs);
+    for (boost::ptr_vector<partjob>::const_iterator i(jobs.begin());
+         i != jobs.end(); ++i) {
+      if (i->err) {
+        CERR << i->dat.CERR.str();
+        throw errbase();
+      }
+      mergemacros(i->dat);
+    }
+  }
+
+  void lilyoutdata::mergemacros(const lilyoutdata& d) {
+    mstaves = std::max(mstaves, d.mstaves);
+    mbeams = std::max(mbeams, d.mbeams);
+    mpppppp = mpppppp || d.mpppppp;
+    msfff = msfff || d.msfff;
+    msffz = msffz || d.msffz;
+    msfffz = msfffz || d.msfffz;
+    mffz = mffz || d.mffz;
+    mfffz = mfffz || d.mfffz;
+    mrfz = mrfz || d.mrfz;
+    mrf = mrf || d.mrf;
+    mslash = mslash || d.mslash;
+    mpretextspan = mpretextspan || d.mpretextspan;
+    mpremeastextspan = mpremeastextspan || d.mpremeastextspan;
+    mpreitaltextspan = mpreitaltextspan || d.mpreitaltextspan;
+    mpedstyletext = mpedstyletext || d.mpedstyletext;
+    mpedstylebracket = mpedstylebracket || d.mpedstylebracket;
+    mfzp = mfzp || d.mfzp;
+    msfp = msfp || d.msfp;
+    msfzp = msfzp || d.msfzp;
+  }
+
+  // a LilyPond process started by modout_write(), runlilyjob() waits for it
+  // and opens the viewer (usually after the run is over, so the settings it
+  // needs are copied here)
+  struct lilyjob {
+    execout::execout lout;
+    execout::execpid pid;
+    std::string fn, pr, opath, viewpath;
+    std::vector<std::string> viewargs;
+    bool verb, msg;
+    lilyjob(FOMUS fom, const char* path, const boost::filesystem::path& fn0,
+            const int vs)
+        : fn(fn0.FS_FILE_STRING()),
+          pr(FS_BASENAME(boost::filesystem::path(path))),
+          viewpath(module_setting_sval(fom, lilyviewexepathid)),
+          verb(vs >= 2), msg(vs >= 1) {
+      std::string ext(module_setting_sval(fom, lilyviewextid));
+      if (!ext.empty() && ext[0] != '.')
+        ext = '.' + ext; // make sure it has a dot
+      boost::filesystem::path fn1(fn0); // replace_extension() modifies it
+      opath = FS_CHANGE_EXTENSION(fn1, ext).FS_FILE_STRING();
+      struct module_list l(module_setting_val(fom, lilyviewexeargsid).val.l);
+      for (const module_value *i = l.vals, *ie = l.vals + l.n; i < ie; ++i)
+        viewargs.push_back(i->val.s);
+    }
+  };
+
+  // LilyPond's output is passed on if `verbose' is 2 or more and goes to the
+  // error output with the exit status if it fails
+  int runlilyjob(void* data) {
+    std::auto_ptr<lilyjob> job((lilyjob*) data);
+    std::string ln, log;
+    while (job->lout.good()) {
+      std::getline(job->lout, ln);
+      if (ln.empty())
+        continue;
+      std::string x("  " + job->pr + ": " + ln + '\n');
+      if (job->verb)
+        module_stdout(x.c_str(), x.size());
+      log += x;
+    }
+    int st;
+    try {
+      st = execout::waitforexit(job->pid);
+    } catch (const execout::execerr& e) { st = -1; }
+    job->lout.close();
+    if (st) {
+      std::ostringstream e;
+      e << "error compiling `" << job->fn << "' (" << job->pr;
+      if (st > 0)
+        e << " exited with status " << st << ")\n";
+      else
+        e << " didn't exit normally)\n";
+      std::string x(e.str() + log);
+      module_stderr(x.c_str(), x.size());
+      return 1;
+    }
+    if (job->viewpath.empty())
+      return 0;
+    try {
+      if (boost::filesystem::last_write_time(
+              boost::filesystem::path(job->opath)) <
+          boost::filesystem::last_write_time(boost::filesystem::path(job->fn)))
+        return 0;
+    } catch (const boost::filesystem::filesystem_error& e) { return 0; }
+    try {
+      if (job->msg)
+        module_stdout("opening viewer...\n", 0);
+      struct module_list none;
+      none.n = 0;
+      none.vals = 0;
+      execout::exec(0, job->viewpath.c_str(), job->viewargs, none,
+                    job->opath.c_str());
+    } catch (const execout::execerr& e) {
+      std::string x("error viewing `" + job->fn + "'\n");
+      module_stderr(x.c_str(), x.size());
+      return 1;
+    }
+    return 0;
+  }
+
   void lilyoutdata::modout_write(
       FOMUS fom, const char* filename) { // filename should be complete
     try {
@@ -2080,11 +2270,14 @@ public:
       autoaccs = module_setting_sval(fom, autoaccsid);
       boost::filesystem::path fn(filename);
       try {
+        x.file.exceptions(boost::filesystem::ofstream::eofbit |
+                          boost::filesystem::ofstream::failbit |
+                          boost::filesystem::ofstream::badbit);
         x.f.exceptions(boost::filesystem::ofstream::eofbit |
                        boost::filesystem::ofstream::failbit |
                        boost::filesystem::ofstream::badbit);
-        x.f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::out |
-                                          boost::filesystem::ofstream::trunc);
+        x.file.open(fn.FS_FILE_STRING());
+        x.f.rdbuf(x.file.rdbuf());
         x << "%% " << std::string(width - 3, '-') << el() << "%% LilyPond "
           << LILYPOND_VERSION_STRING << " Score File" << el()
           << "%% Generated by " << PACKAGE_STRING << el();
@@ -2148,7 +2341,12 @@ public:
             }
           }
         }
-        { // --------------------FAKE PASS, COLLECT MACROS
+        boost::ptr_vector<partjob> jobs;
+        const bool par =
+            module_setting_ival(fom, nthreadsid) > 0 && parts.size() > 1;
+        if (par)
+          printparts(parts, jobs); // both passes
+        else { // --------------------FAKE PASS, COLLECT MACROS
           x.ok = false;
           std::set<std::string> names;
           module_measobj m = module_peeknextmeas(0);
@@ -2260,7 +2458,13 @@ public:
           insertuserstuffaux(uh);
           x << el();
         }
-        { // --------------------THE NOTES
+        if (par) { // --------------------THE NOTES, from printparts()
+          for (boost::ptr_vector<partjob>::const_iterator i(jobs.begin());
+               i != jobs.end(); ++i) {
+            const std::string str(i->out.str());
+            x.f.write(str.data(), str.size());
+          }
+        } else { // --------------------THE NOTES
           std::set<std::string> names;
           module_measobj m = module_nextmeas();
           module_noteobj o = module_nextnote();
@@ -2298,70 +2502,38 @@ public:
           x << " 'Score)" << el();
           dostaves(pa, parts.end(), 1, false);
         }
-        x.f.close();
+        x.file.close();
+        if (x.file.issink())
+          return; // nothing for LilyPond to read
         int vs = module_setting_ival(fom, verboseid);
+        const char* path = module_setting_sval(fom, lilyexepathid);
+        if (strlen(path) <= 0)
+          return;
+        std::auto_ptr<lilyjob> job(new lilyjob(fom, path, fn, vs));
         try {
-          const char* path = module_setting_sval(fom, lilyexepathid);
-          if (strlen(path) <= 0)
-            return;
           if (vs >= 1)
             fout << "running LilyPond..." << std::endl;
-          execout::execout lout;
           struct module_list l(module_setting_val(fom, lilyexeargsid).val.l);
           DBG("n of extra args = " << l.n << std::endl);
           std::vector<std::string> a0;
           a0.push_back("-o" + FS_CHANGE_EXTENSION(fn, "").FS_FILE_STRING());
-          bool verb = (vs >= 2);
-          if (verb) {
+          if (job->verb) {
             fout << "  executing `";
             execout::outputcmd(fout, path, a0, l, fn.FS_FILE_STRING().c_str());
             fout << "'..." << std::endl;
           }
-          execout::execpid pid(
-              execout::exec(&lout, path, a0, l, fn.FS_FILE_STRING().c_str()));
-          std::string ln;
-          std::string pr(FS_BASENAME(boost::filesystem::path(path)));
-          while (lout.good()) {
-            std::getline(lout, ln);
-            if (verb && !ln.empty())
-              fout << "  " << pr << ": " << ln << std::endl;
-          }
-          execout::waituntildone(pid);
-          lout.close();
+          job->pid =
+              execout::exec(&job->lout, path, a0, l, fn.FS_FILE_STRING().c_str());
         } catch (const execout::execerr& e) {
           CERR << "error compiling `" << fn.FS_FILE_STRING() << '\''
                << std::endl;
           cerr = true;
           return;
         }
-        std::string ext(module_setting_sval(fom, lilyviewextid));
-        if (!ext.empty() && ext[0] != '.')
-          ext = '.' + ext; // make sure it has a dot
-        boost::filesystem::path opath(FS_CHANGE_EXTENSION(fn, ext));
-        bool outok;
-        try {
-          outok = (boost::filesystem::last_write_time(opath) >=
-                   boost::filesystem::last_write_time(fn));
-        } catch (const boost::filesystem::filesystem_error& e) {
-          outok = false;
-        }
-        if (outok) {
-          try {
-            const char* path = module_setting_sval(fom, lilyviewexepathid);
-            if (strlen(path) <= 0)
-              return;
-            if (vs >= 1)
-              fout << "opening viewer..." << std::endl;
-            struct module_list l(
-                module_setting_val(fom, lilyviewexeargsid).val.l);
-            execout::exec(0, path, std::vector<std::string>(), l,
-                          opath.FS_FILE_STRING().c_str());
-          } catch (const execout::execerr& e) {
-            CERR << "error viewing `" << fn.FS_FILE_STRING() << '\''
-                 << std::endl;
-            cerr = true;
-          }
-        }
+        if (!module_setting_ival(fom, lilyexewaitid))
+          module_background(&runlilyjob, job.release());
+        else if (runlilyjob(job.release()))
+          cerr = true;
         return;
       } catch (const boost::filesystem::ofstream::failure& e) {
         CERR << "error writing `" << fn.FS_FILE_STRING() << '\'' << std::endl;
@@ -3323,6 +3495,25 @@ int module_get_setting(int n, struct module_setting* set, int id) {
     lilymacrosfzpid = id;
     break;
   }
+  case 39: {
+    set->name = "lily-exe-wait"; // docscat{lilyout}
+    set->type = module_bool;
+    set->descdoc =
+        "Determines whether or not FOMUS waits for LilyPond to finish before "
+        "going on with the rest of the output files and runs."
+        "  Set this to `no' to run LilyPond in the background--a program "
+        "using the library must then call `fomus_wait' before exiting to "
+        "wait for it and get any errors (the `fomus' program does this).";
+    // set->typedoc = ;
+
+    module_setval_int(&set->val, 1);
+
+    set->loc = module_locscore;
+    // set->valid = valid_writewidth;
+    set->uselevel = 3;
+    lilyexewaitid = id;
+    break;
+  }
   default:
     return 0;
   }
@@ -3383,6 +3574,11 @@ void module_ready() {
     ierr = "missing required setting `ped-style'";
     return;
   }
+  nthreadsid = module_settingid("n-threads");
+  if (nthreadsid < 0) {
+    ierr = "missing required setting `n-threads'";
+    return;
+  }
 }
 
 // only fmsout.cc returns true here (outputs before processing anything)
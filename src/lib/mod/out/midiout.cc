@@ -57,6 +57,7 @@
 #include "debugaux.h"
 #include "ilessaux.h"
 using namespace ilessaux;
+#include "sinkaux.h"
 
 #ifdef BOOST_FILESYSTEM_OLDAPI
 #define FS_COMPLETE boost::filesystem::complete
@@ -1862,15 +1863,15 @@ namespace midiout {
   }
 
   struct midichunk {
-    boost::filesystem::ofstream& f;
-    boost::filesystem::ofstream::streampos pos;
-    midichunk(boost::filesystem::ofstream& f)
+    std::ostream& f;
+    std::ostream::pos_type pos;
+    midichunk(std::ostream& f)
         : f(f), pos(f.tellp()) { /*writestr(f, "\0\0\0\0", 4);*/
       f.seekp(pos + (std::streamoff) 4);
     }
     ~midichunk() {
-      boost::filesystem::ofstream::streampos epos = f.tellp();
-      boost::filesystem::ofstream::streampos val =
+      std::ostream::pos_type epos = f.tellp();
+      std::ostream::pos_type val =
           epos - (pos + (std::streamoff) 4);
       f.seekp(pos);
       write4(f, val);
@@ -1883,14 +1884,13 @@ namespace midiout {
     getstuff();
     try {
       boost::filesystem::path fn(filename);
-      boost::filesystem::ofstream f;
+      sinkaux::outfile f;
       try {
         f.exceptions(boost::filesystem::ofstream::eofbit |
                      boost::filesystem::ofstream::failbit |
                      boost::filesystem::ofstream::badbit);
-        f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::out |
-                                        boost::filesystem::ofstream::trunc |
-                                        boost::filesystem::ofstream::binary);
+        f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::binary,
+               true); // chunk lengths are filled in afterwards
         writestr(f, "MThd", 4);
         write4(f, 6);                // always 6
         write2(f, 1);                // format type
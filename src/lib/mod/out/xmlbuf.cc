@@ -0,0 +1,272 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "xmlbuf.h"
+
+#include <cassert>
+#include <cstring>
+#include <ctime>
+
+#include "module.h"
+
+namespace xmlbuf {
+
+  const std::size_t bufsize = 1 << 18;
+  const boost::uint64_t zipmax = 0xffffffffu; // no zip64
+
+  // the buffers are allocated in open(), so an unopened xmlbuf is cheap
+  xmlbuf::xmlbuf()
+      : out(0), sink(false), mxl(false), off(0)
+#ifdef HAVE_ZLIB
+        ,
+        zinit(false), crc(0), usize(0), csize(0), dtime(0), ddate(0), nents(0),
+        eoff(0), edefl(false)
+#endif
+  {}
+
+  xmlbuf::~xmlbuf() {
+#ifdef HAVE_ZLIB
+    if (zinit)
+      deflateEnd(&z);
+#endif
+    if (out)
+      std::fclose(out);
+  }
+
+  bool xmlbuf::write(const void* s, const std::size_t n) {
+    if (n <= 0)
+      return true;
+    if (sink ? module_sinkwrite(sinkfn.c_str(), (const char*) s, n) != 0
+             : std::fwrite(s, 1, n, out) != n)
+      return false;
+    off += n;
+    return true;
+  }
+
+#ifdef HAVE_ZLIB
+  inline void put16(std::vector<char>& v, const boost::uint32_t x) {
+    v.push_back(x & 0xff);
+    v.push_back((x >> 8) & 0xff);
+  }
+  inline void put32(std::vector<char>& v, const boost::uint32_t x) {
+    put16(v, x & 0xffff);
+    put16(v, x >> 16);
+  }
+
+  // local file header, sizes and crc follow the data if `defl'
+  bool xmlbuf::entry(const char* name, const bool defl) {
+    if (off > zipmax)
+      return false;
+    ename = name;
+    eoff = off;
+    edefl = defl;
+    std::vector<char> h;
+    put32(h, 0x04034b50);
+    put16(h, 20);              // version needed
+    put16(h, defl ? 0x08 : 0); // data descriptor
+    put16(h, defl ? 8 : 0);    // deflate/stored
+    put16(h, dtime);
+    put16(h, ddate);
+    put32(h, defl ? 0 : crc);
+    put32(h, defl ? 0 : csize);
+    put32(h, defl ? 0 : usize);
+    put16(h, ename.size());
+    put16(h, 0);
+    h.insert(h.end(), ename.begin(), ename.end());
+    return write(&h[0], h.size());
+  }
+  bool xmlbuf::endentry() {
+    if (usize > zipmax || csize > zipmax)
+      return false;
+    if (edefl) {
+      std::vector<char> d;
+      put32(d, 0x08074b50);
+      put32(d, crc);
+      put32(d, csize);
+      put32(d, usize);
+      if (!write(&d[0], d.size()))
+        return false;
+    }
+    put32(dir, 0x02014b50);
+    put16(dir, 20); // made by
+    put16(dir, 20); // needed
+    put16(dir, edefl ? 0x08 : 0);
+    put16(dir, edefl ? 8 : 0);
+    put16(dir, dtime);
+    put16(dir, ddate);
+    put32(dir, crc);
+    put32(dir, csize);
+    put32(dir, usize);
+    put16(dir, ename.size());
+    put16(dir, 0); // extra
+    put16(dir, 0); // comment
+    put16(dir, 0); // disk
+    put16(dir, 0); // internal attributes
+    put32(dir, 0); // external attributes
+    put32(dir, eoff);
+    dir.insert(dir.end(), ename.begin(), ename.end());
+    ++nents;
+    return true;
+  }
+  bool xmlbuf::storedentry(const char* name, const char* data) {
+    usize = csize = std::strlen(data);
+    crc = crc32(0, (const Bytef*) data, usize);
+    return entry(name, false) && write(data, usize) && endentry();
+  }
+#endif
+
+  bool xmlbuf::open(const std::string& fn, const bool mxl0,
+                    const std::string& rootfile) {
+    assert(!out && !sink);
+    mxl = mxl0;
+    off = 0;
+    buf.resize(bufsize);
+    setp(&buf[0], &buf[0] + buf.size());
+#ifndef HAVE_ZLIB
+    if (mxl)
+      return false;
+#endif
+    if (module_hassink(fn.c_str())) {
+      sink = true;
+      sinkfn = fn;
+    } else {
+      out = std::fopen(fn.c_str(), "wb");
+      if (!out)
+        return false;
+    }
+#ifdef HAVE_ZLIB
+    if (!mxl)
+      return true;
+    std::time_t tim = std::time(0);
+#ifdef HAVE_LOCALTIME_R
+    struct tm tt;
+    struct tm* ti = localtime_r(&tim, &tt);
+#else
+    struct tm* ti = std::localtime(&tim);
+#endif
+    if (ti && ti->tm_year >= 80) {
+      dtime = (ti->tm_hour << 11) | (ti->tm_min << 5) | (ti->tm_sec / 2);
+      ddate = ((ti->tm_year - 80) << 9) | ((ti->tm_mon + 1) << 5) | ti->tm_mday;
+    }
+    dir.clear();
+    nents = 0;
+    std::string cont("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                     "<container>\n"
+                     "  <rootfiles>\n"
+                     "    <rootfile full-path=\"");
+    cont += rootfile;
+    cont += "\" media-type=\"application/vnd.recordare.musicxml+xml\"/>\n"
+            "  </rootfiles>\n"
+            "</container>\n";
+    if (!storedentry("mimetype", "application/vnd.recordare.musicxml") ||
+        !storedentry("META-INF/container.xml", cont.c_str()))
+      return false;
+    zbuf.resize(bufsize);
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    zinit = true;
+    crc = crc32(0, 0, 0);
+    usize = csize = 0;
+    return entry(rootfile.c_str(), true);
+#else
+    return true;
+#endif
+  }
+
+  bool xmlbuf::flushbuf(const bool fin) {
+    if (!out && !sink)
+      return false;
+    std::size_t n = pptr() - pbase();
+    setp(&buf[0], &buf[0] + buf.size());
+#ifdef HAVE_ZLIB
+    if (mxl) {
+      crc = crc32(crc, (const Bytef*) &buf[0], n);
+      usize += n;
+      z.next_in = (Bytef*) &buf[0];
+      z.avail_in = n;
+      while (true) {
+        z.next_out = (Bytef*) &zbuf[0];
+        z.avail_out = zbuf.size();
+        int r = deflate(&z, fin ? Z_FINISH : Z_NO_FLUSH);
+        if (r == Z_STREAM_ERROR)
+          return false;
+        std::size_t m = zbuf.size() - z.avail_out;
+        csize += m;
+        if (!write(&zbuf[0], m))
+          return false;
+        if (fin ? r == Z_STREAM_END : z.avail_out > 0)
+          break;
+      }
+      return true;
+    }
+#endif
+    return write(&buf[0], n);
+  }
+
+  xmlbuf::int_type xmlbuf::overflow(int_type c) {
+    if (!flushbuf(false))
+      return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int xmlbuf::sync() {
+    return flushbuf(false) ? 0 : -1;
+  }
+
+  bool xmlbuf::close() {
+    bool ok = flushbuf(true);
+#ifdef HAVE_ZLIB
+    if (ok && mxl) {
+      ok = endentry() && off <= zipmax;
+      if (ok) {
+        boost::uint64_t doff = off;
+        std::vector<char> e;
+        put32(e, 0x06054b50);
+        put16(e, 0); // disk
+        put16(e, 0); // disk with directory
+        put16(e, nents);
+        put16(e, nents);
+        put32(e, dir.size());
+        put32(e, doff);
+        put16(e, 0); // comment
+        ok = write(&dir[0], dir.size()) && write(&e[0], e.size());
+      }
+    }
+    if (zinit) {
+      deflateEnd(&z);
+      zinit = false;
+    }
+#endif
+    if (out) {
+      if (std::fclose(out) != 0)
+        ok = false;
+      out = 0;
+    }
+    sink = false;
+    return ok;
+  }
+
+} // namespace xmlbuf
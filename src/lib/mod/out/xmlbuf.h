@@ -0,0 +1,93 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSMOD_XMLBUF_H
+#define FOMUSMOD_XMLBUF_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace xmlbuf {
+
+  // Buffered output for xmlout.  Everything written goes into one fixed-size
+  // buffer that is handed to the file in large chunks.  In `.mxl' mode the
+  // file is a zip container (mimetype, META-INF/container.xml and the score)
+  // and the score is deflated as it is written, so no uncompressed copy is
+  // made and memory use doesn't depend on the size of the score.  The chunks
+  // go to the caller's sink instead if there is one for the file.
+  class xmlbuf : public std::streambuf, boost::noncopyable {
+    std::FILE* out;
+    bool sink; // writing to module_sinkwrite()
+    std::string sinkfn;
+    std::vector<char> buf;
+    bool mxl;
+    boost::uint64_t off; // bytes written to the file
+#ifdef HAVE_ZLIB
+    z_stream z;
+    bool zinit;
+    std::vector<char> zbuf;
+    boost::uint32_t crc;
+    boost::uint64_t usize, csize; // current entry
+    boost::uint16_t dtime, ddate; // DOS time stamp
+    std::vector<char> dir;        // central directory
+    boost::uint16_t nents;
+    std::string ename; // current entry
+    boost::uint64_t eoff;
+    bool edefl;
+#endif
+
+public:
+    xmlbuf();
+    ~xmlbuf();
+    // false if the file can't be created, or `mxl' is true and there's no
+    // zlib; `rootfile' is the name of the score inside the container
+    bool open(const std::string& fn, const bool mxl, const std::string& rootfile);
+    // flushes everything and closes the file, false on an error
+    bool close();
+
+protected:
+    int_type overflow(int_type c);
+    int sync();
+
+private:
+    bool flushbuf(const bool fin);
+    bool write(const void* s, const std::size_t n);
+#ifdef HAVE_ZLIB
+    bool entry(const char* name, const bool defl);
+    bool endentry();
+    bool storedentry(const char* name, const char* data);
+#endif
+  };
+
+} // namespace xmlbuf
+
+#endif
@@ -76,6 +76,8 @@
 #include "module.h"
 #include "modutil.h"
 
+#include "xmlbuf.h"
+
 #include "ilessaux.h"
 using namespace ilessaux;
 #include "foutaux.h"
@@ -94,12 +96,14 @@ using namespace foutaux;
 #define FS_COMPLETE boost::filesystem::complete
 #define FS_FILE_STRING file_string
 #define FS_BASENAME(xxx) boost::filesystem::basename(xxx)
+#define FS_EXTENSION(xxx) boost::filesystem::extension(xxx)
 #define FS_CHANGE_EXTENSION(xxx, yyy)                                          \
   boost::filesystem::change_extension(xxx, yyy)
 #else
 #define FS_COMPLETE boost::filesystem::absolute
 #define FS_FILE_STRING string
 #define FS_BASENAME(xxx) xxx.stem().string()
+#define FS_EXTENSION(xxx) xxx.extension().string()
 #define FS_CHANGE_EXTENSION(xxx, yyy) xxx.replace_extension(yyy)
 #endif
 
@@ -129,21 +133,31 @@ namespace xmlout {
   pedmaptype pedstyles;
 
   // XML STUFF
+  const char* xmlescs[256]; // entity for each character that needs one
+
   class enclose;
   struct encloseinfo {
-    boost::filesystem::ofstream f;
+    xmlbuf::xmlbuf buf;
+    std::ostream f;
     int ind; // indent size
     const int inc;
     bool atnewl; //, fintag;
     // std::ostringstream deltxt; bool del;
     enclose* encl;
+    std::string inds;      // newline + indentation, grows as needed
+    std::ostringstream tx; // for formatting CDATA values
     encloseinfo(const int inc)
-        : ind(0), inc(inc), atnewl(false),
-          encl(0) /*, eol(true)*/ /*, ok(true)*/ {
+        : f(&buf), ind(0), inc(inc), atnewl(false),
+          encl(0) /*, eol(true)*/ /*, ok(true)*/, inds(1, '\n') {
 #ifndef NDEBUG
       debug = 12345;
 #endif
     }
+    void newline(std::ostream& o) {
+      if ((int) inds.size() <= ind)
+        inds.resize(ind + 1, inc > 0 ? ' ' : '\t');
+      o.write(inds.data(), ind + 1);
+    }
     void incind() {
       if (inc > 0)
         ind += inc;
@@ -191,7 +205,7 @@ public:
       assert(info.isvalid());
       if (info.encl)
         info.encl->flushenc();
-      info.f << '\n' << std::string(info.ind, (info.inc > 0 ? ' ' : '\t'));
+      info.newline(info.f);
       info.f << '<' << tag;
       info.incind();
       info.encl = this;
@@ -201,10 +215,8 @@ public:
 #ifndef NDEBUG
       debug = 12345;
 #endif
-      deltxt << '\n'
-             << std::string(info.ind,
-                            (info.inc > 0 ? ' ' : '\t')) // put rest in deltxt
-             << '<' << tag;
+      info.newline(deltxt); // put rest in deltxt
+      deltxt << '<' << tag;
       info.incind();
       info.encl = this;
     }
@@ -215,21 +227,19 @@ public:
       info.decind();
       if (del)
         return;
-      info.f.exceptions(
-          boost::filesystem::ofstream::goodbit); // avoid exceptions in
-                                                 // destructor
+      info.f.exceptions(std::ostream::goodbit); // avoid exceptions in
+                                                // destructor
       if (fintag) {
         info.f << "/>";
         fintag = false;
       } else {
         if (!info.atnewl)
-          info.f << '\n' << std::string(info.ind, (info.inc > 0 ? ' ' : '\t'));
+          info.newline(info.f);
         info.f << "</" << tag << ">";
       }
       info.atnewl = false;
-      info.f.exceptions(boost::filesystem::ofstream::eofbit |
-                        boost::filesystem::ofstream::failbit |
-                        boost::filesystem::ofstream::badbit);
+      info.f.exceptions(std::ostream::eofbit | std::ostream::failbit |
+                        std::ostream::badbit);
     }
     void flushenc() {
       assert(isvalid());
@@ -282,41 +292,65 @@ public:
     xmlout::operator<<(ou, x);
   }
 
+  // copies runs of characters that don't need escaping in one write
+  inline void putesc(std::ostream& f, const char* s, const char* e) {
+    const char* r = s;
+    for (; s < e; ++s) {
+      const char* x = xmlescs[(unsigned char) *s];
+      if (x) {
+        f.write(r, s - r);
+        f << x;
+        r = s + 1;
+      }
+    }
+    f.write(r, e - r);
+  }
+
   template <typename T>
   inline encloseinfo& operator<<(encloseinfo& out,
                                  const T& o) { // CDATA text output
     if (out.encl) {
       out.encl->flushenc();
     }
-    std::stringstream str;
-    encprval(str, o); // str << o;
-    while (!str.eof()) {
-      char x = str.get();
-      if (x < 0)
-        break;
-      switch (x) {
-      case '&':
-        out.f << "&amp;";
-        break;
-      case '<':
-        out.f << "&lt;";
-        break;
-      case '>':
-        out.f << "&gt;";
-        break;
-      case '\'':
-        out.f << "&apos;";
-        break;
-      case '"':
-        out.f << "&quot;";
-        break;
-      default:
-        out.f << x;
-      }
-    }
+    out.tx.str(std::string());
+    encprval(out.tx, o); // str << o;
+    const std::string str(out.tx.str());
+    putesc(out.f, str.data(), str.data() + str.size());
     out.atnewl = true; // so end tag prints right after it
     return out;
   }
+  inline encloseinfo& operator<<(encloseinfo& out, const char* o) {
+    if (out.encl) {
+      out.encl->flushenc();
+    }
+    putesc(out.f, o, o + strlen(o));
+    out.atnewl = true;
+    return out;
+  }
+  inline encloseinfo& operator<<(encloseinfo& out, const std::string& o) {
+    if (out.encl) {
+      out.encl->flushenc();
+    }
+    putesc(out.f, o.data(), o.data() + o.size());
+    out.atnewl = true;
+    return out;
+  }
+  inline encloseinfo& operator<<(encloseinfo& out, const char o) {
+    if (out.encl) {
+      out.encl->flushenc();
+    }
+    putesc(out.f, &o, &o + 1);
+    out.atnewl = true;
+    return out;
+  }
+  inline encloseinfo& operator<<(encloseinfo& out, const int o) {
+    if (out.encl) {
+      out.encl->flushenc();
+    }
+    out.f << o; // nothing to escape
+    out.atnewl = true;
+    return out;
+  }
 
   template <typename T>
   class attr {
@@ -336,8 +370,10 @@ public:
   inline encloseinfo&
   operator<<<attr<std::string>>(encloseinfo& out, const attr<std::string>& o) {
     assert(out.isvalid());
-    (out.encl ? out.encl->getf() : out.f)
-        << ' ' << o.getid() << "=\"" << o.getval() << '"';
+    std::ostream& f(out.encl ? out.encl->getf() : out.f);
+    f << ' ' << o.getid() << "=\"";
+    putesc(f, o.getval().data(), o.getval().data() + o.getval().size());
+    f << '"';
     return out;
   }
   template <>
@@ -352,13 +388,15 @@ public:
   inline encloseinfo&
   operator<<<attr<const char*>>(encloseinfo& out, const attr<const char*>& o) {
     assert(out.isvalid());
-    (out.encl ? out.encl->getf() : out.f)
-        << ' ' << o.getid() << "=\"" << o.getval() << '"';
+    std::ostream& f(out.encl ? out.encl->getf() : out.f);
+    f << ' ' << o.getid() << "=\"";
+    putesc(f, o.getval(), o.getval() + strlen(o.getval()));
+    f << '"';
     return out;
   }
 
   int indentid, partnameid, partabbrid, timesigstyleid, thetitleid, theauthorid,
-      beatid, pedstyleid, praccid, altervalsid;
+      beatid, pedstyleid, praccid, altervalsid, nthreadsid;
 
   struct part {
     module_partobj p;
@@ -421,6 +459,7 @@ public:
     std::stringstream CERR;
     std::string errstr;
     encloseinfo x;
+    foutaux::partobjs* objs; // a part printed in a module_parallel() thread
     const char* module_err() {
       if (!cerr)
         return 0;
@@ -428,10 +467,22 @@ public:
       return errstr.c_str();
     }
     xmloutdata(FOMUS fom)
-        : fom(fom), cerr(false), x(module_setting_ival(fom, indentid)) {}
+        : fom(fom), cerr(false), x(module_setting_ival(fom, indentid)),
+          objs(0) {}
     void modout_write(FOMUS fom, const char* filename);
     void dostaves(part& pa, int& grid, std::vector<int>& grids);
     void printpart(part& pa, module_noteobj& n, module_measobj& m);
+    void printparts(boost::ptr_vector<part>& parts, module_noteobj& n,
+                    module_measobj& m);
+    module_measobj nextmeas() {
+      return objs ? objs->nextmeas() : module_nextmeas();
+    }
+    module_noteobj nextnote(const module_noteobj n) {
+      if (objs)
+        return objs->nextnote();
+      module_skipassign(n);
+      return module_nextnote();
+    }
     void printmeas(part& prt, const module_measobj me, module_noteobj& n,
                    std::vector<int>& mclfs, int& measn, fomus_rat& cts,
                    const bool first, modout_keysig& lmkey, int& octch,
@@ -1712,8 +1763,7 @@ public:
       fomus_rat dq(module_dur(n) * wrm4); // duration in # of quarter notes
       if (dq > (fomus_int) 0)
         divs = boost::math::lcm(divs, dq.den);
-      module_skipassign(n);
-      n = module_nextnote();
+      n = nextnote(n);
     }
     wrm4 = wrm4 * divs; // wrm4 is multiplication factor now to get divisions
     std::sort(nos.begin(), nos.end(), order);
@@ -1932,34 +1982,80 @@ public:
     bool sysbreak = false;
     while (m && module_part(m) == pa.p) {
       printmeas(pa, m, n, clfs, measn, cts, fi, lm, octch, sysbreak);
-      m = module_nextmeas();
+      m = nextmeas();
       fi = false;
     }
   }
 
+  // a part printed into its own buffer
+  struct partjob {
+    part& pa;
+    xmloutdata dat;
+    foutaux::partobjs objs;
+    std::ostringstream out;
+    bool err;
+    partjob(FOMUS fom, part& pa, const encloseinfo& x)
+        : pa(pa), dat(fom), err(false) {
+      dat.objs = &objs;
+      dat.x.ind = x.ind; // same state as printpart() starts with in the file
+      dat.x.f.rdbuf(out.rdbuf());
+    }
+  };
+
+  int printpartjob(void* jobs, int i) {
+    partjob& j = ((boost::ptr_vector<partjob>*) jobs)->at(i);
+    try {
+      module_measobj m = j.objs.firstmeas();
+      module_noteobj n = j.objs.firstnote();
+      j.dat.printpart(j.pa, n, m);
+      return 0;
+    } catch (const errbase& e) {
+      j.err = true;
+      return 1;
+    }
+  }
+
+  // same output as calling printpart() for each part--the parts' objects are
+  // fetched here, then the parts are printed into separate buffers on
+  // `n-threads' threads and copied to the file in order
+  void xmloutdata::printparts(boost::ptr_vector<part>& parts, module_noteobj& n,
+                              module_measobj& m) {
+    boost::ptr_vector<partjob> jobs;
+    for (boost::ptr_vector<part>::iterator i(parts.begin()); i != parts.end();
+         ++i) {
+      jobs.push_back(new partjob(fom, *i, x));
+      jobs.back().objs.collect(i->p, m, n);
+    }
+    module_parallel(jobs.size(), printpartjob, &jobs);
+    for (boost::ptr_vector<partjob>::iterator i(jobs.begin()); i != jobs.end();
+         ++i) {
+      if (i->err) {
+        CERR << i->dat.CERR.str();
+        throw errbase();
+      }
+      const std::string str(i->out.str());
+      x.f.write(str.data(), str.size());
+    }
+  }
+
   void xmloutdata::modout_write(
       FOMUS fom, const char* filename) { // filename should be complete
     try {
-      boost::filesystem::path fn(filename); //, mfn, dir;
-      //   SAVE ME!
-      //       std::string
-      //       ext(boost::to_lower_copy(boost::filename::extension(fn)));
-      //       boost::trim_left_if(ext, boost::lambda::_1 == '.');
-      //       bool ismxl;
-      //       if (ext == "mxl") {
-      // 	ismxl = true;
-      // 	mfn = fn;
-      // 	dir = boost::filesystem::change_extension(fn, ".xml");
-      // 	boost::filesystem::change_extension(fn, ".xml");
-      //       } else ismxl = false;
+      boost::filesystem::path fn(filename);
+      std::string ext(boost::to_lower_copy(FS_EXTENSION(fn)));
+      boost::trim_left_if(ext, boost::lambda::_1 == '.');
+      const bool ismxl = (ext == "mxl"); // compressed, deflated as it's written
       try {
         assert(x.isvalid());
-        x.f.exceptions(boost::filesystem::ofstream::eofbit |
-                       boost::filesystem::ofstream::failbit |
-                       boost::filesystem::ofstream::badbit);
+        x.f.clear();
+        x.f.exceptions(std::ostream::eofbit | std::ostream::failbit |
+                       std::ostream::badbit);
         assert(x.isvalid());
-        x.f.open(fn.FS_FILE_STRING(), boost::filesystem::ofstream::out |
-                                          boost::filesystem::ofstream::trunc);
+        if (!x.buf.open(fn.FS_FILE_STRING(), ismxl,
+                        FS_BASENAME(fn) + ".xml")) {
+          x.buf.close();
+          throw std::ostream::failure("can't open");
+        }
         assert(x.isvalid());
         x.f << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
                "<!DOCTYPE score-partwise PUBLIC\n";
@@ -2065,16 +2161,23 @@ public:
           {
             module_noteobj n = module_nextnote();
             module_measobj m = module_nextmeas();
-            std::for_each(parts.begin(), parts.end(),
-                          boost::lambda::bind(
-                              &xmloutdata::printpart, this, boost::lambda::_1,
-                              boost::lambda::var(n), boost::lambda::var(m)));
+            if (module_setting_ival(fom, nthreadsid) > 0 && parts.size() > 1)
+              printparts(parts, n, m);
+            else
+              std::for_each(parts.begin(), parts.end(),
+                            boost::lambda::bind(&xmloutdata::printpart, this,
+                                                boost::lambda::_1,
+                                                boost::lambda::var(n),
+                                                boost::lambda::var(m)));
           }
         }
         x.f << '\n';
-        //#warning "use app-arch/zip for zip compression"
+        x.f.flush();
+        if (!x.buf.close())
+          throw std::ostream::failure("can't close");
         return;
-      } catch (const boost::filesystem::ofstream::failure& e) {
+      } catch (const std::ostream::failure& e) {
+        x.buf.close();
         CERR << "error writing `" << fn.FS_FILE_STRING() << '\'' << std::endl;
       }
     } catch (const boost::filesystem::filesystem_error& e) {
@@ -2175,6 +2278,11 @@ int module_itertype() {
 }
 
 void module_init() {
+  xmlescs[(unsigned char) '&'] = "&amp;";
+  xmlescs[(unsigned char) '<'] = "&lt;";
+  xmlescs[(unsigned char) '>'] = "&gt;";
+  xmlescs[(unsigned char) '\''] = "&apos;";
+  xmlescs[(unsigned char) '"'] = "&quot;";
   durtyps.insert(std::map<fomus_rat, const char*>::value_type(
       module_makerat(1, 256), "256th"));
   durtyps.insert(std::map<fomus_rat, const char*>::value_type(
@@ -2347,6 +2455,11 @@ void module_ready() {
     ierr = "missing required setting `ped-style'";
     return;
   }
+  nthreadsid = module_settingid("n-threads");
+  if (nthreadsid < 0) {
+    ierr = "missing required setting `n-threads'";
+    return;
+  }
 }
 
 // only fmsout.cc returns true here (outputs before processing anything)
@@ -2358,6 +2471,10 @@ const char* modout_get_extension(int n) {
   switch (n) {
   case 0:
     return "xml";
+#ifdef HAVE_ZLIB
+  case 1:
+    return "mxl";
+#endif
   default:
     return 0;
   }
@@ -265,7 +265,7 @@ const char* module_initerr() {
   return 0;
 }
 int module_itertype() {
-  return module_bypart | module_graceonly;
+  return module_bypart | module_graceonly | module_partlocal;
 }
 void module_init() {}
 void module_free() { /*assert(newcount == 0);*/
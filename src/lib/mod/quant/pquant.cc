@@ -87,7 +87,7 @@ const char* module_initerr() {
   return 0;
 }
 int module_itertype() {
-  return module_bymeas | module_norests | module_noperc;
+  return module_bymeas | module_norests | module_noperc | module_partlocal;
 }
 void module_init() {}
 void module_free() { /*assert(newcount == 0);*/
@@ -884,7 +884,7 @@ void module_init() {
 void module_free() { /*assert(newcount == 0);*/
 }
 int module_itertype() {
-  return module_bypart;
+  return module_bypart | module_partlocal;
 } // notes aren't divided yet, so they reach across measures
 
 int module_get_setting(int n, module_setting* set, int id) {
@@ -750,7 +750,7 @@ enum module_type module_type() {
   return module_modspecial;
 }
 int module_itertype() {
-  return module_bymeas | module_byvoice | module_norests;
+  return module_bymeas | module_byvoice | module_norests | module_partlocal;
 }
 const char* module_initerr() {
   return ierr;
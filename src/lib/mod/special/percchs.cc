@@ -151,7 +151,8 @@ enum module_type module_type() {
   return module_modspecial;
 }
 int module_itertype() {
-  return module_bypart | module_byvoice | module_perconly | module_norests;
+  return module_bypart | module_byvoice | module_perconly | module_norests |
+         module_partlocal;
 }
 const char* module_initerr() {
   return ierr;
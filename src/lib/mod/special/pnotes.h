@@ -51,7 +51,7 @@ namespace pnotes {
   inline void free() {}
   int get_setting(int n, module_setting* set, int id);
   inline int itertype() {
-    return module_bymeas | module_perconly;
+    return module_bymeas | module_perconly | module_partlocal;
   }
   void fill_iface(void* moddata, void* iface);
   inline const char* engine() {
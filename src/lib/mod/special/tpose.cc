@@ -272,7 +272,7 @@ const char* module_initerr() {
   return ierr;
 }
 int module_itertype() {
-  return module_bypart | module_norests | module_noperc;
+  return module_bypart | module_norests | module_noperc | module_partlocal;
 }
 
 void module_init() {}
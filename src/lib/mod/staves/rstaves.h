@@ -58,7 +58,8 @@ namespace rstaves {
   }
   //#warning "uncomment nograce"
   inline int itertype() {
-    return module_bypart | /*module_nograce |*/ module_byvoice;
+    return module_bypart | /*module_nograce |*/ module_byvoice |
+           module_partlocal;
   }
 
   //   inline int engine_iface() {return ENGINE_INTERFACEID;}
@@ -27,13 +27,11 @@
 #include <deque>
 #include <iterator> // back_inserter
 #include <limits>
-#include <map>
 #include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
-#include <boost/ptr_container/ptr_map.hpp>
 #include <boost/utility.hpp> // next & prior
 
 #include "ifacedist.h"
@@ -43,6 +41,8 @@
 #include "modutil.h"
 
 #include "debugaux.h"
+#include "distwtaux.h"
+using namespace distwtaux;
 
 namespace staves {
 
@@ -52,7 +52,8 @@ namespace staves {
       cleforderid, pitchorderid, clefchangeid, staffchangeid, voicemaxid,
       /*octupid, octdownid,*/ exponid, enginemodid, rangeid,
       heapsizeid /*, defclefid*/, preferredid, clefprefid, highlowclefid,
-      highlowstaffid, staffid, clefid, balanceid /*, vertbalanceid*/;
+      highlowstaffid, staffid, clefid, balanceid /*, vertbalanceid*/,
+      beamwidthid, searchwidthid;
 
 #ifndef NDEBUG
   inline fomus_float testgtzero(const fomus_float sc) {
@@ -63,6 +64,17 @@ namespace staves {
 #define testgtzero(xxx) (xxx)
 #endif
 
+  // the last note on a staff (or in a voice) in a node's search path
+  struct lastclef {
+    int depth, clef; // depth 0 = none
+  };
+  struct laststaff {
+    int voice, depth, staff;
+    bool operator<(const int v) const {
+      return voice < v;
+    }
+  };
+
   struct stavesnode _NONCOPYABLE {
     module_noteobj note;
     int uplls, downlls; //, octup, octdown;
@@ -77,8 +89,13 @@ namespace staves {
     int valid;
 #endif
     int defcl;
-    fomus_rat no, ti /*, teti*/;
+    fomus_rat no, ti, teti;
     fomus_int wno;
+    int depth;           // position in the search path, the first note is 1
+    lastclef stprev;     // the note before this one on the same staff...
+    laststaff voprev;    // ...and in the same voice
+    std::vector<lastclef> stlasts;  // by staff - 1, including this note
+    std::vector<laststaff> volasts; // sorted by voice, including this note
     stavesnode(const module_noteobj note, const int staff, const int clef,
                const module_partobj prt, const fomus_float totclefpref)
         : note(note), clef(clef), staff(staff), voice(module_voice(note)),
@@ -88,7 +105,7 @@ namespace staves {
 #endif
           defcl(module_strtoclef(module_staffclef(prt, staff))),
           no(module_pitch(note)), ti(module_time(note)),
-          /*teti(module_tiedendtime(note)),*/ wno(module_writtennote(note)) {
+          teti(module_tiedendtime(note)), wno(module_writtennote(note)) {
       module_clefobj cl = staves_clef(prt, staff, clef);
       uplls = midpitch + module_setting_ival(cl, upllsid) * 2 +
               5; // add these to mid written pitch to get max/min writ pitch
@@ -109,6 +126,36 @@ namespace staves {
       // vertbalancepenalty = module_setting_fval(note, vertbalanceid);
       expon = pow(2, -1 / module_setting_fval(note, exponid));
     }
+    // carry the last clef on each staff and staff in each voice along the
+    // path, `prev' is 0 for the first note
+    void follow(const stavesnode* prev, const int nstaves) {
+      if (prev) {
+        depth = prev->depth + 1;
+        stlasts = prev->stlasts;
+        volasts = prev->volasts;
+      } else {
+        depth = 1;
+        lastclef z = {0, 0};
+        stlasts.assign(nstaves, z);
+      }
+      assert(staff >= 1 && staff <= (int) stlasts.size());
+      lastclef& l = stlasts[staff - 1];
+      stprev = l;
+      l.depth = depth;
+      l.clef = clef;
+      std::vector<laststaff>::iterator v(
+          std::lower_bound(volasts.begin(), volasts.end(), voice));
+      if (v != volasts.end() && v->voice == voice) {
+        voprev = *v;
+        v->depth = depth;
+        v->staff = staff;
+      } else {
+        voprev.voice = voice;
+        voprev.depth = 0;
+        laststaff x = {voice, depth, staff};
+        volasts.insert(v, x);
+      }
+    }
 #ifndef NDEBUG
     bool isvalid() const {
       return valid == 12345;
@@ -210,6 +257,10 @@ namespace staves {
     std::vector<staff> staves; // individual voices, size is the nchoices
     module_noteobj ass, getn;
     module_partobj prt;
+    // scratch space for getscore() (only used from the search thread, see
+    // distwtaux.h)
+    mutable scorescratch<scorenode> scr;
+    mutable std::vector<std::vector<int>> stvoices; // voices by staff - 1
     stavesdata() : ass(0), getn(0) {
       diface.moddata = 0;
       diface.data.octdist_setid = octdistid;
@@ -245,6 +296,7 @@ namespace staves {
         assert(!clefs.empty());
         i->tcp /= clefs.size(); // get the average
       }
+      stvoices.resize(st);
       return cl.n * st;
     }
     // order (clefs are in order vertically)
@@ -253,40 +305,35 @@ namespace staves {
     inline fomus_float orderbalance(
         const std::vector<scorenode>& arr,
         const stavesnode& n2) const { // only looks at overlapping notes!
-      std::vector<scorenode>::const_iterator i(boost::prior(arr.begin()));
       fomus_float sc = 0;
-      boost::ptr_map<const int, std::set<int>> cnt; // staff, count
-      std::set<int>* x;
-      cnt.insert(n2.staff, x = new std::set<int>);
-      x->insert(n2.voice);
+      for (std::vector<std::vector<int>>::iterator i(stvoices.begin());
+           i != stvoices.end(); ++i)
+        i->clear();
+      stvoices[n2.staff - 1].push_back(n2.voice); // voices in each staff
       for (std::vector<scorenode>::const_iterator i(arr.begin());
            i != arr.end(); ++i) {
-        if (module_tiedendtime(i->node->note) > n2.ti) { // was >
-          boost::ptr_map<const int, std::set<int>>::iterator c(
-              cnt.find(i->node->staff));
-          if (c == cnt.end()) {
-            cnt.insert(i->node->staff, x = new std::set<int>);
-            x->insert(i->node->voice);
-          } else
-            c->second->insert(i->node->voice);
+        if (i->node->teti > n2.ti) { // was >
+          std::vector<int>& x = stvoices[i->node->staff - 1];
+          if (std::find(x.begin(), x.end(), i->node->voice) == x.end())
+            x.push_back(i->node->voice);
           assert(n2.cleforderpenalty >= 0);
           assert(n2.pitchorderpenalty >= 0);
           if (i->node->staff < n2.staff) { // i is in higher staff
             if (i->node->midpitch <= n2.midpitch)
               sc += n2.cleforderpenalty;
-            if (module_pitch(i->node->note) < n2.no)
+            if (i->node->no < n2.no)
               sc += n2.pitchorderpenalty;
           } else if (i->node->staff > n2.staff) { // i is in lower staff
             if (i->node->midpitch >= n2.midpitch)
               sc += n2.cleforderpenalty;
-            if (module_pitch(i->node->note) > n2.no)
+            if (i->node->no > n2.no)
               sc += n2.pitchorderpenalty;
           }
         }
       }
-      for (boost::ptr_map<int, std::set<int>>::const_iterator i(cnt.begin());
-           i != cnt.end(); ++i) {
-        int s = i->second->size();
+      for (std::vector<std::vector<int>>::const_iterator i(stvoices.begin());
+           i != stvoices.end(); ++i) {
+        int s = i->size();
         if (s > 2) {
           sc += n2.voicemaxpenalty * (s - 2);
         }
@@ -338,29 +385,22 @@ namespace staves {
       assert(
           nodes.n >
           0); // nodes are guaranteed to be in range, though needs to be pruned
-      std::vector<scorenode> arr;
-      stavesnode** ie = (stavesnode**) nodes.nodes + nodes.n - 1;
+      std::vector<scorenode>& arr(scr.arr);
+      stavesnode** ib = (stavesnode**) nodes.nodes;
+      stavesnode** ie = ib + nodes.n - 1;
       const stavesnode& n2 = **ie;
-      std::map<int, int> lsts;  // staff, clef
-      std::map<int, int> vlsts; // voice, staff
-      for (stavesnode** i = (stavesnode**) nodes.nodes; i != ie; ++i) {
-        fomus_float d = diface.dist(diface.moddata, (*i)->note, n2.note);
-        std::map<int, int>::iterator l(lsts.find((*i)->staff));
-        std::map<int, int>::iterator vl(vlsts.find((*i)->voice));
-        if (d <= diface.data.rangemax)
-          arr.push_back(
-              scorenode(*i, pow(n2.expon, d),
-                        vl != vlsts.end() && vl->second != (*i)->staff,
-                        l != lsts.end() && l->second != (*i)->clef));
-        if (l == lsts.end())
-          lsts.insert(std::map<int, int>::value_type((*i)->staff, (*i)->clef));
-        else
-          l->second = (*i)->clef;
-        if (vl == vlsts.end())
-          vlsts.insert(
-              std::map<int, int>::value_type((*i)->voice, (*i)->staff));
-        else
-          vl->second = (*i)->staff;
+      // the nodes are the end of a search path, so a change only counts if
+      // the note it's a change from is in them too
+      const int w = (*ib)->depth;
+      scr.begin(n2.note);
+      for (stavesnode** i = ib; i != ie; ++i) {
+        const distweight& x(scr.weight(diface, (ie - i) - 1, (*i)->note,
+                                       n2.note, n2.expon));
+        if (x.inrange)
+          arr.push_back(scorenode(
+              *i, x.wt,
+              (*i)->voprev.depth >= w && (*i)->voprev.staff != (*i)->staff,
+              (*i)->stprev.depth >= w && (*i)->stprev.clef != (*i)->clef));
         assert(arr.empty() || arr.back().node->isvalid());
       }
       search_score sc;
@@ -444,7 +484,10 @@ namespace staves {
         return 0;
       }
     ITSOK2:
-      return new stavesnode(n, st, cl, prt, ss.tcp);
+      stavesnode* x = new stavesnode(n, st, cl, prt, ss.tcp);
+      x->follow(prevnode == api.begin ? 0 : (const stavesnode*) prevnode,
+                staves.size());
+      return x;
     }
     void assignnext(const int choice) {
       DBG("ASSIGNING STAFF = " << module_time(module_peeknextnote(ass))
@@ -551,6 +594,16 @@ namespace staves {
     return module_valid_int(val, 10, module_incl, 0, module_nobound, 0,
                             heapsizetype);
   }
+  const char* beamwidthtype = "integer>=0";
+  int valid_beamwidth(const struct module_value val) {
+    return module_valid_int(val, 0, module_incl, 0, module_nobound, 0,
+                            beamwidthtype);
+  }
+  const char* searchwidthtype = "integer>=1";
+  int valid_searchwidth(const struct module_value val) {
+    return module_valid_int(val, 1, module_incl, 0, module_nobound, 0,
+                            searchwidthtype);
+  }
 
 } // namespace staves
 
@@ -581,6 +634,8 @@ void module_fill_iface(void* moddata, void* iface) { // module
   ms.f = std::numeric_limits<fomus_float>::max();
   ((search_iface*) iface)->min_score = ms;
   ((search_iface*) iface)->heapsize = module_setting_ival(p, heapsizeid);
+  ((search_iface*) iface)->beamwidth = module_setting_ival(p, beamwidthid);
+  ((search_iface*) iface)->expandwidth = module_setting_ival(p, searchwidthid);
 }
 
 const char* module_longname() {
@@ -612,7 +667,7 @@ const char* module_initerr() {
   return ierr;
 }
 int module_itertype() {
-  return module_bypart | module_firsttied | module_norests;
+  return module_bypart | module_firsttied | module_norests | module_partlocal;
 }
 void module_init() {}
 void module_free() { /*assert(newcount == 0);*/
@@ -1017,6 +1072,41 @@ int module_get_setting(int n, module_setting* set, int id) {
   //     vertbalanceid = id;
   //   }
   //   break;
+  case 20: {
+    set->name = "staves-beamwidth"; // docscat{staves}
+    set->type = module_int;
+    set->descdoc =
+        "The number of best partial solutions kept at each step when the "
+        "`dynprog' engine is selected (0 keeps all of them)."
+        "  Smaller values speed up the search for staff and clef "
+        "assignments in parts with many choices at some cost in quality.";
+    set->typedoc = beamwidthtype;
+
+    module_setval_int(&set->val, 0);
+
+    set->loc = module_locpart;
+    set->valid = valid_beamwidth;
+    set->uselevel = 3;
+    beamwidthid = id;
+  } break;
+  case 21: {
+    set->name = "staves-searchwidth"; // docscat{staves}
+    set->type = module_int;
+    set->descdoc =
+        "The number of best partial solutions that are expanded together "
+        "when the `bfsearch' engine is selected."
+        "  Values larger than 1 let the search advance on several "
+        "alternatives at once, trading some of the best-first ordering for "
+        "fewer rounds.";
+    set->typedoc = searchwidthtype;
+
+    module_setval_int(&set->val, 1);
+
+    set->loc = module_locpart;
+    set->valid = valid_searchwidth;
+    set->uselevel = 3;
+    searchwidthid = id;
+  } break;
   default:
     return 0;
   }
@@ -1045,6 +1135,7 @@ inline bool scmp(const module_obj a, const module_obj b, const int id) {
 }
 int module_sameinst(module_obj a, module_obj b) {
   return scmp(a, b, enginemodid) && icmp(a, b, heapsizeid) &&
+         icmp(a, b, beamwidthid) && icmp(a, b, searchwidthid) &&
          scmp(a, b, distmodid) && vcmp(a, b, octdistid) &&
          vcmp(a, b, beatdistid) && vcmp(a, b, rangeid);
 }
@@ -65,7 +65,7 @@ namespace merge {
     return s;
   }
 
-  int minnotesid, chordscid, distscid, heapsizeid, enginemodid;
+  int minnotesid, chordscid, distscid, heapsizeid, enginemodid, searchwidthid;
 
   struct noteobjbase {
     module_noteobj n;
@@ -211,7 +211,7 @@ namespace merge {
     std::auto_ptr<noteobjvect> vect; // for assigning if picked
     const pairvect& switchs; // which voices merge to where... for assigning
     fomus_float sc;
-    fomus_int dist;
+    fomus_int dist, mind;
     boost::ptr_list<nodemap>::iterator it;
 #ifndef NDEBUG
     int valid;
@@ -237,6 +237,7 @@ namespace merge {
       }
       if (lastinm)
         ++dist; // add one for measure boundary
+      mind = module_setting_ival(vect->front().n, minnotesid);
     }
 #ifndef NDEBUG
     bool isvalid() const {
@@ -253,8 +254,7 @@ namespace merge {
     }
     fomus_int mindist() const {
       assert(isvalid());
-      assert(!vect->empty());
-      return module_setting_ival(vect->front().n, minnotesid);
+      return mind;
     }
   };
   inline bool nodesamemerge(const node& x, const node& y) {
@@ -491,6 +491,11 @@ namespace merge {
     return module_valid_int(val, 10, module_incl, 0, module_nobound, 0,
                             heapsizetype);
   }
+  const char* searchwidthtype = "integer>=1";
+  int valid_searchwidth(const struct module_value val) {
+    return module_valid_int(val, 1, module_incl, 0, module_nobound, 0,
+                            searchwidthtype);
+  }
 
   extern "C" {
   void
@@ -577,6 +582,7 @@ void module_fill_iface(void* moddata, void* iface) { // module
   ms.f = std::numeric_limits<fomus_float>::max();
   ((search_iface*) iface)->min_score = ms;
   ((search_iface*) iface)->heapsize = module_setting_ival(p, heapsizeid);
+  ((search_iface*) iface)->expandwidth = module_setting_ival(p, searchwidthid);
 }
 
 const char* module_longname() {
@@ -602,7 +608,7 @@ enum module_type module_type() {
   return module_modmerge;
 }
 int module_itertype() {
-  return module_bypart;
+  return module_bypart | module_partlocal;
 }
 
 const char* module_initerr() {
@@ -714,6 +720,24 @@ int module_get_setting(int n, module_setting* set, int id) {
     enginemodid = id;
     break;
   }
+  case 5: {
+    set->name = "merge-searchwidth"; // docscat{voices}
+    set->type = module_int;
+    set->descdoc =
+        "The number of best partial solutions that are expanded together "
+        "when the `bfsearch' engine is selected."
+        "  Values larger than 1 let the search advance on several "
+        "alternatives at once, trading some of the best-first ordering for "
+        "fewer rounds.";
+    set->typedoc = searchwidthtype;
+
+    module_setval_int(&set->val, 1);
+
+    set->loc = module_locpart;
+    set->valid = valid_searchwidth;
+    set->uselevel = 3;
+    searchwidthid = id;
+  } break;
   default:
     return 0;
   }
@@ -734,5 +758,6 @@ inline bool scmp(const module_obj a, const module_obj b, const int id) {
   return strcmp(module_setting_sval(a, id), module_setting_sval(a, id)) == 0;
 }
 int module_sameinst(module_obj a, module_obj b) {
-  return scmp(a, b, enginemodid) && icmp(a, b, heapsizeid);
+  return scmp(a, b, enginemodid) && icmp(a, b, heapsizeid) &&
+         icmp(a, b, searchwidthid);
 }
@@ -52,7 +52,7 @@ namespace prune {
   inline void free() {}
   int get_setting(int n, module_setting* set, int id);
   inline int itertype() {
-    return module_bypart | module_byvoice;
+    return module_bypart | module_byvoice | module_partlocal;
   }
   void fill_iface(void* moddata, void* iface);
   inline const char* engine() {
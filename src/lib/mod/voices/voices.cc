@@ -26,7 +26,6 @@
 #include <cstring>
 #include <iterator> // back_inserter
 #include <limits>
-#include <map>
 #include <set>
 #include <sstream>
 #include <string>
@@ -41,13 +40,97 @@
 #include "module.h"
 
 #include "debugaux.h"
+#include "distwtaux.h"
+using namespace distwtaux;
 
 namespace voices {
 
   // setting ids
   int vertmaxid, heapsizeid, vertmaxscid, previsgraceid, voiceolapid,
       voicecrossid, /*balanceid,*/ smoothid, adjsmoothid, exponid, octdistid,
-      beatdistid, rangeid, distmodid, enginemodid, connectid, dissimid;
+      beatdistid, rangeid, distmodid, enginemodid, connectid, dissimid,
+      beamwidthid, searchwidthid, snapshotid;
+
+  // settings every node reads, fetched with module_snapshot()
+  enum snapset {
+    snap_vertmaxsc,
+    snap_previsgrace,
+    snap_voiceolap,
+    snap_voicecross,
+    snap_smooth,
+    snap_adjsmooth,
+    snap_expon,
+    snap_vertmax,
+    snap_connect,
+    snap_dissim,
+    snap_n
+  };
+
+  // the notes of one measure, from a single module_snapshot() call instead of
+  // 15 API calls for every note and voice choice
+  struct meassnap {
+    module_measobj meas;
+    int n, last;
+    std::vector<module_noteobj> notes;
+    std::vector<int> flags;
+    std::vector<fomus_rat> ti, teti, no;
+    std::vector<fomus_float> sets;
+    int setids[snap_n];
+    meassnap() : meas(0), n(0), last(0) {
+      setids[snap_vertmaxsc] = vertmaxscid;
+      setids[snap_previsgrace] = previsgraceid;
+      setids[snap_voiceolap] = voiceolapid;
+      setids[snap_voicecross] = voicecrossid;
+      setids[snap_smooth] = smoothid;
+      setids[snap_adjsmooth] = adjsmoothid;
+      setids[snap_expon] = exponid;
+      setids[snap_vertmax] = vertmaxid;
+      setids[snap_connect] = connectid;
+      setids[snap_dissim] = dissimid;
+    }
+    int fill(const int cap) {
+      notes.resize(cap);
+      flags.resize(cap);
+      ti.resize(cap);
+      teti.resize(cap);
+      no.resize(cap);
+      sets.resize(cap * snap_n);
+      module_notesnap sn;
+      memset(&sn, 0, sizeof(sn));
+      sn.cap = cap;
+      sn.notes = &notes[0];
+      sn.flags = &flags[0];
+      sn.rtime = &ti[0];
+      sn.rtiedendtime = &teti[0];
+      sn.rpitch = &no[0];
+      sn.nsets = snap_n;
+      sn.setids = setids;
+      sn.setvals = &sets[0];
+      return module_snapshot(meas, &sn);
+    }
+    int find(const module_noteobj note) { // index of `note'
+      if (last < n && notes[last] == note)
+        return last; // same note, next voice choice
+      if (last + 1 < n && notes[last + 1] == note)
+        return ++last;
+      for (int i = 0; i < n; ++i) {
+        if (notes[i] == note)
+          return last = i;
+      }
+      meas = module_meas(note); // new measure
+      if ((n = fill(std::max(n, 32))) > (int) notes.size())
+        fill(n);
+      for (int i = 0; i < n; ++i) {
+        if (notes[i] == note)
+          return last = i;
+      }
+      assert(false);
+      return -1;
+    }
+    fomus_float set(const int i, const snapset s) const {
+      return sets[s * notes.size() + i];
+    }
+  };
 
   struct voicenode _NONCOPYABLE {
     module_noteobj note;
@@ -62,6 +145,26 @@ namespace voices {
     int vmax;
     fomus_rat ti, teti, no;
     bool isgr;
+    voicenode(const meassnap& sn, const int i, const int voice)
+        : note(sn.notes[i]), voice(voice),
+#ifndef NDEBUG
+          valid(12345),
+#endif
+          ti(sn.ti[i]), teti(sn.teti[i]), no(sn.no[i]),
+          isgr(sn.flags[i] & module_snap_grace) {
+      vertmaxpenalty = sn.set(i, snap_vertmaxsc);
+      previsgracescore = sn.set(i, snap_previsgrace);
+      voiceolappenalty = sn.set(i, snap_voiceolap);
+      voicecrosspenalty = sn.set(i, snap_voicecross);
+      // balancepenalty = module_setting_fval(note, balanceid);
+      smoothpenalty = sn.set(i, snap_smooth);
+      adjsmoothpenalty = sn.set(i, snap_adjsmooth);
+      expon = pow(2, -1 / sn.set(i, snap_expon));
+      vmax = (int) sn.set(i, snap_vertmax);
+      connectpenalty = sn.set(i, snap_connect);
+      dissimpenalty = sn.set(i, snap_dissim);
+    }
+    // one API call per field (`voices-snapshot' off)
     voicenode(const module_noteobj note, const int voice)
         : note(note), voice(voice),
 #ifndef NDEBUG
@@ -69,9 +172,6 @@ namespace voices {
 #endif
           ti(module_time(note)), teti(module_tiedendtime(note)),
           no(module_pitch(note)), isgr(module_isgrace(note)) {
-      initstuff();
-    }
-    void initstuff() {
       vertmaxpenalty = module_setting_fval(note, vertmaxscid);
       previsgracescore = module_setting_fval(note, previsgraceid);
       voiceolappenalty = module_setting_fval(note, voiceolapid);
@@ -140,15 +240,23 @@ namespace voices {
 
   struct voicesdata _NONCOPYABLE {
     std::vector<int> voices; // individual voices, size is the nchoices
+    std::vector<int> slots;  // voice -> index in `voices', -1 if not there
     search_api api;          // engine api
     module_noteobj ass, getn;
+    meassnap snap;
+    bool usesnap; // `voices-snapshot'
     dist_iface diface; // fill it up with data!
+    // scratch space for getscore() (only used from the search thread, see
+    // distwtaux.h)
+    mutable scorescratch<scorenode> scr;
+    mutable std::vector<int> cnt; // note count for each voice in `voices'
     voicesdata() : ass(0), getn(0) {
       diface.moddata = 0;
       diface.data.octdist_setid = octdistid;
       diface.data.beatdist_setid = beatdistid;
       diface.data.byendtime = true;
       module_partobj p = module_peeknextpart(0);
+      usesnap = module_setting_ival(p, snapshotid);
       diface.data.rangemax = module_setting_fval(p, rangeid);
       module_get_auxiface(module_setting_sval(p, distmodid), DIST_INTERFACEID,
                           &diface);
@@ -164,21 +272,38 @@ namespace voices {
     int getlistofvoices(const module_partobj p) {
       module_intslist vl(module_voices(p)); // gets them all
       voices.assign(vl.ints, vl.ints + vl.n);
+      slots.clear();
+      for (int i = 0; i < (int) voices.size(); ++i) {
+        int v = voices[i];
+        if (v < 0)
+          continue;
+        if (v >= (int) slots.size())
+          slots.resize(v + 1, -1);
+        if (slots[v] < 0)
+          slots[v] = i;
+      }
+      cnt.resize(voices.size());
       return voices.size();
     }
+    int slot(const int voice) const {
+      return (voice >= 0 && voice < (int) slots.size()) ? slots[voice] : -1;
+    }
 
     search_score getscore(const search_nodes& nodes)
         const { // nodes ordered by offset, last one is the node being scored
       assert(
           nodes.n >
           0); // nodes are guaranteed to be in range, though needs to be pruned
-      std::vector<scorenode> arr;
-      voicenode** ie = (voicenode**) nodes.nodes + nodes.n - 1;
+      std::vector<scorenode>& arr(scr.arr);
+      voicenode** ib = (voicenode**) nodes.nodes;
+      voicenode** ie = ib + nodes.n - 1;
       const voicenode& n2 = **ie;
-      for (voicenode** i = (voicenode**) nodes.nodes; i != ie; ++i) {
-        fomus_float d = diface.dist(diface.moddata, (*i)->note, n2.note);
-        if (d <= diface.data.rangemax)
-          arr.push_back(scorenode(*i, pow(n2.expon, d)));
+      scr.begin(n2.note);
+      for (voicenode** i = ib; i != ie; ++i) {
+        const distweight& w(scr.weight(diface, (ie - i) - 1, (*i)->note,
+                                       n2.note, n2.expon));
+        if (w.inrange)
+          arr.push_back(scorenode(*i, w.wt));
       }
       search_score sc;
       sc.f = vertmax(arr, n2);
@@ -208,20 +333,19 @@ namespace voices {
     }
     fomus_float vertmax(const std::vector<scorenode>& arr,
                         const voicenode& n2) const {
-      std::map<int, int> cnt; // map of voice -> note-count
-      cnt.insert(std::map<int, int>::value_type(n2.voice, 1));
+      std::fill(cnt.begin(), cnt.end(), 0);
+      int s = slot(n2.voice);
+      if (s >= 0)
+        cnt[s] = 1;
       fomus_rat clos = {std::numeric_limits<fomus_int>::max(), 1};
       bool issam = true; // don't penalize by default
       for (std::vector<scorenode>::const_iterator i(arr.begin());
            i != arr.end(); ++i) {
         fomus_rat et(i->node->teti);
         if (et > n2.ti) { // overlapping notes only
-          std::map<int, int>::iterator c(cnt.find(
-              i->node->voice)); // TODO: account for all possible voices
-          if (c == cnt.end())
-            cnt.insert(std::map<int, int>::value_type(i->node->voice, 1));
-          else
-            ++c->second;
+          int s = slot(i->node->voice); // TODO: account for all possible voices
+          if (s >= 0)
+            ++cnt[s];
         } else { // not overlapping
           fomus_rat d(n2.ti - et);
           if (d < clos) {
@@ -234,11 +358,10 @@ namespace voices {
       }
       fomus_float sc = (issam ? 0 : n2.connectpenalty);
       assert(voices.size() > 0);
-      for (std::vector<int>::const_iterator i(voices.begin());
-           i != voices.end();
+      for (int i = 0; i < (int) voices.size();
            ++i) { // TODO: only those present in simult. notes
-        std::map<int, int>::iterator c(cnt.find(*i));
-        int n = (c == cnt.end() ? 0 : c->second);
+        int s = slots[voices[i]];
+        int n = (s >= 0 ? cnt[s] : 0);
         if (n > n2.vmax)
           sc += (n - n2.vmax) * n2.vertmaxpenalty;
       }
@@ -257,7 +380,8 @@ namespace voices {
       assert(choice >= 0 && choice < (int) voices.size());
       if (!module_hasvoice(n, voices[choice]))
         return 0;
-      return new voicenode(n, voices[choice]);
+      return usesnap ? new voicenode(snap, snap.find(n), voices[choice])
+                     : new voicenode(n, voices[choice]);
     }
     void assignnext(const int choice) {
       DBG("ASSIGNING VOICE = " << voices[choice] << std::endl);
@@ -330,6 +454,16 @@ namespace voices {
     return module_valid_int(val, 10, module_incl, 0, module_nobound, 0,
                             heapsizetype);
   }
+  const char* beamwidthtype = "integer>=0";
+  int valid_beamwidth(const struct module_value val) {
+    return module_valid_int(val, 0, module_incl, 0, module_nobound, 0,
+                            beamwidthtype);
+  }
+  const char* searchwidthtype = "integer>=1";
+  int valid_searchwidth(const struct module_value val) {
+    return module_valid_int(val, 1, module_incl, 0, module_nobound, 0,
+                            searchwidthtype);
+  }
   const char* scoretype = "real>=0";
   int valid_score(const struct module_value val) {
     return module_valid_num(val, module_makeval((fomus_int) 0), module_incl,
@@ -389,6 +523,8 @@ void module_fill_iface(void* moddata, void* iface) { // module
   ms.f = std::numeric_limits<fomus_float>::max();
   ((search_iface*) iface)->min_score = ms;
   ((search_iface*) iface)->heapsize = module_setting_ival(p, heapsizeid);
+  ((search_iface*) iface)->beamwidth = module_setting_ival(p, beamwidthid);
+  ((search_iface*) iface)->expandwidth = module_setting_ival(p, searchwidthid);
 }
 
 const char* module_longname() {
@@ -413,7 +549,8 @@ enum module_type module_type() {
   return module_modvoices;
 }
 int module_itertype() {
-  return module_bypart | module_norests | module_firsttied | module_noperc;
+  return module_bypart | module_norests | module_firsttied | module_noperc |
+         module_partlocal;
 }
 
 const char* module_initerr() {
@@ -735,6 +872,56 @@ int module_get_setting(int n, module_setting* set, int id) {
     set->uselevel = 3;
     smoothid = id;
   } break;
+  case 16: {
+    set->name = "voices-beamwidth"; // docscat{voices}
+    set->type = module_int;
+    set->descdoc =
+        "The number of best partial solutions kept at each step when the "
+        "`dynprog' engine is selected (0 keeps all of them)."
+        "  Smaller values speed up the search for voice assignments in "
+        "parts with many choices at some cost in quality.";
+    set->typedoc = beamwidthtype;
+
+    module_setval_int(&set->val, 0);
+
+    set->loc = module_locpart;
+    set->valid = valid_beamwidth;
+    set->uselevel = 3;
+    beamwidthid = id;
+  } break;
+  case 17: {
+    set->name = "voices-searchwidth"; // docscat{voices}
+    set->type = module_int;
+    set->descdoc =
+        "The number of best partial solutions that are expanded together "
+        "when the `bfsearch' engine is selected."
+        "  Values larger than 1 let the search advance on several "
+        "alternatives at once, trading some of the best-first ordering for "
+        "fewer rounds.";
+    set->typedoc = searchwidthtype;
+
+    module_setval_int(&set->val, 1);
+
+    set->loc = module_locpart;
+    set->valid = valid_searchwidth;
+    set->uselevel = 3;
+    searchwidthid = id;
+  } break;
+  case 18: {
+    set->name = "voices-snapshot"; // docscat{voices}
+    set->type = module_bool;
+    set->descdoc =
+        "Whether or not the voices module reads each measure's notes and "
+        "settings all at once instead of one field at a time."
+        "  This only affects speed (it's here so the two can be compared in "
+        "benchmarks).";
+
+    module_setval_int(&set->val, 1);
+
+    set->loc = module_locpart;
+    set->uselevel = 3;
+    snapshotid = id;
+  } break;
   default:
     return 0;
   }
@@ -756,6 +943,8 @@ inline bool scmp(const module_obj a, const module_obj b, const int id) {
 }
 int module_sameinst(module_obj a, module_obj b) {
   return scmp(a, b, enginemodid) && icmp(a, b, heapsizeid) &&
+         icmp(a, b, beamwidthid) && icmp(a, b, searchwidthid) &&
+         icmp(a, b, snapshotid) &&
          scmp(a, b, distmodid) && vcmp(a, b, octdistid) &&
          vcmp(a, b, beatdistid) && vcmp(a, b, rangeid);
 }
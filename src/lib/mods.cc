@@ -329,6 +329,7 @@ namespace fomus {
 
   bool dlin = false;
   void clearmodules() {
+    waitbackground(0); // their code is about to be unloaded
     if (dlin) {
       mods.clear();
       modsbyname.clear();
@@ -1411,7 +1412,7 @@ fomus_int module_setting_ival(module_obj f, int id) {
   ENTER_API;
   try {
     if (f) {
-      if (id < 0 || id > (int) vars.size()) {
+      if (id < 0 || id >= (int) vars.size()) {
         CERR << "invalid setting id " << id;
         modprinterr();
         throw errbase();
@@ -1430,7 +1431,7 @@ struct fomus_rat module_setting_rval(module_obj f, int id) {
   ENTER_API;
   try {
     if (f) {
-      if (id < 0 || id > (int) vars.size()) {
+      if (id < 0 || id >= (int) vars.size()) {
         CERR << "invalid setting id " << id;
         modprinterr();
         throw errbase();
@@ -1449,7 +1450,7 @@ fomus_float module_setting_fval(module_obj f, int id) {
   ENTER_API;
   try {
     if (f) {
-      if (id < 0 || id > (int) vars.size()) {
+      if (id < 0 || id >= (int) vars.size()) {
         CERR << "invalid setting id " << id;
         modprinterr();
         throw errbase();
@@ -1468,7 +1469,7 @@ const char* module_setting_sval(module_obj f, int id) {
   ENTER_API;
   try {
     if (f) {
-      if (id < 0 || id > (int) vars.size()) {
+      if (id < 0 || id >= (int) vars.size()) {
         CERR << "invalid setting id " << id;
         modprinterr();
         throw errbase();
@@ -1487,7 +1488,7 @@ struct module_value module_setting_val(module_obj f, int id) {
   ENTER_API;
   try {
     if (f) {
-      if (id < 0 || id > (int) vars.size()) {
+      if (id < 0 || id >= (int) vars.size()) {
         CERR << "invalid setting id " << id;
         modprinterr();
         throw errbase();
@@ -1627,6 +1628,162 @@ module_partobj module_peeknextpart(module_partobj part) {
   EXIT_API_0;
 }
 
+int module_snapshot(module_obj obj, struct module_notesnap* snap) {
+  ENTER_API;
+  try {
+    assert(((modobjbase*) obj)->isvalid());
+    for (int s = 0; s < snap->nsets; ++s) {
+      if (snap->setids[s] < 0 || snap->setids[s] >= (int) vars.size()) {
+        CERR << "invalid setting id " << snap->setids[s];
+        modprinterr();
+        throw errbase();
+      }
+    }
+    return snap->n = ((modobjbase*) obj)->snapshot(*snap, 0);
+  } catch (const wrongtype& e) {
+    wrongtypeerr(e);
+    throw errbase();
+  } catch (const badset& e) {
+    modprinterr();
+    throw errbase();
+  }
+  EXIT_API_0;
+}
+
+namespace fomus {
+  // module_parallel() jobs run on the pool as the calling module's stage, each
+  // with its own `profile' counts
+  struct paralleljob {
+    stage* sta;
+    fomusdata* fd;
+    int (*fun)(void*, int);
+    void* data;
+    std::vector<stagecounts> counts; // by job
+    paralleljob(stage* sta, fomusdata* fd, int (*fun)(void*, int), void* data,
+                const int n)
+        : sta(sta), fd(fd), fun(fun), data(data), counts(n) {}
+    void operator()(const int i) { // throws errbase if the job fails
+      stage* s0 = stageobj.get(); // the caller runs jobs too
+      fomusdata* f0 = threadfd.get();
+      stageobj.reset(sta);
+      threadfd.reset(fd);
+      workercounts.reset(&counts[i]);
+      bool err;
+      {
+        arenaguard yyy(fd->getarena());
+        err = fun(data, i);
+      }
+      workercounts.reset();
+      threadfd.reset(f0);
+      stageobj.reset(s0);
+      if (err)
+        throw errbase();
+    }
+  };
+} // namespace fomus
+
+int module_parallel(int n, int (*fun)(void* data, int i), void* data) {
+  ENTER_API;
+  fomusdata* fd = threadfd.get();
+  assert(fd);
+  stage* sta = stageobj.get();
+  fint nt =
+      std::min(fd->get_ival(NTHREADS_ID), (fint) std::numeric_limits<int>::max());
+  if (nt > 0 && n > 1 && sta) {
+    paralleljob job(sta, fd, fun, data, n);
+    bool err = false;
+    try {
+      if (!runpooljobs(*sta, boost::ref(job), n, nt))
+        goto SERIAL;
+    } catch (const errbase& e) {
+      err = true; // the module reports its own errors
+    }
+    for (std::vector<stagecounts>::const_iterator i(job.counts.begin());
+         i != job.counts.end(); ++i)
+      sta->addcounts(*i);
+    return err;
+  }
+SERIAL:
+  for (int i = 0; i < n; ++i)
+    if (fun(data, i))
+      return 1;
+  return 0;
+  EXIT_API_0;
+}
+
+namespace fomus {
+  // module_background() jobs run on detached threads, a job is finished once
+  // it's out of the module's code--each one counts in the group of the
+  // instance that started it and in the process-wide total
+  bggroup allbg;
+  void runbackground(int (*fun)(void*), void* data,
+                     const boost::shared_ptr<bggroup>& grp) { // thread enter
+    bool f = fun(data);
+    {
+      boost::lock_guard<boost::mutex> xxx(grp->mut);
+      --grp->running;
+      if (f)
+        grp->failed = true;
+      grp->cond.notify_all();
+    }
+    boost::lock_guard<boost::mutex> xxx(allbg.mut);
+    --allbg.running;
+    if (f)
+      allbg.failed = true;
+    allbg.cond.notify_all();
+  }
+  bool waitbackground(bggroup* grp) {
+    if (!grp)
+      grp = &allbg;
+    boost::unique_lock<boost::mutex> xxx(grp->mut);
+    while (grp->running > 0)
+      grp->cond.wait(xxx);
+    bool r = !grp->failed;
+    grp->failed = false;
+    return r;
+  }
+  int runningbackground(bggroup* grp) {
+    if (!grp)
+      grp = &allbg;
+    boost::lock_guard<boost::mutex> xxx(grp->mut);
+    return grp->running;
+  }
+} // namespace fomus
+
+void module_background(int (*fun)(void* data), void* data) {
+  ENTER_API;
+  assert(threadfd.get());
+  const boost::shared_ptr<bggroup> grp(threadfd->getbg());
+  {
+    boost::lock_guard<boost::mutex> xxx(allbg.mut);
+    ++allbg.running;
+  }
+  {
+    boost::lock_guard<boost::mutex> xxx(grp->mut);
+    ++grp->running;
+  }
+  try {
+    boost::thread(boost::bind(&runbackground, fun, data, grp)).detach();
+  } catch (const boost::thread_resource_error& e) {
+    runbackground(fun, data, grp); // can't start a thread, do it now
+  }
+  EXIT_API_VOID;
+}
+
+int module_hassink(const char* filename) {
+  ENTER_API;
+  assert(threadfd.get());
+  return threadfd->hassink(filename);
+  EXIT_API_0;
+}
+
+int module_sinkwrite(const char* filename, const char* buf, fomus_int n) {
+  ENTER_API;
+  assert(threadfd.get());
+  return !threadfd->sinkwrite(filename, buf, n);
+  EXIT_API_0;
+}
+
 module_measobj module_meas(module_noteobj note) {
   ENTER_API;
   try {
@@ -3463,6 +3620,18 @@ void module_stderr(const char* str, unsigned long n) {
   }
   EXIT_API_VOID;
 }
+void module_countnodes(fomus_int n) {
+  ENTER_API;
+  if (stageobj.get())
+    stageobj->addnodes(n);
+  EXIT_API_VOID;
+}
+void module_countcache(fomus_int lookups, fomus_int hits) {
+  ENTER_API;
+  if (stageobj.get())
+    stageobj->addcache(lookups, hits);
+  EXIT_API_VOID;
+}
 
 void metaparts_assign(module_noteobj note, module_partobj part, int voice,
                       fomus_rat pitch) {
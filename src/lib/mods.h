@@ -534,6 +534,13 @@ public:
   void initmodules();
   void clearmodules();
 
+  // module_background() jobs of an instance's group (all of them if `grp' is
+  // NULL): wait for them (false if any failed since the last wait) or count
+  // the ones still running
+  struct bggroup;
+  bool waitbackground(bggroup* grp);
+  int runningbackground(bggroup* grp);
+
   // used to execute backend modules
   class fomusdata;
   struct runpair {
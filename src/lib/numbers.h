@@ -345,30 +345,49 @@ namespace FNAMESPACE {
     return module_ratneg(x);
   }
 
+  // a.den == b.den (positive, small)--one gcd instead of rat normalizing both
+  // operands and the result
+  inline struct fomus_rat samedensum(const fint n, const fint d) {
+    if (d == 1)
+      return makerat(n, 1);
+    const fint g = boost::integer::gcd(n, d);
+    return makerat(n / g, d / g);
+  }
+
   inline bool operator==(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) == rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) == 0
+                                 : rat(a.num, a.den) == rat(b.num, b.den);
   }
   inline bool operator!=(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) != rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) != 0
+                                 : rat(a.num, a.den) != rat(b.num, b.den);
   }
   inline bool operator<(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) < rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) < 0
+                                 : rat(a.num, a.den) < rat(b.num, b.den);
   }
   inline bool operator<=(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) <= rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) <= 0
+                                 : rat(a.num, a.den) <= rat(b.num, b.den);
   }
   inline bool operator>(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) > rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) > 0
+                                 : rat(a.num, a.den) > rat(b.num, b.den);
   }
   inline bool operator>=(const struct fomus_rat& a, const struct fomus_rat& b) {
-    return rat(a.num, a.den) >= rat(b.num, b.den);
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) >= 0
+                                 : rat(a.num, a.den) >= rat(b.num, b.den);
   }
   inline struct fomus_rat operator+(const struct fomus_rat& a,
                                     const struct fomus_rat& b) {
+    if (a.den == b.den && module_ratsmall(a, b))
+      return samedensum(a.num + b.num, a.den);
     return rattofrat(rat(a.num, a.den) + rat(b.num, b.den));
   }
   inline struct fomus_rat operator-(const struct fomus_rat& a,
                                     const struct fomus_rat& b) {
+    if (a.den == b.den && module_ratsmall(a, b))
+      return samedensum(a.num - b.num, a.den);
     return rattofrat(rat(a.num, a.den) - rat(b.num, b.den));
   }
   inline struct fomus_rat operator*(const struct fomus_rat& a,
@@ -443,29 +462,39 @@ namespace FNAMESPACE {
   }
 
   inline bool operator==(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) == b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) == 0
+                                 : rat(a.num, a.den) == b;
   }
   inline bool operator!=(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) != b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) != 0
+                                 : rat(a.num, a.den) != b;
   }
   inline bool operator<(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) < b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) < 0
+                                 : rat(a.num, a.den) < b;
   }
   inline bool operator<=(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) <= b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) <= 0
+                                 : rat(a.num, a.den) <= b;
   }
   inline bool operator>(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) > b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) > 0
+                                 : rat(a.num, a.den) > b;
   }
   inline bool operator>=(const struct fomus_rat& a, const fomus_int b) {
-    return rat(a.num, a.den) >= b;
+    return module_ratsmall(a, b) ? module_ratcmp(a, b) >= 0
+                                 : rat(a.num, a.den) >= b;
   }
   inline struct fomus_rat operator+(const struct fomus_rat& a,
                                     const fomus_int b) {
+    if (module_ratsmall(a, b))
+      return samedensum(a.num + b * a.den, a.den);
     return rattofrat(rat(a.num, a.den) + b);
   }
   inline struct fomus_rat operator-(const struct fomus_rat& a,
                                     const fomus_int b) {
+    if (module_ratsmall(a, b))
+      return samedensum(a.num - b * a.den, a.den);
     return rattofrat(rat(a.num, a.den) - b);
   }
   inline struct fomus_rat operator*(const struct fomus_rat& a,
@@ -478,22 +507,28 @@ namespace FNAMESPACE {
   }
 
   inline bool operator==(const fomus_int a, const struct fomus_rat& b) {
-    return a == rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 == module_ratcmp(b, a)
+                                 : a == rat(b.num, b.den);
   }
   inline bool operator!=(const fomus_int a, const struct fomus_rat& b) {
-    return a != rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 != module_ratcmp(b, a)
+                                 : a != rat(b.num, b.den);
   }
   inline bool operator<(const fomus_int a, const struct fomus_rat& b) {
-    return a < rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 < module_ratcmp(b, a)
+                                 : a < rat(b.num, b.den);
   }
   inline bool operator<=(const fomus_int a, const struct fomus_rat& b) {
-    return a <= rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 <= module_ratcmp(b, a)
+                                 : a <= rat(b.num, b.den);
   }
   inline bool operator>(const fomus_int a, const struct fomus_rat& b) {
-    return a > rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 > module_ratcmp(b, a)
+                                 : a > rat(b.num, b.den);
   }
   inline bool operator>=(const fomus_int a, const struct fomus_rat& b) {
-    return a >= rat(b.num, b.den);
+    return module_ratsmall(b, a) ? 0 >= module_ratcmp(b, a)
+                                 : a >= rat(b.num, b.den);
   }
   inline struct fomus_rat operator+(const fomus_int a,
                                     const struct fomus_rat& b) {
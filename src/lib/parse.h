@@ -124,6 +124,8 @@ namespace FNAMESPACE {
 #define INITTEMPOTXT_ID 90
 #define INITTEMPO_ID 91
 #define DETACH_ID 92
+#define PARTPARALLEL_ID 93
+#define PROFILE_ID 94
 
   typedef boostspirit::position_iterator<
       char const*, boostspirit::file_position_base<std::string>>
@@ -27,12 +27,79 @@
 
 namespace fomus {
 
+  // clocks for `profile', in seconds
+  inline double profwall() {
+    static const boost::posix_time::ptime t0(
+        boost::posix_time::microsec_clock::universal_time());
+    return (boost::posix_time::microsec_clock::universal_time() - t0)
+               .total_microseconds() *
+           1e-6;
+  }
+  inline double profcpu() { // calling thread only, if the system can do it
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double) std::clock() / CLOCKS_PER_SEC;
+#endif
+  }
+
   inline bool modisl(const modbase* a, const modbase* b) {
     int pa = a->getpriority(), pb = a->getpriority();
     return (pa != pb) ? pa < pb
                       : (a->getitertype() & 0x7) < (b->getitertype() & 0x7);
   }
 
+  class workpool;
+  struct syncs _NONCOPYABLE {
+    boost::mutex ownmut;
+    boost::mutex& symut; // the pool's mutex if there is one
+    boost::condition_variable
+        sync; // main thread waits here for the pass to finish or deadlock
+    volatile fint fin;
+    volatile int alv; // stages running and not asleep in measisready()
+    volatile int slp; // stages asleep in measisready()
+    int maxalv;       // max. number running at once
+    volatile bool abt; // abort--mutex isn't used for this
+    stagesvect sta;
+    stagesvect_it i; // next stage to start (always in id order)
+    const int verb;
+    const int pass;
+    fomusdata& fd;
+    workpool* pool;
+    const partscope parts;
+    syncs(fomusdata& fd, const int nt, const int verb,
+          const std::vector<runpair>::iterator& b1,
+          const std::vector<runpair>::iterator& b2, const int pa, int& endpass,
+          bool& efix, workpool* pool = 0, const partscope* parts = 0);
+    void notify() {
+      sync.notify_one();
+    }
+    bool canstart() const { // symut must be locked
+      return !abt && i != sta.end() && alv < maxalv;
+    }
+    stage* getstage() { // symut must be locked
+      if (i == sta.end())
+        return 0;
+      ++alv;
+      return &*i++;
+    }
+    void decalv(); // stage is going to sleep
+    void incalv(const int n) { // n stages woke up
+      boost::lock_guard<boost::mutex> xxx(symut);
+      alv += n;
+      slp -= n;
+    }
+  };
+
+  // a module that can be run in a part's chain
+  inline bool ispartlocal(const modbase& mod) {
+    int tt = mod.getitertype();
+    return (tt & module_partlocal) && (tt & (module_bypart | module_bymeas)) &&
+           !(tt & module_bymeasgroups);
+  }
+
   int fomusdata::getsubstages(const std::string& msg, const int modssetid,
                               stagesvect& sta, syncs& sys, bool& filled,
                               const int endpass, bool& fi, const runpair* fn,
@@ -49,10 +116,11 @@ namespace fomus {
     {
       std::multimap<modbase*, stage*> mods; // mods in effect
       modobjbase* lno = 0;
-      scorepartlist_it pe(scoreparts.end());
-      measmap_it mb(scoreparts.front()->getpart().getmeass().begin()),
-          me(scoreparts.back()->getpart().getmeass().end());
-      for (scorepartlist_it p(scoreparts.begin()); p != pe; ++p) {
+      const partscope& sc(sys.parts);
+      scorepartlist_it pb(sc.b), pe(sc.e);
+      measmap_it mb((*pb)->getpart().getmeass().begin()),
+          me((*boost::prior(pe))->getpart().getmeass().end());
+      for (scorepartlist_it p(pb); p != pe; ++p) {
         measmap_it pmb((*p)->getpart().getmeass().begin()),
             pme((*p)->getpart().getmeass().end());
         for (measmap_it m(pmb); m != pme; ++m) {
@@ -89,6 +157,17 @@ namespace fomus {
               else
                 modbs.push_back(((runpair*) fn)->mb);
             }
+            if (sc.plan) { // every module, whatever `endpass' is
+              bool ok = !gotmeasgrpmods;
+              for (std::vector<modbase*>::const_iterator i(modbs.begin());
+                   ok && i != modbs.end(); ++i)
+                ok = ispartlocal(**i);
+              if (!ok) {
+                *sc.plan = false;
+                return 0;
+              }
+              continue;
+            }
             std::vector<modbase*>::const_iterator modbs1(
                 endpass >= 0
                     ? modbs.begin() + std::min(endpass, (int) modbs.size())
@@ -159,7 +238,7 @@ namespace fomus {
                     sta.push_back(
                         st = new stage(
                             stagenum, msg, sys, **i,
-                            (bp || bm) ? p : scoreparts.begin(),
+                            (bp || bm) ? p : pb,
                             (bm ? m : (bp ? pmb : mb)), fi, tt, *v, *s,
                             (modssetid < 0 ? ((runpair*) fn)->fn.c_str() : 0),
                             invvoicesonly)); // p and m might be different
@@ -218,6 +297,8 @@ namespace fomus {
                         boost::lambda::constant_ref(me),
                         boost::lambda::constant_ref(ne)));
     }
+    if (sys.parts.plan)
+      return 0;
     if (gotmeasgrpmods) {
       if (!filled) {
         filltmppart();
@@ -310,12 +391,12 @@ namespace fomus {
       stagenum += stagenumadj;
     } else if (modssetid == -2 && stal == (fint) sta.size()) {
       sta.push_back(new stage(
-          stagenum, msg, sys, *fn->mb, scoreparts.begin(),
-          scoreparts.front()->getpart().getmeass().begin(), true,
+          stagenum, msg, sys, *fn->mb, sys.parts.b,
+          (*sys.parts.b)->getpart().getmeass().begin(), true,
           fn->mb->getitertype(), 0, 0, ((runpair*) fn)->fn.c_str(),
           invvoicesonly)); // p and m might be different depending on iter_types
-      measmap_it e(scoreparts.back()->getpart().getmeass().end());
-      sta.back().setends(scoreparts.end(), e,
+      measmap_it e((*boost::prior(sys.parts.e))->getpart().getmeass().end());
+      sta.back().setends(sys.parts.e, e,
                          boost::prior(e)->second->getevents().end());
     }
     for (std::vector<std::pair<measure*, stage*>>::const_iterator i(
@@ -325,51 +406,107 @@ namespace fomus {
     return pag ? endpass + 1 : 0;
   }
 
-  struct syncs _NONCOPYABLE {
-    boost::mutex symut;
-    boost::condition_variable sync; // synchronization object for all threads
-    volatile fint fin;
-    volatile int alv;
-    volatile bool abt; // abort--mutex isn't used for this
-    stagesvect sta;
-    stagesvect_it i; // iterator for launching/recycling threads
-    boost::shared_mutex stamut;
-    const int verb;
-    fomusdata& fd;
-    syncs(fomusdata& fd, const int nt, const int verb,
-          const std::vector<runpair>::iterator& b1,
-          const std::vector<runpair>::iterator& b2, const int pa, int& endpass,
-          bool& efix)
-        : abt(false), verb(verb), fd(fd) {
-      endpass = fd.getstages(sta, *this, b1, b2, pa, endpass, efix);
-      fin = sta.size();
-      alv = nt > 0
-                ? std::min((stagesvect::size_type) nt, sta.size())
-                : std::numeric_limits<int>::max(); // number alive at one time
-      i = sta.begin();                             // set iterator to first one
+  // A batch of jobs for the pool's threads, taken in index order with at
+  // most `maxalv' running at once.  The thread that hands them to the pool
+  // takes jobs as well, so they get done even if every other thread is busy.
+  struct workjobs _NONCOPYABLE {
+    boost::function<void(const int)> fun; // throws errbase on error
+    const int n, maxalv;
+    int nx;  // next job to start
+    int alv; // jobs running
+    bool abt;
+    boost::condition_variable done;
+    workjobs(const boost::function<void(const int)>& fun, const int n,
+             const int maxalv)
+        : fun(fun), n(n), maxalv(maxalv), nx(0), alv(0), abt(false) {}
+    bool canstart() const { // pool's mutex must be locked
+      return !abt && nx < n && alv < maxalv;
     }
-    void notify() {
-      sync.notify_one();
+  };
+
+  // Persistent worker threads, created once in runfomus() and handed a new
+  // syncs object for every pass.  Stages are started strictly in id order
+  // (a stage only ever waits on stages with lower ids, so this can't deadlock)
+  // and at most `n-threads' of them run at once.  When a stage goes to sleep
+  // in measisready() its slot is given to the next stage, and the pool grows
+  // (up to a limit) if there's no idle thread to take it.
+  class workpool _NONCOPYABLE {
+    friend struct syncs;
+    boost::mutex mut;
+    boost::condition_variable wake; // idle threads wait here
+    boost::thread_group threads;
+    syncs* sys;
+    std::vector<workjobs*> jobs;
+    int nthr, nidle, maxthr;
+    bool quit;
+
+public:
+    workpool(const int n)
+        : sys(0), nthr(0), nidle(0),
+          maxthr(n < std::numeric_limits<int>::max() / 4 ? n * 4 : n),
+          quit(false) {}
+    ~workpool() {
+      {
+        boost::lock_guard<boost::mutex> xxx(mut);
+        quit = true;
+      }
+      wake.notify_all();
+      threads.join_all();
     }
-    stage* getstage() {
-      boost::upgrade_lock<boost::shared_mutex> xxx(stamut);
-      if (i == sta.end())
-        return 0;
-      boost::upgrade_to_unique_lock<boost::shared_mutex> yyy(xxx);
-      return &*i++;
+    void run(syncs& s);
+    void runjobs(workjobs& j);
+    void threadfun();
+
+private:
+    workjobs* nextjobs() const { // mut must be locked
+      for (std::vector<workjobs*>::const_iterator i(jobs.begin());
+           i != jobs.end(); ++i)
+        if ((*i)->canstart())
+          return *i;
+      return 0;
     }
-    void decalv() {
-      {
-        boost::unique_lock<boost::mutex> xxx(symut);
-        --alv;
-        if (alv <= 0) {
-          xxx.unlock();
-          notify();
+    void dojob(workjobs& j, boost::unique_lock<boost::mutex>& xxx);
+    void grow() { // mut must be locked
+      if (sys && sys->canstart()) {
+        if (nidle > 0)
+          wake.notify_one();
+        else if (nthr < maxthr) {
+          ++nthr;
+          ++nidle;
+          threads.create_thread(boost::bind(&workpool::threadfun, this));
         }
       }
     }
+    bool canrun() const { // can another stage be started?
+      return sys->canstart() && (nidle > 0 || nthr < maxthr);
+    }
   };
 
+  syncs::syncs(fomusdata& fd, const int nt, const int verb,
+               const std::vector<runpair>::iterator& b1,
+               const std::vector<runpair>::iterator& b2, const int pa,
+               int& endpass, bool& efix, workpool* pool,
+               const partscope* parts)
+      : symut(pool ? pool->mut : ownmut), alv(0), slp(0), abt(false),
+        verb(verb), pass(pa), fd(fd), pool(pool),
+        parts(parts ? *parts : fd.allparts()) {
+    endpass = fd.getstages(sta, *this, b1, b2, pa, endpass, efix);
+    fin = sta.size();
+    maxalv = nt > 0 ? nt
+                    : std::numeric_limits<int>::max(); // number alive at once
+    i = sta.begin(); // set iterator to first one
+  }
+
+  void syncs::decalv() {
+    boost::lock_guard<boost::mutex> xxx(symut);
+    --alv;
+    ++slp;
+    if (pool)
+      pool->grow(); // hand the slot to the next stage
+    if (alv <= 0)
+      notify(); // main thread checks for deadlock
+  }
+
   void fomusdata::writeout(stagesvect& sta, syncs& sys,
                            std::vector<runpair>::iterator b1,
                            const std::vector<runpair>::iterator& b2,
@@ -384,7 +521,7 @@ namespace fomus {
       getsubstages(msg.str(), -1, sta, sys, filled, -1, fix = true, &*b1);
     }
     if (pre) {
-      delfills();
+      delfills(sys.parts);
       std::for_each(
           sta.begin(), sta.end(),
           boost::lambda::bind(&stage::resetnoteits, boost::lambda::_1));
@@ -396,7 +533,7 @@ namespace fomus {
                            const std::vector<runpair>::iterator& b2,
                            const int pa, int endpass, bool& efix) {
 #ifndef NDEBUG
-    for (scorepartlist_it i(scoreparts.begin()); i != scoreparts.end(); ++i)
+    for (scorepartlist_it i(sys.parts.b); i != sys.parts.e; ++i)
       (*i)->resetstage();
 #endif
     bool filled = false, fix;
@@ -408,6 +545,8 @@ namespace fomus {
         << pa << ", here we go... ()()()()()()()()" << std::endl);
     switch (pa) {
     case 0: { // don't need `prepare' for pa < 1
+      if (!acrossparts(sys.parts))
+        break;
       if (sys.verb >= 1)
         fout << "processing..." << std::endl;
       preprocess();
@@ -420,8 +559,8 @@ namespace fomus {
     }
     case 1: {
       if (endpass <= 0)
-        delfills();
-      prepare();
+        delfills(sys.parts);
+      prepare(sys.parts);
       endpass = getsubstages(sys.verb >= 2 ? "  quantizing time values..." : "",
                              TQUANTMOD_ID, sta, sys, filled, endpass, efix);
       runpair x(
@@ -431,7 +570,7 @@ namespace fomus {
       break;
     }
     case 2: {
-      prepare();
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  quantizing pitches..." : "", PQUANTMOD_ID,
                    sta, sys, filled, -1, fix = true);
       runpair x(&imod_postpquant);
@@ -451,27 +590,29 @@ namespace fomus {
       break;
     }
     case 3: { // fake grace notes become full durations
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_fillnotes1_destr); // ***
       getsubstages("", -1, sta, sys, filled, -1, fix = true, &x);
       break;
     }
     case 4: {
-      fillnotes1();
-      prepare();
+      fillnotes1(sys.parts);
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  distributing metapart events..." : "",
                    METAPARTSMOD_ID, sta, sys, filled, -1, fix = true);
       break;
     }
     case 5: {
+      if (!acrossparts(sys.parts))
+        break;
       postmparts();
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_redoties_destr); // *** uses willbetied
       getsubstages("", -1, sta, sys, filled, -1, fix = true, &x);
       break;
     }
     case 6: {
-      prepare();
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  processing percussion events..." : "",
                    PERCNOTESMOD_ID, sta, sys, filled, -1, fix = true);
       runpair x(&imod_pnotes_destr); // ***
@@ -479,7 +620,7 @@ namespace fomus {
       break;
     }
     case 7: { // pruning must come early, before processing spanner marks
-      prepare();
+      prepare(sys.parts);
       endpass =
           getsubstages(sys.verb >= 2 ? "  pruning overlapping pitches..." : "",
                        PRUNEMOD_ID, sta, sys, filled, endpass,
@@ -490,7 +631,7 @@ namespace fomus {
       break;
     }
     case 8: {
-      prepare();
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  distributing mark events..." : "",
                    MARKEVS1MOD_ID, sta, sys, filled, -1, fix = true);
       runpair x(&imod_postmarkevs_destr); // ***
@@ -498,8 +639,8 @@ namespace fomus {
       break;
     }
     case 9: {
-      fillholes1(); // insert temporary events
-      prepare();
+      fillholes1(sys.parts); // insert temporary events
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  quantizing time values of marks..." : "",
                    TQUANTMOD_ID, sta, sys, filled, -1, fix = true, 0, true);
       runpair x(
@@ -509,7 +650,7 @@ namespace fomus {
       break;
     }
     case 10: {
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_inbetweenmarks); // removes duplicate marks
       getsubstages("", -1, sta, sys, filled, -1, fix = true, &x);
       x.mb = &imod_prevspan;
@@ -542,7 +683,7 @@ namespace fomus {
       break;
     }
     case 11: {
-      prepare();
+      prepare(sys.parts);
       if (endpass <= 0) {
         runpair x(&imod_contmarkss);
         getsubstages("", -1, sta, sys, filled, -1, fix = true, &x);
@@ -578,7 +719,7 @@ namespace fomus {
       break;
     }
     case 12: {
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_fillholes_destr); // *** fill in holes with rests here
       getsubstages("", -1, sta, sys, filled, -1, fix = true,
                    &x); // need rests before processing marks
@@ -586,11 +727,11 @@ namespace fomus {
     }
     case 13: {
       DBG("gonna fill some holes" << std::endl);
-      fillholes1(); // must follow fillholes
+      fillholes1(sys.parts); // must follow fillholes
       DBG("gonna fill some more holes" << std::endl);
-      fillholes2(); // full measure rests
+      fillholes2(sys.parts); // full measure rests
       DBG("filled all them holes" << std::endl);
-      prepare();
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  creating cautionary accidentals..." : "",
                    CAUTACCSMOD_ID, sta, sys, filled, -1,
                    fix = true); // depends on octave signs, special notations
@@ -601,9 +742,11 @@ namespace fomus {
       break;
     }
     case 14: {
+      if (!acrossparts(sys.parts))
+        break;
       if (endpass <= 0)
         postparts(); // must follow parts layout
-      prepare();
+      prepare(sys.parts);
       endpass = getsubstages(sys.verb >= 2 ? "  dividing/tying notes..." : "",
                              DIVMOD_ID, sta, sys, filled, endpass, efix);
       runpair x(&imod_posttie_destr); // ***
@@ -612,22 +755,22 @@ namespace fomus {
       break;
     }
     case 15: {
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_splittrems_destr); // ***
       getsubstages("", -1, sta, sys, filled, -1, fix = true,
                    &x); // will split notes, must be last
       break;
     }
     case 16: {
-      prepare();
+      prepare(sys.parts);
       runpair x(&imod_fillnotes2_destr); // *** deal with "point" durations
       getsubstages("", -1, sta, sys, filled, -1, fix = true, &x);
       break;
     }
     case 17: {      // the rest can't really be checked--they alter flags and
                     // settings...
-      fillnotes1(); // reinserts temporary events
-      prepare();
+      fillnotes1(sys.parts); // reinserts temporary events
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  choosing rest staves..." : "",
                    RESTSTAVESMOD_ID, sta, sys, filled, -1, fix = true);
       runpair x(&imod_poststaves2_destr); // *** deal with where rests go
@@ -635,7 +778,7 @@ namespace fomus {
       break;
     }
     case 18: {
-      prepare();
+      prepare(sys.parts);
       endpass = getsubstages(sys.verb >= 2 ? "  merging parts..." : "",
                              MERGEMOD_ID, sta, sys, filled, endpass,
                              efix); // single rests, voices as chords--if in
@@ -646,7 +789,7 @@ namespace fomus {
       break;
     }
     case 19: {
-      prepare();
+      prepare(sys.parts);
       getsubstages(sys.verb >= 2 ? "  beaming notes..." : "", BEAMMOD_ID, sta,
                    sys, filled, -1, fix = true);
       runpair x(&imod_postbeams);
@@ -672,16 +815,19 @@ namespace fomus {
       break;
     }
     case 20:
+      if (!acrossparts(sys.parts))
+        break;
       fillholes3();
-      prepare();
+      prepare(sys.parts);
 #ifndef NDEBUGOUT
       dumpall();
 #endif
     case -1:
-      writeout(sta, sys, b1, b2, pa < 0);
+      if (acrossparts(sys.parts))
+        writeout(sta, sys, b1, b2, pa < 0);
     }
 #ifndef NDEBUGOUT
-    for (scorepartlist_it i(scoreparts.begin()); i != scoreparts.end(); ++i)
+    for (scorepartlist_it i(sys.parts.b); i != sys.parts.e; ++i)
       (*i)->showstage();
 #endif
     return endpass;
@@ -689,6 +835,20 @@ namespace fomus {
 
 #define LASTPASS 20
 
+  // runs getstages() without making any stages to see whether pass `pa'
+  // only looks at one part at a time
+  bool fomusdata::canchain(const int pa,
+                           const std::vector<runpair>::iterator& b1,
+                           const std::vector<runpair>::iterator& b2) {
+    bool ok = true;
+    int endpass = 0;
+    bool efix = true;
+    partscope sc(scoreparts.begin(), scoreparts.end(), false, &ok);
+    syncs sys(*this, 0, 0, b1, b2, pa, endpass, efix, 0, &sc);
+    assert(sys.sta.empty());
+    return ok;
+  }
+
   typedef std::multimap<stage*, boost::condition_variable_any*> wakeupcondmap;
   typedef wakeupcondmap::iterator wakeupcondmap_it;
   typedef wakeupcondmap::const_iterator wakeupcondmap_constit;
@@ -960,8 +1120,9 @@ namespace fomus {
           goto AGAIN;
         wakeups.insert(
             wakeupcondmap_val(ss, &thisstage.wkup)); // store a pointer!
-        thisstage.getsys().decalv(); // decrement # alive count--main thread
-                                     // will report deadlock
+        thisstage.getsys().decalv(); // decrement # alive count--next stage
+                                     // can start, main thread will report
+                                     // deadlock
         DBG("stage (" << thisstage.getid() << ") at meas (" << CMUT(off).off
                       << ") is SLEEPING and WAITING on stage (" << ss->getid()
                       << ")" << std::endl);
@@ -969,9 +1130,13 @@ namespace fomus {
 #ifndef NDEBUG
         stage* x0x0 = ss;
 #endif
+        profiler* pr = thisstage.getsys().fd.getprofiler();
+        double t0 = pr ? profwall() : 0;
         thisstage.wkup.wait(xxx); // unlock xxx only after locking wkup's
                                   // mutex--signaling thread later re-increments
                                   // alv and removes cond from the meas
+        if (pr)
+          thisstage.addwait(profwall() - t0);
         assert(stages.find(x0x0) == stages.end());
         DBG("stage (" << thisstage.getid() << ") at meas (" << CMUT(off).off
                       << ") is AWAKE" << std::endl);
@@ -1021,11 +1186,8 @@ namespace fomus {
         wakeups.erase(i++);
       }
     }
-    {
-      syncs& sys(stageobj->getsys());
-      boost::lock_guard<boost::mutex> xxx(sys.symut);
-      sys.alv += n;
-    }
+    if (n > 0)
+      stageobj->getsys().incalv(n);
     DBG("stage (" << stageobj->getid() << ") at meas (" << CMUT(off).off
                   << ") is FINISHED" << std::endl);
     for (std::vector<boost::condition_variable_any*>::iterator x(bla.begin());
@@ -1054,8 +1216,26 @@ namespace fomus {
     DBG("%%%% I reset the lockcheck %%%%" << std::endl);
 #endif
     DBG("%%%% now I'm getting ready to exec %%%%" << std::endl);
+    profiler* pr = fd->getprofiler();
+    double w0, c0;
+    if (pr) {
+      w0 = profwall();
+      c0 = profcpu();
+    }
     mod.exec(fd, dat.data, filename); // API
     DBG("%%%% done with exec %%%%" << std::endl);
+    if (pr) {
+      profentry e;
+      e.stages = 1;
+      e.notes = checkin;
+      e.nodes = nodes;
+      e.lookups = lookups;
+      e.hits = hits;
+      e.wall = profwall() - w0;
+      e.cpu = profcpu() - c0;
+      e.wait = waited;
+      pr->addstage(sys.pass, mod.getsname(), e);
+    }
 #ifndef NDEBUG
     DBG("%%%% getting ready to reset the lockcheck again %%%%" << std::endl);
     lockcheck.reset();
@@ -1073,50 +1253,181 @@ namespace fomus {
   boost::thread_specific_ptr<stage> stageobj(delstageobj);
   boost::thread_specific_ptr<fomusdata> threadfd(delfomusdata0);
   boost::thread_specific_ptr<char> threadcharptr(delthreadcharptr);
+  boost::thread_specific_ptr<stagecounts> workercounts(delstagecounts);
 
-  // structure for boost's thread API
-  struct exec_thread {
+  // runs all of the stages one after another in the calling thread
+  struct exec_all {
     syncs& sys;
-    exec_thread(syncs& sys) : sys(sys) {}
+    exec_all(syncs& sys) : sys(sys) {}
     void operator()();
   };
 
-  void exec_thread::operator()() { // thread enter
-    DBG(" thread is running" << std::endl);
+  void exec_all::operator()() {
     try {
       threadfd.reset(&sys.fd);
+      arenaguard yyy(sys.fd.getarena());
       while (true) {
-        stageobj.reset(sys.getstage());
-        if (!stageobj.get()) { // no more stages--reached the end
-          boost::unique_lock<boost::mutex> xxx(sys.symut);
-          --sys.alv; // thread is dead
-          DBG("Thread is dead... Down to sys.alv = [[ " << sys.alv << " ]] "
-                                                        << std::endl);
-          if (sys.fin <= 0 || sys.alv <= 0) {
-            xxx.unlock(); // this is really ok
-            sys.notify();
-          }
-          return; // exit thread
+        {
+          boost::lock_guard<boost::mutex> xxx(sys.symut);
+          stageobj.reset(sys.getstage());
         }
+        if (!stageobj.get()) // no more stages--reached the end
+          return;
         DBG("! EXECUTING STAGE {{{" << stageobj.get()->getid() << "}}}"
                                     << std::endl);
         stageobj->exec(&sys.fd);
-        boost::unique_lock<boost::mutex> xxx(sys.symut);
+        boost::lock_guard<boost::mutex> xxx(sys.symut);
+        --sys.alv;
         --sys.fin;
-        DBG("Done executing... Down to sys.fin = [[ " << sys.fin << " ]]"
-                                                      << std::endl);
       }
-    } catch (const boost::thread_interrupted& e) { // thread intrrupt
+    } catch (const boost::thread_interrupted& e) {
       DBG("thread has been interrupted" << std::endl);
     } catch (const errbase& e) {
       DBG("an error occurred" << std::endl);
       sys.abt = true;
     }
-    {
-      boost::unique_lock<boost::mutex> xxx(sys.symut);
-      sys.alv = 0;
+  }
+
+  void workpool::threadfun() { // thread enter
+    DBG(" thread is running" << std::endl);
+    boost::unique_lock<boost::mutex> xxx(mut);
+    try {
+      while (true) {
+        workjobs* j = 0;
+        while (!quit && !(sys && sys->canstart()) && !(j = nextjobs()))
+          wake.wait(xxx);
+        if (quit)
+          break;
+        if (j) {
+          --nidle;
+          dojob(*j, xxx);
+          ++nidle;
+          continue;
+        }
+        syncs& s = *sys;
+        --nidle;
+        stageobj.reset(s.getstage());
+        xxx.unlock();
+        threadfd.reset(&s.fd);
+        arenaguard yyy(s.fd.getarena());
+        DBG("! EXECUTING STAGE {{{" << stageobj.get()->getid() << "}}}"
+                                    << std::endl);
+        bool ok = true;
+        try {
+          stageobj->exec(&s.fd);
+        } catch (const boost::thread_interrupted& e) { // thread intrrupt
+          DBG("thread has been interrupted" << std::endl);
+          ok = false;
+        } catch (const errbase& e) {
+          DBG("an error occurred" << std::endl);
+          ok = false;
+        }
+        stageobj.reset();
+        xxx.lock();
+        ++nidle;
+        --s.alv;
+        if (ok)
+          --s.fin;
+        else
+          s.abt = true;
+        DBG("Done executing... Down to sys.fin = [[ " << s.fin << " ]]"
+                                                      << std::endl);
+        if (s.fin <= 0 || s.abt || s.alv <= 0)
+          s.notify();
+      }
+    } catch (const boost::thread_interrupted& e) { // interrupted while idle
+      DBG("thread has been interrupted" << std::endl);
+    }
+  }
+
+  void workpool::run(syncs& s) {
+    boost::unique_lock<boost::mutex> xxx(mut);
+    DBG("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"
+        "$$$$$$$$$$$$"
+        << std::endl);
+    DBG("[[ " << s.fin << " ]] stages ready to go" << std::endl);
+#ifndef NDEBUGOUT
+    for (stagesvect_it i(s.sta.begin()); i != s.sta.end(); ++i)
+      DBG(i->getid() << " ");
+    DBG(std::endl);
+#endif
+    DBG("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"
+        "$$$$$$$$$$$$"
+        << std::endl);
+    sys = &s;
+    for (int n = std::min((stagesvect::size_type) s.maxalv, s.sta.size());
+         nthr < n; ++nthr, ++nidle)
+      threads.create_thread(boost::bind(&workpool::threadfun, this));
+    wake.notify_all();
+    while (s.fin > 0) {
+      if (s.abt || (s.alv <= 0 && !canrun())) {
+        DBG("MODULE THREADS ARE DEADLOCKED, CAN'T CONTINUE" << std::endl);
+        s.abt = true;
+        sys = 0;
+        quit = true;
+        xxx.unlock();
+        wake.notify_all();
+        threads.interrupt_all(); // wake up the sleepers
+        threads.join_all();
+        throw errbase();
+      }
+      s.sync.wait(xxx); // wait for threads to finish or sleep
+    }
+    sys = 0;
+    assert(s.alv == 0);
+    assert(s.slp == 0);
+  }
+
+  void workpool::dojob(workjobs& j,
+                       boost::unique_lock<boost::mutex>& xxx) { // mut locked
+    int i = j.nx++;
+    ++j.alv;
+    xxx.unlock();
+    bool ok = true;
+    try {
+      j.fun(i);
+    } catch (const boost::thread_interrupted& e) {
+      DBG("thread has been interrupted" << std::endl);
+      ok = false;
+    } catch (const errbase& e) {
+      DBG("an error occurred" << std::endl);
+      ok = false;
     }
-    sys.notify();
+    xxx.lock();
+    --j.alv;
+    if (!ok)
+      j.abt = true;
+    j.done.notify_all(); // the thread in runjobs() might take the next one
+  }
+
+  void workpool::runjobs(workjobs& j) {
+    boost::unique_lock<boost::mutex> xxx(mut);
+    jobs.push_back(&j);
+    for (int n = std::min(j.n, j.maxalv) - 1; nidle < n && nthr < maxthr;
+         ++nthr, ++nidle)
+      threads.create_thread(boost::bind(&workpool::threadfun, this));
+    wake.notify_all();
+    while (true) {
+      if (j.canstart())
+        dojob(j, xxx);
+      else if (j.alv > 0)
+        j.done.wait(xxx);
+      else
+        break;
+    }
+    jobs.erase(std::find(jobs.begin(), jobs.end(), &j));
+    if (j.abt)
+      throw errbase();
+  }
+
+  bool runpooljobs(stage& sta, const boost::function<void(const int)>& fun,
+                   const int n, const int nt) {
+    workpool* pool = sta.getsys().pool;
+    if (!pool)
+      return false;
+    workjobs j(fun, n, nt);
+    pool->runjobs(j);
+    return true;
   }
 
   inline void fomusdata::singlethread(const int v,
@@ -1125,61 +1436,150 @@ namespace fomus {
                                       const int pa, int& endpass, bool& efix) {
     syncs sys(*this, 0, v, b1, b2, pa, endpass, efix);
     assert(!stageobj.get());
-    (exec_thread(sys))();
+    (exec_all(sys))();
     stageobj.reset();
     assert(!stageobj.get());
     if (sys.abt)
       throw errbase();
   }
 
-  void fomusdata::multithread(const int n, const int v,
+  void fomusdata::multithread(workpool& pool, const int n, const int v,
                               const std::vector<runpair>::iterator& b1,
                               const std::vector<runpair>::iterator& b2,
                               const int pa, int& endpass, bool& efix) {
-    syncs sys(*this, n, v, b1, b2, pa, endpass, efix);
-    if (sys.alv <= 0)
+    syncs sys(*this, n, v, b1, b2, pa, endpass, efix, &pool);
+    if (sys.sta.empty())
       return;
-    boost::thread_group threads;
-    {
-      boost::unique_lock<boost::mutex> sylock(
-          sys.symut); // locks the main cond mutex
-      DBG("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"
-          "$$$$$$$$$$$$"
-          << std::endl);
-      DBG("[[ " << sys.fin << " ]] stages ready to go" << std::endl);
-#ifndef NDEBUGOUT
-      for (stagesvect_it i(sys.sta.begin()); i != sys.sta.end(); ++i)
-        DBG(i->getid() << " ");
-      DBG(std::endl);
-#endif
-      DBG("[[ " << sys.alv << " ]] threads ready to go" << std::endl);
-      DBG("$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"
-          "$$$$$$$$$$$$"
-          << std::endl);
-      for (int i = 0; i < sys.alv; ++i)
-        threads.create_thread(exec_thread(sys));
-      while (true) {
-        sys.sync.wait(sylock); // wait for threads to finish or sleep
-        if (sys.fin <= 0)
-          break;
-        if (sys.alv <= 0) {
-          sylock.unlock();
-          DBG("MODULE THREADS ARE DEADLOCKED, CAN'T CONTINUE" << std::endl);
-          sys.abt = true;
-          threads.interrupt_all();
-          threads.join_all();
-          throw errbase();
-        }
+    pool.run(sys);
+    assert(sys.fin == 0);
+  }
+
+  // job `i' runs all of the chained passes on the i'th part, with the stages
+  // of each pass run one after another--only getstages() (and the helpers
+  // it calls) is done one part at a time
+  struct partchain _NONCOPYABLE {
+    fomusdata& fd;
+    const int verb;
+    const std::vector<runpair>::iterator &b1, &b2;
+    const int pa1, pa2;
+    boost::mutex mut; // getstages() is called by one chain at a time
+    std::vector<scorepartlist_it> parts;
+    volatile bool abt;
+    partchain(fomusdata& fd, const int verb,
+              const std::vector<runpair>::iterator& b1,
+              const std::vector<runpair>::iterator& b2, const int pa1,
+              const int pa2)
+        : fd(fd), verb(verb), b1(b1), b2(b2), pa1(pa1), pa2(pa2), abt(false) {
+      for (scorepartlist_it i(fd.getscoreparts().begin());
+           i != fd.getscoreparts().end(); ++i)
+        parts.push_back(i);
+    }
+    void operator()(const int i);
+  };
+
+  void partchain::operator()(const int i) { // a pool thread
+    threadfd.reset(&fd);
+    arenaguard yyy(fd.getarena());
+    const partscope sc(parts[i], boost::next(parts[i]), true);
+    int v = i ? std::min(verb, 1) : verb; // only print pass messages once
+    try {
+      for (int pa = pa1; pa < pa2; ++pa) {
+        int endpass = 0;
+        bool efix = true;
+        do {
+          if (abt)
+            return;
+          boost::scoped_ptr<syncs> sys;
+          {
+            boost::lock_guard<boost::mutex> xxx(mut);
+            sys.reset(new syncs(fd, 0, v, b1, b2, pa, endpass, efix, 0, &sc));
+          }
+          (exec_all(*sys))();
+          stageobj.reset();
+          if (sys->abt)
+            throw errbase();
+        } while (endpass > 0);
       }
+    } catch (const errbase& e) {
+      abt = true;
+      throw;
     }
-    threads.join_all();
-    assert(sys.fin == 0);
-    assert(sys.alv == 0);
+  }
+
+  void fomusdata::partchains(workpool& pool, const int n, const int v,
+                             const std::vector<runpair>::iterator& b1,
+                             const std::vector<runpair>::iterator& b2,
+                             const int pa1, const int pa2) {
+    partchain ch(*this, v, b1, b2, pa1, pa2);
+    workjobs j(boost::ref(ch), ch.parts.size(), n);
+    pool.runjobs(j);
+    prepare(allparts()); // chains don't update the caches that cover all parts
+  }
+
+  boost::thread_specific_ptr<std::string> lastprofile;
+
+  void profiler::addstage(const int pass, const std::string& mod,
+                          const profentry& e) {
+    boost::lock_guard<boost::mutex> xxx(mut);
+    profentry& x = mods[std::make_pair(pass, mod)];
+    x.stages += e.stages;
+    x.notes += e.notes;
+    x.nodes += e.nodes;
+    x.lookups += e.lookups;
+    x.hits += e.hits;
+    x.wall += e.wall;
+    x.cpu += e.cpu;
+    x.wait += e.wait;
+  }
+
+  inline void printjsonstr(std::ostream& ou, const std::string& str) {
+    ou << '"';
+    for (std::string::const_iterator i(str.begin()); i != str.end(); ++i) {
+      if (*i == '"' || *i == '\\')
+        ou << '\\';
+      ou << *i;
+    }
+    ou << '"';
+  }
+
+  void profiler::print(std::ostream& ou, const int nthreads, const double wall,
+                       const double cpu) const {
+    ou.setf(std::ios_base::fixed, std::ios_base::floatfield);
+    ou.precision(6);
+    ou << "{\n  \"version\": ";
+    printjsonstr(ou, VERSION);
+    ou << ",\n  \"n-threads\": " << nthreads << ",\n  \"wall\": " << wall
+       << ",\n  \"cpu\": " << cpu << ",\n  \"passes\": [";
+    for (std::vector<std::pair<std::pair<int, int>, double>>::const_iterator i(
+             passes.begin());
+         i != passes.end(); ++i) {
+      ou << (i == passes.begin() ? "\n" : ",\n") << "    {\"first\": "
+         << i->first.first << ", \"last\": " << i->first.second
+         << ", \"wall\": " << i->second << '}';
+    }
+    ou << "\n  ],\n  \"modules\": [";
+    for (profmap_constit i(mods.begin()); i != mods.end(); ++i) {
+      ou << (i == mods.begin() ? "\n" : ",\n")
+         << "    {\"pass\": " << i->first.first << ", \"module\": ";
+      printjsonstr(ou, i->first.second);
+      const profentry& e = i->second;
+      ou << ", \"stages\": " << e.stages << ", \"notes\": " << e.notes
+         << ", \"nodes\": " << e.nodes << ", \"cache-lookups\": " << e.lookups
+         << ", \"cache-hits\": " << e.hits << ", \"wall\": " << e.wall
+         << ", \"cpu\": " << e.cpu << ", \"wait\": " << e.wait << '}';
+    }
+    ou << "\n  ]\n}\n";
+  }
+
+  inline bool profenv() {
+    const char* e = std::getenv("FOMUS_PROFILE");
+    return e && *e && std::string(e) != "0";
   }
 
   void fomusdata::runfomus(std::vector<runpair>::iterator b1,
                            const std::vector<runpair>::iterator& b2) {
     DBG("################# RUNNING RUNNING RUNNING" << std::endl);
+    arenaguard yyy(getarena());
     DBG("makemeass.size() = " << makemeass.size() << std::endl);
     assert(!scoreparts.empty());
     assert(scoreparts.front()->haspart());
@@ -1211,15 +1611,31 @@ namespace fomus {
     assert(!stageobj.get());
     if (fomerr.get())
       throw errbase();
-    collectallvoices();
-    collectallstaves();
+    collectallvoices(allparts());
+    collectallstaves(allparts());
     fint n =
         std::min(get_ival(NTHREADS_ID), (fint) std::numeric_limits<int>::max());
     int v = get_ival(VERBOSE_ID);
-    sortorder(); // reset sort indexes so module_less() works
+    bool pp = n > 0 && get_ival(PARTPARALLEL_ID);
+    lastprofile.reset();
+    if (get_ival(PROFILE_ID) || profenv())
+      prof.reset(new profiler);
+    boost::filesystem::path prfn(FS_CHANGE_EXTENSION(
+        boost::filesystem::path(b1->fn), std::string(".prof.json")));
+    bool prfile = false; // no file if everything goes to the caller's sinks
+    for (std::vector<runpair>::const_iterator i(b1); i != b2; ++i)
+      if (!i->fn.empty() && !hassink(i->fn)) {
+        prfile = true;
+        break;
+      }
+    double w0 = profwall(), c0 = (double) std::clock() / CLOCKS_PER_SEC;
+    boost::scoped_ptr<workpool> pool(n > 0 ? new workpool(n) : 0);
+    sortorder(allparts()); // reset sort indexes so module_less() works
     for (int pa = -1; pa < LASTPASS;) {
       int endpass = 0;
       bool efix = true;
+      int pa1 = pa, pa2 = pa;
+      double pw = prof ? profwall() : 0;
       if (b1->mb->ispre()) {
         if (n <= 0) {
           do
@@ -1227,7 +1643,7 @@ namespace fomus {
           while (endpass > 0);
         } else {
           do
-            multithread(n, v, b1, boost::next(b1), pa, endpass, efix);
+            multithread(*pool, n, v, b1, boost::next(b1), pa, endpass, efix);
           while (endpass > 0);
         }
         ++b1;
@@ -1235,19 +1651,46 @@ namespace fomus {
           break;
       } else {
         ++pa;
-        if (n <= 0) {
+        int pe = pa;
+        if (pp && scoreparts.size() > 1)
+          while (pe < LASTPASS && canchain(pe, b1, b2))
+            ++pe;
+        pa1 = pa2 = pa;
+        if (pe - pa >= 2) { // nothing to gain from chaining a single pass
+          partchains(*pool, n, v, b1, b2, pa, pe);
+          pa = pa2 = pe - 1;
+        } else if (n <= 0) {
           do
             singlethread(v, b1, b2, pa, endpass, efix);
           while (endpass > 0);
         } else {
           do
-            multithread(n, v, b1, b2, pa, endpass, efix);
+            multithread(*pool, n, v, b1, b2, pa, endpass, efix);
           while (endpass > 0);
         }
       }
       assert(!stageobj.get());
       if (fomerr.get())
         throw errbase();
+      if (prof)
+        prof->addpass(pa1, pa2, profwall() - pw);
+    }
+    if (prof) {
+      std::ostringstream ss;
+      prof->print(ss, n, profwall() - w0,
+                  (double) std::clock() / CLOCKS_PER_SEC - c0);
+      lastprofile.reset(new std::string(ss.str()));
+      prof.reset();
+      if (prfile) {
+        if (v >= 1)
+          fout << "writing profile `" << prfn.FS_FILE_STRING() << "'..."
+               << std::endl;
+        boost::filesystem::ofstream f(prfn);
+        f << *lastprofile;
+        if (!f)
+          CERR << "error writing file `" << prfn.FS_FILE_STRING() << '\''
+               << std::endl;
+      }
     }
     fout << "done" << std::endl;
   }
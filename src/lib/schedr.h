@@ -82,6 +82,19 @@ namespace fomus {
   };
 
   struct syncs;
+  // `profile' counts of a module_parallel() job, added to its stage when all of
+  // the jobs are done
+  struct stagecounts {
+    fint nodes, lookups, hits;
+    stagecounts() : nodes(0), lookups(0), hits(0) {}
+  };
+  inline void delstagecounts(stagecounts*) {} // no cleanup--owned by the job
+  extern boost::thread_specific_ptr<stagecounts> workercounts;
+  // runs fun(0) ... fun(n - 1) on the thread pool of `sta''s pass, at most `nt'
+  // at once (the calling thread takes jobs too)--false if the pass has no
+  // pool, throws errbase if a job failed
+  bool runpooljobs(stage& sta, const boost::function<void(const int)>& fun,
+                   const int n, const int nt);
   class stage {
     fomus_int id;
     const std::string msg;
@@ -106,6 +119,9 @@ namespace fomus {
     int debugvalid;
 #endif
     bool err;
+    fint nodes;    // search nodes reported by engines (`profile')
+    fint lookups, hits; // cache lookups reported by modules (`profile')
+    double waited; // seconds asleep in measisready() (`profile')
 
 public:
     boost::condition_variable_any wkup;
@@ -122,7 +138,8 @@ public:
           firstmeas(true), firstpart(true), isfirst(first), done(false),
           mitdone(false), pitdone(false), checkin(0), checkout(0),
           fl(ty, voice, staff, invvoicesonly), filename(filename),
-          istmpmeas(false), err(false) {
+          istmpmeas(false), err(false), nodes(0), lookups(0), hits(0),
+          waited(0) {
 #ifndef NDEBUG
       debugvalid = 12345;
 #endif
@@ -140,7 +157,8 @@ public:
           mitdone(false), pitdone(true), checkin(0), checkout(0),
           fl(ty, voice, staff, invvoicesonly), measend(meas2),
           noteend(boost::prior(meas2)->second->getevents().end()),
-          filename(filename), istmpmeas(true), err(false) {
+          filename(filename), istmpmeas(true), err(false), nodes(0),
+          lookups(0), hits(0), waited(0) {
 #ifndef NDEBUG
       debugvalid = 12345;
 #endif
@@ -222,6 +240,33 @@ public:
       assert(isvalid());
       return err;
     }
+    void addnodes(const fint n) {
+      assert(isvalid());
+      if (workercounts.get())
+        workercounts->nodes += n;
+      else
+        nodes += n;
+    }
+    void addcache(const fint l, const fint h) {
+      assert(isvalid());
+      if (workercounts.get()) {
+        workercounts->lookups += l;
+        workercounts->hits += h;
+      } else {
+        lookups += l;
+        hits += h;
+      }
+    }
+    void addcounts(const stagecounts& c) { // stage's own thread only
+      assert(isvalid());
+      nodes += c.nodes;
+      lookups += c.lookups;
+      hits += c.hits;
+    }
+    void addwait(const double t) {
+      assert(isvalid());
+      waited += t;
+    }
   };
 
   inline bool stageless::operator()(const stage* x, const stage* y) const {
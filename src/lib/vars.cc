@@ -1235,6 +1235,8 @@ public:
     vars.push_back(boost::shared_ptr<varbase>(new var_inittempotxt));
     vars.push_back(boost::shared_ptr<varbase>(new var_inittempo));
     vars.push_back(boost::shared_ptr<varbase>(new var_detach));
+    vars.push_back(boost::shared_ptr<varbase>(new var_partparallel));
+    vars.push_back(boost::shared_ptr<varbase>(new var_profile));
 
     initing = false;
     for (varsvect_constit i(vars.begin()); i != vars.end(); ++i)
@@ -2833,6 +2833,100 @@ public:
     }
   };
 
+  class var_partparallel : public boolvar {
+public:
+    var_partparallel() : boolvar((fint) false) {
+      assert(getid() == PARTPARALLEL_ID);
+      initmodval();
+    }
+    var_partparallel(const fint val) : boolvar(val) {
+      initmodval();
+    }
+    var_partparallel(const var_partparallel& x, const filepos& pos)
+        : boolvar(x, pos) {
+      initmodval();
+    }
+    var_partparallel(const var_partparallel& x, const numb& v,
+                     const filepos& pos)
+        : boolvar(x, v, pos) {
+      initmodval();
+    }
+
+    varbase* getnew(const fint v, const filepos& p) const {
+      return new var_partparallel(*this, v, p);
+    }
+    varbase* getnew(const numb& v, const filepos& p) const {
+      return new var_partparallel(*this, v, p);
+    }
+
+    const char* getname() const {
+      return "part-parallel";
+    } // docscat{basic}
+    module_setting_loc getloc() const {
+      return module_locscore;
+    }
+    int getuselevel() const {
+      return 2;
+    }
+    const char* getdescdoc() const {
+      return "Set this to `yes' to run consecutive passes that only involve "
+             "modules working on one part at a time as a separate chain for "
+             "each part, so that parts don't have to wait for each other "
+             "between these passes."
+             "  This only has an effect if `n-threads' is greater than 0 and "
+             "can speed things up considerably for scores with many parts.";
+    }
+  };
+
+  class var_profile : public boolvar {
+public:
+    var_profile() : boolvar((fint) false) {
+      assert(getid() == PROFILE_ID);
+      initmodval();
+    }
+    var_profile(const fint val) : boolvar(val) {
+      initmodval();
+    }
+    var_profile(const var_profile& x, const filepos& pos) : boolvar(x, pos) {
+      initmodval();
+    }
+    var_profile(const var_profile& x, const numb& v, const filepos& pos)
+        : boolvar(x, v, pos) {
+      initmodval();
+    }
+
+    varbase* getnew(const fint v, const filepos& p) const {
+      return new var_profile(*this, v, p);
+    }
+    varbase* getnew(const numb& v, const filepos& p) const {
+      return new var_profile(*this, v, p);
+    }
+
+    const char* getname() const {
+      return "profile";
+    } // docscat{basic}
+    module_setting_loc getloc() const {
+      return module_locscore;
+    }
+    int getuselevel() const {
+      return 3;
+    }
+    const char* getdescdoc() const {
+      return "Set this to `yes' to time every module in every pass and write "
+             "a report in JSON format next to the output files (with the "
+             "extension `.prof.json')."
+             "  No file is written when every output goes to memory "
+             "(fomus_run_sinks()), the report is only available from "
+             "fomus_get_profile() then."
+             "  The report lists wall-clock and CPU time, time spent waiting "
+             "for other modules, the number of notes processed, the number "
+             "of search nodes generated by engines and how often modules found "
+             "a result in their caches."
+             "  Setting the environment variable FOMUS_PROFILE to a nonzero "
+             "value has the same effect.";
+    }
+  };
+
   inline int valid_chooseclef(int n, const char* val) {
     return isvalidclef(val);
   }
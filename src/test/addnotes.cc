@@ -0,0 +1,194 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// batch entry driver for `make check-addnotes'--enters the same notes and rests
+// with one field per call (fomus_ival, etc.), with fomus_add_notes() and with
+// fomus_add_notes() in realtime mode, runs each instance to a `.fms' sink and
+// saves them as NAME.0.fms, NAME.1.fms and NAME.2.fms, which must be identical:
+//   fomusaddnotes NAME
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fomusapi.h"
+
+#define CERR std::cerr << "fomusaddnotes: "
+
+#include "testaux.h"
+
+const char* parts = "part <id fl inst flute>\npart <id vc inst cello>\n";
+
+FOMUS newone(const std::string& fn) {
+  FOMUS f = fomus_new();
+  fomus_parse(f, parts);
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "filename");
+  fomus_sval(f, fomus_par_settingval, fomus_act_set, fn.c_str());
+  // same order in each instance, so the part ids are the same
+  fomus_intern_part(f, "fl");
+  fomus_intern_part(f, "vc");
+  return f;
+}
+
+// a few measures in two parts: rationals and floats, rests, two voices, marks
+// and integer and fractional dynamics
+struct notes {
+  std::vector<fomus_note_rec> recs;
+  int fl, vc, v1[1], v2[1], v12[2], stacc[1], acc[2];
+  notes(FOMUS f)
+      : fl(fomus_intern_part(f, "fl")), vc(fomus_intern_part(f, "vc")) {
+    v1[0] = 1;
+    v2[0] = 2;
+    v12[0] = 1;
+    v12[1] = 2;
+    stacc[0] = fomus_intern_mark(".");
+    acc[0] = fomus_intern_mark(">");
+    acc[1] = stacc[0];
+    for (int i = 0; i < 32; ++i) {
+      fomus_note_rec r = {0, (i & 1) ? vc : fl};
+      if (i % 3 == 0) {
+        r.flags = fomus_note_float;
+        r.ftime = i / 2 * 1.5;
+        r.fdur = 0.5;
+        r.fpitch = 60 + i % 12;
+      } else {
+        r.time.num = i / 2 * 3;
+        r.time.den = 2;
+        r.dur.num = 1 + i % 3;
+        r.dur.den = 3;
+        r.pitch.num = 48 + i % 24;
+        r.pitch.den = 1;
+      }
+      if (i % 7 == 6)
+        r.flags |= fomus_note_rest;
+      if (i % 4 == 0) {
+        r.flags |= fomus_note_intdyn;
+        r.dyn = i % 5;
+      } else
+        r.dyn = 0.25 * (i % 4);
+      switch (i % 5) {
+      case 0:
+        r.nvoices = 1;
+        r.voices = v1;
+        break;
+      case 1:
+        r.nvoices = 1;
+        r.voices = v2;
+        break;
+      case 2:
+        r.nvoices = 2;
+        r.voices = v12;
+        break;
+      default:
+        r.nvoices = -1;
+      }
+      if (i % 4 == 1) {
+        r.nmarks = 1;
+        r.marks = stacc;
+      } else if (i % 6 == 2) {
+        r.nmarks = 2;
+        r.marks = acc;
+      }
+      recs.push_back(r);
+    }
+  }
+};
+
+// the same thing one field at a time
+void addfields(FOMUS f, const notes& ns) {
+  for (std::vector<fomus_note_rec>::const_iterator r(ns.recs.begin());
+       r != ns.recs.end(); ++r) {
+    fomus_sval(f, fomus_par_part, fomus_act_set,
+               r->part == ns.fl ? "fl" : "vc");
+    if (r->flags & fomus_note_float) {
+      fomus_fval(f, fomus_par_time, fomus_act_set, r->ftime);
+      fomus_fval(f, fomus_par_duration, fomus_act_set, r->fdur);
+    } else {
+      fomus_rval(f, fomus_par_time, fomus_act_set, r->time.num, r->time.den);
+      fomus_rval(f, fomus_par_duration, fomus_act_set, r->dur.num, r->dur.den);
+    }
+    if (r->flags & fomus_note_intdyn)
+      fomus_ival(f, fomus_par_dynlevel, fomus_act_set, (fomus_int) r->dyn);
+    else
+      fomus_fval(f, fomus_par_dynlevel, fomus_act_set, r->dyn);
+    if (r->nvoices >= 0) {
+      fomus_act(f, fomus_par_voice, fomus_act_clear);
+      for (int v = 0; v < r->nvoices; ++v)
+        fomus_ival(f, fomus_par_voice, fomus_act_add, r->voices[v]);
+    }
+    for (int m = 0; m < r->nmarks; ++m) {
+      fomus_sval(f, fomus_par_markid, fomus_act_set,
+                 r->marks[m] == ns.stacc[0] ? "." : ">");
+      fomus_act(f, fomus_par_mark, fomus_act_add);
+    }
+    if (r->flags & fomus_note_rest) {
+      fomus_act(f, fomus_par_restevent, fomus_act_add);
+    } else {
+      if (r->flags & fomus_note_float)
+        fomus_fval(f, fomus_par_pitch, fomus_act_set, r->fpitch);
+      else
+        fomus_rval(f, fomus_par_pitch, fomus_act_set, r->pitch.num,
+                   r->pitch.den);
+      fomus_act(f, fomus_par_noteevent, fomus_act_add);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    CERR << "usage: fomusaddnotes NAME" << std::endl;
+    return EXIT_FAILURE;
+  }
+  fomus_init();
+  if (fomus_err()) {
+    CERR << "fomus_init failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string nm(argv[1]);
+  FOMUS f0 = newone(nm + ".fms");
+  FOMUS f1 = newone(nm + ".fms");
+  FOMUS f2 = newone(nm + ".fms");
+  if (fomus_err()) {
+    CERR << "can't define parts" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const notes ns(f0);
+  if (ns.fl < 0 || ns.vc < 0 || ns.stacc[0] < 0 || ns.acc[0] < 0) {
+    CERR << "can't find parts or marks" << std::endl;
+    return EXIT_FAILURE;
+  }
+  addfields(f0, ns);
+  const bool ok0 = !fomus_err();
+  fomus_add_notes(f1, &ns.recs[0], ns.recs.size());
+  const bool ok1 = !fomus_err();
+  fomus_rt(1); // batches are queued and entered by the listener thread
+  fomus_add_notes(f2, &ns.recs[0], ns.recs.size());
+  const bool ok2 = !fomus_err();
+  fomus_rt(0);
+  if (!ok0 || !ok1 || !ok2 || fomus_err()) {
+    CERR << "entering notes failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const bool r0 = runone(f0, nm + ".0.fms");
+  const bool r1 = runone(f1, nm + ".1.fms");
+  const bool r2 = runone(f2, nm + ".2.fms");
+  return r0 && r1 && r2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// malformed `.fmb' writer for `make check-fmb', writes DIR/overlap.fmb (every
+// note shares one voice, so the events' ranges overlap--must load),
+// DIR/cycle.fmb (a list that contains itself) and DIR/zeroden.fmb (a time
+// with a zero denominator)--both must be rejected:
+//   fomusbadfmb DIR
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fomusapi.h"
+#include "module.h"
+
+#include "fmbaux.h"
+using namespace fmbaux;
+
+#define CERR std::cerr << "fomusbadfmb: "
+
+struct fmbfile {
+  std::string strs;
+  std::vector<fmbsetting> sets;
+  std::vector<fmbval> vals;
+  std::vector<fmbevent> evs;
+  std::vector<boost::int32_t> voices;
+  fmbfile() : strs(1, 0) {}
+  boost::uint32_t str(const char* s) {
+    boost::uint32_t o = strs.size();
+    strs.append(s, strlen(s) + 1);
+    return o;
+  }
+  bool save(const std::string& fn) const;
+};
+
+template <typename T>
+void putsect(std::string& buf, std::vector<fmbsect>& ss,
+             const fmbsect_kind kind, const T* dat, const std::size_t n) {
+  fmbsect s = {(boost::uint32_t) kind, sizeof(T), n, 0};
+  ss.push_back(s);
+  buf.append((const char*) dat, n * sizeof(T));
+  buf.resize(fmbalign(buf.size()));
+}
+
+// same layout as fmbout
+bool fmbfile::save(const std::string& fn) const {
+  std::vector<std::string> dats(5);
+  std::vector<fmbsect> ss;
+  putsect(dats[0], ss, fmbsect_strings, strs.data(), strs.size());
+  putsect(dats[1], ss, fmbsect_settings, sets.empty() ? 0 : &sets[0],
+          sets.size());
+  putsect(dats[2], ss, fmbsect_values, vals.empty() ? 0 : &vals[0],
+          vals.size());
+  putsect(dats[3], ss, fmbsect_events, evs.empty() ? 0 : &evs[0], evs.size());
+  putsect(dats[4], ss, fmbsect_voices, voices.empty() ? 0 : &voices[0],
+          voices.size());
+  fmbheader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, fmbmagic, sizeof(h.magic));
+  h.version = fmbversion;
+  h.order = fmborder;
+  h.nsects = ss.size();
+  boost::uint64_t o = fmbalign(sizeof(fmbheader) + ss.size() * sizeof(fmbsect));
+  for (std::size_t i = 0; i < ss.size(); ++i) {
+    ss[i].offset = o;
+    o += dats[i].size();
+  }
+  std::string buf((const char*) &h, sizeof(h));
+  buf.append((const char*) &ss[0], ss.size() * sizeof(fmbsect));
+  buf.resize(fmbalign(buf.size()));
+  for (std::size_t i = 0; i < dats.size(); ++i)
+    buf += dats[i];
+  FILE* f = fopen(fn.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool r = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+  return fclose(f) == 0 && r;
+}
+
+fmbval intval(const fomus_int x) {
+  fmbval v;
+  memset(&v, 0, sizeof(v));
+  v.type = module_int;
+  v.v.i = x;
+  return v;
+}
+
+void addnote(fmbfile& f, const fmbval& time, const boost::uint32_t voice0) {
+  fmbevent e;
+  memset(&e, 0, sizeof(e));
+  e.type = fmbev_note;
+  e.part = f.str("default");
+  e.time = time;
+  e.grace.type = module_none;
+  e.dur = intval(1);
+  e.pitch = intval(60);
+  e.dyn = intval(0);
+  e.voice0 = voice0;
+  e.nvoices = 1;
+  f.evs.push_back(e);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    CERR << "usage: fomusbadfmb DIR" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string dir(argv[1]);
+  bool ok = true;
+  { // more notes than voices, all pointing at the same one
+    fmbfile f;
+    f.voices.push_back(1);
+    for (int i = 0; i < 100; ++i)
+      addnote(f, intval(i), 0);
+    ok = f.save(dir + "/overlap.fmb") && ok;
+  }
+  { // a setting whose list's only element is the list itself
+    fmbfile f;
+    fmbsetting s;
+    memset(&s, 0, sizeof(s));
+    s.name = f.str("title");
+    s.val.type = module_list;
+    s.val.n = 1;
+    s.val.v.s = 0;
+    f.sets.push_back(s);
+    f.vals.push_back(s.val);
+    ok = f.save(dir + "/cycle.fmb") && ok;
+  }
+  { // time 1/0
+    fmbfile f;
+    fmbval t;
+    memset(&t, 0, sizeof(t));
+    t.type = module_rat;
+    t.v.i = 1;
+    t.den = 0;
+    f.voices.push_back(1);
+    addnote(f, t, 0);
+    ok = f.save(dir + "/zeroden.fmb") && ok;
+  }
+  if (!ok)
+    CERR << "can't write to `" << dir << '\'' << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
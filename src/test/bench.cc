@@ -0,0 +1,583 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark driver for `make bench'--runs each input through
+// fomus_load/fomus_run a number of times for each `n-threads' value and prints
+// one line of statistics per input and thread count.  Each input/thread
+// combination runs in its own child process so that peak RSS belongs to that
+// combination only (so this needs fork() and wait4())
+
+// output format (one line per run, whitespace separated, never reordered--add
+// new columns at the end and bump BENCH_FORMAT if they change):
+//   input threads iters notes median-ms p95-ms maxrss-kb notes/sec speedup
+//   nodes/sec module-ms
+// (speedup is the median time with the first `-t' value divided by this one,
+// nodes/sec is the search nodes made by the engines per second spent in the
+// modules that made them, from the `profile' report--0 without `-p',
+// module-ms is the median time spent in the `-m' module over all passes--0
+// without `-m')
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fomusapi.h"
+
+#define BENCH_FORMAT 4
+
+#define CERR std::cerr << "fomusbench: "
+
+struct benchinput {
+  std::string name;     // name printed in the report
+  std::string filename; // `.fms' file (empty if synthetic)
+  std::string text;     // synthetic score text (loaded with fomus_parse)
+  long notes;
+  benchinput(const std::string& name, const std::string& filename,
+             const std::string& text, const long notes)
+      : name(name), filename(filename), text(text), notes(notes) {}
+};
+
+// a (duration, pitch) pair harvested from the test corpus, duration in 1/8ths
+// of a beat
+struct seednote {
+  int dur;
+  int pitch;
+  seednote(const int dur, const int pitch) : dur(dur), pitch(pitch) {}
+};
+
+inline double nowms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+inline std::string stripcomment(const std::string& line) {
+  std::string::size_type i = line.find("//");
+  return i == std::string::npos ? line : line.substr(0, i);
+}
+
+inline bool iswordchar(const char c) {
+  return isalnum((unsigned char) c) || c == '-' || c == '_';
+}
+
+// position of `word' as a whole word in `str' at or after `from'
+std::string::size_type findword(const std::string& str, const char* word,
+                                std::string::size_type from = 0) {
+  std::string::size_type n = strlen(word);
+  while (true) {
+    std::string::size_type i = str.find(word, from);
+    if (i == std::string::npos)
+      return i;
+    if ((i == 0 || !iswordchar(str[i - 1])) &&
+        (i + n >= str.length() || !iswordchar(str[i + n])))
+      return i;
+    from = i + n;
+  }
+}
+
+// note events in a `.fms' file, counted as `pitch' keywords outside of `//'
+// comments (good enough for notes/sec, the regression corpus has no `/-'
+// comments around note events)
+long countnotes(const std::string& filename) {
+  std::ifstream in(filename.c_str());
+  std::string line;
+  long n = 0;
+  while (std::getline(in, line)) {
+    line = stripcomment(line);
+    for (std::string::size_type i = findword(line, "pitch");
+         i != std::string::npos; i = findword(line, "pitch", i + 5))
+      ++n;
+  }
+  return n;
+}
+
+// reads a duration like `1', `1/2' or `1+1/2' into 1/8ths of a beat (0 if it
+// isn't on that grid)
+int readdur(const std::string& str) {
+  int wh = 0, num = 0, den = 1;
+  if (sscanf(str.c_str(), "%d+%d/%d", &wh, &num, &den) == 3) {
+  } else if (sscanf(str.c_str(), "%d/%d", &num, &den) == 2) {
+    wh = 0;
+  } else if (sscanf(str.c_str(), "%d", &wh) == 1) {
+    num = 0;
+    den = 1;
+  } else
+    return 0;
+  if (den <= 0 || 8 % den != 0)
+    return 0;
+  return wh * 8 + num * (8 / den);
+}
+
+// collects `dur X pitch Y' pairs from the inputs so synthetic scores have the
+// same mix of rhythms and intervals as the regression tests
+void harvest(const std::vector<std::string>& files,
+             std::vector<seednote>& seeds) {
+  for (std::vector<std::string>::const_iterator f(files.begin());
+       f != files.end(); ++f) {
+    std::ifstream in(f->c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+      line = stripcomment(line);
+      std::string::size_type d = findword(line, "dur");
+      std::string::size_type p = findword(line, "pitch");
+      if (d == std::string::npos || p == std::string::npos || p < d)
+        continue;
+      std::istringstream ds(line.substr(d + 3));
+      std::istringstream ps(line.substr(p + 5));
+      std::string dstr;
+      double pi;
+      if (!(ds >> dstr) || !(ps >> pi))
+        continue;
+      int du = readdur(dstr);
+      if (du <= 0 || du > 32 || pi < 21 || pi > 108)
+        continue;
+      seeds.push_back(seednote(du, (int) pi));
+    }
+  }
+  if (seeds.empty()) { // no inputs, use a scale
+    for (int i = 0; i < 8; ++i)
+      seeds.push_back(seednote(i % 3 == 0 ? 4 : 2, 60 + i * 2));
+  }
+}
+
+inline int gcd(int a, int b) {
+  while (b) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+inline std::string eighths(const int x) {
+  std::ostringstream s;
+  int g = gcd(x, 8);
+  if (g == 8)
+    s << x / 8;
+  else
+    s << x / g << '/' << 8 / g;
+  return s.str();
+}
+
+struct benchinst {
+  const char* id;
+  int lo; // bottom of a two-octave window the pitches are folded into
+};
+const benchinst benchinsts[] = {{"flute", 67},  {"oboe", 62},  {"violin", 60},
+                                {"viola", 53},  {"cello", 41}, {"horn", 50},
+                                {"piano", 48}};
+const int nbenchinsts = sizeof(benchinsts) / sizeof(benchinst);
+
+// a synthetic score of `parts' parts, `meass' measures of 4/4 and `dens'
+// overlapping layers of notes in each part, `nsets' goes on every note
+benchinput synthesize(const std::vector<seednote>& seeds, const int parts,
+                      const int meass, const int dens,
+                      const std::string& nsets) {
+  std::ostringstream s;
+  std::ostringstream nm;
+  nm << "synth-" << parts << 'x' << meass << 'x' << dens;
+  long notes = 0;
+  for (int p = 0; p < parts; ++p)
+    s << "part <id p" << p << " inst " << benchinsts[p % nbenchinsts].id
+      << ">\n";
+  const int end = meass * 4 * 8;
+  std::vector<seednote>::size_type k = 0;
+  for (int p = 0; p < parts; ++p) {
+    s << "part p" << p << '\n';
+    const int lo = benchinsts[p % nbenchinsts].lo;
+    for (int l = 0; l < dens; ++l) {
+      k = (k + 7 * l + 13 * p) % seeds.size(); // vary the material by layer
+      for (int t = 0; t < end;) {
+        const seednote& n = seeds[k];
+        k = (k + 1) % seeds.size();
+        int du = std::min(n.dur, end - t);
+        int pi = n.pitch;
+        while (pi < lo)
+          pi += 12;
+        while (pi >= lo + 24)
+          pi -= 12;
+        s << "time " << eighths(t) << " dur " << eighths(du) << " pitch "
+          << pi << nsets << ";\n";
+        ++notes;
+        t += du;
+      }
+    }
+  }
+  return benchinput(nm.str(), "", s.str(), notes);
+}
+
+struct benchopts {
+  int iters;
+  int warmup;
+  std::vector<int> threads;
+  std::string ext;
+  std::string outfile;
+  std::vector<std::string> sets; // `.fms' setting lines (`-e')
+  std::string nsets;             // settings on every synthetic note (`-g')
+  std::string mod;               // module timed on its own (`-m')
+  bool prof;
+};
+
+// one timed run
+struct benchrun {
+  double ms;
+  double nodes;  // search nodes made by the engines
+  double nodems; // time spent in the modules that made them
+  double modms;  // time spent in the `-m' module
+};
+
+// adds up the `nodes' and `wall' of every module entry with nodes in a
+// `profile' report (one module per line), and the `wall' of every entry for
+// module `mod'
+void profnodes(const char* prof, const std::string& mod, benchrun& r) {
+  std::istringstream in(prof);
+  std::string line;
+  const std::string mo("\"module\": \"" + mod + '"');
+  while (std::getline(in, line)) {
+    if (!mod.empty() && line.find(mo) != std::string::npos) {
+      std::string::size_type w = line.find("\"wall\": ");
+      if (w != std::string::npos)
+        r.modms += atof(line.c_str() + w + 8) * 1000;
+    }
+    std::string::size_type n = line.find("\"nodes\": ");
+    std::string::size_type w = line.find("\"wall\": ", n);
+    if (n == std::string::npos || w == std::string::npos)
+      continue;
+    double nodes = atof(line.c_str() + n + 9);
+    if (nodes <= 0)
+      continue;
+    r.nodes += nodes;
+    r.nodems += atof(line.c_str() + w + 8) * 1000;
+  }
+}
+
+inline bool check(const char* what) {
+  if (fomus_err()) {
+    CERR << what << " failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// runs one input once, `r.ms' is negative on error
+void runonce(const benchinput& in, const int threads, const benchopts& opts,
+             benchrun& r) {
+  r.ms = -1;
+  r.nodes = r.nodems = r.modms = 0;
+  double t0 = nowms();
+  FOMUS f = fomus_new();
+  if (!check("fomus_new"))
+    return;
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "verbose");
+  fomus_ival(f, fomus_par_settingval, fomus_act_set, 0);
+  if (in.filename.empty())
+    fomus_parse(f, in.text.c_str());
+  else
+    fomus_load(f, in.filename.c_str());
+  if (!check("loading input"))
+    return;
+  // settings after the input so they override the input file's
+  for (std::vector<std::string>::const_iterator i(opts.sets.begin());
+       i != opts.sets.end(); ++i)
+    fomus_parse(f, i->c_str());
+  if (!check("parsing `-e' settings"))
+    return;
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "profile");
+  fomus_ival(f, fomus_par_settingval, fomus_act_set, opts.prof);
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "n-threads");
+  fomus_ival(f, fomus_par_settingval, fomus_act_set, threads);
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "verbose");
+  fomus_ival(f, fomus_par_settingval, fomus_act_set, 0);
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "filename");
+  fomus_sval(f, fomus_par_settingval, fomus_act_set, opts.outfile.c_str());
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "output");
+  fomus_act(f, fomus_par_list, fomus_act_start);
+  fomus_act(f, fomus_par_list, fomus_act_end);
+  fomus_act(f, fomus_par_settingval, fomus_act_set);
+  if (!check("setting options"))
+    return;
+  fomus_run(f);
+  if (!check("fomus_run"))
+    return;
+  r.ms = nowms() - t0;
+  if (opts.prof)
+    profnodes(fomus_get_profile(), opts.mod, r);
+}
+
+// child process: all iterations of one input/thread combination, runs are
+// written to `fd'
+int runchild(const benchinput& in, const int threads, const benchopts& opts,
+             const int fd) {
+  fomus_init();
+  if (!check("fomus_init"))
+    return EXIT_FAILURE;
+  for (int i = -opts.warmup; i < opts.iters; ++i) {
+    benchrun r;
+    runonce(in, threads, opts, r);
+    if (r.ms < 0)
+      return EXIT_FAILURE;
+    if (i >= 0 && write(fd, &r, sizeof(r)) != (ssize_t) sizeof(r))
+      return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+inline double median(const std::vector<double>& v) { // v is sorted
+  return v.size() % 2 ? v[v.size() / 2]
+                      : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+}
+
+// nearest-rank percentile of sorted times
+inline double percentile(const std::vector<double>& v, const int pc) {
+  std::vector<double>::size_type r = (v.size() * pc + 99) / 100;
+  return v[r > 0 ? r - 1 : 0];
+}
+
+// `base' is the median of the first thread count for this input (0 if this is
+// it), the median is returned in `med'
+bool benchone(const benchinput& in, const int threads, const benchopts& opts,
+              const double base, double& med) {
+  int fds[2];
+  if (pipe(fds)) {
+    CERR << "pipe: " << strerror(errno) << std::endl;
+    return false;
+  }
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid < 0) {
+    CERR << "fork: " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    _exit(runchild(in, threads, opts, fds[1]));
+  }
+  close(fds[1]);
+  std::vector<double> times, modtimes;
+  double nodes = 0, nodems = 0;
+  benchrun br;
+  ssize_t r;
+  while ((r = read(fds[0], &br, sizeof(br))) == (ssize_t) sizeof(br)) {
+    times.push_back(br.ms);
+    modtimes.push_back(br.modms);
+    nodes += br.nodes;
+    nodems += br.nodems;
+  }
+  close(fds[0]);
+  int status;
+  struct rusage ru;
+  if (wait4(pid, &status, 0, &ru) < 0) {
+    CERR << "wait4: " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS ||
+      (int) times.size() != opts.iters) {
+    CERR << in.name << " (n-threads " << threads << ") failed" << std::endl;
+    return false;
+  }
+  std::sort(times.begin(), times.end());
+  std::sort(modtimes.begin(), modtimes.end());
+  med = median(times);
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "%-24s %3d %5d %9ld %12.3f %12.3f %10ld %14.1f %8.2f %14.1f %12.3f",
+           in.name.c_str(), threads, opts.iters, in.notes, med,
+           percentile(times, 95), (long) ru.ru_maxrss,
+           med > 0 ? in.notes * 1000.0 / med : 0.0,
+           base > 0 && med > 0 ? base / med : 1.0,
+           nodems > 0 ? nodes * 1000.0 / nodems : 0.0, median(modtimes));
+  std::cout << buf << std::endl;
+  return true;
+}
+
+void usage() {
+  std::cerr
+      << "usage: fomusbench [-n iters] [-w warmup] [-t threads,...] [-x ext]\n"
+         "                  [-s partsxmeasuresxdensity ...] [-S]\n"
+         "                  [-e setting ...] [-g setting ...] [-p] [-m module]\n"
+         "                  file.fms ...\n"
+         "  -n  timed runs per input (default 10)\n"
+         "  -w  untimed runs before those (default 1)\n"
+         "  -t  comma-separated `n-threads' values (default 1,2,4)\n"
+         "  -x  output file extension, i.e. the output module (default "
+         "xml)\n"
+         "  -s  also run a synthetic score of this size built from the "
+         "inputs'\n"
+         "      rhythms and pitches (may be repeated)\n"
+         "  -S  only run the synthetic scores\n"
+         "  -e  a setting for every run, as in a `.fms' file (e.g.\n"
+         "      `voices-engine = dynprog', may be repeated)\n"
+         "  -g  a setting for every note of the synthetic scores (e.g.\n"
+         "      `accs-diatonic-interval-score 3', may be repeated)\n"
+         "  -p  turn on `profile' and report search nodes/sec\n"
+         "  -m  also report the time spent in this module (e.g. `voices',\n"
+         "      implies `-p')\n";
+}
+
+bool readints(const char* str, const char sep, std::vector<int>& v) {
+  std::istringstream s(str);
+  int x;
+  char c;
+  while (s >> x) {
+    if (x <= 0)
+      return false;
+    v.push_back(x);
+    if (!(s >> c))
+      return true;
+    if (c != sep)
+      return false;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  benchopts opts;
+  opts.iters = 10;
+  opts.warmup = 1;
+  opts.ext = "xml";
+  opts.prof = false;
+  std::vector<std::vector<int>> synths;
+  bool onlysynth = false;
+  int c;
+  while ((c = getopt(argc, argv, "n:w:t:x:s:Se:g:pm:")) != -1) {
+    switch (c) {
+    case 'n':
+      opts.iters = atoi(optarg);
+      break;
+    case 'w':
+      opts.warmup = atoi(optarg);
+      break;
+    case 't':
+      if (!readints(optarg, ',', opts.threads)) {
+        usage();
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'x':
+      opts.ext = optarg;
+      break;
+    case 's': {
+      std::vector<int> v;
+      if (!readints(optarg, 'x', v) || v.size() != 3) {
+        usage();
+        return EXIT_FAILURE;
+      }
+      synths.push_back(v);
+      break;
+    }
+    case 'S':
+      onlysynth = true;
+      break;
+    case 'e':
+      opts.sets.push_back(optarg);
+      break;
+    case 'g':
+      opts.nsets += ' ';
+      opts.nsets += optarg;
+      break;
+    case 'p':
+      opts.prof = true;
+      break;
+    case 'm':
+      opts.mod = optarg;
+      opts.prof = true;
+      break;
+    default:
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.iters <= 0 || opts.warmup < 0) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  if (opts.threads.empty()) {
+    opts.threads.push_back(1);
+    opts.threads.push_back(2);
+    opts.threads.push_back(4);
+  }
+  std::vector<std::string> files(argv + optind, argv + argc);
+  std::vector<benchinput> inputs;
+  if (!onlysynth) {
+    for (std::vector<std::string>::const_iterator i(files.begin());
+         i != files.end(); ++i) {
+      std::string::size_type s = i->find_last_of('/');
+      inputs.push_back(benchinput(s == std::string::npos ? *i
+                                                         : i->substr(s + 1),
+                                  *i, "", countnotes(*i)));
+    }
+  }
+  if (!synths.empty()) {
+    std::vector<seednote> seeds;
+    harvest(files, seeds);
+    for (std::vector<std::vector<int>>::const_iterator i(synths.begin());
+         i != synths.end(); ++i)
+      inputs.push_back(
+          synthesize(seeds, (*i)[0], (*i)[1], (*i)[2], opts.nsets));
+  }
+  if (inputs.empty()) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const char* tmp = getenv("TMPDIR");
+  std::ostringstream of;
+  of << (tmp ? tmp : "/tmp") << "/fomusbench-" << getpid() << '.' << opts.ext;
+  opts.outfile = of.str();
+  std::cout << "# fomusbench format " << BENCH_FORMAT << ", output `."
+            << opts.ext << "', " << opts.iters << " runs after "
+            << opts.warmup << " warmup\n"
+            << "# input                  thr iters     notes    median-ms"
+               "       p95-ms  maxrss-kb      notes/sec  speedup      nodes/sec"
+               "    module-ms"
+            << std::endl;
+  bool ok = true;
+  for (std::vector<benchinput>::const_iterator i(inputs.begin());
+       i != inputs.end(); ++i) {
+    double base = 0, med;
+    for (std::vector<int>::const_iterator t(opts.threads.begin());
+         t != opts.threads.end(); ++t) {
+      if (!benchone(*i, *t, opts, base, med))
+        ok = false;
+      else if (t == opts.threads.begin())
+        base = med;
+    }
+  }
+  unlink(opts.outfile.c_str());
+  if (opts.prof) { // `profile' writes its report next to the output
+    std::ostringstream pf;
+    pf << (tmp ? tmp : "/tmp") << "/fomusbench-" << getpid() << ".prof.json";
+    unlink(pf.str().c_str());
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,89 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// copy driver for `make check-copies'--loads one input, copies the instance
+// twice from two threads at once and runs both copies at once, then runs the
+// original, each to a `.fms' sink, and saves them as NAME.1.fms, NAME.2.fms
+// and NAME.0.fms so they can be compared with the file that `fomus' writes:
+//   fomuscopies NAME INPUT
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "fomusapi.h"
+
+#define CERR std::cerr << "fomuscopies: "
+
+#include "testaux.h"
+
+struct copyjob {
+  FOMUS base;
+  std::string fn;
+  boost::barrier& bar;
+  bool& ok;
+  copyjob(FOMUS base, const std::string& fn, boost::barrier& bar, bool& ok)
+      : base(base), fn(fn), bar(bar), ok(ok) {}
+  void operator()() const {
+    bar.wait(); // both copy at the same time
+    FOMUS f = fomus_copy(base);
+    const bool cp = !fomus_err();
+    bar.wait(); // both copies are made before either one runs
+    if (!cp) {
+      CERR << "fomus_copy failed" << std::endl;
+      return;
+    }
+    ok = runone(f, fn);
+  }
+};
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    CERR << "usage: fomuscopies NAME INPUT" << std::endl;
+    return EXIT_FAILURE;
+  }
+  fomus_init();
+  if (fomus_err()) {
+    CERR << "fomus_init failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  FOMUS f = fomus_new();
+  fomus_load(f, argv[2]);
+  // same name as `fomus INPUT -o NAME.fms', modules can print it
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "filename");
+  fomus_sval(f, fomus_par_settingval, fomus_act_set,
+             (std::string(argv[1]) + ".fms").c_str());
+  if (fomus_err()) {
+    CERR << "loading `" << argv[2] << "' failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string nm(argv[1]);
+  boost::barrier bar(2);
+  bool ok1 = false, ok2 = false;
+  boost::thread t1(copyjob(f, nm + ".1.fms", bar, ok1));
+  boost::thread t2(copyjob(f, nm + ".2.fms", bar, ok2));
+  t1.join();
+  t2.join();
+  const bool ok0 = runone(f, nm + ".0.fms"); // the original still has its notes
+  return ok0 && ok1 && ok2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+#   Copyright (C) 2009, 2010, 2011  David Psenicka
+#   This file is part of FOMUS.
+
+#   FOMUS is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+
+#   FOMUS is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# stands in for LilyPond in `make check-lilyexec': takes the same arguments
+# (-oBASE FILE.ly), takes a while and writes BASE.pdf, or fails if
+# FAKELILY_FAIL is set
+
+for A in "$@"; do
+  case "$A" in
+    -o*) OUT="${A#-o}" ;;
+    *) IN="$A" ;;
+  esac
+done
+sleep 2
+if test -n "$FAKELILY_FAIL"; then
+  echo "fakelily: cannot process \`$IN'" >&2
+  exit 3
+fi
+echo "fakelily: writing \`$OUT.pdf'"
+cp "$IN" "$OUT.pdf"
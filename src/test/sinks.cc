@@ -0,0 +1,96 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// sink driver for `make check-sinks'--runs one input through fomus_run_sinks
+// with a sink for each format on the command line and saves what each sink got
+// as NAME.EXT.sink, so it can be compared with the NAME.EXT file that `fomus'
+// writes:
+//   fomussinks NAME INPUT EXT...
+// (every other sink uses the write callback, the rest collect the file in
+// their buffers)
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fomusapi.h"
+
+#define CERR std::cerr << "fomussinks: "
+
+#include "testaux.h"
+
+int appendstr(void* data, const char* buf, fomus_int n) {
+  ((std::string*) data)->append(buf, n);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    CERR << "usage: fomussinks NAME INPUT EXT..." << std::endl;
+    return EXIT_FAILURE;
+  }
+  fomus_init();
+  if (fomus_err()) {
+    CERR << "fomus_init failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  FOMUS f = fomus_new();
+  fomus_load(f, argv[2]);
+  // same name as `fomus INPUT -o NAME.EXT', modules can print it
+  fomus_sval(f, fomus_par_setting, fomus_act_set, "filename");
+  fomus_sval(f, fomus_par_settingval, fomus_act_set,
+             (std::string(argv[1]) + ".fms").c_str());
+  if (fomus_err()) {
+    CERR << "loading `" << argv[2] << "' failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const int n = argc - 3;
+  std::vector<fomus_sink> sinks(n);
+  std::vector<std::string> strs(n);
+  for (int i = 0; i < n; ++i) {
+    sinks[i].ext = argv[i + 3];
+    sinks[i].write = (i % 2) ? appendstr : 0;
+    sinks[i].data = &strs[i];
+    sinks[i].buf = 0;
+    sinks[i].size = 0;
+  }
+  fomus_run_sinks(f, &sinks[0], n);
+  if (fomus_err()) {
+    CERR << "fomus_run_sinks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int ret = EXIT_SUCCESS;
+  for (int i = 0; i < n; ++i) {
+    const char* b = sinks[i].write ? strs[i].data() : sinks[i].buf;
+    if (sinks[i].write && sinks[i].size != (fomus_int) strs[i].size()) {
+      CERR << "`." << argv[i + 3] << "' sink size is " << sinks[i].size
+           << ", got " << strs[i].size() << " bytes" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+    const std::string fn(std::string(argv[1]) + '.' + argv[i + 3] + ".sink");
+    if (!savefile(fn, b ? b : "", sinks[i].size)) {
+      CERR << "can't write `" << fn << '\'' << std::endl;
+      ret = EXIT_FAILURE;
+    }
+    fomus_free_sink(&sinks[i]);
+  }
+  return ret;
+}
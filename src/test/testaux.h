@@ -0,0 +1,61 @@
+// -*- c++ -*-
+
+/*
+    Copyright (C) 2009, 2010, 2011  David Psenicka
+    This file is part of FOMUS.
+
+    FOMUS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    FOMUS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOMUSTEST_TESTAUX_H
+#define FOMUSTEST_TESTAUX_H
+
+// helpers shared by the test drivers (fomussinks, fomuscopies, fomusaddnotes),
+// each defines CERR (its error prefix) before including this
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "fomusapi.h"
+
+#ifndef CERR
+#error "CERR must be defined before testaux.h is included"
+#endif
+
+inline bool savefile(const std::string& fn, const char* buf,
+                     const fomus_int n) {
+  FILE* f = fopen(fn.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool r = fwrite(buf, 1, n, f) == (size_t) n;
+  return fclose(f) == 0 && r;
+}
+
+// runs an instance to a `.fms' sink and saves it
+inline bool runone(FOMUS f, const std::string& fn) {
+  fomus_sink s = {"fms", 0, 0, 0, 0};
+  fomus_run_sinks(f, &s, 1);
+  if (fomus_err()) {
+    CERR << "running `" << fn << "' failed" << std::endl;
+    return false;
+  }
+  const bool r = savefile(fn, s.buf ? s.buf : "", s.size);
+  if (!r)
+    CERR << "can't write `" << fn << '\'' << std::endl;
+  fomus_free_sink(&s);
+  return r;
+}
+
+#endif